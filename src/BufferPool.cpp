@@ -0,0 +1,175 @@
+#include <utility>
+#include "BufferPool.h"
+
+namespace {
+
+    // Smallest class whose buffers hold `size` bytes; CLASS_COUNT if none.
+    size_t ClassFor(size_t size) {
+        size_t index = 0;
+        while (index < BufferPool::CLASS_COUNT && (BufferPool::MIN_CLASS_SIZE << index) < size) {
+            ++index;
+        }
+        return index;
+    }
+
+    // Largest class a buffer with this capacity can serve; CLASS_COUNT if
+    // it is too small to keep.
+    size_t ClassOf(size_t capacity) {
+        if (capacity < BufferPool::MIN_CLASS_SIZE) {
+            return BufferPool::CLASS_COUNT;
+        }
+        size_t index = 0;
+        while (index + 1 < BufferPool::CLASS_COUNT && (BufferPool::MIN_CLASS_SIZE << (index + 1)) <= capacity) {
+            ++index;
+        }
+        return index;
+    }
+
+    template <typename Buffer>
+    void Release(Buffer& buffer) {
+        Buffer empty;
+        buffer.swap(empty);
+    }
+}
+
+BufferPool& BufferPool::Instance() {
+    static BufferPool instance;
+    return instance;
+}
+
+void BufferPool::SetRetentionLimit(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    retentionLimit_ = bytes;
+    TrimShelf(charbuffs_, bytes);
+    TrimShelf(bytes_, bytes);
+    TrimShelf(chars_, bytes);
+}
+
+size_t BufferPool::GetRetentionLimit() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return retentionLimit_;
+}
+
+template <typename Buffer>
+void BufferPool::RentFrom(Shelf<Buffer>& shelf, size_t size, Buffer& buffer) {
+    buffer.clear();
+    if (size == 0 || buffer.capacity() >= size) {
+        return;
+    }
+
+    size_t index = ClassFor(size);
+    bool found = false;
+    size_t retentionLimit;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        retentionLimit = retentionLimit_;
+        ReturnTo(shelf, buffer);
+
+        // A buffer one class up is still a better use of retained memory
+        // than a new allocation.
+        for (size_t candidate = index; candidate < CLASS_COUNT && candidate <= index + 1 && !found; ++candidate) {
+            std::vector<Buffer>& free = shelf.classes[candidate];
+            if (!free.empty()) {
+                buffer = std::move(free.back());
+                free.pop_back();
+                buffer.clear();
+                retainedBytes_ -= buffer.capacity();
+                --retainedBuffers_;
+                found = true;
+            }
+        }
+        if (found) {
+            ++hits_;
+        }
+        else {
+            ++misses_;
+        }
+    }
+
+    if (!found) {
+        // Full class size, so the buffer fits its class when it comes back;
+        // a buffer the pool could never keep gets only what was asked for.
+        bool poolable = index < CLASS_COUNT && (MIN_CLASS_SIZE << index) <= retentionLimit;
+        buffer.reserve(poolable ? MIN_CLASS_SIZE << index : size);
+    }
+}
+
+template <typename Buffer>
+void BufferPool::ReturnTo(Shelf<Buffer>& shelf, Buffer& buffer) {
+    size_t capacity = buffer.capacity();
+    size_t index = ClassOf(capacity);
+    if (index == CLASS_COUNT || retainedBytes_ + capacity > retentionLimit_) {
+        Release(buffer);
+        return;
+    }
+
+    buffer.clear();
+    shelf.classes[index].push_back(std::move(buffer));
+    retainedBytes_ += capacity;
+    ++retainedBuffers_;
+    Release(buffer);
+}
+
+template <typename Buffer>
+void BufferPool::TrimShelf(Shelf<Buffer>& shelf, size_t limit) {
+    for (size_t index = CLASS_COUNT; index-- > 0 && retainedBytes_ > limit;) {
+        std::vector<Buffer>& free = shelf.classes[index];
+        while (!free.empty() && retainedBytes_ > limit) {
+            retainedBytes_ -= free.back().capacity();
+            --retainedBuffers_;
+            free.pop_back();
+        }
+    }
+}
+
+void BufferPool::Rent(size_t size, std::vector<char>& buffer) {
+    RentFrom(chars_, size, buffer);
+}
+
+void BufferPool::Rent(size_t size, std::vector<unsigned char>& buffer) {
+    RentFrom(bytes_, size, buffer);
+}
+
+void BufferPool::Rent(size_t size, PoDoFo::charbuff& buffer) {
+    RentFrom(charbuffs_, size, buffer);
+}
+
+void BufferPool::Return(std::vector<char>& buffer) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ReturnTo(chars_, buffer);
+}
+
+void BufferPool::Return(std::vector<unsigned char>& buffer) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ReturnTo(bytes_, buffer);
+}
+
+void BufferPool::Return(PoDoFo::charbuff& buffer) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ReturnTo(charbuffs_, buffer);
+}
+
+void BufferPool::Trim() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    TrimShelf(charbuffs_, 0);
+    TrimShelf(bytes_, 0);
+    TrimShelf(chars_, 0);
+}
+
+BufferPool::Stats BufferPool::GetStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stats stats;
+    stats.hits = hits_;
+    stats.misses = misses_;
+    stats.retainedBuffers = retainedBuffers_;
+    stats.retainedBytes = retainedBytes_;
+    stats.retentionLimit = retentionLimit_;
+    return stats;
+}
+
+std::string BufferPool::FormatStats() const {
+    Stats stats = GetStats();
+    return "hits " + std::to_string(stats.hits) + ", misses " + std::to_string(stats.misses) +
+        ", retained " + std::to_string(stats.retainedBuffers) + " buffer(s) / " +
+        std::to_string(stats.retainedBytes) + " of " + std::to_string(stats.retentionLimit) + " bytes";
+}
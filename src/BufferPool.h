@@ -0,0 +1,104 @@
+#ifndef __BUFFER_POOL_H__
+#define __BUFFER_POOL_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "podofo/podofo.h"
+
+// Large byte buffers reused across files and merge calls.
+//
+// The component lives in the 1C host process for its whole session, and
+// allocating and freeing a buffer of the size of every input, JPEG and
+// output part fragments that process's heap. Buffers are rented by size and
+// returned when done; returned buffers are kept by size class (powers of two
+// from MIN_CLASS_SIZE) as long as the total stays within the retention
+// limit, and freed otherwise. All methods may be called from any thread.
+class BufferPool {
+public:
+    static constexpr size_t MIN_CLASS_SIZE = 64 * 1024;
+    static constexpr size_t CLASS_COUNT = 14;   // 64 KB .. 512 MB
+    static constexpr size_t DEFAULT_RETENTION_LIMIT = 64 * 1024 * 1024;
+
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        size_t retainedBuffers = 0;
+        size_t retainedBytes = 0;
+        size_t retentionLimit = 0;
+    };
+
+    static BufferPool& Instance();
+
+    // 0 keeps nothing; buffers over a lower limit are freed at once.
+    void SetRetentionLimit(size_t bytes);
+    size_t GetRetentionLimit() const;
+
+    // Leaves `buffer` empty with room for at least `size` bytes. A buffer
+    // that is already large enough is kept; a smaller one goes back to the
+    // pool first.
+    void Rent(size_t size, std::vector<char>& buffer);
+    void Rent(size_t size, std::vector<unsigned char>& buffer);
+    void Rent(size_t size, PoDoFo::charbuff& buffer);
+
+    // Takes the memory of `buffer` back, leaving it empty.
+    void Return(std::vector<char>& buffer);
+    void Return(std::vector<unsigned char>& buffer);
+    void Return(PoDoFo::charbuff& buffer);
+
+    // Frees every retained buffer.
+    void Trim();
+
+    Stats GetStats() const;
+    // "hits 10, misses 2, retained 3 buffer(s) / 1048576 of 67108864 bytes"
+    std::string FormatStats() const;
+
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+private:
+    template <typename Buffer>
+    struct Shelf {
+        std::vector<Buffer> classes[CLASS_COUNT];
+    };
+
+    BufferPool() = default;
+
+    template <typename Buffer>
+    void RentFrom(Shelf<Buffer>& shelf, size_t size, Buffer& buffer);
+    template <typename Buffer>
+    void ReturnTo(Shelf<Buffer>& shelf, Buffer& buffer);
+    template <typename Buffer>
+    void TrimShelf(Shelf<Buffer>& shelf, size_t limit);
+
+    mutable std::mutex mutex_;
+    Shelf<std::vector<char>> chars_;
+    Shelf<std::vector<unsigned char>> bytes_;
+    Shelf<PoDoFo::charbuff> charbuffs_;
+    size_t retentionLimit_ = DEFAULT_RETENTION_LIMIT;
+    size_t retainedBytes_ = 0;
+    size_t retainedBuffers_ = 0;
+    uint64_t hits_ = 0;
+    uint64_t misses_ = 0;
+};
+
+// A buffer rented for one scope; it goes back to the pool on every exit path.
+template <typename Buffer>
+class PooledBuffer {
+public:
+    PooledBuffer() = default;
+    explicit PooledBuffer(size_t size) { BufferPool::Instance().Rent(size, buffer_); }
+    ~PooledBuffer() { BufferPool::Instance().Return(buffer_); }
+
+    PooledBuffer(const PooledBuffer&) = delete;
+    PooledBuffer& operator=(const PooledBuffer&) = delete;
+
+    Buffer& Get() { return buffer_; }
+
+private:
+    Buffer buffer_;
+};
+
+#endif // __BUFFER_POOL_H__
@@ -0,0 +1,235 @@
+#include "ContentHash.h"
+#include "CpuFeatures.h"
+
+#include <cstring>
+
+namespace {
+
+    constexpr uint64_t Prime64_1 = 0x9E3779B185EBCA87ULL;
+    constexpr uint64_t Prime64_2 = 0xC2B2AE3D27D4EB4FULL;
+    constexpr uint64_t Prime64_3 = 0x165667B19E3779F9ULL;
+    constexpr uint64_t Prime64_4 = 0x85EBCA77C2B2AE63ULL;
+    constexpr uint64_t Prime64_5 = 0x27D4EB2F165667C5ULL;
+    constexpr uint64_t Prime32_1 = 0x9E3779B1ULL;
+    constexpr uint64_t Prime32_2 = 0x85EBCA77ULL;
+    constexpr uint64_t Prime32_3 = 0xC2B2AE3DULL;
+
+    constexpr size_t SecretSize = 192;
+    constexpr size_t StripeSize = 64;
+    constexpr size_t StripesPerBlock = (SecretSize - StripeSize) / 8;
+    constexpr size_t BlockSize = StripeSize * StripesPerBlock;
+    // Inputs up to this size take the XXH64 path.
+    constexpr size_t ShortInputLimit = 256;
+
+    inline uint64_t Read64(const uint8_t* p) {
+        uint64_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    inline uint32_t Read32(const uint8_t* p) {
+        uint32_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    inline uint64_t Rotl64(uint64_t v, int r) {
+        return (v << r) | (v >> (64 - r));
+    }
+
+    // Pseudo-random secret, derived once with splitmix64.
+    struct Secret {
+        alignas(64) uint8_t bytes[SecretSize];
+        Secret() {
+            uint64_t state = 0x243F6A8885A308D3ULL;
+            for (size_t i = 0; i < SecretSize; i += 8) {
+                state += 0x9E3779B97F4A7C15ULL;
+                uint64_t z = state;
+                z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+                z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+                z ^= z >> 31;
+                std::memcpy(bytes + i, &z, sizeof(z));
+            }
+        }
+    };
+
+    const Secret& GetSecret() {
+        static const Secret secret;
+        return secret;
+    }
+
+    uint64_t XxhRound(uint64_t acc, uint64_t input) {
+        acc += input * Prime64_2;
+        acc = Rotl64(acc, 31);
+        return acc * Prime64_1;
+    }
+
+    uint64_t XxhMergeRound(uint64_t acc, uint64_t val) {
+        acc ^= XxhRound(0, val);
+        return acc * Prime64_1 + Prime64_4;
+    }
+
+    uint64_t Xxh64(const uint8_t* p, size_t size, uint64_t seed) {
+        const uint8_t* end = p + size;
+        uint64_t h;
+
+        if (size >= 32) {
+            uint64_t v1 = seed + Prime64_1 + Prime64_2;
+            uint64_t v2 = seed + Prime64_2;
+            uint64_t v3 = seed;
+            uint64_t v4 = seed - Prime64_1;
+            const uint8_t* limit = end - 32;
+            do {
+                v1 = XxhRound(v1, Read64(p));
+                v2 = XxhRound(v2, Read64(p + 8));
+                v3 = XxhRound(v3, Read64(p + 16));
+                v4 = XxhRound(v4, Read64(p + 24));
+                p += 32;
+            } while (p <= limit);
+
+            h = Rotl64(v1, 1) + Rotl64(v2, 7) + Rotl64(v3, 12) + Rotl64(v4, 18);
+            h = XxhMergeRound(h, v1);
+            h = XxhMergeRound(h, v2);
+            h = XxhMergeRound(h, v3);
+            h = XxhMergeRound(h, v4);
+        }
+        else {
+            h = seed + Prime64_5;
+        }
+
+        h += static_cast<uint64_t>(size);
+
+        while (p + 8 <= end) {
+            h ^= XxhRound(0, Read64(p));
+            h = Rotl64(h, 27) * Prime64_1 + Prime64_4;
+            p += 8;
+        }
+        if (p + 4 <= end) {
+            h ^= static_cast<uint64_t>(Read32(p)) * Prime64_1;
+            h = Rotl64(h, 23) * Prime64_2 + Prime64_3;
+            p += 4;
+        }
+        while (p < end) {
+            h ^= (*p) * Prime64_5;
+            h = Rotl64(h, 11) * Prime64_1;
+            ++p;
+        }
+
+        h ^= h >> 33;
+        h *= Prime64_2;
+        h ^= h >> 29;
+        h *= Prime64_3;
+        h ^= h >> 32;
+        return h;
+    }
+
+    void AccumulateScalar(uint64_t* acc, const uint8_t* input, size_t stripes, const uint8_t* secret) {
+        for (size_t s = 0; s < stripes; ++s, input += StripeSize, secret += 8) {
+            for (int i = 0; i < 8; ++i) {
+                uint64_t data = Read64(input + 8 * i);
+                uint64_t key = data ^ Read64(secret + 8 * i);
+                acc[i ^ 1] += data;
+                acc[i] += (key & 0xFFFFFFFFULL) * (key >> 32);
+            }
+        }
+    }
+
+    void Scramble(uint64_t* acc, const uint8_t* secret) {
+        for (int i = 0; i < 8; ++i) {
+            uint64_t a = acc[i];
+            a ^= a >> 47;
+            a ^= Read64(secret + 8 * i);
+            acc[i] = a * Prime32_1;
+        }
+    }
+
+    uint64_t Mul128Fold64(uint64_t a, uint64_t b) {
+        uint64_t aLo = a & 0xFFFFFFFFULL, aHi = a >> 32;
+        uint64_t bLo = b & 0xFFFFFFFFULL, bHi = b >> 32;
+        uint64_t loLo = aLo * bLo;
+        uint64_t hiLo = aHi * bLo;
+        uint64_t loHi = aLo * bHi;
+        uint64_t hiHi = aHi * bHi;
+        uint64_t cross = (loLo >> 32) + (hiLo & 0xFFFFFFFFULL) + loHi;
+        uint64_t upper = (hiLo >> 32) + (cross >> 32) + hiHi;
+        uint64_t lower = (cross << 32) | (loLo & 0xFFFFFFFFULL);
+        return lower ^ upper;
+    }
+
+    uint64_t Avalanche(uint64_t h) {
+        h ^= h >> 37;
+        h *= 0x165667919E3779F9ULL;
+        h ^= h >> 32;
+        return h;
+    }
+
+    uint64_t HashLong(const uint8_t* p, size_t size, uint64_t seed, ContentHashAccumulateFn accumulate) {
+        const uint8_t* secret = GetSecret().bytes;
+
+        uint64_t acc[8] = {
+            Prime32_3, Prime64_1 + seed, Prime64_2, Prime64_3,
+            Prime64_4, Prime32_2, Prime64_5 - seed, Prime32_1
+        };
+
+        size_t blocks = (size - 1) / BlockSize;
+        for (size_t n = 0; n < blocks; ++n) {
+            accumulate(acc, p + n * BlockSize, StripesPerBlock, secret);
+            Scramble(acc, secret + SecretSize - StripeSize);
+        }
+
+        size_t stripes = ((size - 1) - blocks * BlockSize) / StripeSize;
+        accumulate(acc, p + blocks * BlockSize, stripes, secret);
+        // The last stripe overlaps the previous one so no padding is needed.
+        accumulate(acc, p + size - StripeSize, 1, secret + SecretSize - StripeSize - 7);
+
+        uint64_t result = static_cast<uint64_t>(size) * Prime64_1 ^ seed;
+        for (int i = 0; i < 4; ++i) {
+            result += Mul128Fold64(acc[2 * i] ^ Read64(secret + 11 + 16 * i),
+                acc[2 * i + 1] ^ Read64(secret + 19 + 16 * i));
+        }
+        return Avalanche(result);
+    }
+
+    struct Dispatch {
+        ContentHashAccumulateFn accumulate;
+        const char* name;
+    };
+
+    Dispatch Detect() {
+        if (kContentHashAccumulateAvx2 && CpuFeatures::HasAvx2()) {
+            return { kContentHashAccumulateAvx2, "AVX2" };
+        }
+        if (kContentHashAccumulateSse2 && CpuFeatures::HasSse2()) {
+            return { kContentHashAccumulateSse2, "SSE2" };
+        }
+        if (kContentHashAccumulateNeon && CpuFeatures::HasNeon()) {
+            return { kContentHashAccumulateNeon, "NEON" };
+        }
+        return { AccumulateScalar, "Scalar" };
+    }
+
+    const Dispatch& Active() {
+        static const Dispatch dispatch = Detect();
+        return dispatch;
+    }
+}
+
+uint64_t ContentHash::Hash64(const void* data, size_t size, uint64_t seed) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    if (size <= ShortInputLimit) {
+        return Xxh64(p, size, seed);
+    }
+    return HashLong(p, size, seed, Active().accumulate);
+}
+
+uint64_t ContentHash::Hash64Scalar(const void* data, size_t size, uint64_t seed) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    if (size <= ShortInputLimit) {
+        return Xxh64(p, size, seed);
+    }
+    return HashLong(p, size, seed, AccumulateScalar);
+}
+
+const char* ContentHash::ActiveIsaName() {
+    return Active().name;
+}
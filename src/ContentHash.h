@@ -0,0 +1,32 @@
+#ifndef __CONTENT_HASH_H__
+#define __CONTENT_HASH_H__
+
+#include <cstddef>
+#include <cstdint>
+
+// Fast non-cryptographic 64-bit hash for content addressing (deduplication,
+// caches). Short inputs use XXH64; longer ones use a striped accumulator in
+// the style of XXH3 whose inner loop runs on SSE2, AVX2 or NEON when the CPU
+// has it. Every variant produces the same value as the scalar reference.
+class ContentHash {
+public:
+    static uint64_t Hash64(const void* data, size_t size, uint64_t seed = 0);
+
+    // Reference implementation, used to verify the SIMD paths.
+    static uint64_t Hash64Scalar(const void* data, size_t size, uint64_t seed = 0);
+
+    static const char* ActiveIsaName();
+};
+
+// Inner loop: accumulates `stripes` consecutive 64-byte stripes into the
+// eight 64-bit lanes, stepping the secret by 8 bytes per stripe.
+typedef void (*ContentHashAccumulateFn)(uint64_t* acc, const uint8_t* input,
+    size_t stripes, const uint8_t* secret);
+
+// Per-ISA accumulators, defined in the ContentHash*.cpp translation units.
+// A pointer is nullptr when its instruction set is not available for the target.
+extern const ContentHashAccumulateFn kContentHashAccumulateSse2;
+extern const ContentHashAccumulateFn kContentHashAccumulateAvx2;
+extern const ContentHashAccumulateFn kContentHashAccumulateNeon;
+
+#endif // __CONTENT_HASH_H__
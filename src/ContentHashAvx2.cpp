@@ -0,0 +1,39 @@
+#include "ContentHash.h"
+
+// Built with AVX2 code generation enabled (see CMakeLists.txt); only reached
+// after the runtime CPU check in ContentHash.cpp.
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+
+namespace {
+
+    void AccumulateAvx2(uint64_t* acc, const uint8_t* input, size_t stripes, const uint8_t* secret) {
+        __m256i a0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(acc));
+        __m256i a1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(acc) + 1);
+
+        for (size_t s = 0; s < stripes; ++s, input += 64, secret += 8) {
+            __m256i d0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(input));
+            __m256i d1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(input) + 1);
+            __m256i k0 = _mm256_xor_si256(d0, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(secret)));
+            __m256i k1 = _mm256_xor_si256(d1, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(secret) + 1));
+
+            __m256i p0 = _mm256_mul_epu32(k0, _mm256_shuffle_epi32(k0, _MM_SHUFFLE(0, 3, 0, 1)));
+            __m256i p1 = _mm256_mul_epu32(k1, _mm256_shuffle_epi32(k1, _MM_SHUFFLE(0, 3, 0, 1)));
+
+            a0 = _mm256_add_epi64(a0, _mm256_add_epi64(p0, _mm256_shuffle_epi32(d0, _MM_SHUFFLE(1, 0, 3, 2))));
+            a1 = _mm256_add_epi64(a1, _mm256_add_epi64(p1, _mm256_shuffle_epi32(d1, _MM_SHUFFLE(1, 0, 3, 2))));
+        }
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(acc), a0);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(acc) + 1, a1);
+    }
+}
+
+const ContentHashAccumulateFn kContentHashAccumulateAvx2 = AccumulateAvx2;
+
+#else
+
+const ContentHashAccumulateFn kContentHashAccumulateAvx2 = nullptr;
+
+#endif
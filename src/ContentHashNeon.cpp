@@ -0,0 +1,37 @@
+#include "ContentHash.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+
+#include <arm_neon.h>
+
+namespace {
+
+    void AccumulateNeon(uint64_t* acc, const uint8_t* input, size_t stripes, const uint8_t* secret) {
+        uint64x2_t a[4];
+        for (int i = 0; i < 4; ++i) {
+            a[i] = vld1q_u64(acc + 2 * i);
+        }
+
+        for (size_t s = 0; s < stripes; ++s, input += 64, secret += 8) {
+            for (int i = 0; i < 4; ++i) {
+                uint64x2_t data = vreinterpretq_u64_u8(vld1q_u8(input + 16 * i));
+                uint64x2_t key = veorq_u64(data, vreinterpretq_u64_u8(vld1q_u8(secret + 16 * i)));
+                uint64x2_t product = vmull_u32(vmovn_u64(key), vshrn_n_u64(key, 32));
+                uint64x2_t swapped = vextq_u64(data, data, 1);
+                a[i] = vaddq_u64(a[i], vaddq_u64(product, swapped));
+            }
+        }
+
+        for (int i = 0; i < 4; ++i) {
+            vst1q_u64(acc + 2 * i, a[i]);
+        }
+    }
+}
+
+const ContentHashAccumulateFn kContentHashAccumulateNeon = AccumulateNeon;
+
+#else
+
+const ContentHashAccumulateFn kContentHashAccumulateNeon = nullptr;
+
+#endif
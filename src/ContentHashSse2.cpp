@@ -0,0 +1,39 @@
+#include "ContentHash.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+
+#include <emmintrin.h>
+
+namespace {
+
+    void AccumulateSse2(uint64_t* acc, const uint8_t* input, size_t stripes, const uint8_t* secret) {
+        __m128i a[4];
+        for (int i = 0; i < 4; ++i) {
+            a[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(acc) + i);
+        }
+
+        for (size_t s = 0; s < stripes; ++s, input += 64, secret += 8) {
+            for (int i = 0; i < 4; ++i) {
+                __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input) + i);
+                __m128i key = _mm_xor_si128(data, _mm_loadu_si128(reinterpret_cast<const __m128i*>(secret) + i));
+                // Low 32 bits times high 32 bits of every 64-bit key lane.
+                __m128i product = _mm_mul_epu32(key, _mm_shuffle_epi32(key, _MM_SHUFFLE(0, 3, 0, 1)));
+                // Each lane also absorbs the data of its neighbour.
+                __m128i swapped = _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+                a[i] = _mm_add_epi64(a[i], _mm_add_epi64(product, swapped));
+            }
+        }
+
+        for (int i = 0; i < 4; ++i) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(acc) + i, a[i]);
+        }
+    }
+}
+
+const ContentHashAccumulateFn kContentHashAccumulateSse2 = AccumulateSse2;
+
+#else
+
+const ContentHashAccumulateFn kContentHashAccumulateSse2 = nullptr;
+
+#endif
@@ -0,0 +1,86 @@
+#include "CpuFeatures.h"
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define CPU_FEATURES_X86
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <cpuid.h>
+#define CPU_FEATURES_X86
+#endif
+
+namespace {
+
+#ifdef CPU_FEATURES_X86
+    void Cpuid(int leaf, int subleaf, unsigned regs[4]) {
+#ifdef _MSC_VER
+        int info[4];
+        __cpuidex(info, leaf, subleaf);
+        for (int i = 0; i < 4; ++i) regs[i] = static_cast<unsigned>(info[i]);
+#else
+        __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+    }
+
+    unsigned long long ReadXcr0() {
+#ifdef _MSC_VER
+        return _xgetbv(0);
+#else
+        unsigned eax = 0, edx = 0;
+        __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+        return (static_cast<unsigned long long>(edx) << 32) | eax;
+#endif
+    }
+
+    bool DetectSse2() {
+        unsigned regs[4];
+        Cpuid(0, 0, regs);
+        if (regs[0] < 1) return false;
+        Cpuid(1, 0, regs);
+        return (regs[3] & (1u << 26)) != 0;
+    }
+
+    bool DetectAvx2() {
+        unsigned regs[4];
+        Cpuid(0, 0, regs);
+        unsigned maxLeaf = regs[0];
+        if (maxLeaf < 7) return false;
+
+        Cpuid(1, 0, regs);
+        bool osxsave = (regs[2] & (1u << 27)) != 0;
+        bool avx = (regs[2] & (1u << 28)) != 0;
+        if (!osxsave || !avx) return false;
+
+        // The OS must save YMM state on context switches.
+        if ((ReadXcr0() & 0x6) != 0x6) return false;
+
+        Cpuid(7, 0, regs);
+        return (regs[1] & (1u << 5)) != 0;
+    }
+#endif
+}
+
+bool CpuFeatures::HasSse2() {
+#ifdef CPU_FEATURES_X86
+    static const bool supported = DetectSse2();
+    return supported;
+#else
+    return false;
+#endif
+}
+
+bool CpuFeatures::HasAvx2() {
+#ifdef CPU_FEATURES_X86
+    static const bool supported = DetectAvx2();
+    return supported;
+#else
+    return false;
+#endif
+}
+
+bool CpuFeatures::HasNeon() {
+#if defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+    return true;
+#else
+    return false;
+#endif
+}
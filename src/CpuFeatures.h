@@ -0,0 +1,13 @@
+#ifndef __CPU_FEATURES_H__
+#define __CPU_FEATURES_H__
+
+// Runtime instruction set detection shared by the SIMD code paths.
+class CpuFeatures {
+public:
+    static bool HasSse2();
+    static bool HasAvx2();
+    // NEON is part of the baseline on every ARM target we build for.
+    static bool HasNeon();
+};
+
+#endif // __CPU_FEATURES_H__
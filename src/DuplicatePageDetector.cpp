@@ -0,0 +1,554 @@
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <memory>
+#include "GdiplusManager.h"
+#include "Logger.h"
+#include "ContentHash.h"
+#include "PdfOutputWriter.h"
+#include "DuplicatePageDetector.h"
+
+namespace {
+
+    using PoDoFo::PdfDictionary;
+    using PoDoFo::PdfObject;
+
+    constexpr int MaxParentDepth = 64;
+    constexpr int MaxNesting = 32;
+
+    // Difference hash grid: each of the 16 rows compares 17 cells pairwise.
+    constexpr int GridRows = 16;
+    constexpr int GridColumns = 17;
+    // Images whose cells differ by less than this (of 255) carry too little
+    // detail to compare: blank sheets would all match each other.
+    constexpr double MinContrast = 8.0;
+    constexpr double AspectTolerance = 0.02;
+
+    typedef double Grid[GridRows][GridColumns];
+
+    bool IsName(const PdfObject* obj, const char* name) {
+        return obj && obj->IsName() && obj->GetName() == name;
+    }
+
+    int ReadInt(const PdfDictionary& dict, const char* key) {
+        const PdfObject* value = dict.FindKey(key);
+        return value && value->IsNumber() ? static_cast<int>(value->GetNumber()) : 0;
+    }
+
+    // Value of a page attribute, which may be inherited; references are
+    // followed only when `resolve` is set.
+    const PdfObject* FindInherited(const PdfObject& page, const char* key, bool resolve) {
+        const PdfObject* current = &page;
+        for (int depth = 0; current && current->IsDictionary() && depth < MaxParentDepth; ++depth) {
+            const PdfDictionary& dict = current->GetDictionary();
+            const PdfObject* value = resolve ? dict.FindKey(key) : dict.GetKey(key);
+            if (value) {
+                return value;
+            }
+            current = current->GetDictionary().FindKey("Parent");
+        }
+        return nullptr;
+    }
+
+    // Canonical description of a value in which each reference is replaced
+    // by the digest of the object it points to, so the same content copied
+    // under other object numbers describes the same.
+    class Describer {
+    public:
+        explicit Describer(PoDoFo::PdfIndirectObjectList& objects) : objects_(objects) {}
+
+        void Append(const PdfObject& value, std::string& out, int depth = 0) {
+            if (depth > MaxNesting) {
+                out += '?';
+            }
+            else if (value.IsReference()) {
+                out += 'R';
+                out += Digest(value.GetReference(), depth);
+            }
+            else if (value.IsDictionary()) {
+                AppendDictionary(value.GetDictionary(), nullptr, out, depth);
+            }
+            else if (value.IsArray()) {
+                out += '[';
+                for (const PdfObject& item : value.GetArray()) {
+                    Append(item, out, depth + 1);
+                    out += ' ';
+                }
+                out += ']';
+            }
+            else {
+                PdfOutputWriter::AppendValue(value, out);
+            }
+        }
+
+        // The annotations of a page with their appearance streams, form
+        // field values and so on. The link back to the page itself (/P)
+        // is left out, so that a copy of the page describes the same.
+        void AppendAnnotations(const PdfObject& annots, std::string& out) {
+            if (!annots.IsArray()) {
+                Append(annots, out);
+                return;
+            }
+            out += '[';
+            for (const PdfObject& item : annots.GetArray()) {
+                const PdfObject* annot = item.IsReference() ? objects_.GetObject(item.GetReference()) : &item;
+                if (annot && annot->IsDictionary()) {
+                    AppendDictionary(annot->GetDictionary(), "P", out, 0);
+                }
+                else if (annot) {
+                    Append(*annot, out);
+                }
+                out += ' ';
+            }
+            out += ']';
+        }
+
+    private:
+        PoDoFo::PdfIndirectObjectList& objects_;
+        std::unordered_map<uint32_t, std::string> digests_;
+
+        void AppendDictionary(const PdfDictionary& dict, const char* skipKey, std::string& out, int depth) {
+            out += "<<";
+            for (const auto& pair : dict) {
+                if (skipKey && pair.first == skipKey) {
+                    continue;
+                }
+                out += pair.first.ToString();
+                out += ' ';
+                Append(pair.second, out, depth + 1);
+            }
+            out += ">>";
+        }
+
+        // 16 bytes per object, computed once; an object reached again while
+        // it is being described (a cycle) contributes a fixed marker.
+        const std::string& Digest(const PoDoFo::PdfReference& ref, int depth) {
+            auto cached = digests_.find(ref.ObjectNumber());
+            if (cached != digests_.end()) {
+                return cached->second;
+            }
+            digests_[ref.ObjectNumber()] = "(cycle)";
+
+            std::string description;
+            const PdfObject* object = objects_.GetObject(ref);
+            const PdfObject* type = object && object->IsDictionary() ? object->GetDictionary().GetKey("Type") : nullptr;
+            if (IsName(type, "Page") || IsName(type, "Pages")) {
+                // A page reached from an annotation (a link target, a
+                // field on several pages) stands for itself: describing it
+                // would take in the whole page tree.
+                description = "page " + std::to_string(ref.ObjectNumber());
+            }
+            else if (object) {
+                Append(*object, description, depth + 1);
+                if (object->HasStream()) {
+                    PoDoFo::charbuff raw = object->GetStream()->GetCopy(true);
+                    uint64_t hash = ContentHash::Hash64(raw.data(), raw.size());
+                    description += "stream " + std::to_string(raw.size()) + " ";
+                    description.append(reinterpret_cast<const char*>(&hash), sizeof(hash));
+                }
+            }
+
+            uint64_t hashes[2] = {
+                ContentHash::Hash64(description.data(), description.size(), 0),
+                ContentHash::Hash64(description.data(), description.size(), 1)
+            };
+            std::string& digest = digests_[ref.ObjectNumber()];
+            digest.assign(reinterpret_cast<const char*>(hashes), sizeof(hashes));
+            return digest;
+        }
+    };
+
+    // The image XObject a page draws when its content does nothing but
+    // place that one image (q, cm, Do, Q): a scanned sheet.
+    const PdfObject* FindSoleImage(const PdfObject& page) {
+        const PdfObject* contents = page.GetDictionary().FindKey("Contents");
+        std::vector<const PdfObject*> streams;
+        if (contents && contents->HasStream()) {
+            streams.push_back(contents);
+        }
+        else if (contents && contents->IsArray()) {
+            for (unsigned i = 0; i < contents->GetArray().GetSize(); ++i) {
+                const PdfObject* item = contents->GetArray().FindAt(i);
+                if (!item || !item->HasStream()) {
+                    return nullptr;
+                }
+                streams.push_back(item);
+            }
+        }
+
+        std::string text;
+        for (const PdfObject* stream : streams) {
+            PoDoFo::charbuff data = stream->GetStream()->GetCopy();
+            text.append(data.data(), data.size());
+            text += '\n';
+        }
+
+        std::string name;
+        std::string lastName;
+        int draws = 0;
+        size_t pos = 0;
+        auto isWhitespace = [](char c) {
+            return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\f' || c == '\0';
+        };
+        auto isDelimiter = [&](char c) {
+            return isWhitespace(c) || c == '(' || c == ')' || c == '<' || c == '>' || c == '[' || c == ']' ||
+                c == '{' || c == '}' || c == '/' || c == '%';
+        };
+
+        while (pos < text.size()) {
+            char c = text[pos];
+            if (c == '%') {
+                pos = text.find_first_of("\r\n", pos);
+                pos = pos == std::string::npos ? text.size() : pos;
+            }
+            else if (c == '/') {
+                size_t end = pos + 1;
+                while (end < text.size() && !isDelimiter(text[end])) ++end;
+                lastName = text.substr(pos + 1, end - pos - 1);
+                pos = end;
+            }
+            else if (isWhitespace(c)) {
+                ++pos;
+            }
+            else if (isDelimiter(c)) {
+                // Strings, arrays and dictionaries belong to other operators.
+                return nullptr;
+            }
+            else {
+                size_t end = pos;
+                while (end < text.size() && !isDelimiter(text[end])) ++end;
+                std::string token = text.substr(pos, end - pos);
+                pos = end;
+                if (std::isdigit(static_cast<unsigned char>(c)) || c == '-' || c == '+' || c == '.') {
+                    continue;
+                }
+                if (token == "Do") {
+                    name = lastName;
+                    ++draws;
+                }
+                else if (token != "q" && token != "Q" && token != "cm") {
+                    return nullptr;
+                }
+            }
+        }
+
+        if (draws != 1) {
+            return nullptr;
+        }
+        const PdfObject* resources = FindInherited(page, "Resources", true);
+        const PdfObject* xobjects = resources && resources->IsDictionary()
+            ? resources->GetDictionary().FindKey("XObject") : nullptr;
+        const PdfObject* image = xobjects && xobjects->IsDictionary()
+            ? xobjects->GetDictionary().FindKey(name) : nullptr;
+        return image && image->HasStream() && IsName(image->GetDictionary().FindKey("Subtype"), "Image")
+            ? image : nullptr;
+    }
+
+    // Mean brightness of each grid cell for 1 or 8 bit gray or RGB samples.
+    bool AverageSamples(const PoDoFo::charbuff& data, unsigned width, unsigned height, int components, int bits,
+        Grid& grid) {
+        size_t rowBytes = bits == 1 ? (static_cast<size_t>(width) * components + 7) / 8
+            : static_cast<size_t>(width) * components;
+        if (data.size() < rowBytes * height) {
+            return false;
+        }
+
+        double counts[GridRows][GridColumns] = {};
+        for (auto& row : grid) for (double& cell : row) cell = 0;
+
+        const uint8_t* pixels = reinterpret_cast<const uint8_t*>(data.data());
+        for (unsigned y = 0; y < height; ++y) {
+            const uint8_t* row = pixels + y * rowBytes;
+            size_t gy = static_cast<size_t>(y) * GridRows / height;
+            for (unsigned x = 0; x < width; ++x) {
+                double value;
+                if (bits == 1) {
+                    value = (row[x / 8] >> (7 - x % 8)) & 1 ? 255.0 : 0.0;
+                }
+                else if (components == 3) {
+                    value = 0.299 * row[x * 3] + 0.587 * row[x * 3 + 1] + 0.114 * row[x * 3 + 2];
+                }
+                else {
+                    value = row[x];
+                }
+                size_t gx = static_cast<size_t>(x) * GridColumns / width;
+                grid[gy][gx] += value;
+                counts[gy][gx] += 1;
+            }
+        }
+
+        for (int y = 0; y < GridRows; ++y) {
+            for (int x = 0; x < GridColumns; ++x) {
+                grid[y][x] = counts[y][x] > 0 ? grid[y][x] / counts[y][x] : 0;
+            }
+        }
+        return true;
+    }
+
+    // JPEGs are decoded by GDI+ and scaled straight down to the grid.
+    bool AverageJpeg(const PoDoFo::charbuff& raw, Grid& grid) {
+        GdiplusManager::Instance().EnsureInitialized();
+
+        IStream* stream = nullptr;
+        if (CreateStreamOnHGlobal(nullptr, TRUE, &stream) != S_OK) {
+            return false;
+        }
+
+        bool ok = false;
+        ULONG written = 0;
+        if (stream->Write(raw.data(), static_cast<ULONG>(raw.size()), &written) == S_OK && written == raw.size()) {
+            LARGE_INTEGER liZero = {};
+            stream->Seek(liZero, STREAM_SEEK_SET, nullptr);
+
+            std::unique_ptr<Gdiplus::Bitmap> source(new Gdiplus::Bitmap(stream));
+            Gdiplus::Bitmap target(GridColumns, GridRows, PixelFormat24bppRGB);
+            if (source->GetLastStatus() == Gdiplus::Ok && target.GetLastStatus() == Gdiplus::Ok) {
+                Gdiplus::Status status;
+                {
+                    Gdiplus::Graphics graphics(&target);
+                    graphics.SetInterpolationMode(Gdiplus::InterpolationModeHighQualityBilinear);
+                    status = graphics.DrawImage(source.get(), 0, 0, GridColumns, GridRows);
+                }
+
+                Gdiplus::Rect rect(0, 0, GridColumns, GridRows);
+                Gdiplus::BitmapData data;
+                if (status == Gdiplus::Ok &&
+                    target.LockBits(&rect, Gdiplus::ImageLockModeRead, PixelFormat24bppRGB, &data) == Gdiplus::Ok) {
+                    for (int y = 0; y < GridRows; ++y) {
+                        const uint8_t* row = static_cast<const uint8_t*>(data.Scan0) + static_cast<ptrdiff_t>(y) * data.Stride;
+                        for (int x = 0; x < GridColumns; ++x) {
+                            // GDI+ rows are B, G, R.
+                            grid[y][x] = 0.114 * row[x * 3] + 0.587 * row[x * 3 + 1] + 0.299 * row[x * 3 + 2];
+                        }
+                    }
+                    target.UnlockBits(&data);
+                    ok = true;
+                }
+            }
+        }
+
+        stream->Release();
+        return ok;
+    }
+
+    bool VisualHash(const PdfObject& image, uint64_t bits[4], double& aspect) {
+        const PdfDictionary& dict = image.GetDictionary();
+        int width = ReadInt(dict, "Width");
+        int height = ReadInt(dict, "Height");
+        if (width <= 0 || height <= 0 || dict.HasKey("Decode") || dict.HasKey("DecodeParms")) {
+            return false;
+        }
+        aspect = static_cast<double>(width) / height;
+
+        const PdfObject* filter = dict.FindKey("Filter");
+        if (filter && filter->IsArray()) {
+            filter = filter->GetArray().GetSize() == 1 ? filter->GetArray().FindAt(0) : nullptr;
+            if (!filter) {
+                return false;
+            }
+        }
+
+        Grid grid;
+        if (IsName(filter, "DCTDecode")) {
+            if (!AverageJpeg(image.GetStream()->GetCopy(true), grid)) {
+                return false;
+            }
+        }
+        else if (!filter || IsName(filter, "FlateDecode")) {
+            const PdfObject* colorSpace = dict.FindKey("ColorSpace");
+            int components = 0;
+            if (IsName(colorSpace, "DeviceGray")) {
+                components = 1;
+            }
+            else if (IsName(colorSpace, "DeviceRGB")) {
+                components = 3;
+            }
+            else if (colorSpace && colorSpace->IsArray() && colorSpace->GetArray().GetSize() == 2 &&
+                IsName(colorSpace->GetArray().FindAt(0), "ICCBased")) {
+                const PdfObject* profile = colorSpace->GetArray().FindAt(1);
+                components = profile && profile->IsDictionary() ? ReadInt(profile->GetDictionary(), "N") : 0;
+            }
+            int bitsPerComponent = ReadInt(dict, "BitsPerComponent");
+            if ((components != 1 && components != 3) || (bitsPerComponent != 8 &&
+                !(bitsPerComponent == 1 && components == 1)) ||
+                !AverageSamples(image.GetStream()->GetCopy(), static_cast<unsigned>(width),
+                    static_cast<unsigned>(height), components, bitsPerComponent, grid)) {
+                return false;
+            }
+        }
+        else {
+            // CCITT, JBIG2, JPEG 2000: exact matches only.
+            return false;
+        }
+
+        double lowest = 255.0, highest = 0.0;
+        for (const auto& row : grid) {
+            for (double cell : row) {
+                lowest = (std::min)(lowest, cell);
+                highest = (std::max)(highest, cell);
+            }
+        }
+        if (highest - lowest < MinContrast) {
+            return false;
+        }
+
+        bits[0] = bits[1] = bits[2] = bits[3] = 0;
+        for (int y = 0; y < GridRows; ++y) {
+            for (int x = 0; x + 1 < GridColumns; ++x) {
+                if (grid[y][x] > grid[y][x + 1]) {
+                    int bit = y * (GridColumns - 1) + x;
+                    bits[bit / 64] |= 1ULL << (bit % 64);
+                }
+            }
+        }
+        return true;
+    }
+
+    uint32_t BandKey(const uint64_t bits[4], int band) {
+        uint32_t value = static_cast<uint32_t>(bits[band / 4] >> (16 * (band % 4))) & 0xFFFF;
+        return static_cast<uint32_t>(band) << 16 | value;
+    }
+
+    int Distance(const uint64_t a[4], const uint64_t b[4]) {
+        int distance = 0;
+        for (int i = 0; i < 4; ++i) {
+            for (uint64_t diff = a[i] ^ b[i]; diff != 0; diff &= diff - 1) {
+                ++distance;
+            }
+        }
+        return distance;
+    }
+}
+
+bool DuplicatePageDetector::Check(PoDoFo::PdfMemDocument& doc, unsigned firstPage, const std::string& source,
+    std::vector<unsigned>& duplicates) {
+    duplicates.clear();
+    try {
+        PoDoFo::PdfPageCollection& pages = doc.GetPages();
+        Describer describer(doc.GetObjects());
+
+        for (unsigned i = firstPage; i < pages.GetCount(); ++i) {
+            const PdfObject& page = pages.GetPageAt(i).GetObject();
+            unsigned number = i - firstPage + 1;
+
+            std::string description;
+            const PdfObject* contents = page.GetDictionary().GetKey("Contents");
+            if (contents) {
+                describer.Append(*contents, description);
+            }
+            description += '\n';
+            for (const char* key : { "Resources", "MediaBox", "CropBox", "Rotate" }) {
+                const PdfObject* value = FindInherited(page, key, false);
+                description += key;
+                description += ' ';
+                if (value) {
+                    describer.Append(*value, description);
+                }
+                description += '\n';
+            }
+            const PdfObject* annots = page.GetDictionary().FindKey("Annots");
+            description += "Annots ";
+            if (annots) {
+                describer.AppendAnnotations(*annots, description);
+            }
+
+            uint64_t key = ContentHash::Hash64(description.data(), description.size(), 0);
+            uint64_t key2 = ContentHash::Hash64(description.data(), description.size(), 1);
+            std::vector<Seen>& bucket = exact_[key];
+
+            const Seen* exact = nullptr;
+            for (const Seen& seen : bucket) {
+                if (seen.exact2 == key2) {
+                    exact = &seen;
+                    break;
+                }
+            }
+            std::string match;
+            if (exact) {
+                match = exact->source + " page " + std::to_string(exact->page) + " (exact)";
+            }
+            else {
+                bucket.push_back({ key2, source, number });
+
+                const PdfObject* image = FindSoleImage(page);
+                SeenImage entry;
+                if (image && VisualHash(*image, entry.bits, entry.aspect)) {
+                    const SeenImage* seen = FindImage(entry);
+                    if (seen) {
+                        match = seen->source + " page " + std::to_string(seen->page) + " (visual)";
+                    }
+                    else {
+                        entry.source = source;
+                        entry.page = number;
+                        AddImage(entry);
+                    }
+                }
+            }
+
+            if (!match.empty()) {
+                std::string line = source + " page " + std::to_string(number) + " = " + match;
+                Logger::Debug("Duplicate page: " + line);
+                report_ += (report_.empty() ? "" : "\n") + line;
+                if (exact) {
+                    duplicates.push_back(i);
+                }
+                ++duplicates_;
+            }
+        }
+        return true;
+    }
+    catch (const PoDoFo::PdfError& e) {
+        Logger::Error("Duplicate page check failed: PdfError code " + std::to_string(static_cast<int>(e.GetCode())));
+        return false;
+    }
+    catch (const std::exception& e) {
+        Logger::Error("Duplicate page check failed: " + std::string(e.what()));
+        return false;
+    }
+}
+
+const DuplicatePageDetector::SeenImage* DuplicatePageDetector::FindImage(const SeenImage& image) const {
+    std::unordered_map<uint32_t, int> shared;
+    for (int band = 0; band < BANDS; ++band) {
+        auto bucket = bands_.find(BandKey(image.bits, band));
+        if (bucket != bands_.end()) {
+            for (uint32_t index : bucket->second) {
+                ++shared[index];
+            }
+        }
+    }
+
+    // The earliest match, whatever order the candidates come in.
+    const SeenImage* found = nullptr;
+    for (const auto& candidate : shared) {
+        if (candidate.second < BANDS - VISUAL_DISTANCE || (found && &images_[candidate.first] > found)) {
+            continue;
+        }
+        const SeenImage& seen = images_[candidate.first];
+        if (std::fabs(seen.aspect - image.aspect) <= AspectTolerance * seen.aspect &&
+            Distance(seen.bits, image.bits) <= VISUAL_DISTANCE) {
+            found = &seen;
+        }
+    }
+    return found;
+}
+
+void DuplicatePageDetector::AddImage(const SeenImage& image) {
+    uint32_t index = static_cast<uint32_t>(images_.size());
+    images_.push_back(image);
+    for (int band = 0; band < BANDS; ++band) {
+        std::vector<uint32_t>& bucket = bands_[BandKey(image.bits, band)];
+        if (bucket.size() == BAND_LIMIT) {
+            bucket.erase(bucket.begin());
+        }
+        bucket.push_back(index);
+    }
+}
+
+size_t DuplicatePageDetector::GetDuplicateCount() const {
+    return duplicates_;
+}
+
+const std::string& DuplicatePageDetector::GetReport() const {
+    return report_;
+}
@@ -0,0 +1,79 @@
+#ifndef __DUPLICATE_PAGE_DETECTOR_H__
+#define __DUPLICATE_PAGE_DETECTOR_H__
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "podofo/podofo.h"
+
+// Finds pages that were already merged, from an earlier input or earlier in
+// the same input: the same PDF dropped in under two names, or a sheet that
+// went through the scanner twice.
+//
+// Every page gets an exact fingerprint: the raw data of its content streams,
+// its resources with all references resolved (object numbers do not count),
+// its boxes and rotation, and its annotations with their appearance streams,
+// so pages that differ in stamps, comments or filled form fields are not
+// copies. A page an annotation points to counts by its object number only. A page that only draws one image also gets a
+// 256-bit difference hash of that image, so two scans of the same sheet
+// match although their pixels differ; they have to be within
+// VISUAL_DISTANCE bits and have the same aspect ratio. Different scans of
+// the same printed form can match that way too, so visual matches are only
+// reported, never removed.
+//
+// Image hashes are found through BANDS slices of 16 bits: two hashes within
+// VISUAL_DISTANCE bits agree on at least BANDS - VISUAL_DISTANCE slices, so
+// only images sharing that many slices are compared. A slice keeps the last
+// BAND_LIMIT images, which bounds the work per page on long runs of similar
+// scans.
+class DuplicatePageDetector {
+public:
+    enum Mode : int {
+        OFF = 0,
+        REPORT = 1,     // log and list duplicates, keep them
+        REMOVE = 2,     // also remove exact duplicates from the output
+    };
+
+    static constexpr int VISUAL_DISTANCE = 8;
+
+    // Fingerprints the pages from firstPage to the end of doc, which came
+    // from `source`, and returns the indexes of exact copies of pages seen
+    // before. Visual matches go to the report only.
+    bool Check(PoDoFo::PdfMemDocument& doc, unsigned firstPage, const std::string& source,
+        std::vector<unsigned>& duplicates);
+
+    size_t GetDuplicateCount() const;
+    // One line per duplicate: "file page N = file page M (exact|visual)".
+    const std::string& GetReport() const;
+
+private:
+    struct Seen {
+        uint64_t exact2;
+        std::string source;
+        unsigned page;
+    };
+
+    struct SeenImage {
+        uint64_t bits[4];
+        double aspect;
+        std::string source;
+        unsigned page;
+    };
+
+    std::unordered_map<uint64_t, std::vector<Seen>> exact_;
+    static constexpr int BANDS = 16;
+    static constexpr size_t BAND_LIMIT = 256;
+
+    // Earlier image that matches visually, or nullptr.
+    const SeenImage* FindImage(const SeenImage& image) const;
+    void AddImage(const SeenImage& image);
+
+    std::vector<SeenImage> images_;
+    // Band number << 16 | band bits -> indexes into images_.
+    std::unordered_map<uint32_t, std::vector<uint32_t>> bands_;
+    size_t duplicates_ = 0;
+    std::string report_;
+};
+
+#endif // __DUPLICATE_PAGE_DETECTOR_H__
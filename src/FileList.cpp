@@ -0,0 +1,187 @@
+#include <cctype>
+#include <cstdint>
+#include "FileList.h"
+
+namespace {
+
+    const char kUtf8Bom[] = "\xEF\xBB\xBF";
+
+    void SkipBlanks(std::string_view text, size_t& pos) {
+        while (pos < text.size() && std::isspace(static_cast<unsigned char>(text[pos]))) {
+            ++pos;
+        }
+    }
+
+    void AppendUtf8(std::string& out, uint32_t code) {
+        if (code < 0x80) {
+            out += static_cast<char>(code);
+        }
+        else if (code < 0x800) {
+            out += static_cast<char>(0xC0 | (code >> 6));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        }
+        else if (code < 0x10000) {
+            out += static_cast<char>(0xE0 | (code >> 12));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        }
+        else {
+            out += static_cast<char>(0xF0 | (code >> 18));
+            out += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        }
+    }
+
+    bool ReadHex4(std::string_view text, size_t& pos, uint32_t& value) {
+        if (text.size() - pos < 4) {
+            return false;
+        }
+        value = 0;
+        for (size_t end = pos + 4; pos < end; ++pos) {
+            char c = text[pos];
+            value <<= 4;
+            if (c >= '0' && c <= '9') value |= c - '0';
+            else if (c >= 'a' && c <= 'f') value |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') value |= c - 'A' + 10;
+            else return false;
+        }
+        return true;
+    }
+
+    // Reads the string starting at the opening quote at pos.
+    bool ReadString(std::string_view text, size_t& pos, std::string& value, std::string& error) {
+        value.clear();
+        ++pos;
+        while (pos < text.size()) {
+            char c = text[pos++];
+            if (c == '"') {
+                return true;
+            }
+            if (c != '\\') {
+                value += c;
+                continue;
+            }
+            if (pos == text.size()) {
+                break;
+            }
+
+            char escape = text[pos++];
+            switch (escape) {
+            case '"': value += '"'; break;
+            case '\\': value += '\\'; break;
+            case '/': value += '/'; break;
+            case 'b': value += '\b'; break;
+            case 'f': value += '\f'; break;
+            case 'n': value += '\n'; break;
+            case 'r': value += '\r'; break;
+            case 't': value += '\t'; break;
+            case 'u': {
+                uint32_t code = 0;
+                if (!ReadHex4(text, pos, code)) {
+                    error = "bad \\u escape at offset " + std::to_string(pos);
+                    return false;
+                }
+                // A character outside the BMP comes as a surrogate pair.
+                if (code >= 0xD800 && code < 0xDC00 && text.substr(pos, 2) == "\\u") {
+                    size_t next = pos + 2;
+                    uint32_t low = 0;
+                    if (ReadHex4(text, next, low) && low >= 0xDC00 && low < 0xE000) {
+                        code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                        pos = next;
+                    }
+                }
+                AppendUtf8(value, code);
+                break;
+            }
+            default:
+                error = "bad escape at offset " + std::to_string(pos - 1);
+                return false;
+            }
+        }
+        error = "unterminated string";
+        return false;
+    }
+}
+
+bool FileList::Parse(std::string_view text, std::vector<std::string>& paths, std::string& error) {
+    paths.clear();
+    if (text.substr(0, 3) == kUtf8Bom) {
+        text.remove_prefix(3);
+    }
+
+    size_t pos = 0;
+    SkipBlanks(text, pos);
+    if (pos < text.size() && text[pos] == '[') {
+        return ParseJson(text.substr(pos), paths, error);
+    }
+    ParseLines(text, paths);
+    return true;
+}
+
+bool FileList::ParseJson(std::string_view text, std::vector<std::string>& paths, std::string& error) {
+    size_t pos = 1;
+    SkipBlanks(text, pos);
+    if (pos < text.size() && text[pos] == ']') {
+        ++pos;
+    }
+    else {
+        for (;;) {
+            SkipBlanks(text, pos);
+            if (pos == text.size() || text[pos] != '"') {
+                error = "expected a string at offset " + std::to_string(pos);
+                return false;
+            }
+
+            std::string path;
+            if (!ReadString(text, pos, path, error)) {
+                return false;
+            }
+            if (!path.empty()) {
+                paths.push_back(std::move(path));
+            }
+
+            SkipBlanks(text, pos);
+            if (pos < text.size() && text[pos] == ',') {
+                ++pos;
+                continue;
+            }
+            if (pos < text.size() && text[pos] == ']') {
+                ++pos;
+                break;
+            }
+            error = "expected ',' or ']' at offset " + std::to_string(pos);
+            return false;
+        }
+    }
+
+    SkipBlanks(text, pos);
+    if (pos != text.size()) {
+        error = "unexpected text after the array at offset " + std::to_string(pos);
+        return false;
+    }
+    return true;
+}
+
+void FileList::ParseLines(std::string_view text, std::vector<std::string>& paths) {
+    size_t start = 0;
+    while (start < text.size()) {
+        size_t end = text.find('\n', start);
+        if (end == std::string_view::npos) {
+            end = text.size();
+        }
+        std::string_view line = text.substr(start, end - start);
+        start = end + 1;
+
+        // Blanks around the path, including the '\r' of Windows line ends.
+        size_t first = 0;
+        SkipBlanks(line, first);
+        size_t last = line.size();
+        while (last > first && std::isspace(static_cast<unsigned char>(line[last - 1]))) {
+            --last;
+        }
+        if (last > first) {
+            paths.emplace_back(line.substr(first, last - first));
+        }
+    }
+}
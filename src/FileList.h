@@ -0,0 +1,22 @@
+#ifndef __FILE_LIST_H__
+#define __FILE_LIST_H__
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Ordered list of input paths passed to MergeFileList: either a JSON array
+// of strings or plain text with one path per line. Text that starts with
+// '[' (after blanks and a UTF-8 BOM) is read as JSON. Empty lines and
+// empty strings are skipped; paths are returned as written.
+class FileList {
+public:
+    // False with the reason in error when the text is not a valid list.
+    static bool Parse(std::string_view text, std::vector<std::string>& paths, std::string& error);
+
+private:
+    static bool ParseJson(std::string_view text, std::vector<std::string>& paths, std::string& error);
+    static void ParseLines(std::string_view text, std::vector<std::string>& paths);
+};
+
+#endif // __FILE_LIST_H__
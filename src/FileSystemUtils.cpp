@@ -1,9 +1,12 @@
 #include <sstream>
 #include <iomanip>
 #include <algorithm>
+#include <cctype>
+#include <type_traits>
 #include <windows.h>
 
 #include "FileSystemUtils.h"
+#include "BufferPool.h"
 #include "Logger.h"
 #include "StringConverter.h"
 
@@ -68,34 +71,154 @@ bool FileSystemUtils::DirectoryExists(const std::string& path) {
     }
 }
 
-bool FileSystemUtils::GetFilesFromDirectory(const std::string& folderPath, std::vector<std::string>& files) {
-    std::wstring widePath = StringConverter::Utf8ToWide(folderPath);
-    if (widePath.empty()) return false;
+namespace {
 
-    if (widePath.back() != L'\\') widePath += L'\\';
-    widePath += L'*';
+    uint64_t ToUint64(DWORD high, DWORD low) {
+        return (static_cast<uint64_t>(high) << 32) | low;
+    }
 
-    WIN32_FIND_DATAW findData;
-    HANDLE hFind = FindFirstFileW(widePath.c_str(), &findData);
-    if (hFind == INVALID_HANDLE_VALUE) return false;
+    // Byte-wise, like StringConverter::ToLowercase, without the copies.
+    bool SameIgnoringCase(std::string_view a, std::string_view b) {
+        if (a.size() != b.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < a.size(); ++i) {
+            if (std::tolower(static_cast<unsigned char>(a[i])) != std::tolower(static_cast<unsigned char>(b[i]))) {
+                return false;
+            }
+        }
+        return true;
+    }
 
-    do {
-        if (wcscmp(findData.cFileName, L".") == 0 || wcscmp(findData.cFileName, L"..") == 0)
-            continue;
+    // Sorts items by a key computed once per item instead of on both sides
+    // of every comparison.
+    template <typename T, typename KeyFn>
+    void SortByKey(std::vector<T>& items, KeyFn key) {
+        using Key = std::decay_t<decltype(key(items.front()))>;
+        std::vector<std::pair<Key, size_t>> keys;
+        keys.reserve(items.size());
+        for (size_t i = 0; i < items.size(); ++i) {
+            keys.emplace_back(key(items[i]), i);
+        }
+        std::sort(keys.begin(), keys.end());
 
-        if (!(findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
-            std::wstring fullPath = StringConverter::Utf8ToWide(folderPath);
-            if (fullPath.back() != L'\\') fullPath += L'\\';
-            fullPath += findData.cFileName;
+        std::vector<T> sorted;
+        sorted.reserve(items.size());
+        for (const auto& entry : keys) {
+            sorted.push_back(std::move(items[entry.second]));
+        }
+        items.swap(sorted);
+    }
+
+    std::string_view NameOf(const std::string& path) {
+        size_t pos = path.find_last_of("\\/");
+        return std::string_view(path).substr(pos == std::string::npos ? 0 : pos + 1);
+    }
+
+    // Byte strings that compare with memcmp the way the names compare in
+    // the natural and locale orders. Both end with the name itself, so
+    // names the order takes as equal still sort the same way every time.
+    class SortKeyBuilder {
+    public:
+        explicit SortKeyBuilder(FileSystemUtils::SortOrder order) : order_(order) {}
+
+        std::string Make(std::string_view name) {
+            std::string key = order_ == FileSystemUtils::SORT_LOCALE ? LocaleKey(name) : NaturalKey(name);
+            key += '\0';
+            key += name;
+            return key;
+        }
 
-            std::string utf8Path = StringConverter::WideToUtf8(fullPath);
-            if (!utf8Path.empty()) {
-                files.push_back(utf8Path);
+    private:
+        // A run of digits becomes '0', the count of its digits without the
+        // leading zeros and those digits, so a shorter number sorts first.
+        static std::string NaturalKey(std::string_view name) {
+            std::string key;
+            key.reserve(name.size() + 8);
+            size_t i = 0;
+            while (i < name.size()) {
+                unsigned char c = static_cast<unsigned char>(name[i]);
+                if (!std::isdigit(c)) {
+                    key += static_cast<char>(c < 0x80 ? std::tolower(c) : c);
+                    ++i;
+                    continue;
+                }
+
+                size_t start = i;
+                while (i < name.size() && std::isdigit(static_cast<unsigned char>(name[i]))) {
+                    ++i;
+                }
+                size_t first = start;
+                while (first + 1 < i && name[first] == '0') {
+                    ++first;
+                }
+                size_t digits = (std::min)(i - first, static_cast<size_t>(0xFF));
+                key += '0';
+                key += static_cast<char>(digits);
+                key.append(name.data() + i - digits, digits);
             }
+            return key;
         }
-    } while (FindNextFileW(hFind, &findData) != 0);
 
-    FindClose(hFind);
+        std::string LocaleKey(std::string_view name) {
+            int length = MultiByteToWideChar(CP_UTF8, 0, name.data(), static_cast<int>(name.size()), NULL, 0);
+            wide_.resize(static_cast<size_t>((std::max)(length, 0)));
+            if (length <= 0 || MultiByteToWideChar(CP_UTF8, 0, name.data(), static_cast<int>(name.size()),
+                    &wide_[0], length) != length) {
+                return NaturalKey(name);
+            }
+
+            const DWORD flags = LCMAP_SORTKEY | SORT_DIGITSASNUMBERS;
+            int size = LCMapStringEx(LOCALE_NAME_USER_DEFAULT, flags, wide_.data(), length,
+                NULL, 0, NULL, NULL, 0);
+            std::string key(static_cast<size_t>((std::max)(size, 0)), '\0');
+            if (size <= 0 || LCMapStringEx(LOCALE_NAME_USER_DEFAULT, flags, wide_.data(), length,
+                    reinterpret_cast<LPWSTR>(&key[0]), size, NULL, NULL, 0) != size) {
+                return NaturalKey(name);
+            }
+            // Without the terminating zero byte.
+            key.resize(static_cast<size_t>(size - 1));
+            return key;
+        }
+
+        FileSystemUtils::SortOrder order_;
+        std::wstring wide_;
+    };
+
+    template <typename T, typename NameFn>
+    void SortByName(std::vector<T>& items, NameFn name, FileSystemUtils::SortOrder order) {
+        if (order == FileSystemUtils::SORT_BYTEWISE) {
+            SortByKey(items, name);
+            return;
+        }
+        SortKeyBuilder builder(order);
+        SortByKey(items, [&](const T& item) { return builder.Make(name(item)); });
+    }
+}
+
+bool FileSystemUtils::GetFilesFromDirectory(const std::string& folderPath, std::vector<std::string>& files) {
+    DirectoryListing listing;
+    if (!listing.Read(folderPath)) return false;
+
+    files.reserve(files.size() + listing.GetCount());
+    for (size_t i = 0; i < listing.GetCount(); ++i) {
+        files.push_back(listing.GetPath(i));
+    }
+    return true;
+}
+
+bool FileSystemUtils::GetFileEntry(const std::string& filePath, FileEntry& entry) {
+    std::wstring widePath = StringConverter::Utf8ToWide(filePath);
+    if (widePath.empty()) return false;
+
+    WIN32_FILE_ATTRIBUTE_DATA fileInfo;
+    if (!GetFileAttributesExW(widePath.c_str(), GetFileExInfoStandard, &fileInfo)) {
+        return false;
+    }
+    entry.path = filePath;
+    entry.size = ToUint64(fileInfo.nFileSizeHigh, fileInfo.nFileSizeLow);
+    entry.time = ToUint64(fileInfo.ftLastWriteTime.dwHighDateTime, fileInfo.ftLastWriteTime.dwLowDateTime);
+    entry.attributes = fileInfo.dwFileAttributes;
     return true;
 }
 
@@ -150,6 +273,22 @@ bool FileSystemUtils::DelFile(const std::string& filePath) {
     }
 }
 
+bool FileSystemUtils::RenameFile(const std::string& from, const std::string& to) {
+    std::wstring wideFrom = StringConverter::Utf8ToWide(from);
+    std::wstring wideTo = StringConverter::Utf8ToWide(to);
+    if (wideFrom.empty() || wideTo.empty()) {
+        Logger::Error("RenameFile: invalid file path (empty after conversion)");
+        return false;
+    }
+
+    if (!MoveFileExW(wideFrom.c_str(), wideTo.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_COPY_ALLOWED)) {
+        DWORD error = GetLastError();
+        Logger::Error("Failed to rename " + from + " to " + to + " (WinAPI error: " + std::to_string(error) + ")");
+        return false;
+    }
+    return true;
+}
+
 std::string FileSystemUtils::GetFileExtension(const std::string& filePath) {
     size_t dotPos = filePath.find_last_of('.');
     if (dotPos == std::string::npos)
@@ -195,6 +334,50 @@ bool FileSystemUtils::IsSupportedExtension(const std::string& extension) {
         extension == ".jpeg" || extension == ".png";
 }
 
+bool FileSystemUtils::IsOutputFile(std::string_view fileName, const std::string& outputFileName) {
+    // File names on Windows differ in case only, so "Result.PDF" is the
+    // output "result.pdf" as well.
+    if (SameIgnoringCase(fileName, outputFileName)) {
+        return true;
+    }
+
+    std::string_view baseFileName = outputFileName;
+    size_t dotPos = baseFileName.find_last_of('.');
+    if (dotPos != std::string_view::npos) {
+        baseFileName = baseFileName.substr(0, dotPos);
+    }
+    if (!SameIgnoringCase(fileName.substr(0, baseFileName.size()), baseFileName)) {
+        return false;
+    }
+
+    const std::string_view partMarker = "_part";
+    for (size_t pos = 0; pos + partMarker.size() <= fileName.size(); ++pos) {
+        if (SameIgnoringCase(fileName.substr(pos, partMarker.size()), partMarker)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool FileSystemUtils::HasSupportedExtension(std::string_view fileName) {
+    static const std::string_view extensions[] = { ".pdf", ".jpg", ".jpeg", ".png" };
+
+    for (std::string_view extension : extensions) {
+        if (fileName.size() < extension.size()) {
+            continue;
+        }
+        std::string_view tail = fileName.substr(fileName.size() - extension.size());
+        bool same = true;
+        for (size_t i = 0; i < tail.size() && same; ++i) {
+            same = std::tolower(static_cast<unsigned char>(tail[i])) == extension[i];
+        }
+        if (same) {
+            return true;
+        }
+    }
+    return false;
+}
+
 std::vector<std::string> FileSystemUtils::FilterFilesByExtension(const std::vector<std::string>& files) {
     std::vector<std::string> filtered;
     for (const auto& file : files) {
@@ -205,11 +388,8 @@ std::vector<std::string> FileSystemUtils::FilterFilesByExtension(const std::vect
     return filtered;
 }
 
-void FileSystemUtils::SortFilesByName(std::vector<std::string>& files) {
-    std::sort(files.begin(), files.end(),
-        [](const std::string& a, const std::string& b) {
-            return GetFileName(a) < GetFileName(b);
-        });
+void FileSystemUtils::SortFilesByName(std::vector<std::string>& files, SortOrder order) {
+    SortByName(files, NameOf, order);
 }
 
 bool FileSystemUtils::ReadFileToBuffer(const std::string& filePath, std::vector<char>& buffer) {
@@ -290,7 +470,7 @@ bool FileSystemUtils::ReadFileToBuffer(const std::string& filePath, std::vector<
         }
 
         size_t fileDataSize = static_cast<size_t>(fileSize.QuadPart);
-        buffer.clear();
+        BufferPool::Instance().Rent(fileDataSize, buffer);
         buffer.resize(fileDataSize);
 
         DWORD bytesRead = 0;
@@ -375,6 +555,98 @@ bool FileSystemUtils::WriteBufferToFile(const std::string& filePath, const char*
     return true;
 }
 
+bool FileSystemUtils::AppendBufferToFile(const std::string& filePath, const char* data, size_t size) {
+    std::wstring widePath = StringConverter::Utf8ToWide(filePath);
+    if (widePath.empty()) {
+        Logger::Error("Invalid file path (empty after conversion): " + filePath);
+        return false;
+    }
+
+    // Readers are allowed: the document being updated may still hold the
+    // file open for its lazily loaded objects.
+    HANDLE hFile = CreateFileW(
+        widePath.c_str(),
+        FILE_APPEND_DATA,
+        FILE_SHARE_READ,
+        NULL,
+        OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL,
+        NULL
+    );
+
+    if (hFile == INVALID_HANDLE_VALUE) {
+        DWORD error = GetLastError();
+        Logger::Error("Cannot open file for append: " + filePath + " (Error: " + std::to_string(error) + ")");
+        if (error == ERROR_SHARING_VIOLATION) {
+            Logger::Error("File is locked by another process");
+        }
+        return false;
+    }
+
+    DWORD bytesWritten = 0;
+    BOOL result = WriteFile(hFile, data, static_cast<DWORD>(size), &bytesWritten, NULL);
+    if (result) {
+        result = FlushFileBuffers(hFile);
+    }
+
+    CloseHandle(hFile);
+
+    if (!result || bytesWritten != size) {
+        Logger::Error("Failed to append all data to file: " + filePath);
+        return false;
+    }
+
+    Logger::Debug("Successfully appended " + std::to_string(bytesWritten) + " bytes to: " + filePath);
+    return true;
+}
+
+bool FileSystemUtils::ReadFileRange(const std::string& filePath, uint64_t offset, size_t size, std::vector<char>& buffer) {
+    std::wstring widePath = StringConverter::Utf8ToWide(filePath);
+    if (widePath.empty()) {
+        Logger::Error("ReadFileRange: invalid file path (empty after conversion): " + filePath);
+        return false;
+    }
+
+    HANDLE hFile = CreateFileW(
+        widePath.c_str(),
+        GENERIC_READ,
+        FILE_SHARE_READ,
+        NULL,
+        OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL,
+        NULL
+    );
+
+    if (hFile == INVALID_HANDLE_VALUE) {
+        Logger::Error("ReadFileRange: cannot open file: " + filePath +
+            " (Error: " + std::to_string(GetLastError()) + ")");
+        return false;
+    }
+
+    LARGE_INTEGER position;
+    position.QuadPart = static_cast<LONGLONG>(offset);
+    if (!SetFilePointerEx(hFile, position, NULL, FILE_BEGIN)) {
+        Logger::Error("ReadFileRange: cannot seek to " + std::to_string(offset) + " in: " + filePath);
+        CloseHandle(hFile);
+        return false;
+    }
+
+    buffer.resize(size);
+    DWORD bytesRead = 0;
+    BOOL result = ReadFile(hFile, buffer.data(), static_cast<DWORD>(size), &bytesRead, NULL);
+    CloseHandle(hFile);
+
+    if (!result) {
+        Logger::Error("ReadFileRange: failed to read file: " + filePath);
+        buffer.clear();
+        return false;
+    }
+
+    // A range past the end of the file is returned shortened.
+    buffer.resize(bytesRead);
+    return true;
+}
+
 bool FileSystemUtils::FileExists(const std::string& filePath) {
     if (filePath.empty()) {
         Logger::Debug("FileExists: empty path provided");
@@ -407,4 +679,164 @@ bool FileSystemUtils::FileExists(const std::string& filePath) {
         Logger::Error("FileExists: exception - " + std::string(e.what()));
         return false;
     }
-}
\ No newline at end of file
+}
+
+MappedFile::~MappedFile() {
+    Close();
+}
+
+bool MappedFile::Open(const std::string& filePath) {
+    Close();
+
+    std::wstring widePath = StringConverter::Utf8ToWide(filePath);
+    if (widePath.empty()) {
+        Logger::Error("MappedFile: invalid file path (empty after conversion): " + filePath);
+        return false;
+    }
+
+    HANDLE hFile = CreateFileW(
+        widePath.c_str(),
+        GENERIC_READ,
+        FILE_SHARE_READ,
+        NULL,
+        OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS,
+        NULL
+    );
+
+    if (hFile == INVALID_HANDLE_VALUE) {
+        Logger::Error("MappedFile: cannot open file: " + filePath +
+            " (Error: " + std::to_string(GetLastError()) + ")");
+        return false;
+    }
+    file_ = hFile;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(hFile, &fileSize) || fileSize.QuadPart == 0 ||
+        static_cast<unsigned long long>(fileSize.QuadPart) > static_cast<unsigned long long>(SIZE_MAX)) {
+        // Empty files cannot be mapped.
+        Logger::Error("MappedFile: cannot map file of this size: " + filePath);
+        Close();
+        return false;
+    }
+
+    HANDLE hMapping = CreateFileMappingW(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (hMapping == NULL) {
+        Logger::Error("MappedFile: CreateFileMapping failed for: " + filePath +
+            " (Error: " + std::to_string(GetLastError()) + ")");
+        Close();
+        return false;
+    }
+    mapping_ = hMapping;
+
+    data_ = static_cast<const char*>(MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0));
+    if (!data_) {
+        Logger::Error("MappedFile: MapViewOfFile failed for: " + filePath +
+            " (Error: " + std::to_string(GetLastError()) + ")");
+        Close();
+        return false;
+    }
+
+    size_ = static_cast<size_t>(fileSize.QuadPart);
+    return true;
+}
+
+void MappedFile::Close() {
+    if (data_) {
+        UnmapViewOfFile(data_);
+        data_ = nullptr;
+    }
+    if (mapping_) {
+        CloseHandle(static_cast<HANDLE>(mapping_));
+        mapping_ = nullptr;
+    }
+    if (file_) {
+        CloseHandle(static_cast<HANDLE>(file_));
+        file_ = nullptr;
+    }
+    size_ = 0;
+}
+
+bool DirectoryListing::Read(const std::string& folderPath, const Filter& filter) {
+    folder_.clear();
+    names_.clear();
+    items_.clear();
+
+    std::wstring folder = StringConverter::Utf8ToWide(folderPath);
+    if (folder.empty()) return false;
+
+    if (folder.back() != L'\\') folder += L'\\';
+    folder_ = StringConverter::WideToUtf8(folder);
+
+    // Basic information leaves out the 8.3 names, and large fetch asks the
+    // server for many entries per round-trip.
+    WIN32_FIND_DATAW findData;
+    HANDLE hFind = FindFirstFileExW((folder + L'*').c_str(), FindExInfoBasic, &findData,
+        FindExSearchNameMatch, NULL, FIND_FIRST_EX_LARGE_FETCH);
+    if (hFind == INVALID_HANDLE_VALUE) {
+        Logger::Error("DirectoryListing: cannot read folder: " + folderPath +
+            " (Error: " + std::to_string(GetLastError()) + ")");
+        return false;
+    }
+
+    do {
+        if (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+            continue;
+
+        // Converted straight into the name buffer and dropped again if the
+        // filter rejects it; UTF-8 takes at most three bytes per UTF-16 unit.
+        int length = static_cast<int>(wcslen(findData.cFileName));
+        size_t offset = names_.size();
+        names_.resize(offset + static_cast<size_t>(length) * 3);
+        int written = WideCharToMultiByte(CP_UTF8, 0, findData.cFileName, length,
+            &names_[offset], length * 3, NULL, NULL);
+        names_.resize(offset + (written > 0 ? written : 0));
+        if (written <= 0 || (filter && !filter(std::string_view(names_.data() + offset, written)))) {
+            names_.resize(offset);
+            continue;
+        }
+
+        Item item;
+        item.nameOffset = offset;
+        item.nameLength = static_cast<size_t>(written);
+        item.size = ToUint64(findData.nFileSizeHigh, findData.nFileSizeLow);
+        item.time = ToUint64(findData.ftLastWriteTime.dwHighDateTime, findData.ftLastWriteTime.dwLowDateTime);
+        item.attributes = findData.dwFileAttributes;
+        items_.push_back(item);
+    } while (FindNextFileW(hFind, &findData) != 0);
+
+    FindClose(hFind);
+    return true;
+}
+
+size_t DirectoryListing::GetCount() const {
+    return items_.size();
+}
+
+std::string_view DirectoryListing::GetName(size_t index) const {
+    const Item& item = items_[index];
+    return std::string_view(names_.data() + item.nameOffset, item.nameLength);
+}
+
+std::string DirectoryListing::GetPath(size_t index) const {
+    std::string_view name = GetName(index);
+    std::string path;
+    path.reserve(folder_.size() + name.size());
+    path += folder_;
+    path += name;
+    return path;
+}
+
+FileSystemUtils::FileEntry DirectoryListing::GetEntry(size_t index) const {
+    const Item& item = items_[index];
+    FileSystemUtils::FileEntry entry;
+    entry.path = GetPath(index);
+    entry.size = item.size;
+    entry.time = item.time;
+    entry.attributes = item.attributes;
+    return entry;
+}
+
+void DirectoryListing::SortByName(std::vector<size_t>& indices, FileSystemUtils::SortOrder order) const {
+    ::SortByName(indices, [this](size_t index) { return GetName(index); }, order);
+}
@@ -1,26 +1,120 @@
 #ifndef __FILESYSTEMUTILS_H__
 #define __FILESYSTEMUTILS_H__
 
+#include <cstdint>
+#include <functional>
 #include <string>
+#include <string_view>
 #include <vector>
 
 class FileSystemUtils {
 public:
+    // Order of input files by name.
+    enum SortOrder : int {
+        // Byte by byte: "scan10" before "scan2", Cyrillic by UTF-8 code.
+        SORT_BYTEWISE = 0,
+        // Runs of digits compare as numbers, ASCII letters without case.
+        SORT_NATURAL = 1,
+        // Collation of the user's locale, digits compared as numbers, as
+        // Explorer sorts.
+        SORT_LOCALE = 2
+    };
+
+    // A file as the directory enumeration reports it.
+    struct FileEntry {
+        std::string path;
+        uint64_t size = 0;
+        uint64_t time = 0;          // FILETIME of the last write
+        uint32_t attributes = 0;
+    };
+
     static bool DirectoryExists(const std::string& path);
     static bool GetFilesFromDirectory(const std::string& folderPath, std::vector<std::string>& files);
+    // Size, time and attributes of one file; a DirectoryListing has them for
+    // a whole folder from one enumeration.
+    static bool GetFileEntry(const std::string& filePath, FileEntry& entry);
     static size_t GetFileSize(const std::string& filePath);
     static std::string GetFileExtension(const std::string& filePath);
     static std::string GetFileName(const std::string& filePath);
     static std::string GetFileNameWithoutExtension(const std::string& filePath);
     static std::string GetFileDirectory(const std::string& filePath);
     static std::string GeneratePartFileName(const std::string& basePath, int partNumber);
+    // True for the output file itself and for its parts.
+    static bool IsOutputFile(std::string_view fileName, const std::string& outputFileName);
     static bool IsSupportedExtension(const std::string& extension);
+    // The same check on a bare file name, without copying it.
+    static bool HasSupportedExtension(std::string_view fileName);
     static std::vector<std::string> FilterFilesByExtension(const std::vector<std::string>& files);
-    static void SortFilesByName(std::vector<std::string>& files);
+    static void SortFilesByName(std::vector<std::string>& files, SortOrder order = SORT_BYTEWISE);
     static bool ReadFileToBuffer(const std::string& filePath, std::vector<char>& buffer);
     static bool WriteBufferToFile(const std::string& filePath, const char* data, size_t size);
+    static bool AppendBufferToFile(const std::string& filePath, const char* data, size_t size);
+    static bool ReadFileRange(const std::string& filePath, uint64_t offset, size_t size, std::vector<char>& buffer);
     static bool DelFile(const std::string& filePath);
+    // Replaces `to` if it exists; a plain rename within one volume.
+    static bool RenameFile(const std::string& from, const std::string& to);
     static bool FileExists(const std::string& filePath);
 };
 
+// Files of one folder from a single enumeration, made for folders with a
+// hundred thousand entries and more: the enumeration fetches entries in
+// large batches, the filter sees each name before anything is stored for
+// it, kept names lie back to back in one buffer, and sorting compares keys
+// computed once per file. On a network share the size, time and attributes
+// of every file come with the enumeration instead of a query per file.
+class DirectoryListing {
+public:
+    // Gets the UTF-8 file name; the file is kept when it returns true.
+    using Filter = std::function<bool(std::string_view fileName)>;
+
+    // Replaces the previous contents; directories are skipped.
+    bool Read(const std::string& folderPath, const Filter& filter = nullptr);
+
+    size_t GetCount() const;
+    std::string_view GetName(size_t index) const;
+    std::string GetPath(size_t index) const;
+    FileSystemUtils::FileEntry GetEntry(size_t index) const;
+
+    // Orders file indices by file name.
+    void SortByName(std::vector<size_t>& indices,
+        FileSystemUtils::SortOrder order = FileSystemUtils::SORT_BYTEWISE) const;
+
+private:
+    struct Item {
+        size_t nameOffset;
+        size_t nameLength;
+        uint64_t size;
+        uint64_t time;
+        uint32_t attributes;
+    };
+
+    // With the trailing separator.
+    std::string folder_;
+    std::string names_;
+    std::vector<Item> items_;
+};
+
+// Read-only view of a whole file mapped into memory; pages are read from
+// disk only when they are touched.
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool Open(const std::string& filePath);
+    void Close();
+
+    const char* Data() const { return data_; }
+    size_t Size() const { return size_; }
+
+private:
+    void* file_ = nullptr;
+    void* mapping_ = nullptr;
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+};
+
 #endif // __FILESYSTEMUTILS_H__
@@ -0,0 +1,678 @@
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+#include "Logger.h"
+#include "ContentHash.h"
+#include "TrueTypeSubset.h"
+#include "FontSubsetConsolidator.h"
+
+namespace {
+
+    using PoDoFo::PdfObject;
+    using PoDoFo::PdfReference;
+
+    constexpr size_t SubsetTagLength = 6;
+    constexpr size_t CMapEntriesPerBlock = 100;
+
+    struct SubsetFont {
+        PdfObject* type0 = nullptr;
+        PdfObject* cidFont = nullptr;
+        PdfObject* descriptor = nullptr;
+        std::string groupKey;
+        TrueTypeSubset program;
+        size_t programSize = 0;
+        double defaultWidth = 1000.0;
+        std::map<uint32_t, double> widths;
+        std::map<uint32_t, std::string> toUnicode;
+    };
+
+    struct Cluster {
+        std::vector<size_t> members;
+        TrueTypeSubset program;
+        double defaultWidth = 1000.0;
+        std::map<uint32_t, double> widths;
+        std::map<uint32_t, std::string> toUnicode;
+    };
+
+    PdfObject* Resolve(PoDoFo::PdfIndirectObjectList& objects, PdfObject* obj) {
+        if (obj && obj->IsReference()) {
+            return objects.GetObject(obj->GetReference());
+        }
+        return obj;
+    }
+
+    bool IsName(const PdfObject* obj, const char* name) {
+        return obj && obj->IsName() && obj->GetName() == name;
+    }
+
+    bool HasSubsetTag(const std::string& name) {
+        if (name.size() <= SubsetTagLength || name[SubsetTagLength] != '+') {
+            return false;
+        }
+        for (size_t i = 0; i < SubsetTagLength; ++i) {
+            if (name[i] < 'A' || name[i] > 'Z') {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    std::string ReplaceSubsetTag(const std::string& name, const std::string& tag) {
+        return HasSubsetTag(name) ? tag + name.substr(SubsetTagLength) : name;
+    }
+
+    // Subset tags are derived from the font program, so the same merged
+    // subset always gets the same name.
+    std::string MakeSubsetTag(const std::string& program) {
+        uint64_t hash = ContentHash::Hash64(program.data(), program.size());
+        std::string tag;
+        for (size_t i = 0; i < SubsetTagLength; ++i) {
+            tag += static_cast<char>('A' + hash % 26);
+            hash /= 26;
+        }
+        return tag;
+    }
+
+    bool ParseWidths(PoDoFo::PdfIndirectObjectList& objects, PdfObject* w, std::map<uint32_t, double>& widths) {
+        w = Resolve(objects, w);
+        if (!w) {
+            return true;
+        }
+        if (!w->IsArray()) {
+            return false;
+        }
+
+        PoDoFo::PdfArray& items = w->GetArray();
+        size_t i = 0;
+        while (i < items.size()) {
+            PdfObject* first = Resolve(objects, &items[i]);
+            PdfObject* next = i + 1 < items.size() ? Resolve(objects, &items[i + 1]) : nullptr;
+            if (!first || !first->IsNumberOrReal() || !next) {
+                return false;
+            }
+            uint32_t cid = static_cast<uint32_t>(first->GetReal());
+
+            if (next->IsArray()) {
+                // c [w1 w2 ...]
+                for (PdfObject& item : next->GetArray()) {
+                    PdfObject* width = Resolve(objects, &item);
+                    if (!width || !width->IsNumberOrReal()) {
+                        return false;
+                    }
+                    widths[cid++] = width->GetReal();
+                }
+                i += 2;
+            }
+            else {
+                // c_first c_last w
+                PdfObject* width = i + 2 < items.size() ? Resolve(objects, &items[i + 2]) : nullptr;
+                if (!next->IsNumberOrReal() || !width || !width->IsNumberOrReal()) {
+                    return false;
+                }
+                uint32_t last = static_cast<uint32_t>(next->GetReal());
+                if (last < cid || last - cid > 0xFFFF) {
+                    return false;
+                }
+                for (uint32_t c = cid; c <= last; ++c) {
+                    widths[c] = width->GetReal();
+                }
+                i += 3;
+            }
+        }
+        return true;
+    }
+
+    PoDoFo::PdfObject MakeNumber(double value) {
+        if (value == std::floor(value)) {
+            return PdfObject(static_cast<int64_t>(value));
+        }
+        return PdfObject(value);
+    }
+
+    PoDoFo::PdfArray BuildWidths(const std::map<uint32_t, double>& widths) {
+        PoDoFo::PdfArray result;
+        auto it = widths.begin();
+        while (it != widths.end()) {
+            uint32_t start = it->first;
+            PoDoFo::PdfArray run;
+            uint32_t expected = start;
+            while (it != widths.end() && it->first == expected) {
+                run.Add(MakeNumber(it->second));
+                ++it;
+                ++expected;
+            }
+            result.Add(PdfObject(static_cast<int64_t>(start)));
+            result.Add(PdfObject(run));
+        }
+        return result;
+    }
+
+    // Minimal tokenizer for the bfchar/bfrange sections of a ToUnicode CMap.
+    class CMapTokenizer {
+    public:
+        explicit CMapTokenizer(const std::string& text) : text_(text) {}
+
+        // Returns false at the end; hex strings come back decoded with isHex set.
+        bool Next(std::string& token, bool& isHex) {
+            SkipWhitespace();
+            if (pos_ >= text_.size()) {
+                return false;
+            }
+
+            isHex = false;
+            token.clear();
+            char c = text_[pos_];
+            if ((c == '<' || c == '>') && pos_ + 1 < text_.size() && text_[pos_ + 1] == c) {
+                token.assign(2, c);
+                pos_ += 2;
+                return true;
+            }
+            if (c == '<') {
+                isHex = true;
+                ++pos_;
+                std::string digits;
+                while (pos_ < text_.size() && text_[pos_] != '>') {
+                    if (std::isxdigit(static_cast<unsigned char>(text_[pos_]))) {
+                        digits += text_[pos_];
+                    }
+                    ++pos_;
+                }
+                ++pos_;
+                if (digits.size() % 2 != 0) {
+                    digits += '0';
+                }
+                for (size_t i = 0; i < digits.size(); i += 2) {
+                    token += static_cast<char>(std::stoi(digits.substr(i, 2), nullptr, 16));
+                }
+                return true;
+            }
+            if (c == '[' || c == ']') {
+                token = c;
+                ++pos_;
+                return true;
+            }
+            while (pos_ < text_.size() && !IsDelimiter(text_[pos_])) {
+                token += text_[pos_++];
+            }
+            if (token.empty()) {
+                token = text_[pos_++];
+            }
+            return true;
+        }
+
+    private:
+        const std::string& text_;
+        size_t pos_ = 0;
+
+        static bool IsDelimiter(char c) {
+            return std::isspace(static_cast<unsigned char>(c)) || c == '<' || c == '>' ||
+                c == '[' || c == ']' || c == '/' || c == '%' || c == '(' || c == ')';
+        }
+
+        void SkipWhitespace() {
+            while (pos_ < text_.size()) {
+                if (text_[pos_] == '%') {
+                    while (pos_ < text_.size() && text_[pos_] != '\n' && text_[pos_] != '\r') {
+                        ++pos_;
+                    }
+                }
+                else if (std::isspace(static_cast<unsigned char>(text_[pos_]))) {
+                    ++pos_;
+                }
+                else {
+                    break;
+                }
+            }
+        }
+    };
+
+    uint32_t CodeFromBytes(const std::string& bytes) {
+        uint32_t code = 0;
+        for (char c : bytes) {
+            code = (code << 8) | static_cast<uint8_t>(c);
+        }
+        return code;
+    }
+
+    std::string OffsetDestination(std::string destination, uint32_t offset) {
+        // The last byte is incremented; carry into the previous byte keeps
+        // UTF-16 ranges that cross a 256 boundary intact.
+        for (size_t i = destination.size(); i > 0 && offset != 0; --i) {
+            uint32_t value = static_cast<uint8_t>(destination[i - 1]) + offset;
+            destination[i - 1] = static_cast<char>(value & 0xFF);
+            offset = value >> 8;
+        }
+        return destination;
+    }
+
+    void ParseToUnicode(const std::string& text, std::map<uint32_t, std::string>& mapping) {
+        CMapTokenizer tokenizer(text);
+        std::string token;
+        bool isHex = false;
+
+        while (tokenizer.Next(token, isHex)) {
+            if (!isHex && token == "beginbfchar") {
+                std::string source, destination;
+                bool hexSource = false, hexDestination = false;
+                while (tokenizer.Next(source, hexSource) && hexSource &&
+                    tokenizer.Next(destination, hexDestination) && hexDestination) {
+                    mapping.emplace(CodeFromBytes(source), destination);
+                }
+            }
+            else if (!isHex && token == "beginbfrange") {
+                std::string low, high, destination;
+                bool hexLow = false, hexHigh = false, hexDestination = false;
+                while (tokenizer.Next(low, hexLow) && hexLow && tokenizer.Next(high, hexHigh) && hexHigh &&
+                    tokenizer.Next(destination, hexDestination)) {
+                    uint32_t first = CodeFromBytes(low);
+                    uint32_t last = CodeFromBytes(high);
+                    if (last < first || last - first > 0xFFFF) {
+                        return;
+                    }
+                    if (hexDestination) {
+                        for (uint32_t code = first; code <= last; ++code) {
+                            mapping.emplace(code, OffsetDestination(destination, code - first));
+                        }
+                    }
+                    else if (destination == "[") {
+                        uint32_t code = first;
+                        std::string item;
+                        bool hexItem = false;
+                        while (tokenizer.Next(item, hexItem) && hexItem) {
+                            mapping.emplace(code++, item);
+                        }
+                    }
+                    else {
+                        return;
+                    }
+                }
+            }
+        }
+    }
+
+    std::string ToHex(const std::string& bytes) {
+        static const char digits[] = "0123456789ABCDEF";
+        std::string hex = "<";
+        for (char c : bytes) {
+            hex += digits[static_cast<uint8_t>(c) >> 4];
+            hex += digits[static_cast<uint8_t>(c) & 0x0F];
+        }
+        hex += '>';
+        return hex;
+    }
+
+    std::string BuildToUnicode(const std::map<uint32_t, std::string>& mapping) {
+        std::string cmap =
+            "/CIDInit /ProcSet findresource begin\n"
+            "12 dict begin\n"
+            "begincmap\n"
+            "/CIDSystemInfo << /Registry (Adobe) /Ordering (UCS) /Supplement 0 >> def\n"
+            "/CMapName /Adobe-Identity-UCS def\n"
+            "/CMapType 2 def\n"
+            "1 begincodespacerange\n<0000> <FFFF>\nendcodespacerange\n";
+
+        auto it = mapping.begin();
+        while (it != mapping.end()) {
+            size_t count = std::min<size_t>(CMapEntriesPerBlock, std::distance(it, mapping.end()));
+            cmap += std::to_string(count) + " beginbfchar\n";
+            for (size_t i = 0; i < count; ++i, ++it) {
+                std::string code;
+                code += static_cast<char>((it->first >> 8) & 0xFF);
+                code += static_cast<char>(it->first & 0xFF);
+                cmap += ToHex(code) + " " + ToHex(it->second) + "\n";
+            }
+            cmap += "endbfchar\n";
+        }
+
+        cmap +=
+            "endcmap\n"
+            "CMapName currentdict /CMap defineresource pop\n"
+            "end\n"
+            "end\n";
+        return cmap;
+    }
+
+    bool WidthsCompatible(const std::map<uint32_t, double>& a, const std::map<uint32_t, double>& b) {
+        for (const auto& entry : b) {
+            auto it = a.find(entry.first);
+            if (it != a.end() && std::fabs(it->second - entry.second) > 1e-3) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void CollectReferences(const PdfObject& obj, std::vector<PdfReference>& out) {
+        if (obj.IsReference()) {
+            out.push_back(obj.GetReference());
+        }
+        else if (obj.IsArray()) {
+            for (const PdfObject& item : obj.GetArray()) {
+                CollectReferences(item, out);
+            }
+        }
+        else if (obj.IsDictionary()) {
+            for (const auto& pair : obj.GetDictionary()) {
+                CollectReferences(pair.second, out);
+            }
+        }
+    }
+
+    void RewriteReferences(PdfObject& obj, const std::unordered_map<uint32_t, PdfReference>& replaced) {
+        if (obj.IsReference()) {
+            auto it = replaced.find(obj.GetReference().ObjectNumber());
+            if (it != replaced.end()) {
+                obj = PdfObject(it->second);
+            }
+        }
+        else if (obj.IsArray()) {
+            for (PdfObject& item : obj.GetArray()) {
+                RewriteReferences(item, replaced);
+            }
+        }
+        else if (obj.IsDictionary()) {
+            for (auto& pair : obj.GetDictionary()) {
+                RewriteReferences(pair.second, replaced);
+            }
+        }
+    }
+
+    bool ReadSubsetFont(PoDoFo::PdfIndirectObjectList& objects, PdfObject* obj, SubsetFont& font) {
+        if (!obj->IsDictionary()) {
+            return false;
+        }
+        PoDoFo::PdfDictionary& dict = obj->GetDictionary();
+        if (!IsName(dict.FindKey("Type"), "Font") || !IsName(dict.FindKey("Subtype"), "Type0")) {
+            return false;
+        }
+
+        const PdfObject* baseFont = dict.FindKey("BaseFont");
+        const PdfObject* encoding = dict.FindKey("Encoding");
+        if (!baseFont || !baseFont->IsName() || !encoding || !encoding->IsName()) {
+            return false;
+        }
+        std::string baseName(baseFont->GetName().GetString());
+        std::string encodingName(encoding->GetName().GetString());
+        if (!HasSubsetTag(baseName) || (encodingName != "Identity-H" && encodingName != "Identity-V")) {
+            return false;
+        }
+
+        PdfObject* descendants = dict.FindKey("DescendantFonts");
+        if (!descendants || !descendants->IsArray() || descendants->GetArray().size() != 1) {
+            return false;
+        }
+        PdfObject* cidFont = Resolve(objects, &descendants->GetArray()[0]);
+        if (!cidFont || !cidFont->IsDictionary()) {
+            return false;
+        }
+        PoDoFo::PdfDictionary& cidDict = cidFont->GetDictionary();
+        const PdfObject* cidToGid = cidDict.FindKey("CIDToGIDMap");
+        if (!IsName(cidDict.FindKey("Subtype"), "CIDFontType2") || (cidToGid && !IsName(cidToGid, "Identity"))) {
+            return false;
+        }
+
+        PdfObject* descriptor = cidDict.FindKey("FontDescriptor");
+        if (!descriptor || !descriptor->IsDictionary()) {
+            return false;
+        }
+        PdfObject* fontFile = descriptor->GetDictionary().FindKey("FontFile2");
+        if (!fontFile || !fontFile->HasStream()) {
+            return false;
+        }
+
+        PoDoFo::charbuff program = fontFile->GetStream()->GetCopy();
+        if (!font.program.Parse(program.data(), program.size())) {
+            return false;
+        }
+        font.programSize = program.size();
+
+        const PdfObject* defaultWidth = cidDict.FindKey("DW");
+        if (defaultWidth && defaultWidth->IsNumberOrReal()) {
+            font.defaultWidth = defaultWidth->GetReal();
+        }
+        if (!ParseWidths(objects, cidDict.GetKey("W"), font.widths)) {
+            return false;
+        }
+
+        PdfObject* toUnicode = dict.FindKey("ToUnicode");
+        if (toUnicode && toUnicode->HasStream()) {
+            PoDoFo::charbuff text = toUnicode->GetStream()->GetCopy();
+            ParseToUnicode(std::string(text.data(), text.size()), font.toUnicode);
+        }
+
+        font.type0 = obj;
+        font.cidFont = cidFont;
+        font.descriptor = descriptor;
+        font.groupKey = baseName.substr(SubsetTagLength + 1) + "|" + encodingName;
+        return true;
+    }
+
+    void UniteBoundingBoxes(PoDoFo::PdfIndirectObjectList& objects, const std::vector<SubsetFont>& fonts,
+        const Cluster& cluster, PoDoFo::PdfDictionary& descriptor) {
+        double box[4] = { 0, 0, 0, 0 };
+        bool found = false;
+        for (size_t index : cluster.members) {
+            PdfObject* bbox = Resolve(objects, fonts[index].descriptor->GetDictionary().FindKey("FontBBox"));
+            if (!bbox || !bbox->IsArray() || bbox->GetArray().size() != 4) {
+                continue;
+            }
+            for (int i = 0; i < 4; ++i) {
+                PdfObject* value = Resolve(objects, &bbox->GetArray()[i]);
+                if (!value || !value->IsNumberOrReal()) {
+                    return;
+                }
+                double v = value->GetReal();
+                box[i] = !found ? v : (i < 2 ? (std::min)(box[i], v) : (std::max)(box[i], v));
+            }
+            found = true;
+        }
+        if (found) {
+            PoDoFo::PdfArray united;
+            for (double v : box) {
+                united.Add(MakeNumber(v));
+            }
+            descriptor.AddKey(PoDoFo::PdfName("FontBBox"), PdfObject(united));
+        }
+    }
+}
+
+bool FontSubsetConsolidator::Consolidate(PoDoFo::PdfMemDocument& doc) {
+    try {
+        PoDoFo::PdfIndirectObjectList& objects = doc.GetObjects();
+
+        std::vector<SubsetFont> fonts;
+        std::map<std::string, std::vector<size_t>> groups;
+        for (PdfObject* obj : objects) {
+            SubsetFont font;
+            if (ReadSubsetFont(objects, obj, font)) {
+                groups[font.groupKey].push_back(fonts.size());
+                fonts.push_back(std::move(font));
+            }
+        }
+
+        // Greedy clustering: a subset joins the first combined subset it
+        // does not contradict.
+        std::vector<Cluster> clusters;
+        for (const auto& group : groups) {
+            if (group.second.size() < 2) {
+                continue;
+            }
+            size_t firstCluster = clusters.size();
+            for (size_t index : group.second) {
+                SubsetFont& font = fonts[index];
+                bool merged = false;
+                for (size_t c = firstCluster; c < clusters.size(); ++c) {
+                    Cluster& cluster = clusters[c];
+                    if (cluster.defaultWidth == font.defaultWidth &&
+                        cluster.program.IsCompatible(font.program) &&
+                        WidthsCompatible(cluster.widths, font.widths)) {
+                        cluster.program.Merge(font.program);
+                        cluster.widths.insert(font.widths.begin(), font.widths.end());
+                        cluster.toUnicode.insert(font.toUnicode.begin(), font.toUnicode.end());
+                        cluster.members.push_back(index);
+                        merged = true;
+                        break;
+                    }
+                }
+                if (!merged) {
+                    Cluster cluster;
+                    cluster.members.push_back(index);
+                    cluster.program = font.program;
+                    cluster.defaultWidth = font.defaultWidth;
+                    cluster.widths = font.widths;
+                    cluster.toUnicode = font.toUnicode;
+                    clusters.push_back(std::move(cluster));
+                }
+            }
+        }
+
+        std::unordered_map<uint32_t, PdfReference> replaced;
+        std::vector<PdfReference> dropRoots;
+        size_t mergedFonts = 0;
+        size_t bytesBefore = 0;
+        size_t bytesAfter = 0;
+
+        for (Cluster& cluster : clusters) {
+            if (cluster.members.size() < 2) {
+                continue;
+            }
+
+            SubsetFont& canonical = fonts[cluster.members.front()];
+            PoDoFo::PdfDictionary& type0 = canonical.type0->GetDictionary();
+            PoDoFo::PdfDictionary& cidFont = canonical.cidFont->GetDictionary();
+            PoDoFo::PdfDictionary& descriptor = canonical.descriptor->GetDictionary();
+
+            std::string program = cluster.program.Serialize();
+            std::string tag = MakeSubsetTag(program);
+
+            // Replaced objects may be shared with other fonts, so new
+            // content always goes into new objects.
+            for (const char* key : { "FontFile2", "CIDSet" }) {
+                const PdfObject* old = descriptor.GetKey(key);
+                if (old && old->IsReference()) {
+                    dropRoots.push_back(old->GetReference());
+                }
+            }
+            const PdfObject* oldWidths = cidFont.GetKey("W");
+            if (oldWidths && oldWidths->IsReference()) {
+                dropRoots.push_back(oldWidths->GetReference());
+            }
+            const PdfObject* oldToUnicode = type0.GetKey("ToUnicode");
+            if (oldToUnicode && oldToUnicode->IsReference()) {
+                dropRoots.push_back(oldToUnicode->GetReference());
+            }
+
+            PdfObject& fontFile = objects.CreateDictionaryObject();
+            fontFile.GetDictionary().AddKey(PoDoFo::PdfName("Length1"),
+                PdfObject(static_cast<int64_t>(program.size())));
+            fontFile.GetOrCreateStream().SetData(PoDoFo::bufferview(program.data(), program.size()));
+            descriptor.AddKey(PoDoFo::PdfName("FontFile2"), PdfObject(fontFile.GetIndirectReference()));
+            // CIDSet lists the glyphs of one subset; it is optional and
+            // would be wrong for the combined one.
+            descriptor.RemoveKey("CIDSet");
+            UniteBoundingBoxes(objects, fonts, cluster, descriptor);
+
+            cidFont.AddKey(PoDoFo::PdfName("W"), PdfObject(BuildWidths(cluster.widths)));
+
+            if (!cluster.toUnicode.empty()) {
+                std::string cmap = BuildToUnicode(cluster.toUnicode);
+                PdfObject& toUnicode = objects.CreateDictionaryObject();
+                toUnicode.GetOrCreateStream().SetData(PoDoFo::bufferview(cmap.data(), cmap.size()));
+                type0.AddKey(PoDoFo::PdfName("ToUnicode"), PdfObject(toUnicode.GetIndirectReference()));
+            }
+
+            const PdfObject* fontName = descriptor.GetKey("FontName");
+            if (fontName && fontName->IsName()) {
+                descriptor.AddKey(PoDoFo::PdfName("FontName"), PdfObject(PoDoFo::PdfName(
+                    ReplaceSubsetTag(std::string(fontName->GetName().GetString()), tag))));
+            }
+            for (PoDoFo::PdfDictionary* dict : { &type0, &cidFont }) {
+                const PdfObject* baseFont = dict->GetKey("BaseFont");
+                if (baseFont && baseFont->IsName()) {
+                    dict->AddKey(PoDoFo::PdfName("BaseFont"), PdfObject(PoDoFo::PdfName(
+                        ReplaceSubsetTag(std::string(baseFont->GetName().GetString()), tag))));
+                }
+            }
+
+            PdfReference canonicalRef = canonical.type0->GetIndirectReference();
+            for (size_t i = 1; i < cluster.members.size(); ++i) {
+                PdfReference dropped = fonts[cluster.members[i]].type0->GetIndirectReference();
+                replaced[dropped.ObjectNumber()] = canonicalRef;
+                dropRoots.push_back(dropped);
+            }
+
+            for (size_t index : cluster.members) {
+                bytesBefore += fonts[index].programSize;
+            }
+            bytesAfter += program.size();
+            mergedFonts += cluster.members.size();
+
+            Logger::Debug("Font subsets merged: " + std::to_string(cluster.members.size()) + " x " +
+                canonical.groupKey + " -> " + std::to_string(cluster.program.GetUsedGlyphCount()) + " glyph(s)");
+        }
+
+        if (replaced.empty()) {
+            return true;
+        }
+
+        // Everything reachable from the dropped fonts is removed unless
+        // something that stays still points to it.
+        std::unordered_set<uint32_t> candidates;
+        std::vector<PdfReference> pending = dropRoots;
+        while (!pending.empty()) {
+            PdfReference ref = pending.back();
+            pending.pop_back();
+            if (!candidates.insert(ref.ObjectNumber()).second) {
+                continue;
+            }
+            if (PdfObject* obj = objects.GetObject(ref)) {
+                CollectReferences(*obj, pending);
+            }
+        }
+
+        for (PdfObject* obj : objects) {
+            if (candidates.count(obj->GetIndirectReference().ObjectNumber()) == 0) {
+                RewriteReferences(*obj, replaced);
+                CollectReferences(*obj, pending);
+            }
+        }
+        while (!pending.empty()) {
+            PdfReference ref = pending.back();
+            pending.pop_back();
+            if (candidates.erase(ref.ObjectNumber()) == 0) {
+                continue;
+            }
+            if (PdfObject* obj = objects.GetObject(ref)) {
+                RewriteReferences(*obj, replaced);
+                CollectReferences(*obj, pending);
+            }
+        }
+
+        std::vector<PdfReference> removed;
+        for (PdfObject* obj : objects) {
+            if (candidates.count(obj->GetIndirectReference().ObjectNumber()) != 0) {
+                removed.push_back(obj->GetIndirectReference());
+            }
+        }
+        for (const PdfReference& ref : removed) {
+            objects.RemoveObject(ref, false);
+        }
+
+        Logger::Debug("Font subset consolidation: " + std::to_string(mergedFonts) + " subset(s) into " +
+            std::to_string(mergedFonts - replaced.size()) + ", font programs " + std::to_string(bytesBefore) +
+            " -> " + std::to_string(bytesAfter) + " bytes, " + std::to_string(removed.size()) + " object(s) removed");
+        return true;
+    }
+    catch (const PoDoFo::PdfError& e) {
+        Logger::Error("Font subset consolidation failed: PdfError code " + std::to_string(static_cast<int>(e.GetCode())));
+        return false;
+    }
+    catch (const std::exception& e) {
+        Logger::Error("Font subset consolidation failed: " + std::string(e.what()));
+        return false;
+    }
+}
@@ -0,0 +1,19 @@
+#ifndef __FONT_SUBSET_CONSOLIDATOR_H__
+#define __FONT_SUBSET_CONSOLIDATOR_H__
+
+#include "podofo/podofo.h"
+
+// Merges the different subsets of one font embedded by the merged inputs
+// (ABCDEF+Arial, GHIJKL+Arial, ...) into a single combined subset.
+//
+// Handles Type0 fonts with Identity encoding over a TrueType CIDFont whose
+// CIDs are glyph IDs. Subsets are combined only when their font programs
+// keep the original glyph numbering and agree on every glyph and width they
+// share; the pages then keep their content streams and only the font
+// references are rewritten. Fonts of any other kind are left untouched.
+class FontSubsetConsolidator {
+public:
+    static bool Consolidate(PoDoFo::PdfMemDocument& doc);
+};
+
+#endif // __FONT_SUBSET_CONSOLIDATOR_H__
@@ -1,7 +1,31 @@
 ﻿#include "GdiplusManager.h"
 #include "Logger.h"
 #include "ImageProcessor.h"
+#include "BufferPool.h"
 #include "StringConverter.h"
+#include "PixelConverter.h"
+
+namespace {
+
+    // 8-bit palette of an indexed bitmap as 32-bit ARGB entries; false when
+    // the bitmap is not indexed or its palette cannot be read.
+    bool ReadPalette(Gdiplus::Bitmap& source, uint32_t (&palette)[256]) {
+        if (source.GetPixelFormat() != PixelFormat8bppIndexed) {
+            return false;
+        }
+        INT paletteSize = source.GetPaletteSize();
+        std::vector<BYTE> paletteBuffer(paletteSize > 0 ? paletteSize : sizeof(Gdiplus::ColorPalette));
+        Gdiplus::ColorPalette* colorPalette = reinterpret_cast<Gdiplus::ColorPalette*>(paletteBuffer.data());
+        if (paletteSize <= 0 || source.GetPalette(colorPalette, paletteSize) != Gdiplus::Ok) {
+            return false;
+        }
+        UINT count = colorPalette->Count < 256 ? colorPalette->Count : 256;
+        for (UINT i = 0; i < count; ++i) {
+            palette[i] = colorPalette->Entries[i];
+        }
+        return true;
+    }
+}
 
 
 CLSID ImageProcessor::GetEncoderClsid(const WCHAR* format) {
@@ -20,45 +44,144 @@ CLSID ImageProcessor::GetEncoderClsid(const WCHAR* format) {
     return CLSID{ 0 };
 }
 
-bool ImageProcessor::LoadAndConvertToJpeg(
-    const std::string& filePath,
-    std::vector<unsigned char>& outData,
-    unsigned int& width,
-    unsigned int& height
-) {
-    GdiplusManager::Instance().EnsureInitialized();
+Gdiplus::Bitmap* ImageProcessor::ConvertToFlatRgb(Gdiplus::Bitmap& source) {
+    UINT width = source.GetWidth();
+    UINT height = source.GetHeight();
+    Gdiplus::Rect rect(0, 0, static_cast<INT>(width), static_cast<INT>(height));
 
-    std::wstring widePath = StringConverter::Utf8ToWide(filePath);
-    if (widePath.empty()) {
-        Logger::Error("Invalid file path (empty after UTF-8 conversion)");
-        return false;
+    Gdiplus::Bitmap* target = new Gdiplus::Bitmap(static_cast<INT>(width), static_cast<INT>(height), PixelFormat24bppRGB);
+    if (target->GetLastStatus() != Gdiplus::Ok) {
+        delete target;
+        return nullptr;
     }
 
-    Gdiplus::Bitmap* memoryBitmap = nullptr;
+    // Indexed images are expanded through the palette by our kernels; any
+    // other format is handed to us as 32bpp ARGB by LockBits itself.
+    uint32_t palette[256] = {};
+    bool indexed = ReadPalette(source, palette);
 
-    {
-        Gdiplus::Bitmap tempBitmap(widePath.c_str());
-        if (tempBitmap.GetLastStatus() != Gdiplus::Ok) {
-            Logger::Error("Failed to load image: " + filePath);
-            return false;
+    Gdiplus::BitmapData sourceData;
+    PixelFormat sourceFormat = indexed ? PixelFormat8bppIndexed : PixelFormat32bppARGB;
+    if (source.LockBits(&rect, Gdiplus::ImageLockModeRead, sourceFormat, &sourceData) != Gdiplus::Ok) {
+        delete target;
+        return nullptr;
+    }
+
+    Gdiplus::BitmapData targetData;
+    if (target->LockBits(&rect, Gdiplus::ImageLockModeWrite, PixelFormat24bppRGB, &targetData) != Gdiplus::Ok) {
+        source.UnlockBits(&sourceData);
+        delete target;
+        return nullptr;
+    }
+
+    const PixelConverter::Kernels& kernels = PixelConverter::Active();
+    std::vector<uint32_t> expandedRow(indexed ? width : 0);
+
+    for (UINT y = 0; y < height; ++y) {
+        const uint8_t* sourceRow = static_cast<const uint8_t*>(sourceData.Scan0) +
+            static_cast<ptrdiff_t>(y) * sourceData.Stride;
+        uint8_t* targetRow = static_cast<uint8_t*>(targetData.Scan0) +
+            static_cast<ptrdiff_t>(y) * targetData.Stride;
+
+        if (indexed) {
+            kernels.ExpandPalette(sourceRow, palette, expandedRow.data(), width);
+            sourceRow = reinterpret_cast<const uint8_t*>(expandedRow.data());
         }
+        kernels.FlattenArgbToRgb(sourceRow, targetRow, width);
+    }
 
-        width = tempBitmap.GetWidth();
-        height = tempBitmap.GetHeight();
+    target->UnlockBits(&targetData);
+    source.UnlockBits(&sourceData);
+
+    return target;
+}
 
-        memoryBitmap = tempBitmap.Clone(0, 0, width, height, PixelFormat32bppARGB);
+bool ImageProcessor::IsGray(Gdiplus::Bitmap& source) {
+    // Gray with transparency is composited onto white as RGB.
+    UINT flags = source.GetFlags();
+    if (flags & Gdiplus::ImageFlagsHasAlpha) {
+        return false;
+    }
+    if ((flags & Gdiplus::ImageFlagsColorSpaceGRAY) || source.GetPixelFormat() == PixelFormat16bppGrayScale) {
+        return true;
     }
 
-    if (!memoryBitmap || memoryBitmap->GetLastStatus() != Gdiplus::Ok) {
-        Logger::Error("Failed to clone bitmap to memory");
-        if (memoryBitmap) delete memoryBitmap;
+    uint32_t palette[256] = {};
+    if (!ReadPalette(source, palette)) {
         return false;
     }
+    for (uint32_t entry : palette) {
+        uint32_t b = entry & 0xFF, g = (entry >> 8) & 0xFF, r = (entry >> 16) & 0xFF;
+        if (r != g || g != b) {
+            return false;
+        }
+    }
+    return true;
+}
+
+Gdiplus::Bitmap* ImageProcessor::ConvertToGray(Gdiplus::Bitmap& source) {
+    UINT width = source.GetWidth();
+    UINT height = source.GetHeight();
+    Gdiplus::Rect rect(0, 0, static_cast<INT>(width), static_cast<INT>(height));
+
+    // An 8bpp bitmap with a gray ramp as its palette: the JPEG encoder
+    // writes it as a one-channel JPEG.
+    Gdiplus::Bitmap* target = new Gdiplus::Bitmap(static_cast<INT>(width), static_cast<INT>(height), PixelFormat8bppIndexed);
+    std::vector<BYTE> rampBuffer(sizeof(Gdiplus::ColorPalette) + 255 * sizeof(Gdiplus::ARGB));
+    Gdiplus::ColorPalette* ramp = reinterpret_cast<Gdiplus::ColorPalette*>(rampBuffer.data());
+    ramp->Flags = Gdiplus::PaletteFlagsGrayScale;
+    ramp->Count = 256;
+    for (UINT i = 0; i < 256; ++i) {
+        ramp->Entries[i] = Gdiplus::Color::MakeARGB(255, static_cast<BYTE>(i), static_cast<BYTE>(i), static_cast<BYTE>(i));
+    }
+    if (target->GetLastStatus() != Gdiplus::Ok || target->SetPalette(ramp) != Gdiplus::Ok) {
+        delete target;
+        return nullptr;
+    }
+
+    uint32_t palette[256] = {};
+    bool indexed = ReadPalette(source, palette);
+
+    Gdiplus::BitmapData sourceData;
+    PixelFormat sourceFormat = indexed ? PixelFormat8bppIndexed : PixelFormat32bppARGB;
+    if (source.LockBits(&rect, Gdiplus::ImageLockModeRead, sourceFormat, &sourceData) != Gdiplus::Ok) {
+        delete target;
+        return nullptr;
+    }
+
+    Gdiplus::BitmapData targetData;
+    if (target->LockBits(&rect, Gdiplus::ImageLockModeWrite, PixelFormat8bppIndexed, &targetData) != Gdiplus::Ok) {
+        source.UnlockBits(&sourceData);
+        delete target;
+        return nullptr;
+    }
+
+    const PixelConverter::Kernels& kernels = PixelConverter::Active();
+    std::vector<uint32_t> expandedRow(indexed ? width : 0);
+
+    for (UINT y = 0; y < height; ++y) {
+        const uint8_t* sourceRow = static_cast<const uint8_t*>(sourceData.Scan0) +
+            static_cast<ptrdiff_t>(y) * sourceData.Stride;
+        uint8_t* targetRow = static_cast<uint8_t*>(targetData.Scan0) +
+            static_cast<ptrdiff_t>(y) * targetData.Stride;
+
+        if (indexed) {
+            kernels.ExpandPalette(sourceRow, palette, expandedRow.data(), width);
+            sourceRow = reinterpret_cast<const uint8_t*>(expandedRow.data());
+        }
+        kernels.ArgbToGray(sourceRow, targetRow, width);
+    }
+
+    target->UnlockBits(&targetData);
+    source.UnlockBits(&sourceData);
 
+    return target;
+}
+
+bool ImageProcessor::EncodeJpeg(Gdiplus::Bitmap& bitmap, int quality, std::vector<unsigned char>& outData) {
     IStream* pStream = nullptr;
     if (CreateStreamOnHGlobal(nullptr, TRUE, &pStream) != S_OK) {
         Logger::Error("Failed to create memory stream");
-        delete memoryBitmap;
         return false;
     }
 
@@ -66,20 +189,23 @@ bool ImageProcessor::LoadAndConvertToJpeg(
     if (clsidJpeg.Data1 == 0) {
         Logger::Error("JPEG encoder not found");
         pStream->Release();
-        delete memoryBitmap;
         return false;
     }
 
-    if (memoryBitmap->Save(pStream, &clsidJpeg, nullptr) != Gdiplus::Ok) {
+    ULONG qualityValue = static_cast<ULONG>(quality);
+    Gdiplus::EncoderParameters parameters;
+    parameters.Count = 1;
+    parameters.Parameter[0].Guid = Gdiplus::EncoderQuality;
+    parameters.Parameter[0].Type = Gdiplus::EncoderParameterValueTypeLong;
+    parameters.Parameter[0].NumberOfValues = 1;
+    parameters.Parameter[0].Value = &qualityValue;
+
+    if (bitmap.Save(pStream, &clsidJpeg, quality > 0 ? &parameters : nullptr) != Gdiplus::Ok) {
         Logger::Error("Failed to save image to JPEG stream");
         pStream->Release();
-        delete memoryBitmap;
         return false;
     }
 
-    delete memoryBitmap;
-    memoryBitmap = nullptr;
-
     STATSTG stat;
     if (pStream->Stat(&stat, STATFLAG_NONAME) != S_OK) {
         Logger::Error("Failed to get stream size");
@@ -88,6 +214,7 @@ bool ImageProcessor::LoadAndConvertToJpeg(
     }
 
     ULONG size = static_cast<ULONG>(stat.cbSize.QuadPart);
+    BufferPool::Instance().Rent(size, outData);
     outData.resize(size);
 
     LARGE_INTEGER liZero = {};
@@ -101,6 +228,54 @@ bool ImageProcessor::LoadAndConvertToJpeg(
         Logger::Error("Failed to read JPEG data from stream");
         return false;
     }
+    return true;
+}
+
+bool ImageProcessor::LoadAndConvertToJpeg(
+    const std::string& filePath,
+    std::vector<unsigned char>& outData,
+    unsigned int& width,
+    unsigned int& height
+) {
+    GdiplusManager::Instance().EnsureInitialized();
+
+    std::wstring widePath = StringConverter::Utf8ToWide(filePath);
+    if (widePath.empty()) {
+        Logger::Error("Invalid file path (empty after UTF-8 conversion)");
+        return false;
+    }
+
+    Gdiplus::Bitmap* memoryBitmap = nullptr;
+
+    {
+        Gdiplus::Bitmap tempBitmap(widePath.c_str());
+        if (tempBitmap.GetLastStatus() != Gdiplus::Ok) {
+            Logger::Error("Failed to load image: " + filePath);
+            return false;
+        }
+
+        width = tempBitmap.GetWidth();
+        height = tempBitmap.GetHeight();
+
+        // Flatten to 24bpp RGB ourselves so the JPEG encoder gets its native
+        // input instead of converting 32bpp ARGB (and dropping alpha) itself.
+        // Gray scans stay one channel, a third of the data as RGB.
+        memoryBitmap = IsGray(tempBitmap) ? ConvertToGray(tempBitmap) : ConvertToFlatRgb(tempBitmap);
+    }
+
+    if (!memoryBitmap || memoryBitmap->GetLastStatus() != Gdiplus::Ok) {
+        Logger::Error("Failed to convert bitmap to RGB or gray");
+        if (memoryBitmap) delete memoryBitmap;
+        return false;
+    }
+
+    bool encoded = EncodeJpeg(*memoryBitmap, 0, outData);
+    delete memoryBitmap;
+    memoryBitmap = nullptr;
+
+    if (!encoded) {
+        return false;
+    }
 
     Logger::Debug("Image loaded and converted to JPEG: " + filePath +
         " (" + std::to_string(width) + "x" + std::to_string(height) + ")");
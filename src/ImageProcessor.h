@@ -4,6 +4,7 @@
 #include <string>
 #include <vector>
 #include <windows.h>
+#include <gdiplus.h>
 
 class ImageProcessor {
 public:
@@ -14,8 +15,20 @@ public:
         unsigned int& height
     );
 
+    // Encodes a bitmap (24bpp RGB preferred) as JPEG; quality is 1-100, 0
+    // keeps the encoder default. A bitmap from ConvertToGray gives a
+    // grayscale JPEG.
+    static bool EncodeJpeg(Gdiplus::Bitmap& bitmap, int quality, std::vector<unsigned char>& outData);
+
+    // Opaque images with gray pixels only: gray JPEGs and PNGs, indexed
+    // images with a gray palette.
+    static bool IsGray(Gdiplus::Bitmap& source);
+    // 8bpp bitmap with a gray palette; nullptr on failure.
+    static Gdiplus::Bitmap* ConvertToGray(Gdiplus::Bitmap& source);
+
 private:
     static CLSID GetEncoderClsid(const WCHAR* format);
+    static Gdiplus::Bitmap* ConvertToFlatRgb(Gdiplus::Bitmap& source);
 };
 
 #endif // __IMAGE_PROCESSOR_H__
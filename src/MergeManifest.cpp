@@ -0,0 +1,171 @@
+#include <cstdio>
+#include <stdexcept>
+#include "BufferPool.h"
+#include "ContentHash.h"
+#include "FileSystemUtils.h"
+#include "Logger.h"
+#include "MergeManifest.h"
+
+namespace {
+
+    const char kHeader[] = "PDFFILES-MANIFEST";
+
+    std::string Hex(uint64_t value) {
+        char text[17];
+        std::snprintf(text, sizeof(text), "%llx", static_cast<unsigned long long>(value));
+        return text;
+    }
+
+    uint64_t ParseHex(const std::string& text) {
+        size_t used = 0;
+        uint64_t value = std::stoull(text, &used, 16);
+        if (used != text.size()) {
+            throw std::invalid_argument("not a hexadecimal number: " + text);
+        }
+        return value;
+    }
+
+    std::vector<std::string> SplitFields(const std::string& line) {
+        std::vector<std::string> fields;
+        size_t start = 0;
+        size_t tab;
+        while ((tab = line.find('\t', start)) != std::string::npos) {
+            fields.push_back(line.substr(start, tab - start));
+            start = tab + 1;
+        }
+        fields.push_back(line.substr(start));
+        return fields;
+    }
+}
+
+bool MergeManifest::Input::SameAs(const Input& other) const {
+    return hash == other.hash && size == other.size && time == other.time;
+}
+
+bool MergeManifest::Identify(const FileSystemUtils::FileEntry& file, Input& input) {
+    MappedFile mapped;
+    if (!mapped.Open(file.path)) {
+        return false;
+    }
+    input.path = file.path;
+    input.hash = ContentHash::Hash64(mapped.Data(), mapped.Size());
+    input.size = mapped.Size();
+    input.time = file.time;
+    return true;
+}
+
+bool MergeManifest::Checksum(const std::string& filePath, uint64_t& size, uint64_t& checksum) {
+    MappedFile file;
+    if (!FileSystemUtils::FileExists(filePath) || !file.Open(filePath)) {
+        return false;
+    }
+    size = file.Size();
+    checksum = ContentHash::Hash64(file.Data(), file.Size());
+    return true;
+}
+
+bool MergeManifest::Load(const std::string& manifestPath, const std::string& settings) {
+    settings_ = settings;
+    parts_.clear();
+    if (!FileSystemUtils::FileExists(manifestPath)) {
+        return false;
+    }
+
+    PooledBuffer<std::vector<char>> buffer;
+    if (!FileSystemUtils::ReadFileToBuffer(manifestPath, buffer.Get())) {
+        return false;
+    }
+    std::string text(buffer.Get().begin(), buffer.Get().end());
+
+    try {
+        std::vector<Part> parts;
+        bool header = false;
+        bool sameSettings = false;
+        size_t start = 0;
+        while (start < text.size()) {
+            size_t end = text.find('\n', start);
+            if (end == std::string::npos) {
+                end = text.size();
+            }
+            std::vector<std::string> fields = SplitFields(text.substr(start, end - start));
+            start = end + 1;
+
+            if (!header) {
+                header = fields.size() == 2 && fields[0] == kHeader && ParseHex(fields[1]) == FORMAT_VERSION;
+                if (!header) {
+                    Logger::Debug("Manifest: unknown format, ignored: " + manifestPath);
+                    return false;
+                }
+            }
+            else if (fields[0] == "settings" && fields.size() == 2) {
+                sameSettings = fields[1] == settings;
+            }
+            else if (fields[0] == "part" && fields.size() == 6 && (fields[5] == "full" || fields[5] == "open")) {
+                Part part;
+                part.path = fields[1];
+                part.storedPath = fields[2];
+                part.size = ParseHex(fields[3]);
+                part.checksum = ParseHex(fields[4]);
+                part.open = fields[5] == "open";
+                parts.push_back(part);
+            }
+            else if (fields[0] == "input" && fields.size() == 5 && !parts.empty()) {
+                Input input;
+                input.hash = ParseHex(fields[1]);
+                input.size = ParseHex(fields[2]);
+                input.time = ParseHex(fields[3]);
+                input.path = fields[4];
+                parts.back().inputs.push_back(input);
+            }
+            else if (!fields[0].empty()) {
+                Logger::Debug("Manifest: damaged, ignored: " + manifestPath);
+                return false;
+            }
+        }
+
+        if (!sameSettings) {
+            Logger::Debug("Manifest: written with other settings, ignored: " + manifestPath);
+            return false;
+        }
+        parts_ = std::move(parts);
+        return true;
+    }
+    catch (const std::exception& e) {
+        Logger::Debug("Manifest: damaged, ignored: " + manifestPath + " (" + e.what() + ")");
+        return false;
+    }
+}
+
+bool MergeManifest::Save(const std::string& manifestPath) const {
+    std::string text = std::string(kHeader) + "\t" + Hex(FORMAT_VERSION) + "\n";
+    text += "settings\t" + settings_ + "\n";
+    for (const Part& part : parts_) {
+        text += "part\t" + part.path + "\t" + part.storedPath + "\t" +
+            Hex(part.size) + "\t" + Hex(part.checksum) + "\t" + (part.open ? "open" : "full") + "\n";
+        for (const Input& input : part.inputs) {
+            text += "input\t" + Hex(input.hash) + "\t" + Hex(input.size) + "\t" +
+                Hex(input.time) + "\t" + input.path + "\n";
+        }
+    }
+
+    std::string temporary = manifestPath + ".tmp";
+    if (!FileSystemUtils::WriteBufferToFile(temporary, text.data(), text.size()) ||
+        !FileSystemUtils::RenameFile(temporary, manifestPath)) {
+        FileSystemUtils::DelFile(temporary);
+        Logger::Error("Manifest: cannot write: " + manifestPath);
+        return false;
+    }
+    return true;
+}
+
+void MergeManifest::SetSettings(const std::string& settings) {
+    settings_ = settings;
+}
+
+std::vector<MergeManifest::Part>& MergeManifest::GetParts() {
+    return parts_;
+}
+
+const std::vector<MergeManifest::Part>& MergeManifest::GetParts() const {
+    return parts_;
+}
@@ -0,0 +1,67 @@
+#ifndef __MERGE_MANIFEST_H__
+#define __MERGE_MANIFEST_H__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "FileSystemUtils.h"
+
+// Sidecar file of a split merge ("<output>.manifest") listing every part
+// written so far, the inputs it was built from and a checksum of the part.
+// A merge run again over the same inputs with the same settings reuses the
+// parts whose inputs are unchanged and builds only the rest.
+//
+// Text, one record per line, fields separated by tabs:
+//   PDFFILES-MANIFEST <version>
+//   settings <output settings the parts were built with>
+//   part <final path> <path the part is stored under> <size> <checksum> <full|open>
+//   input <content hash> <size> <modification time> <path>
+// Input lines belong to the part line above them; numbers are hexadecimal.
+// The last part is open: it was closed by the end of the inputs rather than
+// by the size limit, so more inputs may still belong in it.
+class MergeManifest {
+public:
+    struct Input {
+        std::string path;
+        uint64_t hash = 0;
+        uint64_t size = 0;
+        uint64_t time = 0;      // FILETIME of the last write
+
+        // Same content; the path may differ.
+        bool SameAs(const Input& other) const;
+    };
+
+    struct Part {
+        std::string path;
+        // Differs from path while the part waits for the merge to commit.
+        std::string storedPath;
+        uint64_t size = 0;
+        uint64_t checksum = 0;
+        bool open = false;
+        std::vector<Input> inputs;
+    };
+
+    // Hashes the content of an input; its time comes from the entry.
+    static bool Identify(const FileSystemUtils::FileEntry& file, Input& input);
+    // Size and content hash of a written part.
+    static bool Checksum(const std::string& filePath, uint64_t& size, uint64_t& checksum);
+
+    // Reads the manifest; false when there is none, it is damaged or it was
+    // written with other settings, leaving the manifest empty.
+    bool Load(const std::string& manifestPath, const std::string& settings);
+    // Replaces the file under another name and a rename, so a crash leaves
+    // either the old or the new manifest.
+    bool Save(const std::string& manifestPath) const;
+
+    void SetSettings(const std::string& settings);
+    std::vector<Part>& GetParts();
+    const std::vector<Part>& GetParts() const;
+
+private:
+    static constexpr unsigned FORMAT_VERSION = 2;
+
+    std::string settings_;
+    std::vector<Part> parts_;
+};
+
+#endif // __MERGE_MANIFEST_H__
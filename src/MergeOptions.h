@@ -0,0 +1,111 @@
+#ifndef __MERGE_OPTIONS_H__
+#define __MERGE_OPTIONS_H__
+
+#include <string>
+#include <vector>
+
+// Settings of a merge call, filled from the PdfFiles properties and passed
+// down to PdfSplitManager.
+struct MergeOptions {
+    // Fold identical fonts, images, ICC profiles etc. copied from different
+    // inputs into one object per output part.
+    bool deduplicateResources = true;
+
+    // Combine different subsets of the same embedded font (ABCDEF+Arial,
+    // GHIJKL+Arial, ...) into one subset per output part.
+    bool consolidateFontSubsets = false;
+
+    // Re-encode uncompressed and weakly compressed streams to Flate before a
+    // part is saved: 0 turns the stage off, 1-9 is the zlib level.
+    int compressionLevel = 0;
+
+    // Also re-encode streams that already use Flate; without it the stage
+    // passes them through unchanged.
+    bool recompressFlateStreams = false;
+
+    // Worker threads for compression; 0 means one per CPU core.
+    int compressionThreads = 0;
+
+    // Save parts in the PDF 1.5 compact layout: object streams and a
+    // cross-reference stream instead of a classic xref table.
+    bool compactOutput = false;
+
+    // Save parts linearized ("fast web view") so that viewers can show the
+    // first page before the whole file is downloaded. Takes precedence over
+    // compactOutput.
+    bool linearize = false;
+
+    // Add the new inputs to the existing output (the file itself or the last
+    // part) as an incremental update instead of rebuilding it.
+    bool appendToExisting = false;
+
+    // PdfSlimmer::Category bits of dead weight removed before a part is
+    // saved; 0 turns the pass off.
+    unsigned slimCategories = 0;
+
+    // Pages already merged from an earlier input or earlier in the same one
+    // (DuplicatePageDetector::Mode): 0 keeps them silently, 1 reports them,
+    // 2 also removes exact copies from the output.
+    int duplicatePages = 0;
+
+    // Memory for one merge in MB, 0 for no limit. Pages over the budget are
+    // moved to a spill file next to the output and the part is completed
+    // there; the budget is estimated from the input file sizes.
+    int memoryBudgetMB = 0;
+
+    // Downsample images inside input PDFs that are drawn above this
+    // resolution and store them as JPEG; 0 turns the stage off. Uses
+    // compressionThreads for its workers.
+    int imageTargetDpi = 0;
+
+    // JPEG quality (1-100) of images re-encoded by that stage.
+    int imageJpegQuality = 75;
+
+    // Read input PDFs with PdfLazyReader: only the pages and what they
+    // reference are parsed. Inputs it cannot handle, and all inputs while
+    // image optimization is on, use the full parser.
+    bool lazyInputLoading = false;
+
+    // Worker threads that parse the objects of an input read by
+    // PdfLazyReader (lazy loading and raw copy): 1 parses them on the
+    // calling thread as they are needed, 0 means one per CPU core.
+    int parseThreads = 1;
+
+    // Build the output with PdfRawWriter: objects of well-formed inputs are
+    // copied as text and their streams byte for byte. Images and inputs it
+    // rejects are converted through PoDoFo first. Deduplication only folds
+    // identical streams without references; the other stages that work on
+    // the whole part (consolidation, compression, slimming, compact and
+    // linearized layouts) are not applied, and the option is ignored
+    // together with appendToExisting.
+    bool rawCopy = false;
+
+    // Raw copy that writes every input to disk as soon as it is copied, so
+    // memory holds one input plus the offsets and page list of the part.
+    // Implies rawCopy.
+    bool streamingOutput = false;
+
+    // Folder of PdfParseCache, empty for none: inputs copied by the raw
+    // copy path are stored there and added again without parsing when the
+    // same file is merged later. Kept under parseCacheLimitMB.
+    std::string parseCacheFolder;
+    int parseCacheLimitMB = 1024;
+
+    // PDF files added before and after the inputs of every merge. They are
+    // parsed once and kept in PdfTemplateCache between calls, and are never
+    // deleted with the inputs.
+    std::vector<std::string> prependTemplates;
+    std::vector<std::string> appendTemplates;
+
+    // Order of the input files by name (FileSystemUtils::SortOrder): 0
+    // compares bytes, 1 compares runs of digits as numbers, 2 uses the
+    // collation of the user's locale with digits as numbers.
+    int fileSortOrder = 0;
+
+    // Split mode only: parts are recorded in a manifest next to the output,
+    // written under temporary names and put in place when the whole merge
+    // succeeds. A repeated merge reuses the parts whose inputs are unchanged.
+    bool resumableMerge = false;
+};
+
+#endif // __MERGE_OPTIONS_H__
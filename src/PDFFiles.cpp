@@ -1,10 +1,65 @@
 ﻿#include "PDFFiles.h"
+#include <algorithm>
 #include "StringConverter.h"
 #include "GdiplusManager.h"
 #include "VariantUtils.h"
 #include "Logger.h"
 #include "FileSystemUtils.h"
 #include "PdfSplitManager.h"
+#include "PdfSlimmer.h"
+#include "BufferPool.h"
+#include "PdfTemplateCache.h"
+#include "ParallelFor.h"
+#include "FileList.h"
+
+namespace {
+    constexpr size_t BytesInMegabyte = 1024 * 1024;
+    // Parse cache of the spool when no ParseCacheFolder is set.
+    const wchar_t kSpoolCacheFolder[] = L"PdfMerge_ParseCache";
+    // A PDF header may follow up to this much other data.
+    constexpr size_t SignatureBytes = 1024;
+
+    // Checks that a listed input exists and starts the way its extension
+    // says, filling in its size and time. Leaves the reason in problem.
+    void ValidateInput(FileSystemUtils::FileEntry& input, std::string& problem) {
+        std::string path = input.path;
+        if (!FileSystemUtils::GetFileEntry(path, input)) {
+            problem = "not found or not accessible";
+            return;
+        }
+        if (input.attributes & FILE_ATTRIBUTE_DIRECTORY) {
+            problem = "is a folder";
+            return;
+        }
+        std::string extension = FileSystemUtils::GetFileExtension(path);
+        if (!FileSystemUtils::IsSupportedExtension(extension)) {
+            problem = "not a PDF, JPG or PNG file";
+            return;
+        }
+
+        std::vector<char> head;
+        size_t size = static_cast<size_t>((std::min)(input.size, static_cast<uint64_t>(SignatureBytes)));
+        if (size == 0 || !FileSystemUtils::ReadFileRange(path, 0, size, head)) {
+            problem = size == 0 ? "empty file" : "cannot be read";
+            return;
+        }
+
+        std::string_view data(head.data(), head.size());
+        bool valid;
+        if (extension == ".pdf") {
+            valid = data.find("%PDF-") != std::string_view::npos;
+        }
+        else if (extension == ".png") {
+            valid = data.substr(0, 4) == "\x89PNG";
+        }
+        else {
+            valid = data.substr(0, 3) == "\xFF\xD8\xFF";
+        }
+        if (!valid) {
+            problem = "content does not match the extension";
+        }
+    }
+}
 
 PdfFiles::PdfFiles() {
     Logger::Debug("=== PdfFiles component initialized ===");
@@ -60,9 +115,442 @@ PdfFiles::PdfFiles() {
             }
         });
 
+    // ========================================================================
+    // СВОЙСТВО: ПроверятьСписокФайлов (ОбъединитьСписокФайлов заранее
+    // проверяет все файлы списка параллельно)
+    // ========================================================================
+    AddProperty(L"ValidateFileList", L"ПроверятьСписокФайлов",
+        [&]() {
+            return std::make_shared<variant_t>(m_validateFileList);
+        },
+        [&](const variant_t& val) {
+            m_validateFileList = VariantUtils::GetBool(val);
+            Logger::Debug(std::string("=== Validate file list: ") +
+                (m_validateFileList ? "ENABLED" : "DISABLED") + " ===");
+        });
+
+    // ========================================================================
+    // СВОЙСТВО: ДедупликацияРесурсов
+    // ========================================================================
+    AddProperty(L"DeduplicateResources", L"ДедупликацияРесурсов",
+        [&]() {
+            return std::make_shared<variant_t>(m_options.deduplicateResources);
+        },
+        [&](const variant_t& val) {
+            m_options.deduplicateResources = VariantUtils::GetBool(val);
+            Logger::Debug(std::string("=== Resource deduplication: ") +
+                (m_options.deduplicateResources ? "ENABLED" : "DISABLED") + " ===");
+        });
+
+    // ========================================================================
+    // СВОЙСТВО: ОбъединятьПодмножестваШрифтов
+    // ========================================================================
+    AddProperty(L"ConsolidateFontSubsets", L"ОбъединятьПодмножестваШрифтов",
+        [&]() {
+            return std::make_shared<variant_t>(m_options.consolidateFontSubsets);
+        },
+        [&](const variant_t& val) {
+            m_options.consolidateFontSubsets = VariantUtils::GetBool(val);
+            Logger::Debug(std::string("=== Font subset consolidation: ") +
+                (m_options.consolidateFontSubsets ? "ENABLED" : "DISABLED") + " ===");
+        });
+
+    // ========================================================================
+    // СВОЙСТВО: УровеньСжатия (0 - выключено, 1-9 - уровень Flate)
+    // ========================================================================
+    AddProperty(L"CompressionLevel", L"УровеньСжатия",
+        [&]() {
+            return std::make_shared<variant_t>(static_cast<int32_t>(m_options.compressionLevel));
+        },
+        [&](const variant_t& val) {
+            int level = VariantUtils::GetInt(val);
+            if (level < 0 || level > 9) {
+                AddError(ADDIN_E_FAIL, "CompressionLevel", "Compression level must be from 0 to 9", false);
+                return;
+            }
+            m_options.compressionLevel = level;
+            Logger::Debug("=== Compression level: " + std::to_string(level) + " ===");
+        });
+
+    AddProperty(L"RecompressFlateStreams", L"ПересжиматьFlateПотоки",
+        [&]() {
+            return std::make_shared<variant_t>(m_options.recompressFlateStreams);
+        },
+        [&](const variant_t& val) {
+            m_options.recompressFlateStreams = VariantUtils::GetBool(val);
+            Logger::Debug(std::string("=== Recompress Flate streams: ") +
+                (m_options.recompressFlateStreams ? "ENABLED" : "DISABLED") + " ===");
+        });
+
+    AddProperty(L"CompressionThreads", L"ПотокиСжатия",
+        [&]() {
+            return std::make_shared<variant_t>(static_cast<int32_t>(m_options.compressionThreads));
+        },
+        [&](const variant_t& val) {
+            int threads = VariantUtils::GetInt(val);
+            m_options.compressionThreads = threads > 0 ? threads : 0;
+            Logger::Debug("=== Compression threads: " + std::to_string(m_options.compressionThreads) + " ===");
+        });
+
+    // ========================================================================
+    // СВОЙСТВО: КомпактныйФормат (потоки объектов и xref-поток, PDF 1.5)
+    // ========================================================================
+    AddProperty(L"CompactOutput", L"КомпактныйФормат",
+        [&]() {
+            return std::make_shared<variant_t>(m_options.compactOutput);
+        },
+        [&](const variant_t& val) {
+            m_options.compactOutput = VariantUtils::GetBool(val);
+            Logger::Debug(std::string("=== Compact output: ") +
+                (m_options.compactOutput ? "ENABLED" : "DISABLED") + " ===");
+        });
+
+    // ========================================================================
+    // СВОЙСТВО: Линеаризация (быстрый просмотр в браузере)
+    // ========================================================================
+    AddProperty(L"Linearize", L"Линеаризация",
+        [&]() {
+            return std::make_shared<variant_t>(m_options.linearize);
+        },
+        [&](const variant_t& val) {
+            m_options.linearize = VariantUtils::GetBool(val);
+            Logger::Debug(std::string("=== Linearized output: ") +
+                (m_options.linearize ? "ENABLED" : "DISABLED") + " ===");
+        });
+
+    // ========================================================================
+    // СВОЙСТВО: ДописыватьВСуществующий (инкрементальное обновление)
+    // ========================================================================
+    AddProperty(L"AppendToExisting", L"ДописыватьВСуществующий",
+        [&]() {
+            return std::make_shared<variant_t>(m_options.appendToExisting);
+        },
+        [&](const variant_t& val) {
+            m_options.appendToExisting = VariantUtils::GetBool(val);
+            Logger::Debug(std::string("=== Append to existing output: ") +
+                (m_options.appendToExisting ? "ENABLED" : "DISABLED") + " ===");
+        });
+
+    // ========================================================================
+    // СВОЙСТВО: КатегорииОблегчения (unused, thumbnails, pieceinfo, metadata,
+    // javascript, forms или all; пустая строка - выключено)
+    // ========================================================================
+    AddProperty(L"SlimCategories", L"КатегорииОблегчения",
+        [&]() {
+            return std::make_shared<variant_t>(PdfSlimmer::FormatCategories(m_options.slimCategories));
+        },
+        [&](const variant_t& val) {
+            unsigned categories = 0;
+            if (!PdfSlimmer::ParseCategories(VariantUtils::GetString(val), categories)) {
+                AddError(ADDIN_E_FAIL, "SlimCategories",
+                    "Unknown category; use unused, thumbnails, pieceinfo, metadata, javascript, forms or all", false);
+                return;
+            }
+            m_options.slimCategories = categories;
+            Logger::Debug("=== Slimming categories: " + PdfSlimmer::FormatCategories(categories) + " ===");
+        });
+
+    // ========================================================================
+    // СВОЙСТВО: ЛенивоеЧтениеPDF (разбирать только страницы и их ресурсы)
+    // ========================================================================
+    AddProperty(L"LazyInputLoading", L"ЛенивоеЧтениеPDF",
+        [&]() {
+            return std::make_shared<variant_t>(m_options.lazyInputLoading);
+        },
+        [&](const variant_t& val) {
+            m_options.lazyInputLoading = VariantUtils::GetBool(val);
+            Logger::Debug(std::string("=== Lazy input loading: ") +
+                (m_options.lazyInputLoading ? "ENABLED" : "DISABLED") + " ===");
+        });
+
+    // ========================================================================
+    // СВОЙСТВО: ПотокиРазбора (0 - по числу ядер, 1 - без параллельного разбора)
+    // ========================================================================
+    AddProperty(L"ParseThreads", L"ПотокиРазбора",
+        [&]() {
+            return std::make_shared<variant_t>(static_cast<int32_t>(m_options.parseThreads));
+        },
+        [&](const variant_t& val) {
+            int threads = VariantUtils::GetInt(val);
+            m_options.parseThreads = threads > 0 ? threads : 0;
+            Logger::Debug("=== Parse threads: " + std::to_string(m_options.parseThreads) + " ===");
+        });
+
+    // ========================================================================
+    // СВОЙСТВО: БыстроеКопирование (копировать объекты входных PDF без разбора)
+    // ========================================================================
+    AddProperty(L"RawCopyMerge", L"БыстроеКопирование",
+        [&]() {
+            return std::make_shared<variant_t>(m_options.rawCopy);
+        },
+        [&](const variant_t& val) {
+            m_options.rawCopy = VariantUtils::GetBool(val);
+            Logger::Debug(std::string("=== Raw copy merge: ") +
+                (m_options.rawCopy ? "ENABLED" : "DISABLED") + " ===");
+        });
+
+    // ========================================================================
+    // СВОЙСТВО: ПотоковаяЗапись (быстрое копирование с записью каждого файла
+    // на диск сразу после копирования)
+    // ========================================================================
+    AddProperty(L"StreamingOutput", L"ПотоковаяЗапись",
+        [&]() {
+            return std::make_shared<variant_t>(m_options.streamingOutput);
+        },
+        [&](const variant_t& val) {
+            m_options.streamingOutput = VariantUtils::GetBool(val);
+            Logger::Debug(std::string("=== Streaming output: ") +
+                (m_options.streamingOutput ? "ENABLED" : "DISABLED") + " ===");
+        });
+
+    // ========================================================================
+    // СВОЙСТВО: ПорядокФайлов (0 - по байтам, 1 - числа по значению,
+    // 2 - по правилам языка пользователя)
+    // ========================================================================
+    AddProperty(L"FileSortOrder", L"ПорядокФайлов",
+        [&]() {
+            return std::make_shared<variant_t>(static_cast<int32_t>(m_options.fileSortOrder));
+        },
+        [&](const variant_t& val) {
+            int order = VariantUtils::GetInt(val);
+            if (order < FileSystemUtils::SORT_BYTEWISE || order > FileSystemUtils::SORT_LOCALE) {
+                AddError(ADDIN_E_FAIL, "FileSortOrder", "Use 0 (bytewise), 1 (natural) or 2 (locale)", false);
+                return;
+            }
+            m_options.fileSortOrder = order;
+            Logger::Debug("=== File sort order: " + std::to_string(order) + " ===");
+        });
+
+    // ========================================================================
+    // СВОЙСТВО: ВозобновляемоеОбъединение (только с разделением на части:
+    // манифест частей, повторный запуск пересобирает только измененные части)
+    // ========================================================================
+    AddProperty(L"ResumableMerge", L"ВозобновляемоеОбъединение",
+        [&]() {
+            return std::make_shared<variant_t>(m_options.resumableMerge);
+        },
+        [&](const variant_t& val) {
+            m_options.resumableMerge = VariantUtils::GetBool(val);
+            Logger::Debug(std::string("=== Resumable merge: ") +
+                (m_options.resumableMerge ? "ENABLED" : "DISABLED") + " ===");
+        });
+
+    // ========================================================================
+    // СВОЙСТВО: ПереиспользованоЧастей (только чтение: части прошлого запуска,
+    // взятые без изменений)
+    // ========================================================================
+    AddProperty(L"ReusedParts", L"ПереиспользованоЧастей", [&]() {
+        return std::make_shared<variant_t>(static_cast<int32_t>(m_reusedParts));
+        });
+
+    // ========================================================================
+    // СВОЙСТВО: ПапкаКэшаРазбора (пусто - без кэша; для быстрого копирования)
+    // ========================================================================
+    AddProperty(L"ParseCacheFolder", L"ПапкаКэшаРазбора",
+        [&]() {
+            return std::make_shared<variant_t>(m_options.parseCacheFolder);
+        },
+        [&](const variant_t& val) {
+            m_options.parseCacheFolder = StringConverter::SanitizePath(VariantUtils::GetString(val));
+            Logger::Debug("=== Parse cache folder: " + m_options.parseCacheFolder + " ===");
+        });
+
+    // ========================================================================
+    // СВОЙСТВО: ЛимитКэшаРазбораМБ
+    // ========================================================================
+    AddProperty(L"ParseCacheLimitMB", L"ЛимитКэшаРазбораМБ",
+        [&]() {
+            return std::make_shared<variant_t>(static_cast<int32_t>(m_options.parseCacheLimitMB));
+        },
+        [&](const variant_t& val) {
+            int limit = VariantUtils::GetInt(val);
+            if (limit < 0) {
+                AddError(ADDIN_E_FAIL, "ParseCacheLimitMB", "Parse cache limit must not be negative", false);
+                return;
+            }
+            m_options.parseCacheLimitMB = limit;
+            Logger::Debug("=== Parse cache limit: " + std::to_string(limit) + " MB ===");
+        });
+
+    // ========================================================================
+    // СВОЙСТВО: ДоляПопаданийКэшаРазбора (только чтение, 0..1 за последнее
+    // объединение)
+    // ========================================================================
+    AddProperty(L"ParseCacheHitRate", L"ДоляПопаданийКэшаРазбора", [&]() {
+        return std::make_shared<variant_t>(m_parseCacheHitRate);
+        });
+
+    // ========================================================================
+    // СВОЙСТВО: ЦелевоеРазрешениеИзображений (dpi изображений во входных PDF,
+    // 0 - выключено)
+    // ========================================================================
+    AddProperty(L"ImageTargetDpi", L"ЦелевоеРазрешениеИзображений",
+        [&]() {
+            return std::make_shared<variant_t>(static_cast<int32_t>(m_options.imageTargetDpi));
+        },
+        [&](const variant_t& val) {
+            int dpi = VariantUtils::GetInt(val);
+            if (dpi < 0) {
+                AddError(ADDIN_E_FAIL, "ImageTargetDpi", "Target resolution must not be negative", false);
+                return;
+            }
+            m_options.imageTargetDpi = dpi;
+            Logger::Debug("=== Image target resolution: " + std::to_string(dpi) + " dpi ===");
+        });
+
+    AddProperty(L"ImageJpegQuality", L"КачествоJpegИзображений",
+        [&]() {
+            return std::make_shared<variant_t>(static_cast<int32_t>(m_options.imageJpegQuality));
+        },
+        [&](const variant_t& val) {
+            int quality = VariantUtils::GetInt(val);
+            if (quality < 1 || quality > 100) {
+                AddError(ADDIN_E_FAIL, "ImageJpegQuality", "JPEG quality must be from 1 to 100", false);
+                return;
+            }
+            m_options.imageJpegQuality = quality;
+            Logger::Debug("=== Image JPEG quality: " + std::to_string(quality) + " ===");
+        });
+
+    // ========================================================================
+    // СВОЙСТВО: ДубликатыСтраниц (0 - не искать, 1 - сообщать, 2 - удалять)
+    // ========================================================================
+    AddProperty(L"DuplicatePages", L"ДубликатыСтраниц",
+        [&]() {
+            return std::make_shared<variant_t>(static_cast<int32_t>(m_options.duplicatePages));
+        },
+        [&](const variant_t& val) {
+            int mode = VariantUtils::GetInt(val);
+            if (mode < DuplicatePageDetector::OFF || mode > DuplicatePageDetector::REMOVE) {
+                AddError(ADDIN_E_FAIL, "DuplicatePages", "Use 0 (off), 1 (report) or 2 (remove)", false);
+                return;
+            }
+            m_options.duplicatePages = mode;
+            Logger::Debug("=== Duplicate pages mode: " + std::to_string(mode) + " ===");
+        });
+
+    // ========================================================================
+    // СВОЙСТВО: ОтчетОДубликатах (только чтение, по строке на дубликат)
+    // ========================================================================
+    AddProperty(L"DuplicatePageReport", L"ОтчетОДубликатах", [&]() {
+        return std::make_shared<variant_t>(m_duplicateReport);
+        });
+
+    // ========================================================================
+    // СВОЙСТВО: ОтчетОблегчения (только чтение, итоги последнего объединения)
+    // ========================================================================
+    AddProperty(L"SlimReport", L"ОтчетОблегчения", [&]() {
+        return std::make_shared<variant_t>(m_slimReport);
+        });
+
+    // ========================================================================
+    // СВОЙСТВО: БюджетПамятиМБ (0 - без ограничения; сверх бюджета страницы
+    // выгружаются во временный файл рядом с результатом)
+    // ========================================================================
+    AddProperty(L"MemoryBudgetMB", L"БюджетПамятиМБ",
+        [&]() {
+            return std::make_shared<variant_t>(static_cast<int32_t>(m_options.memoryBudgetMB));
+        },
+        [&](const variant_t& val) {
+            int budget = VariantUtils::GetInt(val);
+            if (budget < 0) {
+                AddError(ADDIN_E_FAIL, "MemoryBudgetMB", "Memory budget must not be negative", false);
+                return;
+            }
+            m_options.memoryBudgetMB = budget;
+            Logger::Debug("=== Memory budget: " + std::to_string(budget) + " MB ===");
+        });
+
+    // ========================================================================
+    // СВОЙСТВО: ОбъемВыгрузки (только чтение, байт выгружено на диск
+    // при последнем объединении)
+    // ========================================================================
+    AddProperty(L"SpilledBytes", L"ОбъемВыгрузки", [&]() {
+        return std::make_shared<variant_t>(static_cast<double>(m_spilledBytes));
+        });
+
+    // ========================================================================
+    // СВОЙСТВО: ЛимитПулаБуферовМБ (сколько памяти держать между файлами
+    // и вызовами для повторного использования, 0 - не держать)
+    // ========================================================================
+    AddProperty(L"BufferPoolLimitMB", L"ЛимитПулаБуферовМБ",
+        [&]() {
+            return std::make_shared<variant_t>(static_cast<int32_t>(
+                BufferPool::Instance().GetRetentionLimit() / BytesInMegabyte));
+        },
+        [&](const variant_t& val) {
+            int limit = VariantUtils::GetInt(val);
+            if (limit < 0) {
+                AddError(ADDIN_E_FAIL, "BufferPoolLimitMB", "Buffer pool limit must not be negative", false);
+                return;
+            }
+            BufferPool::Instance().SetRetentionLimit(static_cast<size_t>(limit) * BytesInMegabyte);
+            Logger::Debug("=== Buffer pool limit: " + std::to_string(limit) + " MB ===");
+        });
+
+    // ========================================================================
+    // СВОЙСТВО: СтатистикаПулаБуферов (только чтение: попадания, промахи,
+    // удерживаемая память)
+    // ========================================================================
+    AddProperty(L"BufferPoolStats", L"СтатистикаПулаБуферов", [&]() {
+        return std::make_shared<variant_t>(BufferPool::Instance().FormatStats());
+        });
+
+    // ========================================================================
+    // СВОЙСТВО: ЛимитКэшаШаблоновМБ (память под разобранные шаблоны между
+    // вызовами, 0 - не кэшировать)
+    // ========================================================================
+    AddProperty(L"TemplateCacheLimitMB", L"ЛимитКэшаШаблоновМБ",
+        [&]() {
+            return std::make_shared<variant_t>(static_cast<int32_t>(
+                PdfTemplateCache::Instance().GetLimit() / BytesInMegabyte));
+        },
+        [&](const variant_t& val) {
+            int limit = VariantUtils::GetInt(val);
+            if (limit < 0) {
+                AddError(ADDIN_E_FAIL, "TemplateCacheLimitMB", "Template cache limit must not be negative", false);
+                return;
+            }
+            PdfTemplateCache::Instance().SetLimit(static_cast<size_t>(limit) * BytesInMegabyte);
+            Logger::Debug("=== Template cache limit: " + std::to_string(limit) + " MB ===");
+        });
+
+    // ========================================================================
+    // СВОЙСТВО: СтатистикаКэшаШаблонов (только чтение)
+    // ========================================================================
+    AddProperty(L"TemplateCacheStats", L"СтатистикаКэшаШаблонов", [&]() {
+        return std::make_shared<variant_t>(PdfTemplateCache::Instance().FormatStats());
+        });
+
+    // ========================================================================
+    // СВОЙСТВА: состояние наблюдения за папкой (только чтение)
+    // ========================================================================
+    AddProperty(L"SpoolRunning", L"НаблюдениеЗапущено", [&]() {
+        return std::make_shared<variant_t>(m_spool.GetStatus().running);
+        });
+    AddProperty(L"SpoolPending", L"ОжидаютПодготовки", [&]() {
+        return std::make_shared<variant_t>(static_cast<int32_t>(m_spool.GetStatus().pending));
+        });
+    AddProperty(L"SpoolPrepared", L"ПодготовленоФайлов", [&]() {
+        return std::make_shared<variant_t>(static_cast<int32_t>(m_spool.GetStatus().prepared));
+        });
+    AddProperty(L"SpoolFailedFiles", L"ФайлыСОшибками", [&]() {
+        std::string files;
+        for (const auto& file : m_spool.GetStatus().failed) {
+            files += file + "\n";
+        }
+        return std::make_shared<variant_t>(files);
+        });
+
+    AddMethod(L"StartSpool", L"НачатьНаблюдение", this, &PdfFiles::StartSpool);
+    AddMethod(L"StopSpool", L"ОстановитьНаблюдение", this, &PdfFiles::StopSpool);
+    AddMethod(L"AddPrependTemplate", L"ДобавитьШаблонВНачало", this, &PdfFiles::AddPrependTemplate);
+    AddMethod(L"AddAppendTemplate", L"ДобавитьШаблонВКонец", this, &PdfFiles::AddAppendTemplate);
+    AddMethod(L"ClearTemplates", L"ОчиститьШаблоны", this, &PdfFiles::ClearTemplates);
     AddMethod(L"MergePDFFiles", L"ОбъединитьPDFФайлы", this, &PdfFiles::MergePDFFiles);
     AddMethod(L"MergePDFFilesWithSplit", L"ОбъединитьPDFФайлыСРазделением",
         this, &PdfFiles::MergePDFFilesWithSplit);
+    AddMethod(L"MergeFileList", L"ОбъединитьСписокФайлов", this, &PdfFiles::MergeFileList);
 }
 
 std::string PdfFiles::extensionName() {
@@ -72,16 +560,105 @@ std::string PdfFiles::extensionName() {
 void ADDIN_API PdfFiles::Done()
 {
     // Освобождаем GDI+ ресурсы
+    m_spool.Stop();
     GdiplusManager::Instance().Shutdown();
+    BufferPool::Instance().Trim();
+}
+
+bool PdfFiles::StartSpool(const variant_t& folderPath, const variant_t& outputFileName) {
+    std::string path = StringConverter::SanitizePath(VariantUtils::GetString(folderPath));
+    if (path.empty() || !FileSystemUtils::DirectoryExists(path)) {
+        AddError(ADDIN_E_FAIL, "StartSpool", "Folder is not accessible or does not exist: " + path, false);
+        return false;
+    }
+    // The output of the merge lives in the same folder and is not an input.
+    std::string outputName = VariantUtils::GetString(outputFileName);
+    if (outputName.empty()) {
+        AddError(ADDIN_E_FAIL, "StartSpool", "Empty output file name", false);
+        return false;
+    }
+
+    // The watcher prepares into the parse cache, which only the raw copy
+    // merge reads: both are switched on, so that the merge assembles the
+    // prepared files instead of parsing them again.
+    if (!m_options.rawCopy && !m_options.streamingOutput) {
+        m_options.rawCopy = true;
+        Logger::Debug("=== Spool: raw copy merge ENABLED ===");
+    }
+    if (m_options.parseCacheFolder.empty()) {
+        wchar_t tempPath[MAX_PATH];
+        GetTempPathW(MAX_PATH, tempPath);
+        m_options.parseCacheFolder = StringConverter::WideToUtf8(std::wstring(tempPath) + kSpoolCacheFolder);
+        Logger::Debug("=== Spool: parse cache folder: " + m_options.parseCacheFolder + " ===");
+    }
+    if (m_options.appendToExisting || m_options.imageTargetDpi > 0) {
+        Logger::Debug("Spool: append mode or image optimization is on, PDF inputs are only validated");
+    }
+
+    // Prepared with the settings current at the start.
+    if (!m_spool.Start(path, outputName, m_options)) {
+        AddError(ADDIN_E_FAIL, "StartSpool", "Cannot watch folder: " + path, false);
+        return false;
+    }
+    return true;
+}
+
+void PdfFiles::StopSpool() {
+    m_spool.Stop();
+}
+
+bool PdfFiles::AddTemplate(const variant_t& filePath, std::vector<std::string>& templates, const char* method) {
+    std::string path = StringConverter::SanitizePath(VariantUtils::GetString(filePath));
+    if (FileSystemUtils::GetFileExtension(path) != ".pdf" || !FileSystemUtils::FileExists(path)) {
+        AddError(ADDIN_E_FAIL, method, "Template is not an existing PDF file: " + path, false);
+        return false;
+    }
+
+    templates.push_back(path);
+    Logger::Debug(std::string("=== ") + method + ": " + path + " ===");
+    return true;
+}
+
+bool PdfFiles::AddPrependTemplate(const variant_t& filePath) {
+    return AddTemplate(filePath, m_options.prependTemplates, "AddPrependTemplate");
+}
+
+bool PdfFiles::AddAppendTemplate(const variant_t& filePath) {
+    return AddTemplate(filePath, m_options.appendTemplates, "AddAppendTemplate");
+}
+
+void PdfFiles::ClearTemplates() {
+    m_options.prependTemplates.clear();
+    m_options.appendTemplates.clear();
+    Logger::Debug("=== Templates cleared ===");
 }
 
 bool PdfFiles::MergePDFFiles(const variant_t& sourceFolderPath, const variant_t& outputFileName) {
     return PdfFiles::MergePDFFilesWithSplit(sourceFolderPath, outputFileName, 0);
 }
 
-bool PdfFiles::DeleteOldOutputFiles(const std::string& folderPath, const std::string& outputFileName) {
+bool PdfFiles::IsTemplate(const std::string& filePath) const {
+    std::string lower = StringConverter::ToLowercase(filePath);
+    for (const auto* templates : { &m_options.prependTemplates, &m_options.appendTemplates }) {
+        for (const auto& templatePath : *templates) {
+            if (StringConverter::ToLowercase(templatePath) == lower) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool PdfFiles::DeleteOldOutputFiles(const DirectoryListing& listing,
+    const std::string& outputFileName, const std::vector<std::string>& keepFiles) {
     Logger::Debug("Checking for old output files to delete...");
 
+    // A part written over an old one keeps the case of the old name.
+    std::vector<std::string> keepNames;
+    for (const auto& file : keepFiles) {
+        keepNames.push_back(StringConverter::ToLowercase(FileSystemUtils::GetFileName(file)));
+    }
+
     size_t dotPos = outputFileName.find_last_of('.');
     std::string baseFileName = (dotPos != std::string::npos)
         ? outputFileName.substr(0, dotPos)
@@ -89,33 +666,26 @@ bool PdfFiles::DeleteOldOutputFiles(const std::string& folderPath, const std::st
 
     Logger::Debug("Base file name: " + baseFileName);
 
-    std::vector<std::string> allFiles;
-    if (!FileSystemUtils::GetFilesFromDirectory(folderPath, allFiles)) {
-        Logger::Debug("Failed to read directory for cleanup");
-        return false;
-    }
-
     size_t deletedCount = 0;
+    std::string mainFileName = StringConverter::ToLowercase(outputFileName);
 
-    std::string mainFilePath = folderPath;
-    if (mainFilePath.back() != '\\') {
-        mainFilePath += '\\';
-    }
-    mainFilePath += outputFileName;
+    for (size_t i = 0; i < listing.GetCount(); ++i) {
+        std::string_view fileName = listing.GetName(i);
 
-    if (FileSystemUtils::FileExists(mainFilePath)) {
-        if (FileSystemUtils::DelFile(mainFilePath)) {
-            Logger::Debug("Deleted old main file: " + mainFilePath);
-            deletedCount++;
+        if (fileName.size() == mainFileName.size() &&
+            StringConverter::ToLowercase(std::string(fileName)) == mainFileName) {
+            std::string path = listing.GetPath(i);
+            if (FileSystemUtils::DelFile(path)) {
+                Logger::Debug("Deleted old main file: " + path);
+                deletedCount++;
+            }
         }
-    }
-
-    for (const auto& file : allFiles) {
-        std::string fileName = FileSystemUtils::GetFileName(file);
-
-        if (fileName.find(baseFileName) == 0 && fileName.find("_part") != std::string::npos) {
-            if (FileSystemUtils::DelFile(file)) {
-                Logger::Debug("Deleted old part file: " + file);
+        else if (FileSystemUtils::IsOutputFile(fileName, outputFileName) &&
+            std::find(keepNames.begin(), keepNames.end(),
+                StringConverter::ToLowercase(std::string(fileName))) == keepNames.end()) {
+            std::string path = listing.GetPath(i);
+            if (FileSystemUtils::DelFile(path)) {
+                Logger::Debug("Deleted old part file: " + path);
                 deletedCount++;
             }
         }
@@ -143,6 +713,12 @@ bool PdfFiles::MergePDFFilesWithSplit(const variant_t& sourceFolderPath,
 
     Logger::Debug("=== MergePDFFilesWithSplit START ===");
 
+    m_slimReport.clear();
+    m_duplicateReport.clear();
+    m_spilledBytes = 0;
+    m_parseCacheHitRate = 0.0;
+    m_reusedParts = 0;
+
     try {
 
         Logger::Debug("Source folder: " + folderPath);
@@ -173,27 +749,37 @@ bool PdfFiles::MergePDFFilesWithSplit(const variant_t& sourceFolderPath,
         }
         Logger::Debug("Directory access OK");
 
-        // ====================================================================
-        // НОВОЕ: Удаление старых выходных файлов перед началом
-        // ====================================================================
-        Logger::Debug("Cleaning up old output files...");
-        if (!DeleteOldOutputFiles(folderPath, outputFileName_str)) {
-            Logger::Debug("Warning: Could not clean old output files, continuing anyway");
-        }
-
+        // One listing serves the cleanup, the inputs and their sizes; on a
+        // network share every further query is a round-trip. Only inputs
+        // and output files are kept from it.
         Logger::Debug("Reading directory contents...");
-        std::vector<std::string> allFiles;
-        if (!FileSystemUtils::GetFilesFromDirectory(folderPath, allFiles)) {
+        DirectoryListing listing;
+        if (!listing.Read(folderPath, [&](std::string_view fileName) {
+                return FileSystemUtils::HasSupportedExtension(fileName) ||
+                    FileSystemUtils::IsOutputFile(fileName, outputFileName_str);
+            })) {
             Logger::Error("Failed to read directory contents");
             AddError(ADDIN_E_FAIL, "MergePDFFilesWithSplit",
                 "Failed to read folder contents", false);
             return false;
         }
-        Logger::Debug("Found " + std::to_string(allFiles.size()) + " files");
+        Logger::Debug("Found " + std::to_string(listing.GetCount()) + " input and output files");
 
+        // Previous output lives in the same folder and is not an input; the
+        // listing still has the files deleted above. A template kept in the
+        // source folder is added once, in its place, and must survive the
+        // deletion of the inputs.
         Logger::Debug("Filtering files by extension...");
-        std::vector<std::string> files = FileSystemUtils::FilterFilesByExtension(allFiles);
-        Logger::Debug("Filtered to " + std::to_string(files.size()) + " supported files");
+        std::vector<size_t> files;
+        for (size_t i = 0; i < listing.GetCount(); ++i) {
+            std::string_view fileName = listing.GetName(i);
+            if (FileSystemUtils::HasSupportedExtension(fileName) &&
+                !FileSystemUtils::IsOutputFile(fileName, outputFileName_str) &&
+                !IsTemplate(listing.GetPath(i))) {
+                files.push_back(i);
+            }
+        }
+        Logger::Debug("Filtered to " + std::to_string(files.size()) + " input file(s)");
 
         if (files.empty()) {
             Logger::Error("No supported files found");
@@ -202,8 +788,8 @@ bool PdfFiles::MergePDFFilesWithSplit(const variant_t& sourceFolderPath,
             return false;
         }
 
-        Logger::Debug("Sorting files...");
-        FileSystemUtils::SortFilesByName(files);
+        Logger::Debug("Sorting files, order " + std::to_string(m_options.fileSortOrder) + "...");
+        listing.SortByName(files, static_cast<FileSystemUtils::SortOrder>(m_options.fileSortOrder));
 
         // Формируем полный путь выходного файла в каталоге источника
         std::string outputPath = folderPath;
@@ -212,80 +798,362 @@ bool PdfFiles::MergePDFFilesWithSplit(const variant_t& sourceFolderPath,
         }
         outputPath += outputFileName_str;
 
-        Logger::Debug("Creating PDF split manager...");
-        PdfSplitManager splitManager(outputPath, sizeLimitMB);
+        std::vector<FileSystemUtils::FileEntry> inputs;
+        inputs.reserve(files.size());
+        for (size_t index : files) {
+            inputs.push_back(listing.GetEntry(index));
+        }
+        return MergeInputs("MergePDFFilesWithSplit", outputPath, sizeLimitMB, inputs, listing);
+    }
+    catch (const PoDoFo::PdfError& e) {
+        std::string errorMsg = "PoDoFo error: PdfError code " +
+            std::to_string(static_cast<int>(e.GetCode()));
+        Logger::Error(errorMsg);
+        AddError(ADDIN_E_FAIL, "MergePDFFilesWithSplit", errorMsg, false);
+        return false;
+    }
+    catch (const std::exception& e) {
+        std::string errorMsg = "Exception: " + std::string(e.what());
+        Logger::Error(errorMsg);
+        AddError(ADDIN_E_FAIL, "MergePDFFilesWithSplit", errorMsg, false);
+        return false;
+    }
+    catch (...) {
+        Logger::Error("Unknown exception");
+        AddError(ADDIN_E_FAIL, "MergePDFFilesWithSplit",
+            "Unknown error while merging files", false);
+        return false;
+    }
+}
 
-        for (size_t i = 0; i < files.size(); ++i) {
-            Logger::Debug("Processing file " + std::to_string(i + 1) + "/" +
-                std::to_string(files.size()) + ": " + files[i]);
+bool PdfFiles::MergeInputs(const char* method, const std::string& outputPath, double sizeLimitMB,
+    const std::vector<FileSystemUtils::FileEntry>& inputs, const DirectoryListing& outputListing) {
+    std::string outputFileName = FileSystemUtils::GetFileName(outputPath);
 
-            if (!splitManager.AddFile(files[i])) {
-                std::string errorMsg = "Failed to process file: " +
-                    FileSystemUtils::GetFileName(files[i]);
-                Logger::Error(errorMsg);
-                AddError(ADDIN_E_FAIL, "MergePDFFilesWithSplit", errorMsg, false);
-                return false;
+    // The watcher must not hold inputs open while they are read and deleted.
+    SpoolWatcher::Pause spoolPause(m_spool);
+    SpoolWatcher::Status spool = m_spool.GetStatus();
+    if (spool.running) {
+        Logger::Debug("Spool: " + std::to_string(spool.prepared) + " file(s) prepared, " +
+            std::to_string(spool.pending) + " pending, " + std::to_string(spool.failed.size()) +
+            " failed in " + m_spool.GetFolder());
+    }
+
+    // An input the watcher could not prepare fails the merge the same way;
+    // better before the old output is touched.
+    if (!spool.failed.empty()) {
+        std::vector<std::string> failed;
+        for (const auto& file : spool.failed) {
+            failed.push_back(StringConverter::ToLowercase(file));
+        }
+        size_t count = 0;
+        std::string first;
+        for (const auto& input : inputs) {
+            if (std::find(failed.begin(), failed.end(), StringConverter::ToLowercase(input.path)) != failed.end()) {
+                if (count++ == 0) {
+                    first = FileSystemUtils::GetFileName(input.path);
+                }
             }
         }
+        if (count > 0) {
+            std::string errorMsg = std::to_string(count) +
+                " input file(s) could not be prepared by the spool, first " + first;
+            Logger::Error(errorMsg);
+            AddError(ADDIN_E_FAIL, method, errorMsg, false);
+            return false;
+        }
+    }
 
-        Logger::Debug("Finalizing PDF document(s)...");
-        if (!splitManager.Finalize()) {
-            Logger::Error("Failed to finalize documents");
-            AddError(ADDIN_E_FAIL, "MergePDFFilesWithSplit",
-                "Error saving PDF document", false);
+    // ========================================================================
+    // НОВОЕ: Удаление старых выходных файлов перед началом
+    // ========================================================================
+    // Resumable merges replace the old output only once the new one is
+    // complete; until then its parts may still be reused.
+    bool resumable = m_options.resumableMerge && sizeLimitMB > 0 && !m_options.appendToExisting;
+    if (resumable) {
+        Logger::Debug("Resumable merge - keeping existing output files until the merge succeeds");
+    }
+    else if (m_options.appendToExisting) {
+        Logger::Debug("Append mode - keeping existing output files");
+        if (m_keepSourceFiles) {
+            Logger::Debug("Warning: source files are kept, they will be appended again on the next call");
+        }
+    }
+    else {
+        Logger::Debug("Cleaning up old output files...");
+        if (!DeleteOldOutputFiles(outputListing, outputFileName)) {
+            Logger::Debug("Warning: Could not clean old output files, continuing anyway");
+        }
+    }
+
+    Logger::Debug("Creating PDF split manager...");
+    PdfSplitManager splitManager(outputPath, sizeLimitMB, m_options);
+
+    if (m_options.appendToExisting && !splitManager.OpenExistingOutput()) {
+        Logger::Error("Failed to open existing output for appending");
+        AddError(ADDIN_E_FAIL, method,
+            "Existing output file cannot be opened for appending", false);
+        return false;
+    }
+
+    for (const auto& templatePath : m_options.prependTemplates) {
+        if (!splitManager.AddTemplate(templatePath)) {
+            std::string errorMsg = "Failed to add template: " + FileSystemUtils::GetFileName(templatePath);
+            Logger::Error(errorMsg);
+            AddError(ADDIN_E_FAIL, method, errorMsg, false);
+            return false;
+        }
+    }
+
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        Logger::Debug("Processing file " + std::to_string(i + 1) + "/" +
+            std::to_string(inputs.size()) + ": " + inputs[i].path);
+
+        if (!splitManager.AddFile(inputs[i])) {
+            std::string errorMsg = "Failed to process file: " + FileSystemUtils::GetFileName(inputs[i].path);
+            Logger::Error(errorMsg);
+            AddError(ADDIN_E_FAIL, method, errorMsg, false);
+            return false;
+        }
+    }
+
+    for (const auto& templatePath : m_options.appendTemplates) {
+        if (!splitManager.AddTemplate(templatePath)) {
+            std::string errorMsg = "Failed to add template: " + FileSystemUtils::GetFileName(templatePath);
+            Logger::Error(errorMsg);
+            AddError(ADDIN_E_FAIL, method, errorMsg, false);
             return false;
         }
+    }
+
+    Logger::Debug("Finalizing PDF document(s)...");
+    if (!splitManager.Finalize()) {
+        Logger::Error("Failed to finalize documents");
+        AddError(ADDIN_E_FAIL, method,
+            "Error saving PDF document", false);
+        return false;
+    }
+
+    if (resumable) {
+        m_reusedParts = splitManager.GetReusedParts();
+        Logger::Debug("Reused parts: " + std::to_string(m_reusedParts));
+        // Parts of the previous output beyond the new ones.
+        if (!DeleteOldOutputFiles(outputListing, outputFileName, splitManager.GetSavedFiles())) {
+            Logger::Debug("Warning: Could not clean old output files");
+        }
+    }
+
+    if (m_options.slimCategories != 0) {
+        m_slimReport = splitManager.GetSlimReport().ToString();
+        Logger::Debug("Slimming report: " + m_slimReport);
+    }
+
+    if (m_options.duplicatePages != DuplicatePageDetector::OFF) {
+        m_duplicateReport = splitManager.GetDuplicatePages().GetReport();
+        Logger::Debug("Duplicate pages found: " +
+            std::to_string(splitManager.GetDuplicatePages().GetDuplicateCount()));
+    }
+
+    m_spilledBytes = splitManager.GetSpilledBytes();
+    const PdfParseCache& parseCache = splitManager.GetParseCache();
+    if (parseCache.IsOpen()) {
+        m_parseCacheHitRate = parseCache.GetHitRate();
+        Logger::Debug("Parse cache: " + std::to_string(parseCache.GetHits()) + " hit(s), " +
+            std::to_string(parseCache.GetMisses()) + " miss(es)");
+    }
+    if (m_spilledBytes > 0) {
+        Logger::Debug("Spilled to disk: " + std::to_string(m_spilledBytes) + " bytes");
+    }
+    Logger::Debug("Buffer pool: " + BufferPool::Instance().FormatStats());
+    if (!m_options.prependTemplates.empty() || !m_options.appendTemplates.empty()) {
+        Logger::Debug("Template cache: " + PdfTemplateCache::Instance().FormatStats());
+    }
 
-        const auto& savedFiles = splitManager.GetSavedFiles();
-        if (!savedFiles.empty()) {
-            Logger::Debug("Created " + std::to_string(savedFiles.size()) + " file(s):");
-            for (const auto& file : savedFiles) {
-                Logger::Debug("  - " + file);
+    const auto& savedFiles = splitManager.GetSavedFiles();
+    if (!savedFiles.empty()) {
+        Logger::Debug("Created " + std::to_string(savedFiles.size()) + " file(s):");
+        for (const auto& file : savedFiles) {
+            Logger::Debug("  - " + file);
+        }
+    }
+
+    // ========================================================================
+    // Удаление исходных файлов согласно флагу
+    // ========================================================================
+    if (m_keepSourceFiles) {
+        Logger::Debug("Source files preservation enabled - skipping deletion");
+        Logger::Debug(std::string("=== ") + method + " SUCCESS (files preserved) ===");
+    }
+    else {
+        Logger::Debug("Deleting source files...");
+        size_t deletedCount = 0;
+        for (const auto& input : inputs) {
+            const std::string& file = input.path;
+            if (FileSystemUtils::DelFile(file)) {
+                deletedCount++;
+                Logger::Debug("File deleted: " + file);
+            }
+            else {
+                Logger::Debug("Failed to delete: " + file);
             }
         }
+        Logger::Debug("Deleted " + std::to_string(deletedCount) + " source file(s)");
+        Logger::Debug(std::string("=== ") + method + " SUCCESS ===");
+    }
 
-        // ====================================================================
-        // Удаление исходных файлов согласно флагу
-        // ====================================================================
-        if (m_keepSourceFiles) {
-            Logger::Debug("Source files preservation enabled - skipping deletion");
-            Logger::Debug("=== MergePDFFilesWithSplit SUCCESS (files preserved) ===");
+    return true;
+}
+
+bool PdfFiles::MergeFileList(const variant_t& fileList, const variant_t& outputPath, const variant_t& maxSizeMB) {
+    std::string outputPath_str = StringConverter::SanitizePath(VariantUtils::GetString(outputPath));
+    std::string outputFolder = FileSystemUtils::GetFileDirectory(outputPath_str);
+    double sizeLimitMB = VariantUtils::GetDouble(maxSizeMB);
+
+    Logger::SetLogFolder(outputFolder);
+
+    Logger::Debug("=== MergeFileList START ===");
+
+    m_slimReport.clear();
+    m_duplicateReport.clear();
+    m_spilledBytes = 0;
+    m_parseCacheHitRate = 0.0;
+    m_reusedParts = 0;
+
+    try {
+        Logger::Debug("Output file: " + outputPath_str);
+        Logger::Debug("Max size (MB): " + std::to_string(sizeLimitMB));
+        Logger::Debug("Keep source files: " + std::string(m_keepSourceFiles ? "YES" : "NO"));
+
+        // A list built in 1C arrives as a string, one read from a file as
+        // binary data.
+        std::vector<std::string> paths;
+        std::string listError;
+        bool parsed = std::visit(overloaded{
+            [&](const std::string& text) { return FileList::Parse(text, paths, listError); },
+            [&](const std::vector<char>& data) {
+                return FileList::Parse(std::string_view(data.data(), data.size()), paths, listError);
+            },
+            [&](auto&&) { listError = "a string or binary data expected"; return false; }
+            }, fileList);
+        if (!parsed) {
+            std::string errorMsg = "Invalid file list: " + listError;
+            Logger::Error(errorMsg);
+            AddError(ADDIN_E_FAIL, "MergeFileList", errorMsg, false);
+            return false;
         }
-        else {
-            Logger::Debug("Deleting source files...");
-            size_t deletedCount = 0;
-            for (const auto& file : files) {
-                if (FileSystemUtils::DelFile(file)) {
-                    deletedCount++;
-                    Logger::Debug("File deleted: " + file);
-                }
-                else {
-                    Logger::Debug("Failed to delete: " + file);
+
+        if (paths.empty() || outputPath_str.empty()) {
+            Logger::Error("Empty file list or output path");
+            AddError(ADDIN_E_FAIL, "MergeFileList",
+                "Empty file list or output file path", false);
+            return false;
+        }
+
+        if (sizeLimitMB < 0) {
+            Logger::Error("Negative size limit");
+            AddError(ADDIN_E_FAIL, "MergeFileList",
+                "File size cannot be negative", false);
+            return false;
+        }
+
+        if (outputFolder.empty() || !FileSystemUtils::DirectoryExists(outputFolder)) {
+            std::string errorMsg = "Output folder is not accessible or does not exist: " + outputFolder;
+            Logger::Error(errorMsg);
+            AddError(ADDIN_E_FAIL, "MergeFileList", errorMsg, false);
+            return false;
+        }
+
+        // Templates are added around the inputs anyway and are never deleted.
+        // The output and its parts are replaced by the merge, so a list that
+        // still names them from a previous run must not read or delete them.
+        std::string outputFileName = FileSystemUtils::GetFileName(outputPath_str);
+        std::string outputFolderLower = StringConverter::ToLowercase(outputFolder);
+        std::vector<FileSystemUtils::FileEntry> inputs;
+        inputs.reserve(paths.size());
+        for (auto& path : paths) {
+            FileSystemUtils::FileEntry input;
+            input.path = StringConverter::SanitizePath(path);
+            if (IsTemplate(input.path)) {
+                Logger::Debug("Template in the file list, skipped: " + input.path);
+                continue;
+            }
+            if (FileSystemUtils::IsOutputFile(FileSystemUtils::GetFileName(input.path), outputFileName) &&
+                StringConverter::ToLowercase(FileSystemUtils::GetFileDirectory(input.path)) == outputFolderLower) {
+                Logger::Debug("Output file in the file list, skipped: " + input.path);
+                continue;
+            }
+            inputs.push_back(std::move(input));
+        }
+        Logger::Debug("File list: " + std::to_string(inputs.size()) + " input file(s)");
+
+        if (inputs.empty()) {
+            Logger::Error("No input files left in the list");
+            AddError(ADDIN_E_FAIL, "MergeFileList",
+                "File list names only templates or output files", false);
+            return false;
+        }
+
+        // The size and time of every input are needed before the merge
+        // starts; on a share each query is a round-trip, so with validation
+        // they are fetched in parallel together with the checks.
+        if (m_validateFileList) {
+            Logger::Debug("Validating input files...");
+            std::vector<std::string> problems(inputs.size());
+            ParallelFor::Run(inputs.size(), 0, [&](size_t i) {
+                ValidateInput(inputs[i], problems[i]);
+                });
+
+            size_t failed = 0;
+            std::string firstProblem;
+            for (size_t i = 0; i < inputs.size(); ++i) {
+                if (!problems[i].empty()) {
+                    Logger::Error("Invalid input " + inputs[i].path + ": " + problems[i]);
+                    if (failed++ == 0) {
+                        firstProblem = FileSystemUtils::GetFileName(inputs[i].path) + ": " + problems[i];
+                    }
                 }
             }
-            Logger::Debug("Deleted " + std::to_string(deletedCount) + " source file(s)");
-            Logger::Debug("=== MergePDFFilesWithSplit SUCCESS ===");
+            if (failed > 0) {
+                std::string errorMsg = std::to_string(failed) + " invalid input file(s), first " + firstProblem;
+                AddError(ADDIN_E_FAIL, "MergeFileList", errorMsg, false);
+                return false;
+            }
+            Logger::Debug("All input files are valid");
+        }
+        else {
+            for (auto& input : inputs) {
+                // Fails with the reason when it is read.
+                FileSystemUtils::GetFileEntry(input.path, input);
+            }
         }
 
-        return true;
+        // Only the output folder is read, for the files of a previous output.
+        DirectoryListing outputListing;
+        if (!outputListing.Read(outputFolder, [&](std::string_view fileName) {
+                return FileSystemUtils::IsOutputFile(fileName, outputFileName);
+            })) {
+            Logger::Debug("Warning: Could not read the output folder, old output files are kept");
+        }
+
+        return MergeInputs("MergeFileList", outputPath_str, sizeLimitMB, inputs, outputListing);
     }
     catch (const PoDoFo::PdfError& e) {
         std::string errorMsg = "PoDoFo error: PdfError code " +
             std::to_string(static_cast<int>(e.GetCode()));
         Logger::Error(errorMsg);
-        AddError(ADDIN_E_FAIL, "MergePDFFilesWithSplit", errorMsg, false);
+        AddError(ADDIN_E_FAIL, "MergeFileList", errorMsg, false);
         return false;
     }
     catch (const std::exception& e) {
         std::string errorMsg = "Exception: " + std::string(e.what());
         Logger::Error(errorMsg);
-        AddError(ADDIN_E_FAIL, "MergePDFFilesWithSplit", errorMsg, false);
+        AddError(ADDIN_E_FAIL, "MergeFileList", errorMsg, false);
         return false;
     }
     catch (...) {
         Logger::Error("Unknown exception");
-        AddError(ADDIN_E_FAIL, "MergePDFFilesWithSplit",
+        AddError(ADDIN_E_FAIL, "MergeFileList",
             "Unknown error while merging files", false);
         return false;
     }
-}
\ No newline at end of file
+}
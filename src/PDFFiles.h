@@ -2,8 +2,12 @@
 #define __PDFFILES_H__
 
 #include "Component.h"
+#include "FileSystemUtils.h"
+#include "MergeOptions.h"
+#include "SpoolWatcher.h"
 #include <podofo/podofo.h>
 #include <string>
+#include <string_view>
 #include <vector>
 
 using namespace PoDoFo;
@@ -15,6 +19,22 @@ class PdfFiles final : public Component {
 
 private:
     bool m_keepSourceFiles = false;
+    MergeOptions m_options;
+    std::string m_slimReport;
+    std::string m_duplicateReport;
+    uint64_t m_spilledBytes = 0;
+    double m_parseCacheHitRate = 0.0;
+    size_t m_reusedParts = 0;
+    SpoolWatcher m_spool;
+    bool m_validateFileList = false;
+
+    bool AddTemplate(const variant_t& filePath, std::vector<std::string>& templates, const char* method);
+    bool IsTemplate(const std::string& filePath) const;
+    // Everything after the inputs are known: cleanup of the old output in
+    // the listing, the merge, reports and deletion of the inputs. Errors are
+    // reported under the name of method.
+    bool MergeInputs(const char* method, const std::string& outputPath, double sizeLimitMB,
+        const std::vector<FileSystemUtils::FileEntry>& inputs, const DirectoryListing& outputListing);
 
 public:
     // Component version
@@ -25,9 +45,20 @@ public:
     std::string extensionName() override;
     void ADDIN_API Done() override;
 
-    bool DeleteOldOutputFiles(const std::string& folderPath, const std::string& outputFileName);
+    // Deletes the output file and its parts in the listing, except the files
+    // in keepFiles.
+    bool DeleteOldOutputFiles(const DirectoryListing& listing,
+        const std::string& outputFileName, const std::vector<std::string>& keepFiles = {});
+    bool StartSpool(const variant_t& folderPath, const variant_t& outputFileName);
+    void StopSpool();
+    bool AddPrependTemplate(const variant_t& filePath);
+    bool AddAppendTemplate(const variant_t& filePath);
+    void ClearTemplates();
     bool MergePDFFiles(const variant_t& sourceFolderPath, const variant_t& outputFileName);
     bool MergePDFFilesWithSplit(const variant_t& sourceFolderPath, const variant_t& outputFileName, const variant_t& maxSizeMB);
+    // Merges the files of an ordered list (JSON array or one path per line)
+    // from any folders into outputPath, without reading the source folders.
+    bool MergeFileList(const variant_t& fileList, const variant_t& outputPath, const variant_t& maxSizeMB);
 };
 
 #endif // __PDFFILES_H__
\ No newline at end of file
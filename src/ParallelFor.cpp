@@ -0,0 +1,72 @@
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
+#include "ParallelFor.h"
+
+size_t ParallelFor::DefaultThreadCount() {
+    unsigned int cores = std::thread::hardware_concurrency();
+    return cores > 0 ? cores : 1;
+}
+
+void ParallelFor::Run(size_t count, size_t threads, const std::function<void(size_t)>& body) {
+    if (count == 0) {
+        return;
+    }
+
+    if (threads == 0) {
+        threads = DefaultThreadCount();
+    }
+    threads = (std::min)(threads, count);
+
+    if (threads == 1) {
+        for (size_t i = 0; i < count; ++i) {
+            body(i);
+        }
+        return;
+    }
+
+    std::atomic<size_t> next(0);
+    std::atomic<bool> failed(false);
+    std::exception_ptr error;
+    std::mutex errorMutex;
+
+    auto worker = [&]() {
+        for (size_t i = next++; i < count && !failed; i = next++) {
+            try {
+                body(i);
+            }
+            catch (...) {
+                std::lock_guard<std::mutex> lock(errorMutex);
+                if (!error) {
+                    error = std::current_exception();
+                }
+                failed = true;
+            }
+        }
+    };
+
+    // The calling thread is one of the workers.
+    std::vector<std::thread> pool;
+    pool.reserve(threads - 1);
+    for (size_t t = 1; t < threads; ++t) {
+        try {
+            pool.emplace_back(worker);
+        }
+        catch (const std::system_error&) {
+            // Out of threads: the ones already started finish the work.
+            break;
+        }
+    }
+    worker();
+    for (std::thread& thread : pool) {
+        thread.join();
+    }
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
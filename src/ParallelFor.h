@@ -0,0 +1,22 @@
+#ifndef __PARALLEL_FOR_H__
+#define __PARALLEL_FOR_H__
+
+#include <cstddef>
+#include <functional>
+
+// Runs independent work items on a short-lived group of threads.
+//
+// Items are handed out in index order; callers that need deterministic
+// output store per-item results and combine them afterwards on the calling
+// thread. The first exception thrown by an item is rethrown from Run once
+// all threads have stopped.
+class ParallelFor {
+public:
+    // One thread per logical CPU, at least one.
+    static size_t DefaultThreadCount();
+
+    // threads == 0 means DefaultThreadCount(); never more threads than items.
+    static void Run(size_t count, size_t threads, const std::function<void(size_t)>& body);
+};
+
+#endif // __PARALLEL_FOR_H__
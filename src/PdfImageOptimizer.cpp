@@ -0,0 +1,775 @@
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "BufferPool.h"
+#include "GdiplusManager.h"
+#include "Logger.h"
+#include "ImageProcessor.h"
+#include "ParallelFor.h"
+#include "StreamFilters.h"
+#include "PdfImageOptimizer.h"
+
+namespace {
+
+    using PoDoFo::PdfDictionary;
+    using PoDoFo::PdfObject;
+
+    // Raw image data held in memory at once; larger documents are processed
+    // in several batches.
+    constexpr size_t BatchBytes = 64 * 1024 * 1024;
+
+    // Every worker holds a decoded source and target bitmap (a 600 dpi A4
+    // color scan alone is about 100 MB), so fewer threads than for streams.
+    constexpr size_t MaxThreads = 4;
+
+    // Images are resampled only when they exceed the target by this factor:
+    // a small overshoot is not worth a generation of JPEG loss.
+    constexpr double DownsampleThreshold = 1.5;
+
+    // JPEGs at the right resolution are re-encoded only above target + margin.
+    constexpr int QualityMargin = 5;
+
+    constexpr size_t MinImageBytes = 4 * 1024;
+    constexpr int MaxFormDepth = 12;
+    constexpr int MaxParentDepth = 64;
+
+    struct Matrix {
+        double a = 1, b = 0, c = 0, d = 1, e = 0, f = 0;
+    };
+
+    // m applied first, then n (the order of "m cm" on top of CTM n).
+    Matrix Multiply(const Matrix& m, const Matrix& n) {
+        Matrix r;
+        r.a = m.a * n.a + m.b * n.c;
+        r.b = m.a * n.b + m.b * n.d;
+        r.c = m.c * n.a + m.d * n.c;
+        r.d = m.c * n.b + m.d * n.d;
+        r.e = m.e * n.a + m.f * n.c + n.e;
+        r.f = m.e * n.b + m.f * n.d + n.f;
+        return r;
+    }
+
+    // Largest size in points an image is drawn at.
+    struct Placement {
+        double width = 0;
+        double height = 0;
+    };
+
+    struct ScanState {
+        std::unordered_map<const PdfObject*, Placement> placements;
+        // Images used by content that could not be read: their size is unknown.
+        std::unordered_set<const PdfObject*> blocked;
+        std::unordered_map<const PdfObject*, std::string> forms;
+    };
+
+    struct Token {
+        enum Kind { NUMBER, NAME, OPERATOR, OTHER } kind = OTHER;
+        std::string text;
+        double number = 0;
+    };
+
+    // Tokenizer for page content streams; strings, arrays and dictionaries
+    // are skipped as OTHER since only cm/q/Q/Do operands matter here.
+    class ContentTokenizer {
+    public:
+        explicit ContentTokenizer(const std::string& text) : text_(text) {}
+
+        bool Next(Token& token) {
+            SkipWhitespace();
+            if (pos_ >= text_.size()) {
+                return false;
+            }
+
+            token.kind = Token::OTHER;
+            token.text.clear();
+            char c = text_[pos_];
+
+            if (c == '(') {
+                SkipLiteralString();
+                return true;
+            }
+            if (c == '<' || c == '>') {
+                if (pos_ + 1 < text_.size() && text_[pos_ + 1] == c) {
+                    pos_ += 2;
+                }
+                else if (c == '<') {
+                    while (pos_ < text_.size() && text_[pos_] != '>') {
+                        ++pos_;
+                    }
+                    ++pos_;
+                }
+                else {
+                    ++pos_;
+                }
+                return true;
+            }
+            if (c == '[' || c == ']' || c == '{' || c == '}' || c == ')') {
+                ++pos_;
+                return true;
+            }
+            if (c == '/') {
+                ++pos_;
+                token.kind = Token::NAME;
+                while (pos_ < text_.size() && !IsDelimiter(text_[pos_])) {
+                    if (text_[pos_] == '#' && pos_ + 2 < text_.size() &&
+                        std::isxdigit(static_cast<unsigned char>(text_[pos_ + 1])) &&
+                        std::isxdigit(static_cast<unsigned char>(text_[pos_ + 2]))) {
+                        token.text += static_cast<char>(std::stoi(text_.substr(pos_ + 1, 2), nullptr, 16));
+                        pos_ += 3;
+                    }
+                    else {
+                        token.text += text_[pos_++];
+                    }
+                }
+                return true;
+            }
+
+            while (pos_ < text_.size() && !IsDelimiter(text_[pos_])) {
+                token.text += text_[pos_++];
+            }
+            if (token.text.empty()) {
+                ++pos_;
+                return true;
+            }
+            if (std::isdigit(static_cast<unsigned char>(c)) || c == '+' || c == '-' || c == '.') {
+                token.kind = Token::NUMBER;
+                token.number = std::strtod(token.text.c_str(), nullptr);
+            }
+            else {
+                token.kind = Token::OPERATOR;
+            }
+            return true;
+        }
+
+        // Skips the data of an inline image after BI: past "ID", the binary
+        // data and the "EI" that ends it.
+        void SkipInlineImage() {
+            size_t id = FindKeyword("ID", pos_);
+            if (id == std::string::npos) {
+                pos_ = text_.size();
+                return;
+            }
+            size_t ei = FindKeyword("EI", id + 3);
+            pos_ = ei == std::string::npos ? text_.size() : ei + 2;
+        }
+
+    private:
+        const std::string& text_;
+        size_t pos_ = 0;
+
+        static bool IsWhitespace(char c) {
+            return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\f' || c == '\0';
+        }
+
+        static bool IsDelimiter(char c) {
+            return IsWhitespace(c) || c == '(' || c == ')' || c == '<' || c == '>' ||
+                c == '[' || c == ']' || c == '{' || c == '}' || c == '/' || c == '%';
+        }
+
+        // A keyword standing alone between whitespace (or the end of data).
+        size_t FindKeyword(const char* keyword, size_t from) const {
+            for (size_t at = text_.find(keyword, from); at != std::string::npos; at = text_.find(keyword, at + 1)) {
+                bool before = at == 0 || IsWhitespace(text_[at - 1]);
+                bool after = at + 2 >= text_.size() || IsWhitespace(text_[at + 2]);
+                if (before && after) {
+                    return at;
+                }
+            }
+            return std::string::npos;
+        }
+
+        void SkipWhitespace() {
+            while (pos_ < text_.size()) {
+                if (text_[pos_] == '%') {
+                    while (pos_ < text_.size() && text_[pos_] != '\n' && text_[pos_] != '\r') {
+                        ++pos_;
+                    }
+                }
+                else if (IsWhitespace(text_[pos_])) {
+                    ++pos_;
+                }
+                else {
+                    break;
+                }
+            }
+        }
+
+        void SkipLiteralString() {
+            int depth = 0;
+            while (pos_ < text_.size()) {
+                char c = text_[pos_++];
+                if (c == '\\') {
+                    ++pos_;
+                }
+                else if (c == '(') {
+                    ++depth;
+                }
+                else if (c == ')' && --depth == 0) {
+                    return;
+                }
+            }
+        }
+    };
+
+    bool IsName(const PdfObject* obj, const char* name) {
+        return obj && obj->IsName() && obj->GetName() == name;
+    }
+
+    // Page attributes such as /Resources may be inherited from the page tree.
+    const PdfObject* FindInherited(const PdfObject& node, const char* key) {
+        const PdfObject* current = &node;
+        for (int depth = 0; current && current->IsDictionary() && depth < MaxParentDepth; ++depth) {
+            const PdfObject* value = current->GetDictionary().FindKey(key);
+            if (value) {
+                return value;
+            }
+            current = current->GetDictionary().FindKey("Parent");
+        }
+        return nullptr;
+    }
+
+    const PdfObject* FindXObject(const PdfDictionary* resources, const std::string& name) {
+        if (!resources) {
+            return nullptr;
+        }
+        const PdfObject* xobjects = resources->FindKey("XObject");
+        if (!xobjects || !xobjects->IsDictionary()) {
+            return nullptr;
+        }
+        const PdfObject* xobject = xobjects->GetDictionary().FindKey(name);
+        return xobject && xobject->IsDictionary() ? xobject : nullptr;
+    }
+
+    bool ReadMatrix(const PdfObject* obj, Matrix& matrix) {
+        if (!obj || !obj->IsArray() || obj->GetArray().GetSize() != 6) {
+            return false;
+        }
+        double values[6];
+        for (unsigned i = 0; i < 6; ++i) {
+            const PdfObject* item = obj->GetArray().FindAt(i);
+            if (!item || !item->IsNumberOrReal()) {
+                return false;
+            }
+            values[i] = item->GetReal();
+        }
+        matrix = { values[0], values[1], values[2], values[3], values[4], values[5] };
+        return true;
+    }
+
+    // Marks every image reachable from resources whose content is unreadable.
+    void BlockResources(const PdfDictionary* resources, ScanState& state, int depth) {
+        if (!resources || depth > MaxFormDepth) {
+            return;
+        }
+        const PdfObject* xobjects = resources->FindKey("XObject");
+        if (!xobjects || !xobjects->IsDictionary()) {
+            return;
+        }
+        for (const auto& entry : xobjects->GetDictionary()) {
+            const PdfObject* xobject = xobjects->GetDictionary().FindKey(entry.first);
+            if (!xobject || !xobject->IsDictionary()) {
+                continue;
+            }
+            const PdfObject* subtype = xobject->GetDictionary().FindKey("Subtype");
+            if (IsName(subtype, "Image")) {
+                state.blocked.insert(xobject);
+            }
+            else if (IsName(subtype, "Form")) {
+                const PdfObject* formResources = xobject->GetDictionary().FindKey("Resources");
+                BlockResources(formResources && formResources->IsDictionary()
+                    ? &formResources->GetDictionary() : nullptr, state, depth + 1);
+            }
+        }
+    }
+
+    void ScanContent(const std::string& content, const PdfDictionary* resources, const Matrix& base,
+        ScanState& state, int depth);
+
+    void ScanForm(const PdfObject& form, const PdfDictionary* parentResources, const Matrix& ctm,
+        ScanState& state, int depth) {
+        const PdfDictionary& dict = form.GetDictionary();
+        const PdfObject* formResources = dict.FindKey("Resources");
+        const PdfDictionary* resources = formResources && formResources->IsDictionary()
+            ? &formResources->GetDictionary() : parentResources;
+
+        if (depth > MaxFormDepth || !form.HasStream()) {
+            BlockResources(resources, state, 0);
+            return;
+        }
+
+        auto cached = state.forms.find(&form);
+        if (cached == state.forms.end()) {
+            std::string content;
+            try {
+                content = form.GetStream()->GetCopy();
+            }
+            catch (const PoDoFo::PdfError&) {
+                BlockResources(resources, state, 0);
+                return;
+            }
+            cached = state.forms.emplace(&form, std::move(content)).first;
+        }
+
+        Matrix matrix;
+        ReadMatrix(dict.FindKey("Matrix"), matrix);
+        ScanContent(cached->second, resources, Multiply(matrix, ctm), state, depth + 1);
+    }
+
+    void ScanContent(const std::string& content, const PdfDictionary* resources, const Matrix& base,
+        ScanState& state, int depth) {
+        ContentTokenizer tokenizer(content);
+        std::vector<Token> operands;
+        std::vector<Matrix> stack;
+        Matrix ctm = base;
+        Token token;
+
+        while (tokenizer.Next(token)) {
+            if (token.kind != Token::OPERATOR) {
+                operands.push_back(token);
+                continue;
+            }
+
+            if (token.text == "q") {
+                stack.push_back(ctm);
+            }
+            else if (token.text == "Q") {
+                if (!stack.empty()) {
+                    ctm = stack.back();
+                    stack.pop_back();
+                }
+            }
+            else if (token.text == "cm" && operands.size() >= 6) {
+                const Token* m = &operands[operands.size() - 6];
+                bool numeric = true;
+                for (int i = 0; i < 6; ++i) {
+                    numeric = numeric && m[i].kind == Token::NUMBER;
+                }
+                if (numeric) {
+                    Matrix matrix = { m[0].number, m[1].number, m[2].number, m[3].number, m[4].number, m[5].number };
+                    ctm = Multiply(matrix, ctm);
+                }
+            }
+            else if (token.text == "Do" && !operands.empty() && operands.back().kind == Token::NAME) {
+                const PdfObject* xobject = FindXObject(resources, operands.back().text);
+                const PdfObject* subtype = xobject ? xobject->GetDictionary().FindKey("Subtype") : nullptr;
+                if (IsName(subtype, "Image")) {
+                    // The image fills the unit square of the current space.
+                    Placement& placement = state.placements[xobject];
+                    placement.width = (std::max)(placement.width, std::hypot(ctm.a, ctm.b));
+                    placement.height = (std::max)(placement.height, std::hypot(ctm.c, ctm.d));
+                }
+                else if (IsName(subtype, "Form")) {
+                    ScanForm(*xobject, resources, ctm, state, depth);
+                }
+            }
+            else if (token.text == "BI") {
+                tokenizer.SkipInlineImage();
+            }
+
+            operands.clear();
+        }
+    }
+
+    void ScanPages(PoDoFo::PdfMemDocument& doc, ScanState& state) {
+        PoDoFo::PdfPageCollection& pages = doc.GetPages();
+        for (unsigned i = 0; i < pages.GetCount(); ++i) {
+            const PdfObject& page = pages.GetPageAt(i).GetObject();
+            const PdfObject* pageResources = FindInherited(page, "Resources");
+            const PdfDictionary* resources = pageResources && pageResources->IsDictionary()
+                ? &pageResources->GetDictionary() : nullptr;
+
+            std::vector<const PdfObject*> streams;
+            const PdfObject* contents = page.GetDictionary().FindKey("Contents");
+            if (contents && contents->IsArray()) {
+                for (unsigned j = 0; j < contents->GetArray().GetSize(); ++j) {
+                    streams.push_back(contents->GetArray().FindAt(j));
+                }
+            }
+            else if (contents) {
+                streams.push_back(contents);
+            }
+
+            // Content may be split between streams at any token boundary.
+            std::string content;
+            try {
+                for (const PdfObject* stream : streams) {
+                    if (stream && stream->HasStream()) {
+                        content += stream->GetStream()->GetCopy();
+                        content += '\n';
+                    }
+                }
+            }
+            catch (const PoDoFo::PdfError&) {
+                BlockResources(resources, state, 0);
+                continue;
+            }
+
+            ScanContent(content, resources, Matrix(), state, 0);
+        }
+    }
+
+    // Estimates the libjpeg quality setting from the luminance quantization
+    // table; -1 when the data has none.
+    int EstimateJpegQuality(const std::string& data) {
+        static const int StandardLuminance[64] = {
+            16, 11, 10, 16, 24, 40, 51, 61, 12, 12, 14, 19, 26, 58, 60, 55,
+            14, 13, 16, 24, 40, 57, 69, 56, 14, 17, 22, 29, 51, 87, 80, 62,
+            18, 22, 37, 56, 68, 109, 103, 77, 24, 35, 55, 64, 81, 104, 113, 92,
+            49, 64, 78, 87, 103, 121, 120, 101, 72, 92, 95, 98, 112, 100, 103, 99
+        };
+
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data.data());
+        size_t pos = 2;
+        if (data.size() < 4 || bytes[0] != 0xFF || bytes[1] != 0xD8) {
+            return -1;
+        }
+
+        while (pos + 4 <= data.size()) {
+            if (bytes[pos] != 0xFF) {
+                return -1;
+            }
+            unsigned char marker = bytes[pos + 1];
+            if (marker == 0xFF) {
+                ++pos;
+                continue;
+            }
+            if (marker == 0xDA) {
+                return -1;
+            }
+            size_t length = (static_cast<size_t>(bytes[pos + 2]) << 8) | bytes[pos + 3];
+            size_t end = pos + 2 + length;
+            if (length < 2 || end > data.size()) {
+                return -1;
+            }
+
+            for (size_t at = pos + 4; marker == 0xDB && at < end;) {
+                bool wide = (bytes[at] >> 4) != 0;
+                bool luminance = (bytes[at] & 0x0F) == 0;
+                size_t tableSize = wide ? 128 : 64;
+                if (at + 1 + tableSize > end) {
+                    return -1;
+                }
+                if (luminance) {
+                    if (wide) {
+                        return 100;
+                    }
+                    double sum = 0, standard = 0;
+                    for (int i = 0; i < 64; ++i) {
+                        sum += bytes[at + 1 + i];
+                        standard += StandardLuminance[i];
+                    }
+                    double scale = sum * 100.0 / standard;
+                    double quality = scale <= 100.0 ? (200.0 - scale) / 2.0 : 5000.0 / scale;
+                    return static_cast<int>((std::min)((std::max)(std::lround(quality), 1L), 100L));
+                }
+                at += 1 + tableSize;
+            }
+            pos = end;
+        }
+        return -1;
+    }
+
+    struct Job {
+        PdfObject* object = nullptr;
+        bool jpeg = false;
+        bool flate = false;
+        int components = 3;
+        unsigned width = 0;
+        unsigned height = 0;
+        unsigned targetWidth = 0;
+        unsigned targetHeight = 0;
+        std::string raw;
+        std::vector<unsigned char> encoded;
+        bool apply = false;
+    };
+
+    int ReadInt(const PdfDictionary& dict, const char* key) {
+        const PdfObject* value = dict.FindKey(key);
+        return value && value->IsNumber() ? static_cast<int>(value->GetNumber()) : 0;
+    }
+
+    // Fills the format part of the job; false for images left as they are.
+    bool IsEligible(const PdfObject& obj, Job& job) {
+        if (!obj.HasStream() || !obj.IsDictionary()) {
+            return false;
+        }
+        const PdfDictionary& dict = obj.GetDictionary();
+
+        const PdfObject* imageMask = dict.FindKey("ImageMask");
+        if (imageMask && imageMask->IsBool() && imageMask->GetBool()) {
+            return false;
+        }
+        if (dict.HasKey("SMask") || dict.HasKey("Mask") || dict.HasKey("Decode") ||
+            dict.HasKey("DecodeParms") || dict.HasKey("F")) {
+            return false;
+        }
+        if (ReadInt(dict, "BitsPerComponent") != 8) {
+            return false;
+        }
+
+        const PdfObject* colorSpace = dict.FindKey("ColorSpace");
+        if (IsName(colorSpace, "DeviceRGB")) {
+            job.components = 3;
+        }
+        else if (IsName(colorSpace, "DeviceGray")) {
+            job.components = 1;
+        }
+        else if (colorSpace && colorSpace->IsArray() && colorSpace->GetArray().GetSize() == 2 &&
+            IsName(colorSpace->GetArray().FindAt(0), "ICCBased")) {
+            // Kept as is, so only for profiles the JPEG matches: gray or RGB.
+            const PdfObject* profile = colorSpace->GetArray().FindAt(1);
+            int components = profile && profile->IsDictionary() ? ReadInt(profile->GetDictionary(), "N") : 0;
+            if (components != 1 && components != 3) {
+                return false;
+            }
+            job.components = components;
+        }
+        else {
+            return false;
+        }
+
+        const PdfObject* filter = dict.FindKey("Filter");
+        if (filter && filter->IsArray()) {
+            filter = filter->GetArray().GetSize() == 1 ? filter->GetArray().FindAt(0) : nullptr;
+            if (!filter) {
+                return false;
+            }
+        }
+        job.jpeg = IsName(filter, "DCTDecode");
+        job.flate = IsName(filter, "FlateDecode");
+        if (filter && !job.jpeg && !job.flate) {
+            return false;
+        }
+
+        int width = ReadInt(dict, "Width");
+        int height = ReadInt(dict, "Height");
+        if (width <= 0 || height <= 0) {
+            return false;
+        }
+        job.width = static_cast<unsigned>(width);
+        job.height = static_cast<unsigned>(height);
+        return true;
+    }
+
+    // Source pixels as a GDI+ bitmap. JPEGs are decoded by GDI+ from a
+    // memory stream that has to outlive the bitmap.
+    std::unique_ptr<Gdiplus::Bitmap> LoadSource(const Job& job, IStream*& stream) {
+        if (job.jpeg) {
+            if (CreateStreamOnHGlobal(nullptr, TRUE, &stream) != S_OK) {
+                return nullptr;
+            }
+            ULONG written = 0;
+            if (stream->Write(job.raw.data(), static_cast<ULONG>(job.raw.size()), &written) != S_OK ||
+                written != job.raw.size()) {
+                return nullptr;
+            }
+            LARGE_INTEGER liZero = {};
+            stream->Seek(liZero, STREAM_SEEK_SET, nullptr);
+            return std::unique_ptr<Gdiplus::Bitmap>(new Gdiplus::Bitmap(stream));
+        }
+
+        std::string decoded;
+        const std::string* pixels = &job.raw;
+        if (job.flate) {
+            if (!StreamFilters::Decode("FlateDecode", job.raw, decoded)) {
+                return nullptr;
+            }
+            pixels = &decoded;
+        }
+
+        size_t rowBytes = static_cast<size_t>(job.width) * job.components;
+        if (pixels->size() < rowBytes * job.height) {
+            return nullptr;
+        }
+
+        std::unique_ptr<Gdiplus::Bitmap> bitmap(new Gdiplus::Bitmap(
+            static_cast<INT>(job.width), static_cast<INT>(job.height), PixelFormat24bppRGB));
+        Gdiplus::Rect rect(0, 0, static_cast<INT>(job.width), static_cast<INT>(job.height));
+        Gdiplus::BitmapData data;
+        if (bitmap->GetLastStatus() != Gdiplus::Ok ||
+            bitmap->LockBits(&rect, Gdiplus::ImageLockModeWrite, PixelFormat24bppRGB, &data) != Gdiplus::Ok) {
+            return nullptr;
+        }
+
+        // PDF samples are R, G, B (or gray); GDI+ rows are B, G, R.
+        for (unsigned y = 0; y < job.height; ++y) {
+            const uint8_t* source = reinterpret_cast<const uint8_t*>(pixels->data()) + y * rowBytes;
+            uint8_t* target = static_cast<uint8_t*>(data.Scan0) + static_cast<ptrdiff_t>(y) * data.Stride;
+            for (unsigned x = 0; x < job.width; ++x) {
+                if (job.components == 3) {
+                    target[x * 3] = source[x * 3 + 2];
+                    target[x * 3 + 1] = source[x * 3 + 1];
+                    target[x * 3 + 2] = source[x * 3];
+                }
+                else {
+                    target[x * 3] = target[x * 3 + 1] = target[x * 3 + 2] = source[x];
+                }
+            }
+        }
+
+        bitmap->UnlockBits(&data);
+        return bitmap;
+    }
+
+    void Encode(Job& job, int quality) {
+        IStream* stream = nullptr;
+        {
+            std::unique_ptr<Gdiplus::Bitmap> source = LoadSource(job, stream);
+            if (source && source->GetLastStatus() == Gdiplus::Ok &&
+                source->GetWidth() == job.width && source->GetHeight() == job.height) {
+
+                Gdiplus::Bitmap target(static_cast<INT>(job.targetWidth), static_cast<INT>(job.targetHeight),
+                    PixelFormat24bppRGB);
+                Gdiplus::Status status;
+                {
+                    Gdiplus::Graphics graphics(&target);
+                    graphics.SetInterpolationMode(Gdiplus::InterpolationModeHighQualityBicubic);
+                    graphics.SetPixelOffsetMode(Gdiplus::PixelOffsetModeHalf);
+
+                    // Mirrored edges keep the bicubic filter from darkening the border.
+                    Gdiplus::ImageAttributes attributes;
+                    attributes.SetWrapMode(Gdiplus::WrapModeTileFlipXY);
+
+                    Gdiplus::Rect rect(0, 0, static_cast<INT>(job.targetWidth), static_cast<INT>(job.targetHeight));
+                    status = graphics.DrawImage(source.get(), rect, 0, 0, static_cast<INT>(job.width),
+                        static_cast<INT>(job.height), Gdiplus::UnitPixel, &attributes);
+                }
+
+                // Gray sources stay one channel; as RGB the JPEG would hardly
+                // ever be smaller than the original.
+                std::unique_ptr<Gdiplus::Bitmap> gray;
+                if (status == Gdiplus::Ok && job.components == 1) {
+                    gray.reset(ImageProcessor::ConvertToGray(target));
+                    status = gray ? Gdiplus::Ok : Gdiplus::GenericError;
+                }
+                if (status == Gdiplus::Ok && ImageProcessor::EncodeJpeg(gray ? *gray : target, quality, job.encoded)) {
+                    job.apply = job.encoded.size() < job.raw.size();
+                }
+            }
+        }
+        if (stream) {
+            stream->Release();
+        }
+    }
+}
+
+bool PdfImageOptimizer::Optimize(PoDoFo::PdfMemDocument& doc, const MergeOptions& options) {
+    try {
+        double targetDpi = options.imageTargetDpi;
+        int quality = (std::min)((std::max)(options.imageJpegQuality, 1), 100);
+        size_t threads = options.compressionThreads > 0
+            ? static_cast<size_t>(options.compressionThreads)
+            : ParallelFor::DefaultThreadCount();
+        threads = (std::min)(threads, MaxThreads);
+
+        ScanState state;
+        ScanPages(doc, state);
+
+        GdiplusManager::Instance().EnsureInitialized();
+
+        size_t examined = 0;
+        size_t encoded = 0;
+        uint64_t bytesBefore = 0;
+        uint64_t bytesAfter = 0;
+
+        std::vector<Job> batch;
+        size_t batchBytes = 0;
+
+        auto flush = [&]() {
+            ParallelFor::Run(batch.size(), threads, [&](size_t i) {
+                Encode(batch[i], quality);
+            });
+
+            // Written back on this thread in object order; SetData copies,
+            // so the encoded data goes back to the pool right after.
+            for (Job& job : batch) {
+                if (!job.apply) {
+                    BufferPool::Instance().Return(job.encoded);
+                    continue;
+                }
+                PdfDictionary& dict = job.object->GetDictionary();
+                job.object->GetStream()->SetData(PoDoFo::bufferview(
+                    reinterpret_cast<const char*>(job.encoded.data()), job.encoded.size()),
+                    { PoDoFo::PdfFilterType::DCTDecode }, true);
+                dict.AddKey(PoDoFo::PdfName("Width"), PdfObject(static_cast<int64_t>(job.targetWidth)));
+                dict.AddKey(PoDoFo::PdfName("Height"), PdfObject(static_cast<int64_t>(job.targetHeight)));
+                dict.RemoveKey("DL");
+
+                ++encoded;
+                bytesBefore += job.raw.size();
+                bytesAfter += job.encoded.size();
+                BufferPool::Instance().Return(job.encoded);
+            }
+
+            examined += batch.size();
+            batch.clear();
+            batchBytes = 0;
+        };
+
+        // Images in object order, so batches and the written objects do not
+        // depend on how the map hashes pointers.
+        std::vector<const PdfObject*> images;
+        images.reserve(state.placements.size());
+        for (const auto& entry : state.placements) {
+            images.push_back(entry.first);
+        }
+        std::sort(images.begin(), images.end(), [](const PdfObject* a, const PdfObject* b) {
+            return a->GetIndirectReference() < b->GetIndirectReference();
+            });
+
+        for (const PdfObject* image : images) {
+            PdfObject* obj = const_cast<PdfObject*>(image);
+            const Placement& placement = state.placements.at(image);
+            Job job;
+            if (state.blocked.count(obj) || placement.width <= 0 || placement.height <= 0 ||
+                !IsEligible(*obj, job)) {
+                continue;
+            }
+
+            // The largest placement needs the most pixels; both axes must
+            // stay at or above the target.
+            double dpi = (std::min)(job.width * 72.0 / placement.width, job.height * 72.0 / placement.height);
+            bool downsample = dpi > targetDpi * DownsampleThreshold;
+            double scale = downsample ? targetDpi / dpi : 1.0;
+            job.targetWidth = (std::max)(1u, static_cast<unsigned>(std::lround(job.width * scale)));
+            job.targetHeight = (std::max)(1u, static_cast<unsigned>(std::lround(job.height * scale)));
+
+            job.raw = obj->GetStream()->GetCopy(true);
+            if (job.raw.size() < MinImageBytes) {
+                continue;
+            }
+            if (!downsample && (!job.jpeg || EstimateJpegQuality(job.raw) <= quality + QualityMargin)) {
+                continue;
+            }
+
+            job.object = obj;
+            batchBytes += job.raw.size();
+            batch.push_back(std::move(job));
+
+            if (batchBytes >= BatchBytes) {
+                flush();
+            }
+        }
+        flush();
+
+        Logger::Debug("Image optimization (" + std::to_string(options.imageTargetDpi) + " dpi, quality " +
+            std::to_string(quality) + ", " + std::to_string(threads) + " thread(s)): " +
+            std::to_string(encoded) + "/" + std::to_string(examined) + " image(s) re-encoded, " +
+            std::to_string(bytesBefore) + " -> " + std::to_string(bytesAfter) + " bytes, " +
+            std::to_string(state.placements.size()) + " placed image(s)");
+        return true;
+    }
+    catch (const PoDoFo::PdfError& e) {
+        Logger::Error("Image optimization failed: PdfError code " + std::to_string(static_cast<int>(e.GetCode())));
+        return false;
+    }
+    catch (const std::exception& e) {
+        Logger::Error("Image optimization failed: " + std::string(e.what()));
+        return false;
+    }
+}
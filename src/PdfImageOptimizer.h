@@ -0,0 +1,24 @@
+#ifndef __PDF_IMAGE_OPTIMIZER_H__
+#define __PDF_IMAGE_OPTIMIZER_H__
+
+#include "MergeOptions.h"
+#include "podofo/podofo.h"
+
+// Downsamples and re-encodes the raster images of an input PDF before its
+// pages are appended, so that high resolution scans coming in as PDFs get
+// the same treatment as raster inputs.
+//
+// The effective resolution of an image is taken from the largest size it is
+// drawn at on any page (including through form XObjects). Images above
+// MergeOptions::imageTargetDpi are resampled to it and stored as JPEG at
+// imageJpegQuality; JPEGs at the right resolution are re-encoded only when
+// their own quality is clearly higher than the target. Images that are not
+// drawn by any page content, use masks, or have a pixel format other than
+// 8-bit gray/RGB are left as they are, as is any result that is not smaller
+// than the original. Gray images stay gray: one-channel JPEGs, DeviceGray.
+class PdfImageOptimizer {
+public:
+    static bool Optimize(PoDoFo::PdfMemDocument& doc, const MergeOptions& options);
+};
+
+#endif // __PDF_IMAGE_OPTIMIZER_H__
@@ -0,0 +1,238 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <unordered_set>
+#include "Logger.h"
+#include "ContentHash.h"
+#include "FileSystemUtils.h"
+#include "StreamFilters.h"
+#include "PdfOutputWriter.h"
+#include "PdfIncrementalWriter.h"
+
+namespace {
+
+    using PoDoFo::PdfObject;
+    using XRefEntry = PdfOutputWriter::XRefEntry;
+
+    std::string XRefLine(const XRefEntry& entry) {
+        char text[32];
+        std::snprintf(text, sizeof(text), "%010llu %05u %c \n",
+            static_cast<unsigned long long>(entry.field2), static_cast<unsigned>(entry.field3),
+            entry.type == 0 ? 'f' : 'n');
+        return text;
+    }
+
+    // Contiguous runs of object numbers as (first, count) pairs.
+    std::vector<std::pair<uint32_t, uint32_t>> Subsections(const std::map<uint32_t, XRefEntry>& entries) {
+        std::vector<std::pair<uint32_t, uint32_t>> runs;
+        for (const auto& entry : entries) {
+            if (!runs.empty() && runs.back().first + runs.back().second == entry.first) {
+                ++runs.back().second;
+            }
+            else {
+                runs.push_back({ entry.first, 1 });
+            }
+        }
+        return runs;
+    }
+}
+
+PdfIncrementalWriter::PdfIncrementalWriter(int compressionLevel)
+    : compressionLevel_(compressionLevel > 0 ? compressionLevel : 6) {
+}
+
+uint64_t PdfIncrementalWriter::GetBaseSize() const {
+    return baseSize_;
+}
+
+uint64_t PdfIncrementalWriter::HashObject(const PdfObject& obj, std::string& scratch) {
+    // Stream data is not compared: nothing in the merge rewrites the
+    // streams of objects that were already in the file.
+    scratch.clear();
+    PdfOutputWriter::AppendValue(obj, scratch);
+    return ContentHash::Hash64(scratch.data(), scratch.size());
+}
+
+bool PdfIncrementalWriter::Capture(PoDoFo::PdfMemDocument& doc, const std::string& path) {
+    try {
+        baseSize_ = FileSystemUtils::GetFileSize(path);
+        if (baseSize_ == 0) {
+            Logger::Error("Incremental update: cannot get size of " + path);
+            return false;
+        }
+
+        std::vector<char> tail;
+        uint64_t tailStart = baseSize_ > TAIL_SIZE ? baseSize_ - TAIL_SIZE : 0;
+        if (!FileSystemUtils::ReadFileRange(path, tailStart, static_cast<size_t>(baseSize_ - tailStart), tail)) {
+            return false;
+        }
+
+        std::string text(tail.begin(), tail.end());
+        size_t pos = text.rfind("startxref");
+        if (pos == std::string::npos) {
+            Logger::Error("Incremental update: startxref not found in " + path);
+            return false;
+        }
+        previousXref_ = std::strtoull(text.c_str() + pos + 9, nullptr, 10);
+        endsWithNewline_ = text.back() == '\n' || text.back() == '\r';
+
+        // A cross-reference stream starts with "N G obj", a table with "xref".
+        std::vector<char> head;
+        if (!FileSystemUtils::ReadFileRange(path, previousXref_, 4, head)) {
+            return false;
+        }
+        xrefStream_ = std::string(head.begin(), head.end()) != "xref";
+
+        const PoDoFo::PdfDictionary& trailer = doc.GetTrailer().GetDictionary();
+        if (trailer.HasKey("Encrypt")) {
+            Logger::Error("Incremental update: encrypted documents are not supported");
+            return false;
+        }
+
+        const PdfObject* size = trailer.GetKey("Size");
+        baseEntries_ = size && size->IsNumber() ? static_cast<uint32_t>(size->GetNumber()) : 0;
+
+        originalId_.clear();
+        const PdfObject* id = trailer.GetKey("ID");
+        if (id && id->IsArray() && id->GetArray().GetSize() > 0) {
+            PdfOutputWriter::AppendValue(id->GetArray()[0], originalId_);
+        }
+
+        snapshot_.clear();
+        std::string scratch;
+        for (PdfObject* obj : doc.GetObjects()) {
+            const PoDoFo::PdfReference& ref = obj->GetIndirectReference();
+            snapshot_[ref.ObjectNumber()] = { HashObject(*obj, scratch), ref.GenerationNumber() };
+            baseEntries_ = (std::max)(baseEntries_, ref.ObjectNumber() + 1);
+        }
+
+        Logger::Debug("Incremental update base: " + path + ", " + std::to_string(snapshot_.size()) +
+            " object(s), " + std::to_string(baseSize_) + " bytes, previous xref at " +
+            std::to_string(previousXref_) + (xrefStream_ ? " (stream)" : " (table)"));
+        return true;
+    }
+    catch (const PoDoFo::PdfError& e) {
+        Logger::Error("Incremental update: PdfError code " + std::to_string(static_cast<int>(e.GetCode())));
+        return false;
+    }
+    catch (const std::exception& e) {
+        Logger::Error("Incremental update: " + std::string(e.what()));
+        return false;
+    }
+}
+
+bool PdfIncrementalWriter::WriteUpdate(PoDoFo::PdfMemDocument& doc, std::string& output) {
+    try {
+        output.clear();
+        if (!endsWithNewline_) {
+            output += '\n';
+        }
+
+        std::map<uint32_t, XRefEntry> entries;
+        std::unordered_set<uint32_t> present;
+        std::string scratch;
+        size_t added = 0;
+        size_t changed = 0;
+
+        for (PdfObject* obj : doc.GetObjects()) {
+            const PoDoFo::PdfReference& ref = obj->GetIndirectReference();
+            present.insert(ref.ObjectNumber());
+
+            auto it = snapshot_.find(ref.ObjectNumber());
+            bool existing = it != snapshot_.end() && it->second.generation == ref.GenerationNumber();
+            if (existing && it->second.hash == HashObject(*obj, scratch)) {
+                continue;
+            }
+
+            entries[ref.ObjectNumber()] = { 1, baseSize_ + output.size(), ref.GenerationNumber() };
+            PdfOutputWriter::AppendIndirectObject(*obj, output);
+            if (existing) {
+                ++changed;
+            }
+            else {
+                ++added;
+            }
+        }
+
+        for (const auto& entry : snapshot_) {
+            if (!present.count(entry.first)) {
+                entries[entry.first] = { 0, 0, static_cast<uint32_t>(entry.second.generation + 1) };
+            }
+        }
+
+        if (entries.empty()) {
+            output.clear();
+            return true;
+        }
+
+        uint32_t size = (std::max)(baseEntries_, entries.rbegin()->first + 1);
+        uint64_t xrefOffset = baseSize_ + output.size();
+
+        std::string keys = "/Root " + PdfOutputWriter::FormatReference(
+            doc.GetCatalog().GetObject().GetIndirectReference());
+        const PdfObject* info = doc.GetTrailer().GetDictionary().GetKey("Info");
+        if (info && info->IsReference()) {
+            keys += " /Info " + PdfOutputWriter::FormatReference(info->GetReference());
+        }
+        char id[33];
+        std::snprintf(id, sizeof(id), "%016llX%016llX",
+            static_cast<unsigned long long>(ContentHash::Hash64(output.data(), output.size(), 0)),
+            static_cast<unsigned long long>(ContentHash::Hash64(output.data(), output.size(), 1)));
+        keys += " /ID [" + (originalId_.empty() ? "<" + std::string(id) + ">" : originalId_) + " <" + id + ">]";
+
+        if (!xrefStream_) {
+            output += "xref\n";
+            for (const auto& run : Subsections(entries)) {
+                output += std::to_string(run.first) + " " + std::to_string(run.second) + "\n";
+                for (uint32_t number = run.first; number < run.first + run.second; ++number) {
+                    output += XRefLine(entries[number]);
+                }
+            }
+            output += "trailer\n<< /Size " + std::to_string(size) + " /Prev " + std::to_string(previousXref_) +
+                " " + keys + " >>\n";
+        }
+        else {
+            uint32_t xrefNumber = size++;
+            entries[xrefNumber] = { 1, xrefOffset, 0 };
+
+            std::string index;
+            for (const auto& run : Subsections(entries)) {
+                index += (index.empty() ? "" : " ") + std::to_string(run.first) + " " + std::to_string(run.second);
+            }
+
+            std::vector<XRefEntry> list;
+            list.reserve(entries.size());
+            for (const auto& entry : entries) {
+                list.push_back(entry.second);
+            }
+
+            std::string table;
+            int width = PdfOutputWriter::EncodeXRefEntries(list, table);
+            std::string encoded;
+            if (!StreamFilters::Deflate(table.data(), table.size(), compressionLevel_, encoded)) {
+                Logger::Error("Failed to compress cross-reference stream");
+                return false;
+            }
+
+            output += std::to_string(xrefNumber) + " 0 obj\n<</Type /XRef /Size " + std::to_string(size) +
+                " /Index [" + index + "] /W [1 " + std::to_string(width) + " 2] /Prev " +
+                std::to_string(previousXref_) + " " + keys + " /Filter /FlateDecode /Length " +
+                std::to_string(encoded.size()) + ">>\nstream\n" + encoded + "\nendstream\nendobj\n";
+        }
+
+        output += "startxref\n" + std::to_string(xrefOffset) + "\n%%EOF\n";
+
+        Logger::Debug("Incremental update: " + std::to_string(added) + " new and " + std::to_string(changed) +
+            " changed object(s), " + std::to_string(output.size()) + " bytes");
+        return true;
+    }
+    catch (const PoDoFo::PdfError& e) {
+        Logger::Error("Incremental update failed: PdfError code " + std::to_string(static_cast<int>(e.GetCode())));
+        return false;
+    }
+    catch (const std::exception& e) {
+        Logger::Error("Incremental update failed: " + std::string(e.what()));
+        return false;
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef __PDF_INCREMENTAL_WRITER_H__
+#define __PDF_INCREMENTAL_WRITER_H__
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include "podofo/podofo.h"
+
+// Writes the changes made to a document loaded from an existing file as a
+// PDF incremental update: only new and modified objects and a new
+// cross-reference section with /Prev pointing at the previous one. The
+// result is appended to the file, whose existing bytes stay untouched.
+//
+// The new section uses the same kind of cross-reference (table or stream)
+// as the section it extends.
+class PdfIncrementalWriter {
+public:
+    explicit PdfIncrementalWriter(int compressionLevel = 0);
+
+    // Records the document as loaded from `path`; call before changing it.
+    bool Capture(PoDoFo::PdfMemDocument& doc, const std::string& path);
+
+    // Serializes everything changed since Capture. An empty output means
+    // there is nothing to append.
+    bool WriteUpdate(PoDoFo::PdfMemDocument& doc, std::string& output);
+
+    uint64_t GetBaseSize() const;
+
+private:
+    struct Snapshot {
+        uint64_t hash;
+        uint16_t generation;
+    };
+
+    // Bytes read from the end of the file to find the last startxref.
+    static constexpr size_t TAIL_SIZE = 1024;
+
+    int compressionLevel_;
+    std::unordered_map<uint32_t, Snapshot> snapshot_;
+    uint64_t baseSize_ = 0;
+    uint64_t previousXref_ = 0;
+    uint32_t baseEntries_ = 0;
+    bool xrefStream_ = false;
+    bool endsWithNewline_ = true;
+    std::string originalId_;
+
+    static uint64_t HashObject(const PoDoFo::PdfObject& obj, std::string& scratch);
+};
+
+#endif // __PDF_INCREMENTAL_WRITER_H__
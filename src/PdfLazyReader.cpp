@@ -0,0 +1,1237 @@
+#include <algorithm>
+#include <cstdlib>
+#include <unordered_set>
+#include "Logger.h"
+#include "ParallelFor.h"
+#include "StreamFilters.h"
+#include "PdfLazyReader.h"
+
+namespace {
+
+    using PoDoFo::PdfObject;
+    using PoDoFo::PdfDictionary;
+
+    // startxref is searched for in the last bytes of the file.
+    constexpr size_t TailSize = 1024;
+    constexpr int MaxNesting = 64;
+    constexpr int MaxXRefSections = 512;
+    constexpr int MaxTreeDepth = 64;
+    // Cross-reference streams larger than this are treated as damaged.
+    constexpr uint32_t MaxObjectNumber = 8 * 1024 * 1024;
+    // Objects handed to a parse worker at a time; most are a few dozen bytes.
+    constexpr size_t ParseBatchSize = 256;
+
+    bool IsWhitespace(char c) {
+        return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\f' || c == '\0';
+    }
+
+    bool IsDelimiter(char c) {
+        return IsWhitespace(c) || c == '(' || c == ')' || c == '<' || c == '>' ||
+            c == '[' || c == ']' || c == '{' || c == '}' || c == '/' || c == '%';
+    }
+
+    int HexValue(char c) {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+
+    // Object syntax parser over a byte range. Values come back as PoDoFo
+    // objects that belong to no document; references are kept as they are.
+    class Lexer {
+    public:
+        Lexer(const char* data, size_t size, size_t pos = 0) : data_(data), size_(size), pos_(pos) {}
+
+        size_t Position() const { return pos_; }
+
+        void SkipWhitespace() {
+            while (pos_ < size_) {
+                if (data_[pos_] == '%') {
+                    while (pos_ < size_ && data_[pos_] != '\n' && data_[pos_] != '\r') {
+                        ++pos_;
+                    }
+                }
+                else if (IsWhitespace(data_[pos_])) {
+                    ++pos_;
+                }
+                else {
+                    break;
+                }
+            }
+        }
+
+        // A run of regular characters (keyword or number).
+        bool ReadToken(std::string& token) {
+            SkipWhitespace();
+            token.clear();
+            while (pos_ < size_ && !IsDelimiter(data_[pos_])) {
+                token += data_[pos_++];
+            }
+            return !token.empty();
+        }
+
+        bool ReadKeyword(const char* keyword) {
+            size_t start = pos_;
+            std::string token;
+            if (ReadToken(token) && token == keyword) {
+                return true;
+            }
+            pos_ = start;
+            return false;
+        }
+
+        bool ReadUnsigned(uint64_t& value) {
+            size_t start = pos_;
+            std::string token;
+            if (!ReadToken(token) || token.find_first_not_of("0123456789") != std::string::npos) {
+                pos_ = start;
+                return false;
+            }
+            value = std::strtoull(token.c_str(), nullptr, 10);
+            return true;
+        }
+
+        bool ReadValue(PdfObject& value, int depth = 0) {
+            if (depth > MaxNesting) {
+                return false;
+            }
+            SkipWhitespace();
+            if (pos_ >= size_) {
+                return false;
+            }
+
+            char c = data_[pos_];
+            if (c == '/') {
+                std::string name;
+                ReadName(name);
+                value = PdfObject(PoDoFo::PdfName(name));
+                return true;
+            }
+            if (c == '(') {
+                std::string text;
+                if (!ReadLiteralString(text)) {
+                    return false;
+                }
+                value = PdfObject(PoDoFo::PdfString::FromRaw(PoDoFo::bufferview(text.data(), text.size()), false));
+                return true;
+            }
+            if (c == '<' && pos_ + 1 < size_ && data_[pos_ + 1] == '<') {
+                pos_ += 2;
+                PdfDictionary dict;
+                for (;;) {
+                    SkipWhitespace();
+                    if (pos_ + 1 < size_ && data_[pos_] == '>' && data_[pos_ + 1] == '>') {
+                        pos_ += 2;
+                        break;
+                    }
+                    if (pos_ >= size_ || data_[pos_] != '/') {
+                        return false;
+                    }
+                    std::string key;
+                    ReadName(key);
+                    PdfObject item;
+                    if (!ReadValue(item, depth + 1)) {
+                        return false;
+                    }
+                    // A null value is the same as an absent key.
+                    if (!item.IsNull()) {
+                        dict.AddKey(PoDoFo::PdfName(key), item);
+                    }
+                }
+                value = PdfObject(dict);
+                return true;
+            }
+            if (c == '<') {
+                std::string bytes;
+                if (!ReadHexString(bytes)) {
+                    return false;
+                }
+                value = PdfObject(PoDoFo::PdfString::FromRaw(PoDoFo::bufferview(bytes.data(), bytes.size()), true));
+                return true;
+            }
+            if (c == '[') {
+                ++pos_;
+                PoDoFo::PdfArray array;
+                for (;;) {
+                    SkipWhitespace();
+                    if (pos_ < size_ && data_[pos_] == ']') {
+                        ++pos_;
+                        break;
+                    }
+                    PdfObject item;
+                    if (!ReadValue(item, depth + 1)) {
+                        return false;
+                    }
+                    array.Add(item);
+                }
+                value = PdfObject(array);
+                return true;
+            }
+            if ((c >= '0' && c <= '9') || c == '+' || c == '-' || c == '.') {
+                return ReadNumberOrReference(value);
+            }
+
+            std::string token;
+            if (!ReadToken(token)) {
+                return false;
+            }
+            if (token == "true" || token == "false") {
+                value = PdfObject(token == "true");
+                return true;
+            }
+            if (token == "null") {
+                value = PdfObject::Null;
+                return true;
+            }
+            return false;
+        }
+
+    private:
+        const char* data_;
+        size_t size_;
+        size_t pos_;
+
+        void ReadName(std::string& name) {
+            ++pos_;
+            name.clear();
+            while (pos_ < size_ && !IsDelimiter(data_[pos_])) {
+                if (data_[pos_] == '#' && pos_ + 2 < size_ &&
+                    HexValue(data_[pos_ + 1]) >= 0 && HexValue(data_[pos_ + 2]) >= 0) {
+                    name += static_cast<char>(HexValue(data_[pos_ + 1]) * 16 + HexValue(data_[pos_ + 2]));
+                    pos_ += 3;
+                }
+                else {
+                    name += data_[pos_++];
+                }
+            }
+        }
+
+        bool ReadLiteralString(std::string& text) {
+            ++pos_;
+            int depth = 1;
+            while (pos_ < size_) {
+                char c = data_[pos_++];
+                if (c == '(') {
+                    ++depth;
+                }
+                else if (c == ')' && --depth == 0) {
+                    return true;
+                }
+                else if (c == '\r') {
+                    // End of line inside a string reads as a single \n.
+                    if (pos_ < size_ && data_[pos_] == '\n') {
+                        ++pos_;
+                    }
+                    c = '\n';
+                }
+                else if (c == '\\' && pos_ < size_) {
+                    c = data_[pos_++];
+                    switch (c) {
+                    case 'n': c = '\n'; break;
+                    case 'r': c = '\r'; break;
+                    case 't': c = '\t'; break;
+                    case 'b': c = '\b'; break;
+                    case 'f': c = '\f'; break;
+                    case '\r':
+                        if (pos_ < size_ && data_[pos_] == '\n') {
+                            ++pos_;
+                        }
+                        continue;
+                    case '\n':
+                        continue;
+                    default:
+                        if (c >= '0' && c <= '7') {
+                            int code = c - '0';
+                            for (int i = 0; i < 2 && pos_ < size_ && data_[pos_] >= '0' && data_[pos_] <= '7'; ++i) {
+                                code = code * 8 + (data_[pos_++] - '0');
+                            }
+                            c = static_cast<char>(code & 0xFF);
+                        }
+                        break;
+                    }
+                }
+                text += c;
+            }
+            return false;
+        }
+
+        bool ReadHexString(std::string& bytes) {
+            ++pos_;
+            int high = -1;
+            while (pos_ < size_ && data_[pos_] != '>') {
+                int digit = HexValue(data_[pos_++]);
+                if (digit < 0) {
+                    continue;
+                }
+                if (high < 0) {
+                    high = digit;
+                }
+                else {
+                    bytes += static_cast<char>(high * 16 + digit);
+                    high = -1;
+                }
+            }
+            if (pos_ >= size_) {
+                return false;
+            }
+            ++pos_;
+            if (high >= 0) {
+                bytes += static_cast<char>(high * 16);
+            }
+            return true;
+        }
+
+        bool ReadNumberOrReference(PdfObject& value) {
+            std::string token;
+            ReadToken(token);
+            if (token.find('.') != std::string::npos) {
+                value = PdfObject(std::strtod(token.c_str(), nullptr));
+                return true;
+            }
+            value = PdfObject(static_cast<int64_t>(std::strtoll(token.c_str(), nullptr, 10)));
+
+            // "N G R" is a reference; anything else leaves the integer alone.
+            size_t after = pos_;
+            uint64_t generation = 0;
+            if (token[0] != '+' && token[0] != '-' && ReadUnsigned(generation) && ReadKeyword("R")) {
+                value = PdfObject(PoDoFo::PdfReference(static_cast<uint32_t>(std::strtoul(token.c_str(), nullptr, 10)),
+                    static_cast<uint16_t>(generation)));
+                return true;
+            }
+            pos_ = after;
+            return true;
+        }
+    };
+
+    int64_t GetInt(const PdfDictionary& dict, const char* key, int64_t fallback) {
+        const PdfObject* value = dict.GetKey(key);
+        return value && value->IsNumber() ? value->GetNumber() : fallback;
+    }
+
+    // Reverses the PNG predictors (10-15) used by cross-reference and
+    // object streams.
+    bool UndoPngPredictor(const std::string& input, size_t columns, size_t bytesPerPixel, std::string& output) {
+        size_t rowSize = columns * bytesPerPixel;
+        if (rowSize == 0) {
+            return false;
+        }
+        output.clear();
+        output.reserve(input.size());
+        std::string previous(rowSize, '\0');
+        std::string row(rowSize, '\0');
+
+        for (size_t pos = 0; pos + 1 + rowSize <= input.size(); pos += 1 + rowSize) {
+            unsigned char type = static_cast<unsigned char>(input[pos]);
+            const unsigned char* source = reinterpret_cast<const unsigned char*>(input.data() + pos + 1);
+            unsigned char* current = reinterpret_cast<unsigned char*>(&row[0]);
+            const unsigned char* above = reinterpret_cast<const unsigned char*>(previous.data());
+
+            for (size_t i = 0; i < rowSize; ++i) {
+                int left = i >= bytesPerPixel ? current[i - bytesPerPixel] : 0;
+                int up = above[i];
+                int upLeft = i >= bytesPerPixel ? above[i - bytesPerPixel] : 0;
+                int predicted = 0;
+                switch (type) {
+                case 0: predicted = 0; break;
+                case 1: predicted = left; break;
+                case 2: predicted = up; break;
+                case 3: predicted = (left + up) / 2; break;
+                case 4: {
+                    int p = left + up - upLeft;
+                    int pa = std::abs(p - left), pb = std::abs(p - up), pc = std::abs(p - upLeft);
+                    predicted = pa <= pb && pa <= pc ? left : pb <= pc ? up : upLeft;
+                    break;
+                }
+                default:
+                    return false;
+                }
+                current[i] = static_cast<unsigned char>(source[i] + predicted);
+            }
+            output += row;
+            previous.swap(row);
+        }
+        return true;
+    }
+    void CollectReferences(const PdfObject& value, std::vector<uint32_t>& pending) {
+        if (value.IsReference()) {
+            pending.push_back(value.GetReference().ObjectNumber());
+        }
+        else if (value.IsArray()) {
+            for (const PdfObject& item : value.GetArray()) {
+                CollectReferences(item, pending);
+            }
+        }
+        else if (value.IsDictionary()) {
+            for (const auto& entry : value.GetDictionary()) {
+                CollectReferences(entry.second, pending);
+            }
+        }
+    }
+
+    // Copies a parsed value into the output document's numbering.
+    class ValueConverter {
+    public:
+        std::unordered_map<uint32_t, PoDoFo::PdfReference> mapped;
+        // Indirect scalars (lengths, counts) are written in place.
+        std::unordered_map<uint32_t, const PdfObject*> inlined;
+
+        PdfObject Convert(const PdfObject& value, int depth = 0) const {
+            if (depth > MaxNesting) {
+                return PdfObject::Null;
+            }
+            if (value.IsReference()) {
+                uint32_t number = value.GetReference().ObjectNumber();
+                auto target = mapped.find(number);
+                if (target != mapped.end()) {
+                    return PdfObject(target->second);
+                }
+                auto scalar = inlined.find(number);
+                return scalar != inlined.end() ? Convert(*scalar->second, depth + 1) : PdfObject::Null;
+            }
+            if (value.IsArray()) {
+                PoDoFo::PdfArray array;
+                for (const PdfObject& item : value.GetArray()) {
+                    array.Add(Convert(item, depth + 1));
+                }
+                return PdfObject(array);
+            }
+            if (value.IsDictionary()) {
+                PdfDictionary dict;
+                for (const auto& entry : value.GetDictionary()) {
+                    PdfObject item = Convert(entry.second, depth + 1);
+                    if (!item.IsNull()) {
+                        dict.AddKey(entry.first, item);
+                    }
+                }
+                return PdfObject(dict);
+            }
+            return value;
+        }
+    };
+
+    bool IsTreeNode(const PdfObject& value) {
+        if (!value.IsDictionary()) {
+            return false;
+        }
+        const PdfObject* type = value.GetDictionary().GetKey("Type");
+        return type && type->IsName() && (type->GetName() == "Pages" || type->GetName() == "Catalog");
+    }
+
+    // Takes out what a failed AppendPages() added: the pages beyond
+    // pageCount and the objects created for them.
+    bool RemoveAppended(PoDoFo::PdfMemDocument& doc, unsigned pageCount,
+        const std::vector<PoDoFo::PdfReference>& created) {
+        try {
+            PoDoFo::PdfPageCollection& pages = doc.GetPages();
+            while (pages.GetCount() > pageCount) {
+                pages.RemovePageAt(pages.GetCount() - 1);
+            }
+            for (const PoDoFo::PdfReference& ref : created) {
+                doc.GetObjects().RemoveObject(ref, false);
+            }
+            return true;
+        }
+        catch (const PoDoFo::PdfError& e) {
+            Logger::Error("Lazy reader: cannot remove the pages of a failed append, PdfError code " +
+                std::to_string(static_cast<int>(e.GetCode())));
+            return false;
+        }
+    }
+}
+
+PdfLazyReader::PdfLazyReader() = default;
+PdfLazyReader::~PdfLazyReader() = default;
+
+bool PdfLazyReader::Open(const std::string& filePath) {
+    if (!file_.Open(filePath)) {
+        return false;
+    }
+    data_ = file_.Data();
+    size_ = file_.Size();
+    return Load();
+}
+
+bool PdfLazyReader::Open(const char* data, size_t size) {
+    file_.Close();
+    data_ = data;
+    size_ = size;
+    return Load();
+}
+
+const std::vector<PdfLazyReader::Page>& PdfLazyReader::GetPages() const {
+    return pages_;
+}
+
+bool PdfLazyReader::IsDocumentNode(uint32_t number) const {
+    return number < documentNodes_.size() && documentNodes_[number];
+}
+
+size_t PdfLazyReader::GetPageCount() const {
+    return pages_.size();
+}
+
+size_t PdfLazyReader::GetObjectCount() const {
+    return xref_.size();
+}
+
+size_t PdfLazyReader::GetParsedObjectCount() const {
+    return objects_.size();
+}
+
+bool PdfLazyReader::Load() {
+    try {
+        xref_.clear();
+        pages_.clear();
+        documentNodes_.clear();
+        objects_.clear();
+        objectStreams_.clear();
+
+        if (!ReadXRef()) {
+            return false;
+        }
+
+        const PdfDictionary& trailer = trailer_.GetDictionary();
+        if (trailer.HasKey("Encrypt")) {
+            Logger::Debug("Lazy reader: encrypted document");
+            return false;
+        }
+
+        const PdfObject* root = trailer.GetKey("Root");
+        const PdfObject* catalog = root && root->IsReference() ? Dereference(root) : nullptr;
+        const PdfObject* pages = catalog && catalog->IsDictionary() ? catalog->GetDictionary().GetKey("Pages") : nullptr;
+        if (!pages || !pages->IsReference()) {
+            Logger::Debug("Lazy reader: no page tree");
+            return false;
+        }
+
+        documentNodes_.assign(xref_.size(), false);
+        if (root->GetReference().ObjectNumber() < xref_.size()) {
+            documentNodes_[root->GetReference().ObjectNumber()] = true;
+        }
+
+        std::vector<bool> visited(xref_.size(), false);
+        if (!ReadPageTree(pages->GetReference().ObjectNumber(), Page(), 0, visited)) {
+            Logger::Debug("Lazy reader: damaged page tree");
+            return false;
+        }
+        return !pages_.empty();
+    }
+    catch (const PoDoFo::PdfError& e) {
+        Logger::Debug("Lazy reader: PdfError code " + std::to_string(static_cast<int>(e.GetCode())));
+        return false;
+    }
+    catch (const std::exception& e) {
+        Logger::Debug("Lazy reader: " + std::string(e.what()));
+        return false;
+    }
+}
+
+bool PdfLazyReader::ReadXRef() {
+    size_t tailStart = size_ > TailSize ? size_ - TailSize : 0;
+    std::string tail(data_ + tailStart, size_ - tailStart);
+    size_t pos = tail.rfind("startxref");
+    if (pos == std::string::npos) {
+        Logger::Debug("Lazy reader: startxref not found");
+        return false;
+    }
+    uint64_t offset = std::strtoull(tail.c_str() + pos + 9, nullptr, 10);
+
+    known_.clear();
+    std::vector<uint64_t> visited;
+    bool first = true;
+
+    for (int section = 0; section < MaxXRefSections; ++section) {
+        if (offset == 0 || offset >= size_ ||
+            std::find(visited.begin(), visited.end(), offset) != visited.end()) {
+            break;
+        }
+        visited.push_back(offset);
+
+        // Newer sections come first; SetEntry keeps the first entry it sees.
+        Lexer lexer(data_, size_, static_cast<size_t>(offset));
+        PdfObject trailer;
+        bool table = lexer.ReadKeyword("xref");
+        if (table ? !ReadXRefTable(lexer.Position(), trailer) : !ReadXRefStream(static_cast<size_t>(offset), trailer)) {
+            return false;
+        }
+        if (!trailer.IsDictionary()) {
+            return false;
+        }
+
+        // Hybrid files: the stream lists the objects a table reader skips.
+        const PdfObject* xrefStream = trailer.GetDictionary().GetKey("XRefStm");
+        if (table && xrefStream && xrefStream->IsNumber()) {
+            PdfObject ignored;
+            if (!ReadXRefStream(static_cast<size_t>(xrefStream->GetNumber()), ignored)) {
+                return false;
+            }
+        }
+
+        if (first) {
+            trailer_ = trailer;
+            first = false;
+        }
+
+        const PdfObject* prev = trailer.GetDictionary().GetKey("Prev");
+        offset = prev && prev->IsNumber() ? static_cast<uint64_t>(prev->GetNumber()) : 0;
+    }
+
+    // /Size bounds the valid object numbers.
+    int64_t size = GetInt(trailer_.GetDictionary(), "Size", 0);
+    if (size > 0 && static_cast<size_t>(size) < xref_.size()) {
+        xref_.resize(static_cast<size_t>(size));
+    }
+    return !first && !xref_.empty();
+}
+
+void PdfLazyReader::SetEntry(uint32_t number, const XRefEntry& entry) {
+    if (number >= known_.size()) {
+        known_.resize(number + 1, false);
+        xref_.resize(number + 1);
+    }
+    if (!known_[number]) {
+        known_[number] = true;
+        xref_[number] = entry;
+    }
+}
+
+bool PdfLazyReader::ReadXRefTable(size_t offset, PdfObject& trailer) {
+    Lexer lexer(data_, size_, offset);
+
+    for (;;) {
+        if (lexer.ReadKeyword("trailer")) {
+            return lexer.ReadValue(trailer) && trailer.IsDictionary();
+        }
+
+        uint64_t start = 0, count = 0;
+        if (!lexer.ReadUnsigned(start) || !lexer.ReadUnsigned(count) || start + count > MaxObjectNumber) {
+            return false;
+        }
+        for (uint64_t i = 0; i < count; ++i) {
+            uint64_t field1 = 0, field2 = 0;
+            std::string kind;
+            if (!lexer.ReadUnsigned(field1) || !lexer.ReadUnsigned(field2) || !lexer.ReadToken(kind) ||
+                (kind != "n" && kind != "f")) {
+                return false;
+            }
+            XRefEntry entry;
+            entry.type = kind == "n" ? 1 : 0;
+            entry.offset = kind == "n" ? field1 : 0;
+            entry.generation = static_cast<uint16_t>(field2);
+            SetEntry(static_cast<uint32_t>(start + i), entry);
+        }
+    }
+}
+
+bool PdfLazyReader::ReadXRefStream(size_t offset, PdfObject& trailer) {
+    Object stream;
+    if (!ParseIndirect(offset, 0, stream) || !stream.hasStream || !stream.value.IsDictionary()) {
+        return false;
+    }
+    const PdfDictionary& dict = stream.value.GetDictionary();
+    const PdfObject* type = dict.GetKey("Type");
+    const PdfObject* widths = dict.GetKey("W");
+    if (!type || !type->IsName() || type->GetName() != "XRef" || !widths || !widths->IsArray() ||
+        widths->GetArray().GetSize() != 3) {
+        return false;
+    }
+
+    size_t w[3];
+    for (unsigned i = 0; i < 3; ++i) {
+        const PdfObject& width = widths->GetArray()[i];
+        if (!width.IsNumber() || width.GetNumber() < 0 || width.GetNumber() > 8) {
+            return false;
+        }
+        w[i] = static_cast<size_t>(width.GetNumber());
+    }
+    size_t entrySize = w[0] + w[1] + w[2];
+
+    std::string table;
+    if (entrySize == 0 || !DecodeStream(dict, stream.streamData, stream.streamSize, table)) {
+        return false;
+    }
+
+    std::vector<std::pair<uint64_t, uint64_t>> sections;
+    const PdfObject* index = dict.GetKey("Index");
+    if (index && index->IsArray()) {
+        const PoDoFo::PdfArray& items = index->GetArray();
+        for (unsigned i = 0; i + 1 < items.GetSize(); i += 2) {
+            if (!items[i].IsNumber() || !items[i + 1].IsNumber()) {
+                return false;
+            }
+            sections.push_back({ static_cast<uint64_t>(items[i].GetNumber()), static_cast<uint64_t>(items[i + 1].GetNumber()) });
+        }
+    }
+    else {
+        sections.push_back({ 0, static_cast<uint64_t>(GetInt(dict, "Size", 0)) });
+    }
+
+    auto field = [&](size_t pos, size_t width, uint64_t fallback) {
+        if (width == 0) {
+            return fallback;
+        }
+        uint64_t value = 0;
+        for (size_t i = 0; i < width; ++i) {
+            value = (value << 8) | static_cast<unsigned char>(table[pos + i]);
+        }
+        return value;
+    };
+
+    size_t pos = 0;
+    for (const auto& section : sections) {
+        if (section.first + section.second > MaxObjectNumber) {
+            return false;
+        }
+        for (uint64_t i = 0; i < section.second; ++i, pos += entrySize) {
+            if (pos + entrySize > table.size()) {
+                return false;
+            }
+            XRefEntry entry;
+            entry.type = static_cast<uint8_t>(field(pos, w[0], 1));
+            uint64_t second = field(pos + w[0], w[1], 0);
+            uint64_t third = field(pos + w[0] + w[1], w[2], 0);
+            if (entry.type == 1) {
+                entry.offset = second;
+                entry.generation = static_cast<uint16_t>(third);
+            }
+            else if (entry.type == 2) {
+                entry.offset = second;
+                entry.index = static_cast<uint32_t>(third);
+            }
+            else {
+                // Type 0 and unknown types read as free.
+                entry.type = 0;
+            }
+            SetEntry(static_cast<uint32_t>(section.first + i), entry);
+        }
+    }
+
+    trailer = stream.value;
+    return true;
+}
+
+bool PdfLazyReader::ParseIndirect(size_t offset, uint32_t number, Object& object) const {
+    Lexer lexer(data_, size_, offset);
+    uint64_t objectNumber = 0, generation = 0;
+    if (offset >= size_ || !lexer.ReadUnsigned(objectNumber) || !lexer.ReadUnsigned(generation) ||
+        !lexer.ReadKeyword("obj") || (number != 0 && objectNumber != number)) {
+        return false;
+    }
+    lexer.SkipWhitespace();
+    size_t textStart = lexer.Position();
+    if (!lexer.ReadValue(object.value)) {
+        return false;
+    }
+    object.text = data_ + textStart;
+    object.textSize = lexer.Position() - textStart;
+
+    object.hasStream = false;
+    if (!object.value.IsDictionary() || !lexer.ReadKeyword("stream")) {
+        return true;
+    }
+
+    // The keyword is followed by CRLF or LF (a lone CR is tolerated).
+    size_t start = lexer.Position();
+    if (start < size_ && data_[start] == '\r') {
+        ++start;
+    }
+    if (start < size_ && data_[start] == '\n') {
+        ++start;
+    }
+
+    size_t length = SIZE_MAX;
+    const PdfObject* lengthValue = object.value.GetDictionary().GetKey("Length");
+    if (lengthValue && lengthValue->IsNumber() && lengthValue->GetNumber() >= 0) {
+        length = static_cast<size_t>(lengthValue->GetNumber());
+    }
+    else if (lengthValue && lengthValue->IsReference()) {
+        uint32_t lengthNumber = lengthValue->GetReference().ObjectNumber();
+        Object lengthObject;
+        if (lengthNumber < xref_.size() && lengthNumber != number && xref_[lengthNumber].type == 1 &&
+            ParseIndirect(static_cast<size_t>(xref_[lengthNumber].offset), lengthNumber, lengthObject) &&
+            lengthObject.value.IsNumber() && lengthObject.value.GetNumber() >= 0) {
+            length = static_cast<size_t>(lengthObject.value.GetNumber());
+        }
+    }
+
+    bool valid = length != SIZE_MAX && length <= size_ - start;
+    if (valid) {
+        Lexer after(data_, size_, start + length);
+        valid = after.ReadKeyword("endstream");
+    }
+    if (!valid) {
+        // Wrong or unreadable /Length: the data ends before "endstream".
+        const char* end = std::search(data_ + start, data_ + size_, "endstream", "endstream" + 9);
+        if (end == data_ + size_) {
+            return false;
+        }
+        length = static_cast<size_t>(end - (data_ + start));
+        if (length > 0 && data_[start + length - 1] == '\n') {
+            --length;
+        }
+        if (length > 0 && data_[start + length - 1] == '\r') {
+            --length;
+        }
+    }
+
+    object.hasStream = true;
+    object.streamData = data_ + start;
+    object.streamSize = length;
+    return true;
+}
+
+const PdfLazyReader::ObjectStream* PdfLazyReader::GetObjectStream(uint32_t number) {
+    auto cached = objectStreams_.find(number);
+    if (cached != objectStreams_.end()) {
+        return cached->second.get();
+    }
+
+    std::unique_ptr<ObjectStream> stream = LoadObjectStream(number);
+    if (!stream) {
+        return nullptr;
+    }
+    const ObjectStream* result = stream.get();
+    objectStreams_[number] = std::move(stream);
+    return result;
+}
+
+std::unique_ptr<PdfLazyReader::ObjectStream> PdfLazyReader::LoadObjectStream(uint32_t number) const {
+    if (number >= xref_.size() || xref_[number].type != 1) {
+        return nullptr;
+    }
+    Object container;
+    if (!ParseIndirect(static_cast<size_t>(xref_[number].offset), number, container) || !container.hasStream) {
+        return nullptr;
+    }
+
+    const PdfDictionary& dict = container.value.GetDictionary();
+    int64_t count = GetInt(dict, "N", -1);
+    int64_t first = GetInt(dict, "First", -1);
+    std::unique_ptr<ObjectStream> stream(new ObjectStream());
+    if (count < 0 || first < 0 || !DecodeStream(dict, container.streamData, container.streamSize, stream->data) ||
+        static_cast<uint64_t>(first) > stream->data.size()) {
+        return nullptr;
+    }
+
+    Lexer header(stream->data.data(), static_cast<size_t>(first));
+    for (int64_t i = 0; i < count; ++i) {
+        uint64_t objectNumber = 0, offset = 0;
+        if (!header.ReadUnsigned(objectNumber) || !header.ReadUnsigned(offset) ||
+            static_cast<uint64_t>(first) + offset >= stream->data.size()) {
+            return nullptr;
+        }
+        stream->offsets.push_back({ static_cast<uint32_t>(objectNumber), static_cast<size_t>(first + offset) });
+    }
+    return stream;
+}
+
+bool PdfLazyReader::ParseCompressed(const ObjectStream& stream, uint32_t index, uint32_t number, Object& object) const {
+    if (index >= stream.offsets.size() || stream.offsets[index].first != number) {
+        return false;
+    }
+    Lexer lexer(stream.data.data(), stream.data.size(), stream.offsets[index].second);
+    lexer.SkipWhitespace();
+    size_t textStart = lexer.Position();
+    object.hasStream = false;
+    if (!lexer.ReadValue(object.value)) {
+        return false;
+    }
+    object.text = stream.data.data() + textStart;
+    object.textSize = lexer.Position() - textStart;
+    return true;
+}
+
+bool PdfLazyReader::ParseObject(uint32_t number, Object& object) {
+    const XRefEntry& entry = xref_[number];
+    if (entry.type == 1) {
+        return ParseIndirect(static_cast<size_t>(entry.offset), number, object);
+    }
+    if (entry.type == 2) {
+        const ObjectStream* stream = GetObjectStream(static_cast<uint32_t>(entry.offset));
+        return stream && ParseCompressed(*stream, entry.index, number, object);
+    }
+    object.value = PdfObject::Null;
+    object.hasStream = false;
+    return true;
+}
+
+void PdfLazyReader::ParseParallel(const std::vector<uint32_t>& numbers, size_t threads) {
+    std::vector<uint32_t> pending;
+    std::vector<uint32_t> streams;
+    std::unordered_set<uint32_t> streamSet;
+    for (uint32_t number : numbers) {
+        if (number >= xref_.size() || objects_.count(number)) {
+            continue;
+        }
+        pending.push_back(number);
+        uint32_t streamNumber = static_cast<uint32_t>(xref_[number].offset);
+        if (xref_[number].type == 2 && !objectStreams_.count(streamNumber) && streamSet.insert(streamNumber).second) {
+            streams.push_back(streamNumber);
+        }
+    }
+
+    // Object streams first, each decoded by one worker; the caches are only
+    // written on this thread, between the parallel steps.
+    std::vector<std::unique_ptr<ObjectStream>> decoded(streams.size());
+    ParallelFor::Run(streams.size(), threads, [&](size_t i) {
+        decoded[i] = LoadObjectStream(streams[i]);
+    });
+    for (size_t i = 0; i < streams.size(); ++i) {
+        if (decoded[i]) {
+            objectStreams_[streams[i]] = std::move(decoded[i]);
+        }
+    }
+
+    std::vector<std::unique_ptr<Object>> parsed(pending.size());
+    size_t batches = (pending.size() + ParseBatchSize - 1) / ParseBatchSize;
+    ParallelFor::Run(batches, threads, [&](size_t batch) {
+        size_t end = (std::min)((batch + 1) * ParseBatchSize, pending.size());
+        for (size_t i = batch * ParseBatchSize; i < end; ++i) {
+            const XRefEntry& entry = xref_[pending[i]];
+            std::unique_ptr<Object> object(new Object());
+            bool ok = true;
+            if (entry.type == 1) {
+                ok = ParseIndirect(static_cast<size_t>(entry.offset), pending[i], *object);
+            }
+            else if (entry.type == 2) {
+                auto stream = objectStreams_.find(static_cast<uint32_t>(entry.offset));
+                ok = stream != objectStreams_.end() && ParseCompressed(*stream->second, entry.index, pending[i], *object);
+            }
+            else {
+                object->value = PdfObject::Null;
+            }
+            if (ok) {
+                parsed[i] = std::move(object);
+            }
+        }
+    });
+
+    for (size_t i = 0; i < pending.size(); ++i) {
+        if (parsed[i]) {
+            objects_[pending[i]] = std::move(parsed[i]);
+        }
+    }
+}
+
+void PdfLazyReader::Preload(size_t threads) {
+    try {
+        // The same walk as AppendPages(): pages and what they reference,
+        // without following the catalog and the page tree.
+        std::vector<bool> seen(xref_.size(), false);
+        std::vector<uint32_t> level;
+        std::vector<uint32_t> references;
+        for (const Page& page : pages_) {
+            references.push_back(page.number);
+            for (const PdfObject* value : { page.resources, page.mediaBox, page.cropBox, page.rotate }) {
+                if (value) {
+                    CollectReferences(*value, references);
+                }
+            }
+        }
+
+        size_t levels = 0;
+        size_t before = objects_.size();
+        while (!references.empty()) {
+            level.clear();
+            for (uint32_t number : references) {
+                if (number < seen.size() && !seen[number] && !IsDocumentNode(number)) {
+                    seen[number] = true;
+                    level.push_back(number);
+                }
+            }
+            references.clear();
+
+            ParseParallel(level, threads);
+            ++levels;
+
+            for (uint32_t number : level) {
+                auto object = objects_.find(number);
+                if (object != objects_.end() && !IsTreeNode(object->second->value)) {
+                    CollectReferences(object->second->value, references);
+                }
+            }
+        }
+
+        Logger::Debug("Lazy reader: " + std::to_string(objects_.size() - before) + " object(s) preloaded in " +
+            std::to_string(levels) + " level(s)");
+    }
+    catch (const PoDoFo::PdfError& e) {
+        // Whatever is missing is parsed on demand.
+        Logger::Debug("Lazy reader: preload stopped, PdfError code " + std::to_string(static_cast<int>(e.GetCode())));
+    }
+    catch (const std::exception& e) {
+        Logger::Debug("Lazy reader: preload stopped, " + std::string(e.what()));
+    }
+}
+
+const PdfLazyReader::Object* PdfLazyReader::Resolve(uint32_t number) {
+    auto cached = objects_.find(number);
+    if (cached != objects_.end()) {
+        return cached->second.get();
+    }
+
+    std::unique_ptr<Object> object(new Object());
+    if (number >= xref_.size()) {
+        object->value = PdfObject::Null;
+    }
+    else if (!ParseObject(number, *object)) {
+        Logger::Debug("Lazy reader: cannot parse object " + std::to_string(number));
+        return nullptr;
+    }
+
+    const Object* result = object.get();
+    objects_[number] = std::move(object);
+    return result;
+}
+
+const PdfObject* PdfLazyReader::Dereference(const PdfObject* value) {
+    for (int depth = 0; value && value->IsReference() && depth < MaxNesting; ++depth) {
+        const Object* object = Resolve(value->GetReference().ObjectNumber());
+        value = object ? &object->value : nullptr;
+    }
+    return value && !value->IsReference() ? value : nullptr;
+}
+
+bool PdfLazyReader::DecodeStream(const PdfDictionary& dict, const char* data, size_t size, std::string& output) const {
+    std::vector<std::string> filters;
+    std::vector<const PdfObject*> parms;
+
+    const PdfObject* filter = dict.GetKey("Filter");
+    const PdfObject* decodeParms = dict.GetKey("DecodeParms");
+    if (filter && filter->IsName()) {
+        filters.emplace_back(filter->GetName().GetString());
+        parms.push_back(decodeParms);
+    }
+    else if (filter && filter->IsArray()) {
+        for (unsigned i = 0; i < filter->GetArray().GetSize(); ++i) {
+            const PdfObject& item = filter->GetArray()[i];
+            if (!item.IsName()) {
+                return false;
+            }
+            filters.emplace_back(item.GetName().GetString());
+            parms.push_back(decodeParms && decodeParms->IsArray() && i < decodeParms->GetArray().GetSize()
+                ? &decodeParms->GetArray()[i] : nullptr);
+        }
+    }
+    else if (filter) {
+        return false;
+    }
+
+    output.assign(data, size);
+    std::string decoded;
+    for (size_t i = 0; i < filters.size(); ++i) {
+        if (!StreamFilters::Decode(filters[i], output, decoded)) {
+            return false;
+        }
+        output.swap(decoded);
+
+        const PdfObject* parm = parms[i];
+        if (!parm || !parm->IsDictionary()) {
+            continue;
+        }
+        int64_t predictor = GetInt(parm->GetDictionary(), "Predictor", 1);
+        if (predictor == 1) {
+            continue;
+        }
+        int64_t colors = GetInt(parm->GetDictionary(), "Colors", 1);
+        int64_t bits = GetInt(parm->GetDictionary(), "BitsPerComponent", 8);
+        int64_t columns = GetInt(parm->GetDictionary(), "Columns", 1);
+        // Only the byte-aligned PNG predictors that PDF writers use for
+        // cross-reference and object streams.
+        if (predictor < 10 || bits != 8 || colors < 1 || colors > 4 || columns < 1 ||
+            !UndoPngPredictor(output, static_cast<size_t>(columns), static_cast<size_t>(colors), decoded)) {
+            return false;
+        }
+        output.swap(decoded);
+    }
+    return true;
+}
+
+bool PdfLazyReader::ReadPageTree(uint32_t number, Page inherited, int depth, std::vector<bool>& visited) {
+    if (depth > MaxTreeDepth || number >= visited.size() || visited[number]) {
+        return false;
+    }
+    visited[number] = true;
+
+    const Object* node = Resolve(number);
+    if (!node || !node->value.IsDictionary()) {
+        return false;
+    }
+    const PdfDictionary& dict = node->value.GetDictionary();
+
+    if (const PdfObject* value = dict.GetKey("Resources")) inherited.resources = value;
+    if (const PdfObject* value = dict.GetKey("MediaBox")) inherited.mediaBox = value;
+    if (const PdfObject* value = dict.GetKey("CropBox")) inherited.cropBox = value;
+    if (const PdfObject* value = dict.GetKey("Rotate")) inherited.rotate = value;
+
+    const PdfObject* type = dict.GetKey("Type");
+    const PdfObject* kids = Dereference(dict.GetKey("Kids"));
+    bool isPages = (type && type->IsName() && type->GetName() == "Pages") || (!type && kids);
+    if (!isPages) {
+        inherited.number = number;
+        pages_.push_back(inherited);
+        return true;
+    }
+
+    if (!kids || !kids->IsArray()) {
+        return false;
+    }
+    documentNodes_[number] = true;
+    for (unsigned i = 0; i < kids->GetArray().GetSize(); ++i) {
+        const PdfObject& kid = kids->GetArray()[i];
+        if (!kid.IsReference() || !ReadPageTree(kid.GetReference().ObjectNumber(), inherited, depth + 1, visited)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool PdfLazyReader::AppendPages(PoDoFo::PdfMemDocument& doc) {
+    // Set once pass 2 starts changing doc.
+    bool touched = false;
+    unsigned pageCount = 0;
+    std::vector<PoDoFo::PdfReference> createdObjects;
+    try {
+        // Pass 1: parse everything the pages reach. Page objects are the
+        // boundaries (links between pages are remapped, not followed) and
+        // references up into the page tree or the catalog become null.
+        std::unordered_set<uint32_t> pageNumbers;
+        for (const Page& page : pages_) {
+            pageNumbers.insert(page.number);
+        }
+
+        std::vector<uint32_t> pending;
+        for (const Page& page : pages_) {
+            for (const auto& entry : Resolve(page.number)->value.GetDictionary()) {
+                if (entry.first != "Parent") {
+                    CollectReferences(entry.second, pending);
+                }
+            }
+            for (const PdfObject* value : { page.resources, page.mediaBox, page.cropBox, page.rotate }) {
+                if (value) {
+                    CollectReferences(*value, pending);
+                }
+            }
+        }
+
+        std::vector<uint32_t> order;
+        std::unordered_set<uint32_t> seen(pageNumbers);
+        while (!pending.empty()) {
+            uint32_t number = pending.back();
+            pending.pop_back();
+            if (!seen.insert(number).second) {
+                continue;
+            }
+            const Object* object = Resolve(number);
+            if (!object) {
+                return false;
+            }
+            if (object->value.IsNull() || IsDocumentNode(number) || IsTreeNode(object->value)) {
+                continue;
+            }
+            order.push_back(number);
+            CollectReferences(object->value, pending);
+        }
+
+        // Pass 2: create the pages and objects, then fill them in, so that
+        // every reference has its target number before it is converted.
+        ValueConverter converter;
+        std::vector<PdfObject*> targets;
+        PoDoFo::PdfIndirectObjectList& objects = doc.GetObjects();
+        pageCount = doc.GetPages().GetCount();
+        touched = true;
+
+        for (const Page& page : pages_) {
+            // The box is a placeholder until /MediaBox is copied below.
+            PoDoFo::PdfPage& created = doc.GetPages().CreatePage(PoDoFo::Rect(0.0, 0.0, 595.0, 842.0));
+            converter.mapped[page.number] = created.GetObject().GetIndirectReference();
+            targets.push_back(&created.GetObject());
+            createdObjects.push_back(created.GetObject().GetIndirectReference());
+        }
+
+        std::vector<PdfObject*> copies;
+        for (uint32_t number : order) {
+            const PdfObject& value = objects_[number]->value;
+            if (value.IsDictionary()) {
+                PdfObject& copy = objects.CreateDictionaryObject();
+                converter.mapped[number] = copy.GetIndirectReference();
+                copies.push_back(&copy);
+                createdObjects.push_back(copy.GetIndirectReference());
+            }
+            else if (value.IsArray()) {
+                PdfObject& copy = objects.CreateArrayObject();
+                converter.mapped[number] = copy.GetIndirectReference();
+                copies.push_back(&copy);
+                createdObjects.push_back(copy.GetIndirectReference());
+            }
+            else {
+                converter.inlined[number] = &value;
+                copies.push_back(nullptr);
+            }
+        }
+
+        for (size_t i = 0; i < order.size(); ++i) {
+            const Object& source = *objects_[order[i]];
+            PdfObject* copy = copies[i];
+            if (!copy) {
+                continue;
+            }
+            if (source.value.IsArray()) {
+                for (const PdfObject& item : source.value.GetArray()) {
+                    copy->GetArray().Add(converter.Convert(item));
+                }
+                continue;
+            }
+
+            // The data is copied as it is in the input, still encoded with
+            // the filters named in the dictionary copied below.
+            if (source.hasStream) {
+                copy->GetOrCreateStream().SetData(PoDoFo::bufferview(source.streamData, source.streamSize), true);
+            }
+            PdfDictionary& dict = copy->GetDictionary();
+            for (const auto& entry : source.value.GetDictionary()) {
+                PdfObject item = converter.Convert(entry.second);
+                if (!item.IsNull() && !(source.hasStream && entry.first == "Length")) {
+                    dict.AddKey(entry.first, item);
+                }
+            }
+        }
+
+        for (size_t i = 0; i < pages_.size(); ++i) {
+            const Page& page = pages_[i];
+            PdfDictionary& dict = targets[i]->GetDictionary();
+            const PdfDictionary& source = objects_[page.number]->value.GetDictionary();
+            for (const auto& entry : source) {
+                PdfObject item = converter.Convert(entry.second);
+                if (!item.IsNull() && entry.first != "Parent" && entry.first != "Type") {
+                    dict.AddKey(entry.first, item);
+                }
+            }
+
+            const std::pair<const char*, const PdfObject*> inheritable[] = {
+                { "Resources", page.resources }, { "MediaBox", page.mediaBox },
+                { "CropBox", page.cropBox }, { "Rotate", page.rotate } };
+            for (const auto& attribute : inheritable) {
+                if (attribute.second && !source.HasKey(attribute.first)) {
+                    dict.AddKey(PoDoFo::PdfName(attribute.first), converter.Convert(*attribute.second));
+                }
+            }
+        }
+
+        Logger::Debug("Lazy reader: " + std::to_string(pages_.size()) + " page(s) appended, " +
+            std::to_string(objects_.size()) + " of " + std::to_string(xref_.size()) + " object(s) parsed, " +
+            std::to_string(order.size()) + " copied");
+        return true;
+    }
+    catch (const PoDoFo::PdfError& e) {
+        Logger::Error("Lazy reader: PdfError code " + std::to_string(static_cast<int>(e.GetCode())));
+    }
+    catch (const std::exception& e) {
+        Logger::Error("Lazy reader: " + std::string(e.what()));
+    }
+    if (touched) {
+        RemoveAppended(doc, pageCount, createdObjects);
+    }
+    return false;
+}
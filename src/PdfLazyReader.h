@@ -0,0 +1,129 @@
+#ifndef __PDF_LAZY_READER_H__
+#define __PDF_LAZY_READER_H__
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "FileSystemUtils.h"
+#include "podofo/podofo.h"
+
+// Reads an input PDF on demand instead of parsing it completely.
+//
+// Open() reads only the cross-reference sections, the trailer and the page
+// tree; AppendPages() then parses just the objects reachable from the pages
+// and copies them into the output document, stream data straight from the
+// mapped file. Unused resources, old revisions and the rest of the catalog
+// (outlines, forms, structure) are never parsed.
+//
+// Only what the reader can handle safely is accepted: encrypted files and
+// damaged cross-reference data make Open() fail, and the caller falls back
+// to the full PoDoFo parser, which has repair logic.
+class PdfLazyReader {
+public:
+    PdfLazyReader();
+    ~PdfLazyReader();
+
+    bool Open(const std::string& filePath);
+    // The data must stay valid while the reader is used.
+    bool Open(const char* data, size_t size);
+
+    size_t GetPageCount() const;
+    size_t GetObjectCount() const;
+    size_t GetParsedObjectCount() const;
+
+    // Parses every object the pages reach, one breadth-first level at a
+    // time with the objects of a level (and the object streams they are in)
+    // spread over `threads` workers; 0 means one per CPU core. Fills the
+    // same cache the serial loader does, with the same results: objects that
+    // cannot be parsed are left out and fail again when they are used.
+    void Preload(size_t threads);
+
+    // Appends all pages at the end of doc. Every object the pages need is
+    // parsed before doc is touched; when copying into doc fails, the pages
+    // and objects added so far are removed again. Only if that removal
+    // fails too does doc keep more pages than before.
+    bool AppendPages(PoDoFo::PdfMemDocument& doc);
+
+    // Cross-reference entry of one object number.
+    struct XRefEntry {
+        uint8_t type = 0;           // 0 free, 1 at offset, 2 in object stream
+        uint64_t offset = 0;        // offset or object stream number
+        uint32_t index = 0;         // index in the object stream
+        uint16_t generation = 0;
+    };
+
+    // A parsed indirect object. The source text of the value and the stream
+    // data point into the input (or a decoded object stream).
+    struct Object {
+        PoDoFo::PdfObject value;
+        const char* text = nullptr;
+        size_t textSize = 0;
+        const char* streamData = nullptr;
+        size_t streamSize = 0;
+        bool hasStream = false;
+    };
+
+    // A leaf of the page tree with the attributes it inherits from its
+    // ancestors (nullptr where neither the page nor an ancestor has one).
+    struct Page {
+        uint32_t number = 0;
+        const PoDoFo::PdfObject* resources = nullptr;
+        const PoDoFo::PdfObject* mediaBox = nullptr;
+        const PoDoFo::PdfObject* cropBox = nullptr;
+        const PoDoFo::PdfObject* rotate = nullptr;
+    };
+
+    const std::vector<Page>& GetPages() const;
+
+    // Parsed object for a number (cached); an object that is free or
+    // missing resolves to null. nullptr when the object cannot be parsed.
+    const Object* Resolve(uint32_t number);
+
+    // The catalog and the inner nodes of the page tree: references to them
+    // from copied objects are dropped instead of followed.
+    bool IsDocumentNode(uint32_t number) const;
+
+private:
+    struct ObjectStream {
+        std::string data;
+        std::vector<std::pair<uint32_t, size_t>> offsets;   // number, offset
+    };
+
+    MappedFile file_;
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+
+    std::vector<XRefEntry> xref_;
+    std::vector<bool> known_;       // entries already set by a newer section
+    PoDoFo::PdfObject trailer_;
+    std::vector<Page> pages_;
+    std::vector<bool> documentNodes_;
+
+    std::unordered_map<uint32_t, std::unique_ptr<Object>> objects_;
+    std::unordered_map<uint32_t, std::unique_ptr<ObjectStream>> objectStreams_;
+
+    bool Load();
+    bool ReadXRef();
+    bool ReadXRefTable(size_t offset, PoDoFo::PdfObject& trailer);
+    bool ReadXRefStream(size_t offset, PoDoFo::PdfObject& trailer);
+    void SetEntry(uint32_t number, const XRefEntry& entry);
+    bool ReadPageTree(uint32_t number, Page inherited, int depth, std::vector<bool>& visited);
+
+    // Parses "N G obj ... endobj" at offset; number 0 accepts any object.
+    bool ParseIndirect(size_t offset, uint32_t number, Object& object) const;
+    bool ParseCompressed(const ObjectStream& stream, uint32_t index, uint32_t number, Object& object) const;
+    bool ParseObject(uint32_t number, Object& object);
+    const ObjectStream* GetObjectStream(uint32_t number);
+    std::unique_ptr<ObjectStream> LoadObjectStream(uint32_t number) const;
+
+    // Parses the objects of `numbers` that are not cached yet in parallel.
+    void ParseParallel(const std::vector<uint32_t>& numbers, size_t threads);
+
+    const PoDoFo::PdfObject* Dereference(const PoDoFo::PdfObject* value);
+
+    bool DecodeStream(const PoDoFo::PdfDictionary& dict, const char* data, size_t size, std::string& output) const;
+};
+
+#endif // __PDF_LAZY_READER_H__
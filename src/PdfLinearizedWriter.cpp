@@ -0,0 +1,474 @@
+#include <algorithm>
+#include <cstdio>
+#include <unordered_map>
+#include <unordered_set>
+#include "Logger.h"
+#include "ContentHash.h"
+#include "StreamFilters.h"
+#include "PdfOutputWriter.h"
+#include "PdfLinearizedWriter.h"
+
+namespace {
+
+    using PoDoFo::PdfObject;
+    using PoDoFo::PdfReference;
+
+    const char* const kBinaryComment = "%\xE2\xE3\xCF\xD3\n";
+
+    // Hint tables are bit streams, most significant bit first.
+    class BitWriter {
+    public:
+        void Write(uint64_t value, int bits) {
+            for (int b = bits - 1; b >= 0; --b) {
+                current_ = static_cast<uint8_t>((current_ << 1) | ((value >> b) & 1));
+                if (++used_ == 8) {
+                    data_ += static_cast<char>(current_);
+                    current_ = 0;
+                    used_ = 0;
+                }
+            }
+        }
+
+        // Each item of a hint table starts on a byte boundary.
+        void Align() {
+            if (used_ > 0) {
+                data_ += static_cast<char>(current_ << (8 - used_));
+                current_ = 0;
+                used_ = 0;
+            }
+        }
+
+        const std::string& Data() const {
+            return data_;
+        }
+
+    private:
+        std::string data_;
+        uint8_t current_ = 0;
+        int used_ = 0;
+    };
+
+    int BitsFor(uint64_t value) {
+        int bits = 0;
+        while (value != 0) {
+            ++bits;
+            value >>= 1;
+        }
+        return bits;
+    }
+
+    std::string Padded(uint64_t value, int width) {
+        char text[32];
+        std::snprintf(text, sizeof(text), "%*llu", width, static_cast<unsigned long long>(value));
+        return text;
+    }
+
+    std::string XRefLine(uint64_t offset) {
+        char text[32];
+        std::snprintf(text, sizeof(text), "%010llu 00000 n \n", static_cast<unsigned long long>(offset));
+        return text;
+    }
+
+    bool IsPageNode(const PdfObject& obj) {
+        if (!obj.IsDictionary()) {
+            return false;
+        }
+        const PdfObject* type = obj.GetDictionary().GetKey("Type");
+        return type && type->IsName() && (type->GetName() == "Page" || type->GetName() == "Pages");
+    }
+
+    void CollectReferences(const PdfObject& obj, std::vector<PdfReference>& out) {
+        if (obj.IsReference()) {
+            out.push_back(obj.GetReference());
+        }
+        else if (obj.IsArray()) {
+            for (const PdfObject& item : obj.GetArray()) {
+                CollectReferences(item, out);
+            }
+        }
+        else if (obj.IsDictionary()) {
+            for (const auto& pair : obj.GetDictionary()) {
+                CollectReferences(pair.second, out);
+            }
+        }
+    }
+
+    // Extends `order` with every object reachable from it, breadth first.
+    // Barrier objects (page tree nodes, the catalog) are not entered, so a
+    // page does not pull in its parents or the pages its links point to.
+    std::vector<uint32_t> Reach(std::vector<uint32_t> order,
+        const std::unordered_map<uint32_t, PdfObject*>& objects,
+        const std::unordered_set<uint32_t>& barriers) {
+        std::unordered_set<uint32_t> visited(order.begin(), order.end());
+        std::vector<PdfReference> refs;
+        for (size_t i = 0; i < order.size(); ++i) {
+            refs.clear();
+            CollectReferences(*objects.at(order[i]), refs);
+            for (const PdfReference& ref : refs) {
+                uint32_t number = ref.ObjectNumber();
+                if (!visited.insert(number).second || barriers.count(number) || !objects.count(number)) {
+                    continue;
+                }
+                order.push_back(number);
+            }
+        }
+        return order;
+    }
+}
+
+PdfLinearizedWriter::PdfLinearizedWriter(int compressionLevel)
+    : compressionLevel_(compressionLevel > 0 ? compressionLevel : 6) {
+}
+
+bool PdfLinearizedWriter::Write(PoDoFo::PdfMemDocument& doc, std::string& output) {
+    try {
+        std::unordered_map<uint32_t, PdfObject*> objects;
+        std::unordered_set<uint32_t> barriers;
+        std::vector<uint32_t> allNumbers;
+        uint32_t maxNumber = 0;
+
+        for (PdfObject* obj : doc.GetObjects()) {
+            uint32_t number = obj->GetIndirectReference().ObjectNumber();
+            objects[number] = obj;
+            allNumbers.push_back(number);
+            maxNumber = (std::max)(maxNumber, number);
+            if (IsPageNode(*obj)) {
+                barriers.insert(number);
+            }
+        }
+        std::sort(allNumbers.begin(), allNumbers.end());
+
+        uint32_t catalog = doc.GetCatalog().GetObject().GetIndirectReference().ObjectNumber();
+        barriers.insert(catalog);
+
+        PoDoFo::PdfPageCollection& pages = doc.GetPages();
+        unsigned pageCount = pages.GetCount();
+        if (pageCount == 0) {
+            Logger::Error("Linearized save: document has no pages");
+            return false;
+        }
+
+        // Objects used by each page and the number of pages using each object.
+        std::vector<std::vector<uint32_t>> reach(pageCount);
+        std::unordered_map<uint32_t, unsigned> useCount;
+        for (unsigned i = 0; i < pageCount; ++i) {
+            uint32_t page = pages.GetPageAt(i).GetObject().GetIndirectReference().ObjectNumber();
+            reach[i] = Reach({ page }, objects, barriers);
+            for (uint32_t number : reach[i]) {
+                ++useCount[number];
+            }
+        }
+
+        // The layout needs every page object in its own page section.
+        for (unsigned i = 0; i < pageCount; ++i) {
+            if (useCount[reach[i][0]] != 1) {
+                Logger::Error("Linearized save: page " + std::to_string(i + 1) + " occurs more than once in the page tree");
+                return false;
+            }
+        }
+
+        // Sections in file order: document-level objects, the first page with
+        // everything it uses, the private objects of the other pages, objects
+        // shared by those pages, and the rest.
+        std::unordered_set<uint32_t> placed;
+        std::vector<uint32_t> documentLevel = { catalog };
+        std::vector<uint32_t> firstPage = reach[0];
+        std::vector<std::vector<uint32_t>> otherPages(pageCount);
+        std::vector<uint32_t> shared;
+        std::vector<uint32_t> rest;
+
+        placed.insert(catalog);
+        placed.insert(firstPage.begin(), firstPage.end());
+        for (unsigned i = 1; i < pageCount; ++i) {
+            for (uint32_t number : reach[i]) {
+                if (useCount[number] == 1) {
+                    otherPages[i].push_back(number);
+                    placed.insert(number);
+                }
+            }
+        }
+        for (unsigned i = 1; i < pageCount; ++i) {
+            for (uint32_t number : reach[i]) {
+                if (placed.insert(number).second) {
+                    shared.push_back(number);
+                }
+            }
+        }
+
+        // What the viewer needs before showing any page.
+        std::vector<uint32_t> seeds;
+        const PoDoFo::PdfDictionary& catalogDict = objects.at(catalog)->GetDictionary();
+        for (const char* key : { "OpenAction", "ViewerPreferences" }) {
+            const PdfObject* value = catalogDict.GetKey(key);
+            if (!value) {
+                continue;
+            }
+            std::vector<PdfReference> refs;
+            CollectReferences(*value, refs);
+            for (const PdfReference& ref : refs) {
+                if (objects.count(ref.ObjectNumber()) && !barriers.count(ref.ObjectNumber())) {
+                    seeds.push_back(ref.ObjectNumber());
+                }
+            }
+        }
+        for (uint32_t number : Reach(seeds, objects, barriers)) {
+            if (placed.insert(number).second) {
+                documentLevel.push_back(number);
+            }
+        }
+
+        for (uint32_t number : allNumbers) {
+            if (placed.insert(number).second) {
+                rest.push_back(number);
+            }
+        }
+
+        // Objects of the first-page section get the highest numbers so that
+        // the first-page cross-reference table is one contiguous subsection.
+        std::vector<uint32_t> fileOrder;
+        fileOrder.reserve(allNumbers.size());
+        fileOrder.insert(fileOrder.end(), documentLevel.begin(), documentLevel.end());
+        fileOrder.insert(fileOrder.end(), firstPage.begin(), firstPage.end());
+        std::vector<size_t> pageStart(pageCount + 1);
+        pageStart[0] = documentLevel.size();
+        pageStart[1] = fileOrder.size();
+        for (unsigned i = 1; i < pageCount; ++i) {
+            fileOrder.insert(fileOrder.end(), otherPages[i].begin(), otherPages[i].end());
+            pageStart[i + 1] = fileOrder.size();
+        }
+        size_t sharedStart = fileOrder.size();
+        fileOrder.insert(fileOrder.end(), shared.begin(), shared.end());
+        fileOrder.insert(fileOrder.end(), rest.begin(), rest.end());
+
+        size_t documentEnd = documentLevel.size();
+        size_t firstPageEnd = pageStart[1];
+
+        PdfOutputWriter::Renumbering renumber(maxNumber + 1, 0);
+        uint32_t next = 1;
+        for (size_t k = firstPageEnd; k < fileOrder.size(); ++k) {
+            renumber[fileOrder[k]] = next++;
+        }
+        uint32_t linDictNumber = next++;
+        for (size_t k = 0; k < firstPageEnd; ++k) {
+            renumber[fileOrder[k]] = next++;
+        }
+        uint32_t hintNumber = next++;
+        uint32_t size = next;
+
+        std::vector<std::string> bodies(fileOrder.size());
+        std::string digest;
+        for (size_t k = 0; k < fileOrder.size(); ++k) {
+            PdfOutputWriter::AppendIndirectObject(*objects.at(fileOrder[k]), bodies[k], &renumber);
+            uint64_t hash = ContentHash::Hash64(bodies[k].data(), bodies[k].size(), 0);
+            digest.append(reinterpret_cast<const char*>(&hash), sizeof(hash));
+        }
+
+        std::string header = std::string("%PDF-1.7\n") + kBinaryComment;
+        std::string trailerKeys = PdfOutputWriter::TrailerKeys(doc, digest, &renumber);
+        uint32_t firstPageObject = renumber[reach[0][0]];
+
+        auto linearizationDict = [&](uint64_t length, uint64_t hintOffset, uint64_t hintLength,
+            uint64_t firstPageEndOffset, uint64_t mainXrefEntry) {
+            return std::to_string(linDictNumber) + " 0 obj\n<< /Linearized 1 /L " +
+                Padded(length, PLACEHOLDER_WIDTH) + " /H [ " + Padded(hintOffset, PLACEHOLDER_WIDTH) + " " +
+                Padded(hintLength, PLACEHOLDER_WIDTH) + " ] /O " + std::to_string(firstPageObject) + " /E " +
+                Padded(firstPageEndOffset, PLACEHOLDER_WIDTH) + " /N " + std::to_string(pageCount) + " /T " +
+                Padded(mainXrefEntry, PLACEHOLDER_WIDTH) + " >>\nendobj\n";
+        };
+
+        auto firstPageXref = [&](const std::vector<uint64_t>& offsets, uint64_t mainXrefOffset) {
+            std::string table = "xref\n" + std::to_string(linDictNumber) + " " +
+                std::to_string(size - linDictNumber) + "\n";
+            for (uint64_t offset : offsets) {
+                table += XRefLine(offset);
+            }
+            table += "trailer\n<< /Size " + std::to_string(size) + " /Prev " +
+                Padded(mainXrefOffset, PLACEHOLDER_WIDTH) + " " + trailerKeys + " >>\nstartxref\n0\n%%EOF\n";
+            return table;
+        };
+
+        // Offsets are first laid out without the hint stream: the hint tables
+        // themselves describe the file as if the stream were not there.
+        uint64_t linDictOffset = header.size();
+        uint64_t firstXrefOffset = linDictOffset + linearizationDict(0, 0, 0, 0, 0).size();
+        uint64_t position = firstXrefOffset +
+            firstPageXref(std::vector<uint64_t>(size - linDictNumber, 0), 0).size();
+
+        std::vector<uint64_t> offsets(fileOrder.size() + 1);
+        for (size_t k = 0; k < fileOrder.size(); ++k) {
+            offsets[k] = position;
+            position += bodies[k].size();
+        }
+        offsets[fileOrder.size()] = position;
+
+        // Shared object identifiers: every first-page object, then the
+        // shared section, one object per group.
+        std::unordered_map<uint32_t, uint64_t> sharedId;
+        std::vector<uint64_t> groupLengths;
+        for (size_t k = documentEnd; k < firstPageEnd; ++k) {
+            sharedId[fileOrder[k]] = groupLengths.size();
+            groupLengths.push_back(offsets[k + 1] - offsets[k]);
+        }
+        for (size_t k = sharedStart; k < sharedStart + shared.size(); ++k) {
+            sharedId[fileOrder[k]] = groupLengths.size();
+            groupLengths.push_back(offsets[k + 1] - offsets[k]);
+        }
+
+        std::vector<uint64_t> pageObjects(pageCount);
+        std::vector<uint64_t> pageLengths(pageCount);
+        std::vector<std::vector<uint64_t>> pageShared(pageCount);
+        uint64_t maxSharedId = 0;
+        for (unsigned i = 0; i < pageCount; ++i) {
+            pageObjects[i] = pageStart[i + 1] - pageStart[i];
+            pageLengths[i] = offsets[pageStart[i + 1]] - offsets[pageStart[i]];
+            if (i == 0) {
+                continue;
+            }
+            for (uint32_t number : reach[i]) {
+                if (useCount[number] > 1) {
+                    pageShared[i].push_back(sharedId.at(number));
+                    maxSharedId = (std::max)(maxSharedId, sharedId.at(number));
+                }
+            }
+        }
+
+        auto minmax = [](const std::vector<uint64_t>& values) {
+            auto range = std::minmax_element(values.begin(), values.end());
+            return std::make_pair(*range.first, *range.second);
+        };
+        auto objectRange = minmax(pageObjects);
+        auto lengthRange = minmax(pageLengths);
+        auto groupRange = minmax(groupLengths);
+        size_t maxShared = 0;
+        for (const auto& ids : pageShared) {
+            maxShared = (std::max)(maxShared, ids.size());
+        }
+
+        int objectBits = BitsFor(objectRange.second - objectRange.first);
+        int lengthBits = BitsFor(lengthRange.second - lengthRange.first);
+        int sharedCountBits = BitsFor(maxShared);
+        int sharedIdBits = BitsFor(maxSharedId);
+        int groupBits = BitsFor(groupRange.second - groupRange.first);
+
+        // Page offset hint table. Content stream offsets and lengths are given
+        // as whole pages, which is what common writers do as well.
+        BitWriter hints;
+        hints.Write(objectRange.first, 32);
+        hints.Write(offsets[documentEnd], 32);
+        hints.Write(objectBits, 16);
+        hints.Write(lengthRange.first, 32);
+        hints.Write(lengthBits, 16);
+        hints.Write(0, 32);
+        hints.Write(0, 16);
+        hints.Write(lengthRange.first, 32);
+        hints.Write(lengthBits, 16);
+        hints.Write(sharedCountBits, 16);
+        hints.Write(sharedIdBits, 16);
+        hints.Write(0, 16);
+        hints.Write(1, 16);
+        for (unsigned i = 0; i < pageCount; ++i) {
+            hints.Write(pageObjects[i] - objectRange.first, objectBits);
+        }
+        hints.Align();
+        for (unsigned i = 0; i < pageCount; ++i) {
+            hints.Write(pageLengths[i] - lengthRange.first, lengthBits);
+        }
+        hints.Align();
+        for (unsigned i = 0; i < pageCount; ++i) {
+            hints.Write(pageShared[i].size(), sharedCountBits);
+        }
+        hints.Align();
+        for (unsigned i = 0; i < pageCount; ++i) {
+            for (uint64_t id : pageShared[i]) {
+                hints.Write(id, sharedIdBits);
+            }
+        }
+        hints.Align();
+        for (unsigned i = 0; i < pageCount; ++i) {
+            hints.Write(pageLengths[i] - lengthRange.first, lengthBits);
+        }
+        hints.Align();
+
+        // Shared object hint table.
+        size_t sharedTableOffset = hints.Data().size();
+        hints.Write(shared.empty() ? 0 : renumber[shared.front()], 32);
+        hints.Write(shared.empty() ? 0 : offsets[sharedStart], 32);
+        hints.Write(firstPage.size(), 32);
+        hints.Write(groupLengths.size(), 32);
+        hints.Write(0, 16);
+        hints.Write(groupRange.first, 32);
+        hints.Write(groupBits, 16);
+        for (uint64_t length : groupLengths) {
+            hints.Write(length - groupRange.first, groupBits);
+        }
+        hints.Align();
+        for (size_t g = 0; g < groupLengths.size(); ++g) {
+            hints.Write(0, 1);
+        }
+        hints.Align();
+
+        std::string encoded;
+        if (!StreamFilters::Deflate(hints.Data().data(), hints.Data().size(), compressionLevel_, encoded)) {
+            Logger::Error("Failed to compress hint stream");
+            return false;
+        }
+        std::string hintStream = std::to_string(hintNumber) + " 0 obj\n<< /S " + std::to_string(sharedTableOffset) +
+            " /Filter /FlateDecode /Length " + std::to_string(encoded.size()) + " >>\nstream\n" + encoded +
+            "\nendstream\nendobj\n";
+
+        uint64_t hintOffset = offsets[documentEnd];
+        uint64_t shift = hintStream.size();
+        uint64_t mainXrefOffset = position + shift;
+
+        std::string mainXrefHead = "xref\n0 " + std::to_string(linDictNumber);
+        std::string mainXref = mainXrefHead + "\n0000000000 65535 f \n";
+        for (size_t k = firstPageEnd; k < fileOrder.size(); ++k) {
+            mainXref += XRefLine(offsets[k] + shift);
+        }
+        mainXref += "trailer\n<< /Size " + std::to_string(size) + " >>\nstartxref\n" +
+            std::to_string(firstXrefOffset) + "\n%%EOF\n";
+
+        std::vector<uint64_t> firstOffsets;
+        firstOffsets.push_back(linDictOffset);
+        for (size_t k = 0; k < firstPageEnd; ++k) {
+            firstOffsets.push_back(offsets[k] + (k < documentEnd ? 0 : shift));
+        }
+        firstOffsets.push_back(hintOffset);
+
+        uint64_t fileLength = mainXrefOffset + mainXref.size();
+
+        output.clear();
+        output.reserve(fileLength);
+        output += header;
+        output += linearizationDict(fileLength, hintOffset, hintStream.size(),
+            offsets[firstPageEnd] + shift, mainXrefOffset + mainXrefHead.size());
+        output += firstPageXref(firstOffsets, mainXrefOffset);
+        for (size_t k = 0; k < fileOrder.size(); ++k) {
+            if (k == documentEnd) {
+                output += hintStream;
+            }
+            output += bodies[k];
+            std::string().swap(bodies[k]);
+        }
+        output += mainXref;
+
+        if (output.size() != fileLength) {
+            Logger::Error("Linearized save: layout size mismatch (" + std::to_string(output.size()) +
+                " != " + std::to_string(fileLength) + ")");
+            return false;
+        }
+
+        Logger::Debug("Linearized layout: " + std::to_string(firstPage.size()) + " object(s) for page 1, " +
+            std::to_string(shared.size()) + " shared, " + std::to_string(rest.size()) + " other, hint stream " +
+            std::to_string(hintStream.size()) + " bytes");
+        return true;
+    }
+    catch (const PoDoFo::PdfError& e) {
+        Logger::Error("Linearized save failed: PdfError code " + std::to_string(static_cast<int>(e.GetCode())));
+        return false;
+    }
+    catch (const std::exception& e) {
+        Logger::Error("Linearized save failed: " + std::string(e.what()));
+        return false;
+    }
+}
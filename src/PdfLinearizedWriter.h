@@ -0,0 +1,31 @@
+#ifndef __PDF_LINEARIZED_WRITER_H__
+#define __PDF_LINEARIZED_WRITER_H__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "podofo/podofo.h"
+
+// Serializer for linearized ("fast web view") output, PDF Reference Annex F.
+//
+// Objects are renumbered and reordered so that the catalog and everything
+// the first page needs come right after the header, followed by the other
+// pages one by one, the objects shared between them and finally the rest.
+// A primary hint stream tells the viewer where each page and shared object
+// lives, so it can render page 1 and fetch any other page with range
+// requests instead of downloading the whole file.
+class PdfLinearizedWriter {
+public:
+    explicit PdfLinearizedWriter(int compressionLevel);
+
+    bool Write(PoDoFo::PdfMemDocument& doc, std::string& output);
+
+private:
+    int compressionLevel_;
+
+    // Width of the numbers patched in after the layout is known; the
+    // linearization dictionary and the first-page trailer keep their size.
+    static constexpr int PLACEHOLDER_WIDTH = 10;
+};
+
+#endif // __PDF_LINEARIZED_WRITER_H__
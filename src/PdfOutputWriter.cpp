@@ -0,0 +1,250 @@
+#include <algorithm>
+#include <cstdio>
+#include "Logger.h"
+#include "ContentHash.h"
+#include "StreamFilters.h"
+#include "PdfOutputWriter.h"
+
+namespace {
+
+    using PoDoFo::PdfObject;
+
+    const char* const kBinaryComment = "%\xE2\xE3\xCF\xD3\n";
+
+    std::string FormatReal(double value) {
+        char text[64];
+        std::snprintf(text, sizeof(text), "%.6f", value);
+        std::string result(text);
+        size_t dot = result.find('.');
+        if (dot != std::string::npos) {
+            size_t end = result.find_last_not_of('0');
+            result.erase(end == dot ? dot : end + 1);
+        }
+        return result == "-0" ? "0" : result;
+    }
+
+    void AppendDictionary(const PoDoFo::PdfDictionary& dict, std::string& out,
+        const PdfOutputWriter::Renumbering* renumber) {
+        out += "<<";
+        for (const auto& pair : dict) {
+            out += pair.first.ToString();
+            out += ' ';
+            PdfOutputWriter::AppendValue(pair.second, out, renumber);
+        }
+        out += ">>";
+    }
+
+    std::string StreamObject(uint32_t number, const std::string& dictionary, const std::string& data) {
+        return std::to_string(number) + " 0 obj\n<<" + dictionary + " /Length " + std::to_string(data.size()) +
+            ">>\nstream\n" + data + "\nendstream\nendobj\n";
+    }
+}
+
+PdfOutputWriter::PdfOutputWriter(int compressionLevel)
+    : compressionLevel_(compressionLevel > 0 ? compressionLevel : 6) {
+}
+
+std::string PdfOutputWriter::FormatReference(const PoDoFo::PdfReference& ref, const Renumbering* renumber) {
+    if (!renumber) {
+        return std::to_string(ref.ObjectNumber()) + " " + std::to_string(ref.GenerationNumber()) + " R";
+    }
+    uint32_t number = ref.ObjectNumber() < renumber->size() ? (*renumber)[ref.ObjectNumber()] : 0;
+    // A reference to an object that is not written is a reference to null.
+    return number != 0 ? std::to_string(number) + " 0 R" : "null";
+}
+
+void PdfOutputWriter::AppendValue(const PdfObject& obj, std::string& out, const Renumbering* renumber) {
+    if (obj.IsDictionary()) {
+        AppendDictionary(obj.GetDictionary(), out, renumber);
+    }
+    else if (obj.IsArray()) {
+        out += '[';
+        bool first = true;
+        for (const PdfObject& item : obj.GetArray()) {
+            if (!first) {
+                out += ' ';
+            }
+            AppendValue(item, out, renumber);
+            first = false;
+        }
+        out += ']';
+    }
+    else if (obj.IsReference()) {
+        out += FormatReference(obj.GetReference(), renumber);
+    }
+    else if (obj.IsName()) {
+        out += obj.GetName().ToString();
+    }
+    else if (obj.IsString()) {
+        out += obj.GetString().ToString();
+    }
+    else if (obj.IsNumber()) {
+        out += std::to_string(obj.GetNumber());
+    }
+    else if (obj.IsRealStrict()) {
+        out += FormatReal(obj.GetReal());
+    }
+    else if (obj.IsBool()) {
+        out += obj.GetBool() ? "true" : "false";
+    }
+    else {
+        out += "null";
+    }
+}
+
+void PdfOutputWriter::AppendIndirectObject(const PdfObject& obj, std::string& out, const Renumbering* renumber) {
+    const PoDoFo::PdfReference& ref = obj.GetIndirectReference();
+    if (renumber) {
+        out += std::to_string((*renumber)[ref.ObjectNumber()]) + " 0 obj\n";
+    }
+    else {
+        out += std::to_string(ref.ObjectNumber()) + " " + std::to_string(ref.GenerationNumber()) + " obj\n";
+    }
+
+    if (obj.HasStream()) {
+        PoDoFo::charbuff data = obj.GetStream()->GetCopy(true);
+        PoDoFo::PdfDictionary dict(obj.GetDictionary());
+        dict.AddKey(PoDoFo::PdfName("Length"), PdfObject(static_cast<int64_t>(data.size())));
+        AppendDictionary(dict, out, renumber);
+        out += "\nstream\n";
+        out.append(data.data(), data.size());
+        out += "\nendstream";
+    }
+    else {
+        AppendValue(obj, out, renumber);
+    }
+
+    out += "\nendobj\n";
+}
+
+int PdfOutputWriter::EncodeXRefEntries(const std::vector<XRefEntry>& entries, std::string& out) {
+    uint64_t largest = 0;
+    for (const XRefEntry& entry : entries) {
+        largest = entry.field2 > largest ? entry.field2 : largest;
+    }
+    int width = 1;
+    while (width < 8 && (largest >> (8 * width)) != 0) {
+        ++width;
+    }
+
+    out.reserve(out.size() + entries.size() * (3 + width));
+    for (const XRefEntry& entry : entries) {
+        out += static_cast<char>(entry.type);
+        for (int b = width - 1; b >= 0; --b) {
+            out += static_cast<char>((entry.field2 >> (8 * b)) & 0xFF);
+        }
+        out += static_cast<char>((entry.field3 >> 8) & 0xFF);
+        out += static_cast<char>(entry.field3 & 0xFF);
+    }
+    return width;
+}
+
+std::string PdfOutputWriter::TrailerKeys(PoDoFo::PdfMemDocument& doc, const std::string& digest,
+    const Renumbering* renumber) {
+    std::string keys = "/Root " + FormatReference(doc.GetCatalog().GetObject().GetIndirectReference(), renumber);
+
+    const PdfObject* info = doc.GetTrailer().GetDictionary().GetKey("Info");
+    if (info && info->IsReference()) {
+        keys += " /Info " + FormatReference(info->GetReference(), renumber);
+    }
+
+    // The file identifier only has to be unique; deriving it from the
+    // content keeps repeated merges of the same inputs byte-identical.
+    char id[33];
+    std::snprintf(id, sizeof(id), "%016llX%016llX",
+        static_cast<unsigned long long>(ContentHash::Hash64(digest.data(), digest.size(), 0)),
+        static_cast<unsigned long long>(ContentHash::Hash64(digest.data(), digest.size(), 1)));
+    keys += std::string(" /ID [<") + id + "><" + id + ">]";
+    return keys;
+}
+
+bool PdfOutputWriter::WriteCompact(PoDoFo::PdfMemDocument& doc, std::string& output) {
+    try {
+        std::vector<PdfObject*> topLevel;
+        std::vector<PdfObject*> packed;
+        uint32_t maxNumber = 0;
+
+        for (PdfObject* obj : doc.GetObjects()) {
+            const PoDoFo::PdfReference& ref = obj->GetIndirectReference();
+            maxNumber = ref.ObjectNumber() > maxNumber ? ref.ObjectNumber() : maxNumber;
+            // Object streams may only hold generation 0 objects without streams.
+            if (obj->HasStream() || ref.GenerationNumber() != 0) {
+                topLevel.push_back(obj);
+            }
+            else {
+                packed.push_back(obj);
+            }
+        }
+
+        size_t streamCount = (packed.size() + OBJECTS_PER_STREAM - 1) / OBJECTS_PER_STREAM;
+        uint32_t xrefNumber = maxNumber + 1 + static_cast<uint32_t>(streamCount);
+        std::vector<XRefEntry> entries(xrefNumber + 1);
+        entries[0].field3 = 65535;
+
+        output.clear();
+        output += "%PDF-1.7\n";
+        output += kBinaryComment;
+
+        for (PdfObject* obj : topLevel) {
+            const PoDoFo::PdfReference& ref = obj->GetIndirectReference();
+            entries[ref.ObjectNumber()] = { 1, output.size(), ref.GenerationNumber() };
+            AppendIndirectObject(*obj, output);
+        }
+
+        uint32_t streamNumber = maxNumber + 1;
+        for (size_t start = 0; start < packed.size(); start += OBJECTS_PER_STREAM, ++streamNumber) {
+            size_t end = (std::min)(start + OBJECTS_PER_STREAM, packed.size());
+
+            std::string offsets;
+            std::string body;
+            for (size_t i = start; i < end; ++i) {
+                uint32_t number = packed[i]->GetIndirectReference().ObjectNumber();
+                offsets += std::to_string(number) + " " + std::to_string(body.size()) + " ";
+                AppendValue(*packed[i], body);
+                body += '\n';
+                entries[number] = { 2, streamNumber, static_cast<uint32_t>(i - start) };
+            }
+            offsets += '\n';
+
+            std::string encoded;
+            if (!StreamFilters::Deflate((offsets + body).data(), offsets.size() + body.size(),
+                compressionLevel_, encoded)) {
+                Logger::Error("Failed to compress object stream");
+                return false;
+            }
+
+            entries[streamNumber] = { 1, output.size(), 0 };
+            output += StreamObject(streamNumber, "/Type /ObjStm /N " + std::to_string(end - start) +
+                " /First " + std::to_string(offsets.size()) + " /Filter /FlateDecode", encoded);
+        }
+
+        size_t xrefOffset = output.size();
+        entries[xrefNumber] = { 1, xrefOffset, 0 };
+
+        std::string table;
+        int width = EncodeXRefEntries(entries, table);
+        std::string encoded;
+        if (!StreamFilters::Deflate(table.data(), table.size(), compressionLevel_, encoded)) {
+            Logger::Error("Failed to compress cross-reference stream");
+            return false;
+        }
+
+        output += StreamObject(xrefNumber, "/Type /XRef /Size " + std::to_string(xrefNumber + 1) +
+            " /W [1 " + std::to_string(width) + " 2] " + TrailerKeys(doc, output) + " /Filter /FlateDecode",
+            encoded);
+        output += "startxref\n" + std::to_string(xrefOffset) + "\n%%EOF\n";
+
+        Logger::Debug("Compact layout: " + std::to_string(packed.size()) + " object(s) in " +
+            std::to_string(streamCount) + " object stream(s), " + std::to_string(topLevel.size()) +
+            " stream object(s) at top level");
+        return true;
+    }
+    catch (const PoDoFo::PdfError& e) {
+        Logger::Error("Compact save failed: PdfError code " + std::to_string(static_cast<int>(e.GetCode())));
+        return false;
+    }
+    catch (const std::exception& e) {
+        Logger::Error("Compact save failed: " + std::string(e.what()));
+        return false;
+    }
+}
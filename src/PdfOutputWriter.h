@@ -0,0 +1,59 @@
+#ifndef __PDF_OUTPUT_WRITER_H__
+#define __PDF_OUTPUT_WRITER_H__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "podofo/podofo.h"
+
+// Serializer for merged documents in the compact PDF 1.5 layout: every
+// non-stream object is packed into compressed object streams and the
+// cross-reference table is replaced by a cross-reference stream.
+//
+// The building blocks (value serialization, xref stream encoding) are also
+// used by the other save layouts.
+class PdfOutputWriter {
+public:
+    explicit PdfOutputWriter(int compressionLevel);
+
+    bool WriteCompact(PoDoFo::PdfMemDocument& doc, std::string& output);
+
+    // New object number for each old one, indexed by the old number; 0 marks
+    // an object that is not written. Renumbered objects get generation 0.
+    typedef std::vector<uint32_t> Renumbering;
+
+    // Appends the PDF syntax of a direct value.
+    static void AppendValue(const PoDoFo::PdfObject& obj, std::string& out,
+        const Renumbering* renumber = nullptr);
+
+    // Appends "N G obj ... endobj" including the stream data, if any, with
+    // /Length set to the size of the raw (encoded) data.
+    static void AppendIndirectObject(const PoDoFo::PdfObject& obj, std::string& out,
+        const Renumbering* renumber = nullptr);
+
+    // Entries of a cross-reference stream, indexed by object number.
+    struct XRefEntry {
+        uint8_t type = 0;       // 0 free, 1 in file, 2 in object stream
+        uint64_t field2 = 0;    // offset or object stream number
+        uint32_t field3 = 0;    // generation or index in object stream
+    };
+
+    // Encodes entries into the binary /W [1 n 2] layout and returns n.
+    static int EncodeXRefEntries(const std::vector<XRefEntry>& entries, std::string& out);
+
+    // Trailer keys shared by every layout: /Root, /Info and an /ID derived
+    // from `digest`.
+    static std::string TrailerKeys(PoDoFo::PdfMemDocument& doc, const std::string& digest,
+        const Renumbering* renumber = nullptr);
+
+    static std::string FormatReference(const PoDoFo::PdfReference& ref, const Renumbering* renumber = nullptr);
+
+private:
+    int compressionLevel_;
+
+    // Objects per object stream; small enough that a reader extracting one
+    // object does not inflate much more than it needs.
+    static constexpr size_t OBJECTS_PER_STREAM = 200;
+};
+
+#endif // __PDF_OUTPUT_WRITER_H__
@@ -0,0 +1,156 @@
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "Logger.h"
+#include "PdfPageTree.h"
+
+namespace {
+
+    using PoDoFo::PdfObject;
+    using PoDoFo::PdfDictionary;
+
+    constexpr size_t InheritedKeyCount = 4;
+    const char* const kInheritedKeys[InheritedKeyCount] = { "Resources", "MediaBox", "CropBox", "Rotate" };
+
+    // Guards against /Parent cycles in damaged inputs.
+    constexpr int MaxTreeDepth = 256;
+
+    // Sets /Kids, /Count and the /Parent of each kid on a page tree node.
+    void SetKids(PdfObject& node, const std::vector<PdfObject*>& level, const std::vector<int64_t>& counts,
+        size_t start, size_t end, int64_t& total) {
+        PoDoFo::PdfArray kids;
+        total = 0;
+        for (size_t i = start; i < end; ++i) {
+            kids.Add(level[i]->GetIndirectReference());
+            level[i]->GetDictionary().AddKey(PoDoFo::PdfName("Parent"), node.GetIndirectReference());
+            total += counts[i];
+        }
+
+        PdfDictionary& dict = node.GetDictionary();
+        dict.AddKey(PoDoFo::PdfName("Type"), PoDoFo::PdfName("Pages"));
+        dict.AddKey(PoDoFo::PdfName("Kids"), kids);
+        dict.AddKey(PoDoFo::PdfName("Count"), PdfObject(total));
+    }
+
+    // Indirect copy of a direct dictionary or array held by an old node.
+    PdfObject& MakeIndirect(PoDoFo::PdfIndirectObjectList& objects, const PdfObject& value) {
+        if (value.IsArray()) {
+            PdfObject& copy = objects.CreateArrayObject();
+            for (const PdfObject& item : value.GetArray()) {
+                copy.GetArray().Add(item);
+            }
+            return copy;
+        }
+        PdfObject& copy = objects.CreateDictionaryObject();
+        for (const auto& entry : value.GetDictionary()) {
+            copy.GetDictionary().AddKey(entry.first, entry.second);
+        }
+        return copy;
+    }
+}
+
+bool PdfPageTree::Rebuild(PoDoFo::PdfMemDocument& doc) {
+    try {
+        PoDoFo::PdfPageCollection& pages = doc.GetPages();
+        unsigned pageCount = pages.GetCount();
+        if (pageCount == 0) {
+            return true;
+        }
+
+        PoDoFo::PdfIndirectObjectList& objects = doc.GetObjects();
+        PdfObject& root = pages.GetObject();
+        uint32_t rootNumber = root.GetIndirectReference().ObjectNumber();
+
+        // Move inherited attributes down to the pages and note the old inner
+        // nodes on the way up.
+        std::vector<PdfObject*> level;
+        level.reserve(pageCount);
+        std::unordered_set<uint32_t> oldNodes;
+        std::vector<PoDoFo::PdfReference> oldNodeRefs;
+        // A direct dictionary or array on an old node becomes one indirect
+        // object that all its pages refer to, instead of a copy per page.
+        std::unordered_map<const PdfObject*, PoDoFo::PdfReference> shared;
+
+        for (unsigned i = 0; i < pageCount; ++i) {
+            PdfObject& page = pages.GetPageAt(i).GetObject();
+            PdfDictionary& dict = page.GetDictionary();
+
+            const PdfObject* inherited[InheritedKeyCount] = {};
+            const PdfObject* parent = dict.FindKey("Parent");
+            for (int depth = 0; parent && parent->IsDictionary() && depth < MaxTreeDepth; ++depth) {
+                const PdfDictionary& node = parent->GetDictionary();
+                for (size_t k = 0; k < InheritedKeyCount; ++k) {
+                    if (!inherited[k]) {
+                        inherited[k] = node.GetKey(kInheritedKeys[k]);
+                    }
+                }
+                const PoDoFo::PdfReference& ref = parent->GetIndirectReference();
+                if (ref.ObjectNumber() != rootNumber && oldNodes.insert(ref.ObjectNumber()).second) {
+                    oldNodeRefs.push_back(ref);
+                }
+                parent = node.FindKey("Parent");
+            }
+
+            for (size_t k = 0; k < InheritedKeyCount; ++k) {
+                const PdfObject* value = inherited[k];
+                if (!value || dict.HasKey(kInheritedKeys[k])) {
+                    continue;
+                }
+                if (value->IsDictionary() || value->IsArray()) {
+                    auto found = shared.find(value);
+                    if (found == shared.end()) {
+                        found = shared.emplace(value, MakeIndirect(objects, *value).GetIndirectReference()).first;
+                    }
+                    dict.AddKey(PoDoFo::PdfName(kInheritedKeys[k]), found->second);
+                }
+                else {
+                    dict.AddKey(PoDoFo::PdfName(kInheritedKeys[k]), *value);
+                }
+            }
+            level.push_back(&page);
+        }
+
+        // Group bottom-up; the last group on each level may be smaller, so
+        // every page ends up at the same depth.
+        std::vector<int64_t> counts(level.size(), 1);
+        size_t nodeCount = 1;
+        while (level.size() > MAX_KIDS) {
+            std::vector<PdfObject*> parents;
+            std::vector<int64_t> parentCounts;
+            for (size_t start = 0; start < level.size(); start += MAX_KIDS) {
+                size_t end = (std::min)(start + MAX_KIDS, level.size());
+                PdfObject& node = objects.CreateDictionaryObject();
+                int64_t total = 0;
+                SetKids(node, level, counts, start, end, total);
+                parents.push_back(&node);
+                parentCounts.push_back(total);
+            }
+            nodeCount += parents.size();
+            level.swap(parents);
+            counts.swap(parentCounts);
+        }
+
+        // The root object is reused, so the catalog and PoDoFo's page
+        // collection still point at it.
+        root.GetDictionary().Clear();
+        int64_t total = 0;
+        SetKids(root, level, counts, 0, level.size(), total);
+
+        for (const PoDoFo::PdfReference& ref : oldNodeRefs) {
+            objects.RemoveObject(ref, false);
+        }
+
+        Logger::Debug("Page tree: " + std::to_string(pageCount) + " page(s) in " + std::to_string(nodeCount) +
+            " node(s), " + std::to_string(oldNodeRefs.size()) + " old node(s) removed");
+        return true;
+    }
+    catch (const PoDoFo::PdfError& e) {
+        Logger::Error("Page tree rebuild failed: PdfError code " + std::to_string(static_cast<int>(e.GetCode())));
+        return false;
+    }
+    catch (const std::exception& e) {
+        Logger::Error("Page tree rebuild failed: " + std::string(e.what()));
+        return false;
+    }
+}
@@ -0,0 +1,27 @@
+#ifndef __PDF_PAGE_TREE_H__
+#define __PDF_PAGE_TREE_H__
+
+#include <cstddef>
+#include "podofo/podofo.h"
+
+// Balanced page trees for merged output.
+//
+// Appending inputs one after another leaves the output with whatever tree
+// shape the appends produced: one long /Kids array, or one subtree per
+// input. Viewers look pages up by walking /Kids and /Count from the root, so
+// with tens of thousands of pages that shape decides how fast a page opens.
+// The output is saved with a tree in which every node has at most MAX_KIDS
+// children and all pages are at the same depth.
+class PdfPageTree {
+public:
+    // 2 levels hold 1024 pages, 3 levels 32768, 4 levels a million.
+    static constexpr size_t MAX_KIDS = 32;
+
+    // Replaces the page tree of doc with a balanced one. The root node keeps
+    // its object number; the inner nodes of the old tree are removed.
+    // Attributes pages inherited from them (/Resources, /MediaBox,
+    // /CropBox, /Rotate) are set on the pages themselves.
+    static bool Rebuild(PoDoFo::PdfMemDocument& doc);
+};
+
+#endif // __PDF_PAGE_TREE_H__
@@ -0,0 +1,277 @@
+#include <cstdio>
+#include <cstring>
+#include <windows.h>
+#include "BufferPool.h"
+#include "ContentHash.h"
+#include "FileSystemUtils.h"
+#include "Logger.h"
+#include "StringConverter.h"
+#include "PdfParseCache.h"
+
+namespace {
+
+    const char kMagic[8] = { 'P', 'D', 'F', 'F', 'R', 'A', 'G', '\0' };
+    constexpr size_t SiteSize = 8 + 4 + 4 + 4;
+    constexpr size_t HeaderSize = sizeof(kMagic) + 4 * 4 + 8 * 2;
+
+    uint64_t ToUint64(const FILETIME& time) {
+        return (static_cast<uint64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime;
+    }
+
+    void Put32(std::string& out, uint32_t value) {
+        out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    void Put64(std::string& out, uint64_t value) {
+        out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    // Reads the little-endian fields written by Put32/Put64; the caller
+    // checks the size first.
+    template <typename T>
+    T Get(const char*& pos) {
+        T value;
+        std::memcpy(&value, pos, sizeof(value));
+        pos += sizeof(value);
+        return value;
+    }
+
+    std::string Serialize(const PdfRawWriter::Fragment& fragment, uint32_t version) {
+        std::string out;
+        out.reserve(HeaderSize + fragment.sites.size() * SiteSize + fragment.data.size() + 8);
+        out.append(kMagic, sizeof(kMagic));
+        Put32(out, version);
+        Put32(out, fragment.pageCount);
+        Put32(out, fragment.objectCount);
+        Put32(out, 0);
+        Put64(out, fragment.sites.size());
+        Put64(out, fragment.data.size());
+        for (const PdfRawWriter::Fragment::Site& site : fragment.sites) {
+            Put64(out, site.offset);
+            Put32(out, site.length);
+            Put32(out, site.type);
+            Put32(out, site.value);
+        }
+        out += fragment.data;
+        // Torn or damaged entries are misses, not broken output.
+        Put64(out, ContentHash::Hash64(out.data(), out.size(), 0));
+        return out;
+    }
+
+    bool Deserialize(const std::vector<char>& in, uint32_t version, PdfRawWriter::Fragment& fragment) {
+        if (in.size() < HeaderSize + 8 || std::memcmp(in.data(), kMagic, sizeof(kMagic)) != 0) {
+            return false;
+        }
+        const char* end = in.data() + in.size() - 8;
+        const char* checksum = end;
+        if (Get<uint64_t>(checksum) != ContentHash::Hash64(in.data(), in.size() - 8, 0)) {
+            return false;
+        }
+
+        const char* pos = in.data() + sizeof(kMagic);
+        if (Get<uint32_t>(pos) != version) {
+            return false;
+        }
+        fragment.pageCount = Get<uint32_t>(pos);
+        fragment.objectCount = Get<uint32_t>(pos);
+        Get<uint32_t>(pos);
+        uint64_t siteCount = Get<uint64_t>(pos);
+        uint64_t dataSize = Get<uint64_t>(pos);
+        if (siteCount > static_cast<uint64_t>(end - pos) / SiteSize ||
+            dataSize != static_cast<uint64_t>(end - pos) - siteCount * SiteSize) {
+            return false;
+        }
+
+        fragment.sites.resize(static_cast<size_t>(siteCount));
+        for (PdfRawWriter::Fragment::Site& site : fragment.sites) {
+            site.offset = Get<uint64_t>(pos);
+            site.length = Get<uint32_t>(pos);
+            site.type = Get<uint32_t>(pos);
+            site.value = Get<uint32_t>(pos);
+        }
+        fragment.data.assign(pos, end);
+        return true;
+    }
+}
+
+bool PdfParseCache::Covers(const std::string& inputPath, const MergeOptions& options) {
+    return FileSystemUtils::GetFileExtension(inputPath) != ".pdf" || options.imageTargetDpi == 0;
+}
+
+bool PdfParseCache::Open(const std::string& folder, size_t limitBytes) {
+    folder_ = StringConverter::Utf8ToWide(folder);
+    if (folder_.empty()) {
+        return false;
+    }
+    if (folder_.back() != L'\\') {
+        folder_ += L'\\';
+    }
+    CreateDirectoryW(folder_.c_str(), nullptr);
+
+    limit_ = limitBytes;
+    entries_.clear();
+    totalSize_ = 0;
+    hits_ = 0;
+    misses_ = 0;
+
+    WIN32_FIND_DATAW findData;
+    HANDLE hFind = FindFirstFileW((folder_ + L"*.frag").c_str(), &findData);
+    if (hFind == INVALID_HANDLE_VALUE) {
+        if (GetLastError() != ERROR_FILE_NOT_FOUND) {
+            Logger::Error("Parse cache: cannot read folder: " + folder);
+            folder_.clear();
+            return false;
+        }
+    }
+    else {
+        do {
+            if (!(findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+                uint64_t size = (static_cast<uint64_t>(findData.nFileSizeHigh) << 32) | findData.nFileSizeLow;
+                entries_.push_back({ findData.cFileName, size, ToUint64(findData.ftLastWriteTime) });
+                totalSize_ += size;
+            }
+        } while (FindNextFileW(hFind, &findData) != 0);
+        FindClose(hFind);
+    }
+
+    Evict(std::wstring());
+    Logger::Debug("Parse cache: " + std::to_string(entries_.size()) + " entries, " +
+        std::to_string(totalSize_) + " of " + std::to_string(limit_) + " bytes in " + folder);
+    return true;
+}
+
+bool PdfParseCache::IsOpen() const {
+    return !folder_.empty();
+}
+
+bool PdfParseCache::MakeName(const std::string& inputPath, std::wstring& name) const {
+    WIN32_FILE_ATTRIBUTE_DATA info;
+    if (!GetFileAttributesExW(StringConverter::Utf8ToWide(inputPath).c_str(), GetFileExInfoStandard, &info)) {
+        return false;
+    }
+
+    MappedFile file;
+    if (!file.Open(inputPath)) {
+        return false;
+    }
+    char text[80];
+    std::snprintf(text, sizeof(text), "%016llx%016llx-%llx-%llx.frag",
+        static_cast<unsigned long long>(ContentHash::Hash64(file.Data(), file.Size(), 0)),
+        static_cast<unsigned long long>(ContentHash::Hash64(file.Data(), file.Size(), 1)),
+        static_cast<unsigned long long>(file.Size()),
+        static_cast<unsigned long long>(ToUint64(info.ftLastWriteTime)));
+    name = StringConverter::Utf8ToWide(text);
+    return true;
+}
+
+bool PdfParseCache::Lookup(const std::string& inputPath, PdfRawWriter::Fragment& fragment) {
+    lastInput_.clear();
+    if (!IsOpen()) {
+        return false;
+    }
+    if (!MakeName(inputPath, lastName_)) {
+        ++misses_;
+        return false;
+    }
+    lastInput_ = inputPath;
+
+    Entry* entry = nullptr;
+    for (Entry& candidate : entries_) {
+        if (candidate.name == lastName_) {
+            entry = &candidate;
+            break;
+        }
+    }
+
+    std::string path = StringConverter::WideToUtf8(folder_ + lastName_);
+    PooledBuffer<std::vector<char>> buffer;
+    if (!entry || !FileSystemUtils::ReadFileToBuffer(path, buffer.Get()) ||
+        !Deserialize(buffer.Get(), FORMAT_VERSION, fragment)) {
+        ++misses_;
+        return false;
+    }
+
+    // Most recently used from now on.
+    FILETIME now;
+    GetSystemTimeAsFileTime(&now);
+    HANDLE hFile = CreateFileW((folder_ + lastName_).c_str(), FILE_WRITE_ATTRIBUTES,
+        FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile != INVALID_HANDLE_VALUE) {
+        SetFileTime(hFile, nullptr, nullptr, &now);
+        CloseHandle(hFile);
+    }
+    entry->time = ToUint64(now);
+
+    ++hits_;
+    return true;
+}
+
+void PdfParseCache::Store(const std::string& inputPath, const PdfRawWriter::Fragment& fragment) {
+    if (!IsOpen() || inputPath != lastInput_ || fragment.pageCount == 0) {
+        return;
+    }
+
+    std::string data = Serialize(fragment, FORMAT_VERSION);
+    if (data.size() > limit_) {
+        return;
+    }
+
+    // Written under another name and renamed, so a reader never sees half
+    // an entry.
+    std::string path = StringConverter::WideToUtf8(folder_ + lastName_);
+    std::string temporary = path + ".tmp";
+    if (!FileSystemUtils::WriteBufferToFile(temporary, data.data(), data.size()) ||
+        !FileSystemUtils::RenameFile(temporary, path)) {
+        FileSystemUtils::DelFile(temporary);
+        Logger::Debug("Parse cache: cannot store entry for: " + inputPath);
+        return;
+    }
+
+    FILETIME now;
+    GetSystemTimeAsFileTime(&now);
+    bool replaced = false;
+    for (Entry& entry : entries_) {
+        if (entry.name == lastName_) {
+            totalSize_ = totalSize_ - entry.size + data.size();
+            entry.size = data.size();
+            entry.time = ToUint64(now);
+            replaced = true;
+        }
+    }
+    if (!replaced) {
+        entries_.push_back({ lastName_, data.size(), ToUint64(now) });
+        totalSize_ += data.size();
+    }
+    Evict(lastName_);
+}
+
+void PdfParseCache::Evict(const std::wstring& keep) {
+    while (totalSize_ > limit_) {
+        size_t oldest = entries_.size();
+        for (size_t i = 0; i < entries_.size(); ++i) {
+            if (entries_[i].name != keep && (oldest == entries_.size() || entries_[i].time < entries_[oldest].time)) {
+                oldest = i;
+            }
+        }
+        if (oldest == entries_.size()) {
+            break;
+        }
+
+        FileSystemUtils::DelFile(StringConverter::WideToUtf8(folder_ + entries_[oldest].name));
+        totalSize_ -= entries_[oldest].size;
+        entries_.erase(entries_.begin() + oldest);
+    }
+}
+
+uint64_t PdfParseCache::GetHits() const {
+    return hits_;
+}
+
+uint64_t PdfParseCache::GetMisses() const {
+    return misses_;
+}
+
+double PdfParseCache::GetHitRate() const {
+    uint64_t lookups = hits_ + misses_;
+    return lookups > 0 ? static_cast<double>(hits_) / lookups : 0.0;
+}
@@ -0,0 +1,64 @@
+#ifndef __PDF_PARSE_CACHE_H__
+#define __PDF_PARSE_CACHE_H__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "MergeOptions.h"
+#include "PdfRawWriter.h"
+
+// On-disk cache of inputs as PdfRawWriter copied them, so that a merge run
+// again over the same files (a retry after one bad input was replaced)
+// adds them without reading their cross-reference data, parsing their
+// objects or renumbering references.
+//
+// An entry is one file in the cache folder, named after the content hash,
+// size and modification time of the input. The folder is kept under a size
+// limit by removing the least recently used entries; a hit updates the
+// time of its file.
+class PdfParseCache {
+public:
+    // Whether the copied form of the input is the same for any options:
+    // PDFs are only cached when image optimization is off.
+    static bool Covers(const std::string& inputPath, const MergeOptions& options);
+
+    // Scans the folder, creating it if needed, and trims it to the limit.
+    bool Open(const std::string& folder, size_t limitBytes);
+    bool IsOpen() const;
+
+    // A fragment stored for this exact input; false on a miss.
+    bool Lookup(const std::string& inputPath, PdfRawWriter::Fragment& fragment);
+    // Stores the fragment of an input looked up before and evicts old
+    // entries over the limit.
+    void Store(const std::string& inputPath, const PdfRawWriter::Fragment& fragment);
+
+    uint64_t GetHits() const;
+    uint64_t GetMisses() const;
+    // Share of lookups that hit, 0 when there were none.
+    double GetHitRate() const;
+
+private:
+    struct Entry {
+        std::wstring name;
+        uint64_t size;
+        uint64_t time;      // FILETIME of the last write
+    };
+
+    // Format of the entry files; entries of other versions are misses.
+    static constexpr uint32_t FORMAT_VERSION = 1;
+
+    std::wstring folder_;
+    size_t limit_ = 0;
+    std::vector<Entry> entries_;
+    uint64_t totalSize_ = 0;
+    uint64_t hits_ = 0;
+    uint64_t misses_ = 0;
+    // Entry name of the last input looked up, so Store does not hash it again.
+    std::string lastInput_;
+    std::wstring lastName_;
+
+    bool MakeName(const std::string& inputPath, std::wstring& name) const;
+    void Evict(const std::wstring& keep);
+};
+
+#endif // __PDF_PARSE_CACHE_H__
@@ -1,21 +1,51 @@
 #include "Logger.h"
 #include "PdfProcessor.h"
+#include "BufferPool.h"
 #include "FileSystemUtils.h"
 #include "ImageProcessor.h"
+#include "PdfImageOptimizer.h"
+#include "PdfLazyReader.h"
 #include "podofo/main/PdfError.h"
 #include "podofo/main/PdfPainter.h"
+#include <podofo/podofo.h>
 
-bool PdfProcessor::AppendPdfFile(PoDoFo::PdfMemDocument& outputDoc, const std::string& filePath) {
+bool PdfProcessor::AppendPdfFile(PoDoFo::PdfMemDocument& outputDoc, const std::string& filePath,
+    const MergeOptions& options) {
 
     Logger::Debug("AppendPdfFile: " + filePath);
     try {
-        std::vector<char> buffer;
-        if (!FileSystemUtils::ReadFileToBuffer(filePath, buffer)) {
+        if (options.lazyInputLoading && options.imageTargetDpi == 0) {
+            PdfLazyReader reader;
+            bool opened = reader.Open(filePath);
+            if (opened && options.parseThreads != 1) {
+                reader.Preload(static_cast<size_t>(options.parseThreads));
+            }
+            unsigned pageCount = outputDoc.GetPages().GetCount();
+            if (opened && reader.AppendPages(outputDoc)) {
+                Logger::Debug("PDF appended successfully (lazy)");
+                return true;
+            }
+            // The full parser would append the same pages a second time.
+            if (outputDoc.GetPages().GetCount() != pageCount) {
+                Logger::Error("Lazy reader left pages behind, not parsing again: " + filePath);
+                return false;
+            }
+            Logger::Debug("Lazy loading not possible, parsing the whole file: " + filePath);
+        }
+
+        // Declared first: the document may read from the buffer until it is destroyed.
+        PooledBuffer<std::vector<char>> buffer;
+        if (!FileSystemUtils::ReadFileToBuffer(filePath, buffer.Get())) {
             return false;
         }
 
         PoDoFo::PdfMemDocument inputDoc;
-        inputDoc.LoadFromBuffer(PoDoFo::bufferview(buffer.data(), buffer.size()));
+        inputDoc.LoadFromBuffer(PoDoFo::bufferview(buffer.Get().data(), buffer.Get().size()));
+
+        if (options.imageTargetDpi > 0 && !PdfImageOptimizer::Optimize(inputDoc, options)) {
+            Logger::Debug("Warning: image optimization skipped for: " + filePath);
+        }
+
         outputDoc.GetPages().AppendDocumentPages(inputDoc);
 
         Logger::Debug("PDF appended successfully");
@@ -35,7 +65,8 @@ bool PdfProcessor::AppendImageFile(PoDoFo::PdfMemDocument& outputDoc, const std:
     
     Logger::Debug("AppendImageFile: " + filePath);
     try {
-        std::vector<unsigned char> jpegData;
+        PooledBuffer<std::vector<unsigned char>> pooled;
+        std::vector<unsigned char>& jpegData = pooled.Get();
         unsigned int imgW = 0, imgH = 0;
 
         if (!ImageProcessor::LoadAndConvertToJpeg(filePath, jpegData, imgW, imgH)) {
@@ -77,10 +108,6 @@ bool PdfProcessor::AppendImageFile(PoDoFo::PdfMemDocument& outputDoc, const std:
         painter.FinishDrawing();
 
         Logger::Debug("Image appended successfully");
-
-        jpegData.clear();
-        jpegData.shrink_to_fit();
-
         return true;
     }
     catch (const PoDoFo::PdfError& e) {
@@ -93,12 +120,13 @@ bool PdfProcessor::AppendImageFile(PoDoFo::PdfMemDocument& outputDoc, const std:
     }
 }
 
-bool PdfProcessor::ProcessFile(PoDoFo::PdfMemDocument& outputDoc, const std::string& filePath) {
+bool PdfProcessor::ProcessFile(PoDoFo::PdfMemDocument& outputDoc, const std::string& filePath,
+    const MergeOptions& options) {
     std::string ext = FileSystemUtils::GetFileExtension(filePath);
     Logger::Debug("Processing file: " + filePath + " (" + ext + ")");
 
     if (ext == ".pdf") {
-        return AppendPdfFile(outputDoc, filePath);
+        return AppendPdfFile(outputDoc, filePath, options);
     }
     else if (ext == ".jpg" || ext == ".jpeg" || ext == ".png") {
         return AppendImageFile(outputDoc, filePath);
@@ -106,4 +134,26 @@ bool PdfProcessor::ProcessFile(PoDoFo::PdfMemDocument& outputDoc, const std::str
 
     Logger::Error("Unsupported file extension: " + ext);
     return false;
-}
\ No newline at end of file
+}
+
+bool PdfProcessor::ConvertFile(const std::string& filePath, const MergeOptions& options, PoDoFo::charbuff& buffer) {
+    try {
+        PoDoFo::PdfMemDocument doc;
+        if (!ProcessFile(doc, filePath, options)) {
+            return false;
+        }
+
+        PoDoFo::BufferStreamDevice device(buffer);
+        doc.Save(device);
+        return true;
+    }
+    catch (const PoDoFo::PdfError& e) {
+        Logger::Error("Failed to convert file: PdfError code " +
+            std::to_string(static_cast<int>(e.GetCode())));
+        return false;
+    }
+    catch (const std::exception& e) {
+        Logger::Error("Exception: " + std::string(e.what()));
+        return false;
+    }
+}
@@ -3,15 +3,21 @@
 
 #include <string>
 #include "podofo/main/PdfMemDocument.h"
+#include "MergeOptions.h"
 
 constexpr double A4_PAGE_WIDTH = 595.0;
 constexpr double A4_PAGE_HEIGHT = 842.0;
 
 class PdfProcessor {
 public:
-    static bool AppendPdfFile(PoDoFo::PdfMemDocument& outputDoc, const std::string& filePath);
+    static bool AppendPdfFile(PoDoFo::PdfMemDocument& outputDoc, const std::string& filePath,
+        const MergeOptions& options);
     static bool AppendImageFile(PoDoFo::PdfMemDocument& outputDoc, const std::string& filePath);
-    static bool ProcessFile(PoDoFo::PdfMemDocument& outputDoc, const std::string& filePath);
+    static bool ProcessFile(PoDoFo::PdfMemDocument& outputDoc, const std::string& filePath,
+        const MergeOptions& options);
+    // Builds a standalone PDF of one input through PoDoFo: an image on an A4
+    // page, or a PDF the raw copy path cannot read.
+    static bool ConvertFile(const std::string& filePath, const MergeOptions& options, PoDoFo::charbuff& buffer);
 };
 
 #endif // __PDF_PROCESSOR_H__
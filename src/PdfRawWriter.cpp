@@ -0,0 +1,728 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "BufferPool.h"
+#include "Logger.h"
+#include "FileSystemUtils.h"
+#include "ContentHash.h"
+#include "PdfPageTree.h"
+#include "PdfRawWriter.h"
+
+namespace {
+
+    using PoDoFo::PdfObject;
+
+    const char* const kHeader = "%PDF-1.7\n%\xE2\xE3\xCF\xD3\n";
+
+    bool IsWhitespace(char c) {
+        return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\f' || c == '\0';
+    }
+
+    bool IsDelimiter(char c) {
+        return c != '\0' && std::strchr("()<>[]{}/%", c) != nullptr;
+    }
+
+    bool IsRegular(char c) {
+        return !IsWhitespace(c) && !IsDelimiter(c);
+    }
+
+    bool IsDigits(const char* text, size_t size) {
+        for (size_t i = 0; i < size; ++i) {
+            if (text[i] < '0' || text[i] > '9') {
+                return false;
+            }
+        }
+        return size > 0;
+    }
+
+    // End of the literal string starting at text[start] == '(', or npos if
+    // it is not terminated.
+    size_t SkipLiteralString(const char* text, size_t size, size_t start) {
+        int depth = 0;
+        for (size_t i = start; i < size; ++i) {
+            if (text[i] == '\\') {
+                ++i;
+            }
+            else if (text[i] == '(') {
+                ++depth;
+            }
+            else if (text[i] == ')' && --depth == 0) {
+                return i + 1;
+            }
+        }
+        return std::string::npos;
+    }
+
+    // Catalogs and page tree nodes that are not part of the input's own tree
+    // (orphans) are not copied either: they would drag in whole documents.
+    bool HasReferences(const PdfObject& value) {
+        if (value.IsReference()) {
+            return true;
+        }
+        if (value.IsDictionary()) {
+            for (const auto& pair : value.GetDictionary()) {
+                if (HasReferences(pair.second)) {
+                    return true;
+                }
+            }
+        }
+        else if (value.IsArray()) {
+            for (const PdfObject& item : value.GetArray()) {
+                if (HasReferences(item)) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    bool IsTreeNode(const PdfObject& value) {
+        if (!value.IsDictionary()) {
+            return false;
+        }
+        const PdfObject* type = value.GetDictionary().GetKey("Type");
+        return type && type->IsName() && (type->GetName() == "Pages" || type->GetName() == "Catalog");
+    }
+}
+
+PdfRawWriter::PdfRawWriter(bool deduplicate)
+    : deduplicate_(deduplicate) {
+    Reset();
+}
+
+PdfRawWriter::~PdfRawWriter() {
+    WaitForWrite();
+    if (!spillPath_.empty()) {
+        FileSystemUtils::DelFile(spillPath_);
+    }
+}
+
+void PdfRawWriter::Reset() {
+    WaitForWrite();
+    if (!spillPath_.empty()) {
+        FileSystemUtils::DelFile(spillPath_);
+        spillPath_.clear();
+    }
+    spilled_ = 0;
+    out_ = kHeader;
+    offsets_.assign(CATALOG_NUMBER + 1, 0);
+    pages_.clear();
+    leaves_.clear();
+    index_.clear();
+    nextNumber_ = CATALOG_NUMBER + 1;
+}
+
+size_t PdfRawWriter::GetPageCount() const {
+    return pages_.size();
+}
+
+size_t PdfRawWriter::GetSize() const {
+    return spilled_ + out_.size();
+}
+
+size_t PdfRawWriter::GetSpilledSize() const {
+    return spilled_;
+}
+
+size_t PdfRawWriter::GetFoldedObjects() const {
+    return foldedObjects_;
+}
+
+uint64_t PdfRawWriter::GetFoldedBytes() const {
+    return foldedBytes_;
+}
+
+bool PdfRawWriter::WaitForWrite() {
+    if (!write_.valid()) {
+        return true;
+    }
+    bool written = write_.get();
+    writing_.clear();
+    if (!written) {
+        Logger::Error("Raw copy: cannot write spill file: " + spillPath_);
+    }
+    return written;
+}
+
+bool PdfRawWriter::Spill(const std::string& path) {
+    if (!WaitForWrite()) {
+        return false;
+    }
+    if (!spillPath_.empty() && path != spillPath_) {
+        Logger::Error("Raw copy: spill file changed from " + spillPath_ + " to " + path);
+        return false;
+    }
+    if (out_.empty()) {
+        return true;
+    }
+
+    // The two buffers trade places, so the next input is copied into the
+    // memory the previous write has finished with.
+    bool create = spillPath_.empty();
+    spillPath_ = path;
+    spilled_ += out_.size();
+    writing_.swap(out_);
+    write_ = std::async(std::launch::async, [this, create]() {
+        return create
+            ? FileSystemUtils::WriteBufferToFile(spillPath_, writing_.data(), writing_.size())
+            : FileSystemUtils::AppendBufferToFile(spillPath_, writing_.data(), writing_.size());
+    });
+    return true;
+}
+
+uint32_t PdfRawWriter::FindDuplicate(const PdfLazyReader::Object& object, uint32_t number) {
+    const PdfObject* length = object.value.GetDictionary().GetKey("Length");
+    if (!length || !length->IsNumber() || length->GetNumber() != static_cast<int64_t>(object.streamSize) ||
+        HasReferences(object.value)) {
+        return 0;
+    }
+
+    // Without references the text is copied unchanged, so equal source
+    // means equal output.
+    uint64_t key = ContentHash::Hash64(object.streamData, object.streamSize,
+        ContentHash::Hash64(object.text, object.textSize, 0));
+    uint64_t check = ContentHash::Hash64(object.streamData, object.streamSize,
+        ContentHash::Hash64(object.text, object.textSize, 1));
+
+    auto found = index_.find(key);
+    if (found != index_.end()) {
+        // The hashes only find the candidate; folding needs the same bytes.
+        if (found->second.check != check || !SameStream(found->second, object)) {
+            return 0;
+        }
+        ++foldedObjects_;
+        foldedBytes_ += object.textSize + object.streamSize;
+        return found->second.number;
+    }
+
+    index_.emplace(key, IndexEntry{ check, number, object.textSize, object.streamSize, &object });
+    indexAdded_.push_back(key);
+    return 0;
+}
+
+bool PdfRawWriter::SameStream(const IndexEntry& entry, const PdfLazyReader::Object& object) {
+    if (entry.textSize != object.textSize || entry.streamSize != object.streamSize) {
+        return false;
+    }
+
+    uint64_t offset = entry.number < offsets_.size() ? offsets_[entry.number] : 0;
+    if (offset == 0) {
+        // Queued from the input being copied: every input is written out
+        // completely before the next one starts.
+        return std::memcmp(entry.source->text, object.text, object.textSize) == 0 &&
+            std::memcmp(entry.source->streamData, object.streamData, object.streamSize) == 0;
+    }
+
+    // Written by WriteObject() as "N 0 obj\n", the text unchanged (it has no
+    // references), "\nstream\n" and the data.
+    static const char kStream[] = "\nstream\n";
+    uint64_t textAt = offset + std::to_string(entry.number).size() + std::strlen(" 0 obj\n");
+    uint64_t streamAt = textAt + object.textSize + std::strlen(kStream);
+    size_t size = static_cast<size_t>(streamAt - textAt) + object.streamSize;
+
+    const char* written = nullptr;
+    PooledBuffer<std::vector<char>> buffer;
+    if (textAt >= spilled_) {
+        written = out_.data() + (textAt - spilled_);
+    }
+    else if (write_.valid() && textAt >= spilled_ - writing_.size()) {
+        written = writing_.data() + (textAt - (spilled_ - writing_.size()));
+    }
+    else {
+        // The spill file is opened without write sharing, so a read while
+        // the append is still running would make the append fail. wait()
+        // leaves the result to WaitForWrite().
+        if (write_.valid()) {
+            write_.wait();
+        }
+        if (!FileSystemUtils::ReadFileRange(spillPath_, textAt, size, buffer.Get()) || buffer.Get().size() != size) {
+            return false;
+        }
+        written = buffer.Get().data();
+    }
+
+    return std::memcmp(written, object.text, object.textSize) == 0 &&
+        std::memcmp(written + object.textSize, kStream, std::strlen(kStream)) == 0 &&
+        std::memcmp(written + (streamAt - textAt), object.streamData, object.streamSize) == 0;
+}
+
+void PdfRawWriter::BeginObject(uint32_t number) {
+    if (offsets_.size() <= number) {
+        offsets_.resize(number + 1, 0);
+    }
+    offsets_[number] = spilled_ + out_.size();
+    AppendNumber(number, Fragment::OBJECT);
+    out_ += " 0 obj\n";
+}
+
+void PdfRawWriter::AppendNumber(uint32_t number, uint32_t type) {
+    std::string text = std::to_string(number);
+    if (sites_) {
+        sites_->push_back({ out_.size(), static_cast<uint32_t>(text.size()), type, number });
+    }
+    out_ += text;
+}
+
+uint32_t PdfRawWriter::Map(PdfLazyReader& reader, uint32_t number, bool& failed) {
+    if (number == 0 || number >= renumber_.size() || reader.IsDocumentNode(number)) {
+        return 0;
+    }
+    if (renumber_[number] != 0) {
+        return renumber_[number];
+    }
+
+    const PdfLazyReader::Object* object = reader.Resolve(number);
+    if (!object) {
+        failed = true;
+        return 0;
+    }
+    if (object->value.IsNull() || IsTreeNode(object->value)) {
+        return 0;
+    }
+
+    if (deduplicate_ && object->hasStream) {
+        uint32_t duplicate = FindDuplicate(*object, nextNumber_);
+        if (duplicate != 0) {
+            renumber_[number] = duplicate;
+            return duplicate;
+        }
+    }
+
+    renumber_[number] = nextNumber_++;
+    pending_.push_back(number);
+    return renumber_[number];
+}
+
+void PdfRawWriter::MapReferences(PdfLazyReader& reader, const PdfObject& value, bool& failed) {
+    if (value.IsReference()) {
+        Map(reader, value.GetReference().ObjectNumber(), failed);
+    }
+    else if (value.IsDictionary()) {
+        for (const auto& pair : value.GetDictionary()) {
+            MapReferences(reader, pair.second, failed);
+        }
+    }
+    else if (value.IsArray()) {
+        for (const PdfObject& item : value.GetArray()) {
+            MapReferences(reader, item, failed);
+        }
+    }
+}
+
+bool PdfRawWriter::AppendRenumbered(PdfLazyReader& reader, const char* text, size_t size) {
+    size_t i = 0;
+    while (i < size) {
+        char c = text[i];
+        size_t end = i + 1;
+
+        if ((c == '<' || c == '>') && i + 1 < size && text[i + 1] == c) {
+            end = i + 2;
+        }
+        else if (c == '(') {
+            end = SkipLiteralString(text, size, i);
+            if (end == std::string::npos) {
+                return false;
+            }
+        }
+        else if (c == '<') {
+            const void* close = std::memchr(text + i, '>', size - i);
+            if (!close) {
+                return false;
+            }
+            end = static_cast<const char*>(close) - text + 1;
+        }
+        else if (c == '%') {
+            while (end < size && text[end] != '\n' && text[end] != '\r') {
+                ++end;
+            }
+        }
+        else if (c == '/' || IsRegular(c)) {
+            while (end < size && IsRegular(text[end])) {
+                ++end;
+            }
+
+            // "N G R": the number, the generation and R as separate tokens.
+            if (IsDigits(text + i, end - i)) {
+                size_t pos = end;
+                while (pos < size && IsWhitespace(text[pos])) ++pos;
+                size_t generation = pos;
+                while (pos < size && IsRegular(text[pos])) ++pos;
+                size_t generationEnd = pos;
+                while (pos < size && IsWhitespace(text[pos])) ++pos;
+
+                if (generationEnd > generation && IsDigits(text + generation, generationEnd - generation) &&
+                    pos < size && text[pos] == 'R' && (pos + 1 >= size || !IsRegular(text[pos + 1]))) {
+                    bool failed = false;
+                    uint32_t number = Map(reader, static_cast<uint32_t>(std::strtoul(text + i, nullptr, 10)), failed);
+                    if (failed) {
+                        return false;
+                    }
+                    if (number != 0) {
+                        AppendNumber(number, Fragment::REFERENCE);
+                        out_ += " 0 R";
+                    }
+                    else {
+                        out_ += "null";
+                    }
+                    i = pos + 1;
+                    continue;
+                }
+            }
+        }
+
+        out_.append(text + i, end - i);
+        i = end;
+    }
+    return true;
+}
+
+bool PdfRawWriter::WritePage(PdfLazyReader& reader, const PdfLazyReader::Page& page, size_t index) {
+    const PdfLazyReader::Object* object = reader.Resolve(page.number);
+    if (!object || !object->value.IsDictionary() || object->hasStream) {
+        return false;
+    }
+
+    // The page is rebuilt from its parsed value: the parent changes and the
+    // attributes it inherited from the old tree become its own.
+    PoDoFo::PdfDictionary dict(object->value.GetDictionary());
+    dict.RemoveKey("Parent");
+    if (page.resources && !dict.HasKey("Resources")) dict.AddKey(PoDoFo::PdfName("Resources"), *page.resources);
+    if (page.mediaBox && !dict.HasKey("MediaBox")) dict.AddKey(PoDoFo::PdfName("MediaBox"), *page.mediaBox);
+    if (page.cropBox && !dict.HasKey("CropBox")) dict.AddKey(PoDoFo::PdfName("CropBox"), *page.cropBox);
+    if (page.rotate && !dict.HasKey("Rotate")) dict.AddKey(PoDoFo::PdfName("Rotate"), *page.rotate);
+
+    PdfObject value(dict);
+    bool failed = false;
+    MapReferences(reader, value, failed);
+    if (failed) {
+        return false;
+    }
+
+    // Serialized with the input numbers and renumbered like the other
+    // objects, so that every reference goes through AppendRenumbered.
+    std::string body;
+    PdfOutputWriter::AppendValue(value, body);
+
+    BeginObject(pages_[index]);
+    out_ += "<</Parent ";
+    AppendNumber(leaves_[index / PdfPageTree::MAX_KIDS], Fragment::PARENT);
+    out_ += " 0 R";
+    if (!AppendRenumbered(reader, body.data() + 2, body.size() - 2)) {
+        return false;
+    }
+    out_ += "\nendobj\n";
+    return true;
+}
+
+bool PdfRawWriter::WriteObject(PdfLazyReader& reader, uint32_t number) {
+    const PdfLazyReader::Object* object = reader.Resolve(number);
+    if (!object || !object->text) {
+        return false;
+    }
+
+    if (object->hasStream) {
+        // The data is copied as it is, so its length has to be right.
+        const PdfObject* length = object->value.GetDictionary().GetKey("Length");
+        if (length && length->IsReference()) {
+            const PdfLazyReader::Object* resolved = reader.Resolve(length->GetReference().ObjectNumber());
+            length = resolved ? &resolved->value : nullptr;
+        }
+        if (!length || !length->IsNumber() || length->GetNumber() != static_cast<int64_t>(object->streamSize)) {
+            Logger::Debug("Raw copy: stream length mismatch in object " + std::to_string(number));
+            return false;
+        }
+    }
+
+    BeginObject(renumber_[number]);
+    if (!AppendRenumbered(reader, object->text, object->textSize)) {
+        return false;
+    }
+    if (object->hasStream) {
+        out_ += "\nstream\n";
+        out_.append(object->streamData, object->streamSize);
+        out_ += "\nendstream";
+    }
+    out_ += "\nendobj\n";
+    return true;
+}
+
+bool PdfRawWriter::CopyDocument(PdfLazyReader& reader) {
+    renumber_.assign(reader.GetObjectCount(), 0);
+    pending_.clear();
+
+    // Pages get their numbers first so that links between them resolve.
+    const std::vector<PdfLazyReader::Page>& pages = reader.GetPages();
+    size_t firstPage = pages_.size();
+    for (const PdfLazyReader::Page& page : pages) {
+        if (page.number >= renumber_.size() || renumber_[page.number] != 0) {
+            return false;
+        }
+        if (pages_.size() % PdfPageTree::MAX_KIDS == 0) {
+            leaves_.push_back(nextNumber_++);
+        }
+        renumber_[page.number] = nextNumber_++;
+        pages_.push_back(renumber_[page.number]);
+    }
+
+    for (size_t i = 0; i < pages.size(); ++i) {
+        if (!WritePage(reader, pages[i], firstPage + i)) {
+            return false;
+        }
+    }
+
+    size_t copied = 0;
+    while (!pending_.empty()) {
+        uint32_t number = pending_.back();
+        pending_.pop_back();
+        if (!WriteObject(reader, number)) {
+            return false;
+        }
+        ++copied;
+    }
+
+    Logger::Debug("Raw copy: " + std::to_string(pages.size()) + " page(s), " + std::to_string(copied) +
+        " object(s) copied, " + std::to_string(reader.GetParsedObjectCount()) + " of " +
+        std::to_string(reader.GetObjectCount()) + " parsed");
+    return true;
+}
+
+bool PdfRawWriter::AddDocument(PdfLazyReader& reader, Fragment* capture) {
+    size_t outputSize = out_.size();
+    size_t pageCount = pages_.size();
+    size_t leafCount = leaves_.size();
+    uint32_t firstNumber = nextNumber_;
+    size_t foldedObjects = foldedObjects_;
+    uint64_t foldedBytes = foldedBytes_;
+    indexAdded_.clear();
+
+    std::vector<Fragment::Site> sites;
+    bool deduplicate = deduplicate_;
+    if (capture) {
+        *capture = Fragment();
+        sites_ = &sites;
+        deduplicate_ = false;
+    }
+
+    bool copied = false;
+    try {
+        copied = CopyDocument(reader);
+    }
+    catch (const PoDoFo::PdfError& e) {
+        Logger::Debug("Raw copy: PdfError code " + std::to_string(static_cast<int>(e.GetCode())));
+    }
+    catch (const std::exception& e) {
+        Logger::Debug("Raw copy: " + std::string(e.what()));
+    }
+    sites_ = nullptr;
+    deduplicate_ = deduplicate;
+
+    if (copied && capture && !MakeFragment(outputSize, firstNumber, leafCount, pageCount, sites, *capture)) {
+        Logger::Debug("Raw copy: input not captured");
+        *capture = Fragment();
+    }
+
+    if (!copied) {
+        out_.resize(outputSize);
+        pages_.resize(pageCount);
+        leaves_.resize((pageCount + PdfPageTree::MAX_KIDS - 1) / PdfPageTree::MAX_KIDS);
+        nextNumber_ = firstNumber;
+        offsets_.resize((std::min)(offsets_.size(), static_cast<size_t>(firstNumber)));
+        for (uint64_t key : indexAdded_) {
+            index_.erase(key);
+        }
+        foldedObjects_ = foldedObjects;
+        foldedBytes_ = foldedBytes;
+    }
+    indexAdded_.clear();
+
+    renumber_.clear();
+    pending_.clear();
+    return copied;
+}
+
+bool PdfRawWriter::MakeFragment(size_t outputSize, uint32_t firstNumber, size_t firstLeaf, size_t firstPage,
+    std::vector<Fragment::Site>& sites, Fragment& fragment) const {
+    // Local numbers follow the order the numbers were given out in, without
+    // the page tree nodes; that puts the pages first.
+    std::vector<uint32_t> local(nextNumber_ - firstNumber, 0);
+    size_t leaf = firstLeaf;
+    uint32_t count = 0;
+    for (uint32_t number = firstNumber; number < nextNumber_; ++number) {
+        if (leaf < leaves_.size() && leaves_[leaf] == number) {
+            ++leaf;
+            continue;
+        }
+        local[number - firstNumber] = ++count;
+    }
+
+    fragment.pageCount = static_cast<uint32_t>(pages_.size() - firstPage);
+    fragment.objectCount = count;
+    fragment.data.assign(out_, outputSize, std::string::npos);
+    fragment.sites.reserve(sites.size());
+
+    // A PARENT site belongs to the page whose OBJECT site precedes it.
+    uint32_t object = 0;
+    for (Fragment::Site site : sites) {
+        site.offset -= outputSize;
+        if (site.type == Fragment::PARENT) {
+            if (object == 0 || object > fragment.pageCount) {
+                return false;
+            }
+            site.value = object - 1;
+        }
+        else {
+            if (site.value < firstNumber || site.value >= nextNumber_ || local[site.value - firstNumber] == 0) {
+                return false;
+            }
+            site.value = local[site.value - firstNumber];
+            if (site.type == Fragment::OBJECT) {
+                object = site.value;
+            }
+        }
+        fragment.sites.push_back(site);
+    }
+    return true;
+}
+
+bool PdfRawWriter::AddFragment(const Fragment& fragment) {
+    // Checked as a whole first: fragments come from files.
+    if (fragment.pageCount == 0 || fragment.pageCount > fragment.objectCount) {
+        return false;
+    }
+    uint64_t end = 0;
+    for (const Fragment::Site& site : fragment.sites) {
+        uint32_t limit = site.type == Fragment::PARENT ? fragment.pageCount : fragment.objectCount + 1;
+        if (site.offset < end || site.offset + site.length > fragment.data.size() || site.type > Fragment::PARENT ||
+            site.value >= limit || (site.type != Fragment::PARENT && site.value == 0)) {
+            return false;
+        }
+        end = site.offset + site.length;
+    }
+
+    size_t firstPage = pages_.size();
+    std::vector<uint32_t> numbers(fragment.objectCount + 1, 0);
+    for (uint32_t i = 1; i <= fragment.pageCount; ++i) {
+        if (pages_.size() % PdfPageTree::MAX_KIDS == 0) {
+            leaves_.push_back(nextNumber_++);
+        }
+        numbers[i] = nextNumber_++;
+        pages_.push_back(numbers[i]);
+    }
+    for (uint32_t i = fragment.pageCount + 1; i <= fragment.objectCount; ++i) {
+        numbers[i] = nextNumber_++;
+    }
+    if (offsets_.size() < nextNumber_) {
+        offsets_.resize(nextNumber_, 0);
+    }
+
+    out_.reserve(out_.size() + fragment.data.size());
+    size_t pos = 0;
+    for (const Fragment::Site& site : fragment.sites) {
+        out_.append(fragment.data, pos, static_cast<size_t>(site.offset) - pos);
+        uint32_t number = site.type == Fragment::PARENT
+            ? leaves_[(firstPage + site.value) / PdfPageTree::MAX_KIDS]
+            : numbers[site.value];
+        if (site.type == Fragment::OBJECT) {
+            offsets_[number] = spilled_ + out_.size();
+        }
+        out_ += std::to_string(number);
+        pos = static_cast<size_t>(site.offset + site.length);
+    }
+    out_.append(fragment.data, pos, std::string::npos);
+
+    Logger::Debug("Raw copy: " + std::to_string(fragment.pageCount) + " page(s), " +
+        std::to_string(fragment.objectCount) + " object(s) from a captured fragment");
+    return true;
+}
+
+void PdfRawWriter::WritePageTree() {
+    // Levels above the leaves, bottom-up, until one node is left: the root.
+    std::vector<std::vector<uint32_t>> levels(1, leaves_);
+    while (levels.back().size() > 1) {
+        size_t count = (levels.back().size() + PdfPageTree::MAX_KIDS - 1) / PdfPageTree::MAX_KIDS;
+        std::vector<uint32_t> level(count);
+        for (uint32_t& number : level) {
+            number = nextNumber_++;
+        }
+        levels.push_back(level);
+    }
+
+    // Pages under a node of level L: MAX_KIDS^(L+1), fewer for the last one.
+    size_t span = PdfPageTree::MAX_KIDS;
+    for (size_t depth = 0; depth < levels.size(); ++depth, span *= PdfPageTree::MAX_KIDS) {
+        const std::vector<uint32_t>& kids = depth == 0 ? pages_ : levels[depth - 1];
+        for (size_t i = 0; i < levels[depth].size(); ++i) {
+            BeginObject(levels[depth][i]);
+            out_ += "<</Type /Pages";
+            if (depth + 1 < levels.size()) {
+                out_ += " /Parent " + std::to_string(levels[depth + 1][i / PdfPageTree::MAX_KIDS]) + " 0 R";
+            }
+            out_ += " /Kids [";
+            size_t end = (std::min)((i + 1) * PdfPageTree::MAX_KIDS, kids.size());
+            for (size_t k = i * PdfPageTree::MAX_KIDS; k < end; ++k) {
+                out_ += (k == i * PdfPageTree::MAX_KIDS ? "" : " ") + std::to_string(kids[k]) + " 0 R";
+            }
+            size_t count = (std::min)((i + 1) * span, pages_.size()) - i * span;
+            out_ += "] /Count " + std::to_string(count) + ">>\nendobj\n";
+        }
+    }
+
+    offsets_[CATALOG_NUMBER] = spilled_ + out_.size();
+    out_ += std::to_string(CATALOG_NUMBER) + " 0 obj\n<</Type /Catalog /Pages " +
+        std::to_string(levels.back()[0]) + " 0 R>>\nendobj\n";
+}
+
+bool PdfRawWriter::Finish(const std::string& path) {
+    if (pages_.empty()) {
+        Logger::Error("Raw copy: no pages to write");
+        return false;
+    }
+
+    WritePageTree();
+    offsets_.resize(nextNumber_, 0);
+
+    // Same content, same identifier, as in the other layouts. Of a spilled
+    // document only the part still in memory is hashed, with its offset.
+    char id[33];
+    std::snprintf(id, sizeof(id), "%016llX%016llX",
+        static_cast<unsigned long long>(ContentHash::Hash64(out_.data(), out_.size(), spilled_ * 2)),
+        static_cast<unsigned long long>(ContentHash::Hash64(out_.data(), out_.size(), spilled_ * 2 + 1)));
+
+    size_t xrefOffset = spilled_ + out_.size();
+    out_ += "xref\n0 " + std::to_string(nextNumber_) + "\n0000000000 65535 f \n";
+    char line[24];
+    for (uint32_t number = 1; number < nextNumber_; ++number) {
+        std::snprintf(line, sizeof(line), offsets_[number] != 0 ? "%010llu 00000 n \n" : "%010llu 00001 f \n",
+            static_cast<unsigned long long>(offsets_[number]));
+        out_ += line;
+    }
+    out_ += "trailer\n<< /Size " + std::to_string(nextNumber_) + " /Root " + std::to_string(CATALOG_NUMBER) +
+        " 0 R /ID [<" + id + "><" + id + ">] >>\nstartxref\n" + std::to_string(xrefOffset) + "\n%%EOF\n";
+
+    size_t size = spilled_ + out_.size();
+    bool written = WaitForWrite();
+    if (written && spillPath_.empty()) {
+        written = FileSystemUtils::WriteBufferToFile(path, out_.data(), out_.size());
+    }
+    else if (written) {
+        written = FileSystemUtils::AppendBufferToFile(spillPath_, out_.data(), out_.size()) &&
+            FileSystemUtils::RenameFile(spillPath_, path);
+        if (written) {
+            spillPath_.clear();
+        }
+    }
+
+    if (!written) {
+        Logger::Error("Raw copy: failed to write " + path);
+        FileSystemUtils::DelFile(path);
+        Reset();
+        return false;
+    }
+
+    Logger::Debug("Raw copy: " + std::to_string(pages_.size()) + " page(s), " +
+        std::to_string(nextNumber_ - 1) + " object(s), " + std::to_string(size) + " bytes");
+
+    Reset();
+    return true;
+}
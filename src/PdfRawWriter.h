@@ -0,0 +1,162 @@
+#ifndef __PDF_RAW_WRITER_H__
+#define __PDF_RAW_WRITER_H__
+
+#include <cstdint>
+#include <future>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "PdfLazyReader.h"
+#include "PdfOutputWriter.h"
+
+// Concatenates well-formed input PDFs without building an object model.
+//
+// Objects reachable from the pages of an input are located through its
+// cross-reference data (PdfLazyReader), their source text is copied with
+// the indirect references renumbered by a small tokenizer, and stream data
+// is copied byte for byte, still encoded. Finish() adds a new catalog, a
+// balanced page tree (see PdfPageTree) and a cross-reference table.
+//
+// An input is rejected as a whole when any object it needs cannot be parsed
+// or a stream /Length does not match its data; the output is then left as
+// it was before AddDocument(), so the caller can take the PoDoFo path.
+//
+// The output is kept in memory unless Spill() moves it to a file; only
+// object offsets, the page list and the deduplication index stay in memory
+// after that. Spilled output is written on a background thread while the
+// next input is read.
+//
+// With deduplication on, stream objects without references (font programs,
+// ICC profiles, most images) that are byte-identical to one already written
+// are not written again; references to them point at the first copy.
+class PdfRawWriter {
+public:
+    explicit PdfRawWriter(bool deduplicate = false);
+    ~PdfRawWriter();
+
+    PdfRawWriter(const PdfRawWriter&) = delete;
+    PdfRawWriter& operator=(const PdfRawWriter&) = delete;
+
+    // One input as AddDocument() wrote it, with its object numbers local
+    // (1..objectCount, the pages first) and the place of every number
+    // marked, so that it can be added again without parsing. Streams are
+    // not folded while a fragment is captured, so a fragment never refers
+    // to objects of other inputs.
+    struct Fragment {
+        enum SiteType : uint32_t {
+            OBJECT = 0,         // "N 0 obj" of local object N
+            REFERENCE = 1,      // "N 0 R" to local object N
+            PARENT = 2,         // page tree node of local page N (0-based)
+        };
+        struct Site {
+            uint64_t offset;    // of the number in data
+            uint32_t length;    // of the number in data
+            uint32_t type;
+            uint32_t value;
+        };
+
+        std::string data;
+        std::vector<Site> sites;    // in data order
+        uint32_t pageCount = 0;
+        uint32_t objectCount = 0;
+    };
+
+    // Starts a new output document; an unfinished spill file is deleted.
+    void Reset();
+
+    // With `capture`, also fills it with the input as written; it is left
+    // empty when the input is rejected.
+    bool AddDocument(PdfLazyReader& reader, Fragment* capture = nullptr);
+    // Adds an input captured earlier; false, with the output unchanged, if
+    // the fragment is inconsistent.
+    bool AddFragment(const Fragment& fragment);
+
+    size_t GetPageCount() const;
+    // Bytes written so far (the output without catalog, tree and xref),
+    // including the spilled ones.
+    size_t GetSize() const;
+    // Bytes moved to the spill file so far.
+    size_t GetSpilledSize() const;
+
+    // Starts appending the output held in memory to `path`, created by the
+    // first call, and frees it. Every call for one document uses the same
+    // path. A write that fails is reported by the next Spill() or Finish().
+    bool Spill(const std::string& path);
+
+    size_t GetFoldedObjects() const;
+    uint64_t GetFoldedBytes() const;
+
+    // Completes the document, writes it to `path` (renaming the spill file,
+    // which should be on the same volume) and resets the writer.
+    bool Finish(const std::string& path);
+
+private:
+    struct IndexEntry {
+        uint64_t check;         // second hash, with another seed
+        uint32_t number;
+        size_t textSize;
+        size_t streamSize;
+        // Source of an object of the input being copied that is not written
+        // yet; the reader keeps it while that input is copied.
+        const PdfLazyReader::Object* source;
+    };
+
+    std::string out_;
+    std::string spillPath_;
+    size_t spilled_ = 0;
+    // Output being written to the spill file by write_.
+    std::string writing_;
+    std::future<bool> write_;
+
+    bool deduplicate_;
+    std::unordered_map<uint64_t, IndexEntry> index_;
+    // Index keys added by the input being copied, removed if it is rejected.
+    std::vector<uint64_t> indexAdded_;
+    size_t foldedObjects_ = 0;
+    uint64_t foldedBytes_ = 0;
+    std::vector<uint64_t> offsets_;     // by output number; 0 until written
+    std::vector<uint32_t> pages_;       // output numbers in page order
+    // Bottom level of the page tree, one node per PdfPageTree::MAX_KIDS
+    // pages; numbered as the pages arrive so pages can name their parent.
+    std::vector<uint32_t> leaves_;
+    uint32_t nextNumber_ = 0;
+
+    // Output numbers of the input being copied, indexed by input number;
+    // 0 for objects not (yet) copied.
+    PdfOutputWriter::Renumbering renumber_;
+    std::vector<uint32_t> pending_;
+    // Number sites of the input being copied, with output numbers and
+    // offsets into out_; null unless a fragment is captured.
+    std::vector<Fragment::Site>* sites_ = nullptr;
+
+    bool CopyDocument(PdfLazyReader& reader);
+    bool MakeFragment(size_t outputSize, uint32_t firstNumber, size_t firstLeaf, size_t firstPage,
+        std::vector<Fragment::Site>& sites, Fragment& fragment) const;
+    void AppendNumber(uint32_t number, uint32_t type);
+    bool WaitForWrite();
+    // Output number of an identical stream already written, else 0 after
+    // recording this one under `number`.
+    uint32_t FindDuplicate(const PdfLazyReader::Object& object, uint32_t number);
+    // Compares the bytes behind an index entry with the object, from the
+    // source, the output in memory or the spill file.
+    bool SameStream(const IndexEntry& entry, const PdfLazyReader::Object& object);
+    void BeginObject(uint32_t number);
+
+    // Output number for a reference to an input object, queueing the object
+    // for copying on first use; 0 when the reference becomes null. Sets
+    // `failed` if the object cannot be parsed.
+    uint32_t Map(PdfLazyReader& reader, uint32_t number, bool& failed);
+    void MapReferences(PdfLazyReader& reader, const PoDoFo::PdfObject& value, bool& failed);
+
+    // `index` is the position of the page in the output.
+    bool WritePage(PdfLazyReader& reader, const PdfLazyReader::Page& page, size_t index);
+    void WritePageTree();
+    bool WriteObject(PdfLazyReader& reader, uint32_t number);
+
+    // Appends text with every "N G R" replaced by its output reference.
+    bool AppendRenumbered(PdfLazyReader& reader, const char* text, size_t size);
+
+    static constexpr uint32_t CATALOG_NUMBER = 1;
+};
+
+#endif // __PDF_RAW_WRITER_H__
@@ -0,0 +1,381 @@
+#include <cctype>
+#include <unordered_set>
+#include <vector>
+#include "Logger.h"
+#include "PdfOutputWriter.h"
+#include "PdfSlimmer.h"
+
+const char* const PdfSlimmer::CATEGORY_NAMES[CATEGORY_COUNT] = {
+    "unused", "thumbnails", "pieceinfo", "metadata", "javascript", "forms"
+};
+
+namespace {
+
+    using PoDoFo::PdfObject;
+    using PoDoFo::PdfReference;
+    using PoDoFo::PdfDictionary;
+
+    PdfObject* Resolve(PoDoFo::PdfIndirectObjectList& objects, PdfObject* obj) {
+        if (obj && obj->IsReference()) {
+            return objects.GetObject(obj->GetReference());
+        }
+        return obj;
+    }
+
+    bool IsName(const PdfObject* obj, const char* name) {
+        return obj && obj->IsName() && obj->GetName() == name;
+    }
+
+    uint64_t ValueSize(const PdfObject& obj) {
+        std::string text;
+        PdfOutputWriter::AppendValue(obj, text);
+        return text.size();
+    }
+
+    uint64_t ObjectSize(const PdfObject& obj) {
+        uint64_t size = ValueSize(obj);
+        if (obj.HasStream()) {
+            size += obj.GetStream()->GetCopy(true).size();
+        }
+        return size;
+    }
+
+    void CollectReferences(const PdfObject& obj, std::vector<PdfReference>& out) {
+        if (obj.IsReference()) {
+            out.push_back(obj.GetReference());
+        }
+        else if (obj.IsArray()) {
+            for (const PdfObject& item : obj.GetArray()) {
+                CollectReferences(item, out);
+            }
+        }
+        else if (obj.IsDictionary()) {
+            for (const auto& pair : obj.GetDictionary()) {
+                CollectReferences(pair.second, out);
+            }
+        }
+    }
+
+    std::unordered_set<uint32_t> Reachable(PoDoFo::PdfMemDocument& doc) {
+        PoDoFo::PdfIndirectObjectList& objects = doc.GetObjects();
+        std::vector<PdfReference> pending;
+        CollectReferences(doc.GetTrailer(), pending);
+        pending.push_back(doc.GetCatalog().GetObject().GetIndirectReference());
+
+        std::unordered_set<uint32_t> reachable;
+        while (!pending.empty()) {
+            PdfReference ref = pending.back();
+            pending.pop_back();
+            if (!reachable.insert(ref.ObjectNumber()).second) {
+                continue;
+            }
+            PdfObject* obj = objects.GetObject(ref);
+            if (obj) {
+                CollectReferences(*obj, pending);
+            }
+        }
+        return reachable;
+    }
+
+    // Removes the objects that are not reachable from the trailer, except
+    // those in `keep`, and books them under category `index`.
+    void Sweep(PoDoFo::PdfMemDocument& doc, const std::unordered_set<uint32_t>* keep, int index,
+        PdfSlimmer::Report& report) {
+        std::unordered_set<uint32_t> reachable = Reachable(doc);
+        PoDoFo::PdfIndirectObjectList& objects = doc.GetObjects();
+
+        std::vector<PdfReference> garbage;
+        for (PdfObject* obj : objects) {
+            uint32_t number = obj->GetIndirectReference().ObjectNumber();
+            if (reachable.count(number) || (keep && keep->count(number))) {
+                continue;
+            }
+            report.bytes[index] += ObjectSize(*obj);
+            ++report.objects[index];
+            garbage.push_back(obj->GetIndirectReference());
+        }
+
+        for (const PdfReference& ref : garbage) {
+            objects.RemoveObject(ref, false);
+        }
+    }
+
+    void RemoveKey(PdfDictionary& dict, const PoDoFo::PdfName& key, uint64_t& bytes) {
+        const PdfObject* value = dict.GetKey(key);
+        if (value) {
+            bytes += key.ToString().size() + 1 + ValueSize(*value);
+            dict.RemoveKey(key);
+        }
+    }
+
+    bool IsJavaScriptAction(PoDoFo::PdfIndirectObjectList& objects, PdfObject* action) {
+        action = Resolve(objects, action);
+        return action && action->IsDictionary() && IsName(action->GetDictionary().GetKey("S"), "JavaScript");
+    }
+
+    void StripJavaScript(PoDoFo::PdfMemDocument& doc, uint64_t& bytes) {
+        PoDoFo::PdfIndirectObjectList& objects = doc.GetObjects();
+
+        PdfObject* names = Resolve(objects, doc.GetCatalog().GetDictionary().GetKey("Names"));
+        if (names && names->IsDictionary()) {
+            RemoveKey(names->GetDictionary(), "JavaScript", bytes);
+        }
+
+        for (PdfObject* obj : objects) {
+            if (!obj->IsDictionary()) {
+                continue;
+            }
+            PdfDictionary& dict = obj->GetDictionary();
+
+            for (const char* key : { "OpenAction", "A" }) {
+                if (IsJavaScriptAction(objects, dict.GetKey(key))) {
+                    RemoveKey(dict, key, bytes);
+                }
+            }
+
+            PdfObject* triggers = Resolve(objects, dict.GetKey("AA"));
+            if (!triggers || !triggers->IsDictionary()) {
+                continue;
+            }
+            std::vector<PoDoFo::PdfName> scripts;
+            for (auto& pair : triggers->GetDictionary()) {
+                if (IsJavaScriptAction(objects, &pair.second)) {
+                    scripts.push_back(pair.first);
+                }
+            }
+            for (const PoDoFo::PdfName& trigger : scripts) {
+                RemoveKey(triggers->GetDictionary(), trigger, bytes);
+            }
+            if (triggers->GetDictionary().GetSize() == 0) {
+                RemoveKey(dict, "AA", bytes);
+            }
+        }
+    }
+
+    // Font names (with the leading slash) mentioned by a /DA string.
+    void CollectFontNames(const PdfObject* da, std::unordered_set<std::string>& names) {
+        if (!da || !da->IsString()) {
+            return;
+        }
+        std::string text(da->GetString().GetString());
+        for (size_t i = 0; i < text.size(); ++i) {
+            if (text[i] != '/') {
+                continue;
+            }
+            size_t end = i + 1;
+            while (end < text.size() && !std::isspace(static_cast<unsigned char>(text[end])) &&
+                text[end] != '/' && text[end] != '[' && text[end] != '(' && text[end] != '<') {
+                ++end;
+            }
+            names.insert(text.substr(i, end - i));
+            i = end - 1;
+        }
+    }
+
+    void StripForms(PoDoFo::PdfMemDocument& doc, uint64_t& bytes) {
+        PoDoFo::PdfIndirectObjectList& objects = doc.GetObjects();
+        PdfDictionary& catalog = doc.GetCatalog().GetDictionary();
+
+        PdfObject* acroForm = Resolve(objects, catalog.GetKey("AcroForm"));
+        if (!acroForm || !acroForm->IsDictionary()) {
+            return;
+        }
+
+        PdfObject* fields = Resolve(objects, acroForm->GetDictionary().GetKey("Fields"));
+        if (!fields || !fields->IsArray() || fields->GetArray().GetSize() == 0) {
+            // Inputs that had a form once but no fields left.
+            RemoveKey(catalog, "AcroForm", bytes);
+            return;
+        }
+
+        std::unordered_set<std::string> used;
+        CollectFontNames(acroForm->GetDictionary().GetKey("DA"), used);
+
+        std::vector<PdfObject*> pending;
+        std::unordered_set<PdfObject*> visited;
+        for (PdfObject& item : fields->GetArray()) {
+            pending.push_back(&item);
+        }
+        while (!pending.empty()) {
+            PdfObject* field = Resolve(objects, pending.back());
+            pending.pop_back();
+            if (!field || !field->IsDictionary() || !visited.insert(field).second) {
+                continue;
+            }
+            CollectFontNames(field->GetDictionary().GetKey("DA"), used);
+            PdfObject* kids = Resolve(objects, field->GetDictionary().GetKey("Kids"));
+            if (kids && kids->IsArray()) {
+                for (PdfObject& kid : kids->GetArray()) {
+                    pending.push_back(&kid);
+                }
+            }
+        }
+
+        PdfObject* resources = Resolve(objects, acroForm->GetDictionary().GetKey("DR"));
+        PdfObject* fonts = resources && resources->IsDictionary()
+            ? Resolve(objects, resources->GetDictionary().GetKey("Font"))
+            : nullptr;
+        if (!fonts || !fonts->IsDictionary()) {
+            return;
+        }
+
+        std::vector<PoDoFo::PdfName> unused;
+        for (const auto& pair : fonts->GetDictionary()) {
+            if (!used.count(pair.first.ToString())) {
+                unused.push_back(pair.first);
+            }
+        }
+        for (const PoDoFo::PdfName& name : unused) {
+            RemoveKey(fonts->GetDictionary(), name, bytes);
+        }
+    }
+
+    void StripKey(PoDoFo::PdfMemDocument& doc, const char* key, bool pagesOnly, uint64_t& bytes) {
+        for (PdfObject* obj : doc.GetObjects()) {
+            if (!obj->IsDictionary()) {
+                continue;
+            }
+            PdfDictionary& dict = obj->GetDictionary();
+            if (pagesOnly && !IsName(dict.GetKey("Type"), "Page")) {
+                continue;
+            }
+            RemoveKey(dict, key, bytes);
+        }
+    }
+}
+
+void PdfSlimmer::Report::Add(const Report& other) {
+    for (int i = 0; i < CATEGORY_COUNT; ++i) {
+        bytes[i] += other.bytes[i];
+        objects[i] += other.objects[i];
+    }
+}
+
+std::string PdfSlimmer::Report::ToString() const {
+    std::string text;
+    for (int i = 0; i < CATEGORY_COUNT; ++i) {
+        if (bytes[i] == 0 && objects[i] == 0) {
+            continue;
+        }
+        if (!text.empty()) {
+            text += "; ";
+        }
+        text += std::string(CATEGORY_NAMES[i]) + ": " + std::to_string(objects[i]) + " object(s), " +
+            std::to_string(bytes[i]) + " bytes";
+    }
+    return text.empty() ? "nothing removed" : text;
+}
+
+bool PdfSlimmer::ParseCategories(const std::string& text, unsigned& categories) {
+    unsigned result = 0;
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t end = text.find_first_of(",; ", pos);
+        if (end == std::string::npos) {
+            end = text.size();
+        }
+
+        std::string name;
+        for (size_t i = pos; i < end; ++i) {
+            name += static_cast<char>(std::tolower(static_cast<unsigned char>(text[i])));
+        }
+        pos = end + 1;
+
+        if (name.empty()) {
+            continue;
+        }
+        if (name == "all") {
+            result = (1u << CATEGORY_COUNT) - 1;
+            continue;
+        }
+
+        bool known = false;
+        for (int i = 0; i < CATEGORY_COUNT; ++i) {
+            if (name == CATEGORY_NAMES[i]) {
+                result |= 1u << i;
+                known = true;
+            }
+        }
+        if (!known) {
+            Logger::Error("Unknown slimming category: " + name);
+            return false;
+        }
+    }
+
+    categories = result;
+    return true;
+}
+
+std::string PdfSlimmer::FormatCategories(unsigned categories) {
+    std::string text;
+    for (int i = 0; i < CATEGORY_COUNT; ++i) {
+        if (categories & (1u << i)) {
+            text += (text.empty() ? "" : ", ") + std::string(CATEGORY_NAMES[i]);
+        }
+    }
+    return text;
+}
+
+bool PdfSlimmer::Slim(PoDoFo::PdfMemDocument& doc, unsigned categories, Report& report) {
+    try {
+        Report part;
+
+        // Objects orphaned by a category are booked under it. Unreachable
+        // objects that were there before stay unless UNUSED is selected.
+        std::unordered_set<uint32_t> keep;
+        const std::unordered_set<uint32_t>* keepPtr = nullptr;
+        if (categories & UNUSED) {
+            Sweep(doc, nullptr, 0, part);
+        }
+        else {
+            std::unordered_set<uint32_t> reachable = Reachable(doc);
+            for (PdfObject* obj : doc.GetObjects()) {
+                uint32_t number = obj->GetIndirectReference().ObjectNumber();
+                if (!reachable.count(number)) {
+                    keep.insert(number);
+                }
+            }
+            keepPtr = &keep;
+        }
+
+        for (int index = 1; index < CATEGORY_COUNT; ++index) {
+            unsigned category = 1u << index;
+            if (!(categories & category)) {
+                continue;
+            }
+
+            uint64_t bytes = 0;
+            switch (category) {
+            case THUMBNAILS:
+                StripKey(doc, "Thumb", true, bytes);
+                break;
+            case PIECE_INFO:
+                StripKey(doc, "PieceInfo", false, bytes);
+                break;
+            case METADATA:
+                StripKey(doc, "Metadata", false, bytes);
+                break;
+            case JAVASCRIPT:
+                StripJavaScript(doc, bytes);
+                break;
+            case FORMS:
+                StripForms(doc, bytes);
+                break;
+            }
+            part.bytes[index] += bytes;
+            Sweep(doc, keepPtr, index, part);
+        }
+
+        report.Add(part);
+        Logger::Debug("Slimming: " + part.ToString());
+        return true;
+    }
+    catch (const PoDoFo::PdfError& e) {
+        Logger::Error("Slimming failed: PdfError code " + std::to_string(static_cast<int>(e.GetCode())));
+        return false;
+    }
+    catch (const std::exception& e) {
+        Logger::Error("Slimming failed: " + std::string(e.what()));
+        return false;
+    }
+}
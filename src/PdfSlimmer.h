@@ -0,0 +1,45 @@
+#ifndef __PDF_SLIMMER_H__
+#define __PDF_SLIMMER_H__
+
+#include <cstdint>
+#include <string>
+#include "podofo/podofo.h"
+
+// Removes dead weight from a merged part before it is saved: objects no
+// longer reachable from the trailer and, per category, data that viewers
+// of an archive do not need (page thumbnails, application private data,
+// XMP metadata, JavaScript, unused form resources).
+class PdfSlimmer {
+public:
+    enum Category : unsigned {
+        UNUSED = 1u << 0,       // objects not reachable from the trailer
+        THUMBNAILS = 1u << 1,   // /Thumb of pages
+        PIECE_INFO = 1u << 2,   // /PieceInfo of pages, forms and the catalog
+        METADATA = 1u << 3,     // /Metadata XMP streams
+        JAVASCRIPT = 1u << 4,   // document scripts and JavaScript actions
+        FORMS = 1u << 5,        // an AcroForm without fields, unused /DR fonts
+    };
+
+    static constexpr int CATEGORY_COUNT = 6;
+
+    // Bytes and objects removed per category, accumulated over calls.
+    struct Report {
+        uint64_t bytes[CATEGORY_COUNT] = {};
+        size_t objects[CATEGORY_COUNT] = {};
+
+        void Add(const Report& other);
+        std::string ToString() const;
+    };
+
+    // Parses a comma separated list of category names ("unused, metadata")
+    // or "all"; an empty list gives 0. Returns false on an unknown name.
+    static bool ParseCategories(const std::string& text, unsigned& categories);
+    static std::string FormatCategories(unsigned categories);
+
+    static bool Slim(PoDoFo::PdfMemDocument& doc, unsigned categories, Report& report);
+
+private:
+    static const char* const CATEGORY_NAMES[CATEGORY_COUNT];
+};
+
+#endif // __PDF_SLIMMER_H__
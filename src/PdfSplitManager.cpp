@@ -1,13 +1,27 @@
+#include <algorithm>
 #include <podofo/podofo.h>
 #include "Logger.h"
 #include "PdfSplitManager.h"
 #include "PdfProcessor.h"
+#include "FontSubsetConsolidator.h"
+#include "StreamRecompressor.h"
+#include "PdfOutputWriter.h"
+#include "PdfLinearizedWriter.h"
+#include "PdfPageTree.h"
+#include "BufferPool.h"
+#include "PdfTemplateCache.h"
 
-PdfSplitManager::PdfSplitManager(const std::string& basePath, double maxSizeMB)
+PdfSplitManager::PdfSplitManager(const std::string& basePath, double maxSizeMB, const MergeOptions& options)
     : basePath_(basePath)
     , currentPart_(1)
     , accumulatedSize_(0)
-    , currentDoc_(std::make_unique<PoDoFo::PdfMemDocument>()) {
+    , currentDoc_(std::make_unique<PoDoFo::PdfMemDocument>())
+    , options_(options)
+    , incrementalWriter_(options.compressionLevel)
+    , rawCopy_((options.rawCopy || options.streamingOutput) && !options.appendToExisting)
+    , streaming_(options.streamingOutput && !options.appendToExisting)
+    , rawWriter_(options.deduplicateResources)
+    , memoryBudget_(options.appendToExisting ? 0 : static_cast<size_t>(options.memoryBudgetMB) * BYTES_IN_MEGABYTE) {
 
     maxSizeBytes_ = (maxSizeMB > 0)
         ? static_cast<size_t>(maxSizeMB * BYTES_IN_MEGABYTE)
@@ -20,6 +34,57 @@ PdfSplitManager::PdfSplitManager(const std::string& basePath, double maxSizeMB)
     else {
         Logger::Debug("Split mode disabled");
     }
+
+    Logger::Debug("Resource deduplication: " + std::string(options_.deduplicateResources ? "ON" : "OFF"));
+    Logger::Debug("Font subset consolidation: " + std::string(options_.consolidateFontSubsets ? "ON" : "OFF"));
+    Logger::Debug("Output layout: " + std::string(options_.linearize ? "linearized" :
+        options_.compactOutput ? "compact (object streams)" : "classic"));
+    Logger::Debug("Slimming: " + (options_.slimCategories != 0
+        ? PdfSlimmer::FormatCategories(options_.slimCategories) : std::string("OFF")));
+    Logger::Debug("Duplicate pages: " + std::string(
+        options_.duplicatePages == DuplicatePageDetector::REMOVE ? "remove" :
+        options_.duplicatePages == DuplicatePageDetector::REPORT ? "report" : "OFF") +
+        (options_.duplicatePages != DuplicatePageDetector::OFF && rawCopy_ ? " (not applied to raw copy)" : ""));
+    Logger::Debug("Append to existing output: " + std::string(options_.appendToExisting ? "ON" : "OFF"));
+    Logger::Debug("Stream compression level: " + std::to_string(options_.compressionLevel) +
+        (options_.compressionLevel > 0 ? "" : " (OFF)"));
+    Logger::Debug("Lazy input loading: " + std::string(options_.lazyInputLoading ? "ON" : "OFF"));
+    Logger::Debug("Parse threads: " + (options_.parseThreads == 1 ? std::string("1 (serial)") :
+        options_.parseThreads == 0 ? std::string("one per core") : std::to_string(options_.parseThreads)));
+    Logger::Debug("Raw copy merge: " + std::string(rawCopy_ ? "ON" : options_.rawCopy ? "OFF (append mode)" : "OFF"));
+    Logger::Debug("Streaming output: " + std::string(streaming_ ? "ON" :
+        options_.streamingOutput ? "OFF (append mode)" : "OFF"));
+    if (rawCopy_) {
+        Logger::Debug("Raw copy: consolidation, compression, slimming and output layouts are not applied; "
+            "deduplication folds identical streams only");
+    }
+    if (!options_.parseCacheFolder.empty()) {
+        if (!rawCopy_) {
+            Logger::Debug("Parse cache: OFF (used by raw copy only)");
+        }
+        else if (!parseCache_.Open(options_.parseCacheFolder,
+            static_cast<size_t>((std::max)(options_.parseCacheLimitMB, 0)) * BYTES_IN_MEGABYTE)) {
+            Logger::Debug("Warning: parse cache not available");
+        }
+    }
+    resumable_ = options_.resumableMerge && maxSizeBytes_ > 0 && !options_.appendToExisting;
+    if (resumable_) {
+        manifest_.SetSettings(GetOutputSettings());
+        resuming_ = previous_.Load(GetManifestPath(), GetOutputSettings()) && !previous_.GetParts().empty();
+        Logger::Debug("Resumable merge: ON, " + std::to_string(previous_.GetParts().size()) +
+            " part(s) of the previous run recorded");
+    }
+    else {
+        Logger::Debug("Resumable merge: " + std::string(!options_.resumableMerge ? "OFF" :
+            options_.appendToExisting ? "OFF (append mode)" : "OFF (split mode only)"));
+    }
+    Logger::Debug("Memory budget: " + (memoryBudget_ > 0
+        ? std::to_string(memoryBudget_ / BYTES_IN_MEGABYTE) + " MB" +
+            (rawCopy_ ? "" : " (spilled parts are written in the classic layout)")
+        : std::string(options_.memoryBudgetMB > 0 ? "OFF (append mode)" : "OFF")));
+    Logger::Debug("Image target resolution: " + (options_.imageTargetDpi > 0
+        ? std::to_string(options_.imageTargetDpi) + " dpi, JPEG quality " + std::to_string(options_.imageJpegQuality)
+        : std::string("OFF")));
 }
 
 PdfSplitManager::~PdfSplitManager() {
@@ -39,12 +104,72 @@ PdfSplitManager::~PdfSplitManager() {
     }
 }
 
+bool PdfSplitManager::OpenExistingOutput() {
+    std::string path = basePath_;
+
+    if (maxSizeBytes_ > 0) {
+        int lastPart = 0;
+        while (FileSystemUtils::FileExists(FileSystemUtils::GeneratePartFileName(basePath_, lastPart + 1))) {
+            ++lastPart;
+        }
+        if (lastPart == 0) {
+            Logger::Debug("No existing parts, starting from part #1");
+            return true;
+        }
+
+        path = FileSystemUtils::GeneratePartFileName(basePath_, lastPart);
+        currentPart_ = lastPart;
+        if (FileSystemUtils::GetFileSize(path) >= maxSizeBytes_) {
+            currentPart_ = lastPart + 1;
+            Logger::Debug("Last part is full, starting part #" + std::to_string(currentPart_));
+            return true;
+        }
+    }
+    else if (!FileSystemUtils::FileExists(path)) {
+        Logger::Debug("No existing output, creating: " + path);
+        return true;
+    }
+
+    try {
+        currentDoc_->Load(path);
+    }
+    catch (const PoDoFo::PdfError& e) {
+        Logger::Error("Failed to load existing output: " + path + ", PdfError code " +
+            std::to_string(static_cast<int>(e.GetCode())));
+        return false;
+    }
+
+    if (!incrementalWriter_.Capture(*currentDoc_, path)) {
+        Logger::Error("Existing output cannot be updated: " + path);
+        return false;
+    }
+
+    appendTarget_ = path;
+    accumulatedSize_ = static_cast<size_t>(incrementalWriter_.GetBaseSize());
+    deduplicator_.SkipExistingObjects(*currentDoc_);
+
+    Logger::Debug("Appending to existing output: " + path + " (" +
+        std::to_string(currentDoc_->GetPages().GetCount()) + " page(s))");
+    return true;
+}
+
+size_t PdfSplitManager::GetCurrentPageCount() const {
+    // Outside raw copy mode the writer only holds spilled pages.
+    size_t pages = rawWriter_.GetPageCount();
+    if (!rawCopy_ && currentDoc_) {
+        pages += currentDoc_->GetPages().GetCount();
+    }
+    return pages;
+}
+
 bool PdfSplitManager::ShouldStartNewPart(size_t additionalSize) const {
     if (maxSizeBytes_ == 0) {
         return false;
     }
 
-    size_t estimatedSize = accumulatedSize_ + additionalSize;
+    // Parts are estimated from input sizes; in compact mode the output is
+    // scaled by the ratio observed on the previous part.
+    size_t estimatedSize = static_cast<size_t>((accumulatedSize_ + additionalSize) * outputRatio_);
     bool shouldSplit = estimatedSize >= maxSizeBytes_;
 
     if (shouldSplit) {
@@ -55,14 +180,60 @@ bool PdfSplitManager::ShouldStartNewPart(size_t additionalSize) const {
     return shouldSplit;
 }
 
+void PdfSplitManager::PrepareDocumentForSave() {
+    // Each stage works on the complete part and is optional: a failure is
+    // logged and the part is saved without it.
+    if (pagesRemoved_) {
+        // Objects only the removed duplicate pages used.
+        currentDoc_->CollectGarbage();
+        pagesRemoved_ = false;
+    }
+    if (!PdfPageTree::Rebuild(*currentDoc_)) {
+        Logger::Debug("Warning: page tree balancing skipped");
+    }
+    if (options_.slimCategories != 0 && !PdfSlimmer::Slim(*currentDoc_, options_.slimCategories, slimReport_)) {
+        Logger::Debug("Warning: slimming skipped");
+    }
+    if (options_.consolidateFontSubsets && !FontSubsetConsolidator::Consolidate(*currentDoc_)) {
+        Logger::Debug("Warning: font subset consolidation skipped");
+    }
+    if (options_.compressionLevel > 0 && !StreamRecompressor::Recompress(*currentDoc_, options_)) {
+        Logger::Debug("Warning: stream compression skipped");
+    }
+}
+
+bool PdfSplitManager::SerializeCurrentDocument(PoDoFo::charbuff& buffer) {
+    if (options_.linearize) {
+        PdfLinearizedWriter writer(options_.compressionLevel);
+        if (writer.Write(*currentDoc_, buffer)) {
+            return true;
+        }
+        // A part that cannot be linearized is still a valid document.
+        Logger::Debug("Warning: linearization skipped");
+        buffer.clear();
+    }
+    else if (options_.compactOutput) {
+        PdfOutputWriter writer(options_.compressionLevel);
+        return writer.WriteCompact(*currentDoc_, buffer);
+    }
+
+    PoDoFo::BufferStreamDevice device(buffer);
+    currentDoc_->Save(device);
+    return true;
+}
+
 bool PdfSplitManager::SaveCurrentDocument(const std::string& outputPath) {
-    if (!currentDoc_ || currentDoc_->GetPages().GetCount() == 0) {
+    if (GetCurrentPageCount() == 0) {
         return true;
     }
 
     std::string path = outputPath.empty() ? basePath_ : outputPath;
     bool isSplit = !outputPath.empty();
 
+    if (!appendTarget_.empty() && path == appendTarget_) {
+        return SaveIncrementalUpdate(path);
+    }
+
     if (isSplit) {
         Logger::Debug("Saving part " + std::to_string(currentPart_) + ": " + path);
     }
@@ -70,11 +241,28 @@ bool PdfSplitManager::SaveCurrentDocument(const std::string& outputPath) {
         Logger::Debug("Saving single file: " + path);
     }
 
+    if (rawCopy_) {
+        return SaveRawDocument(path, isSplit);
+    }
+
+    if (rawWriter_.GetPageCount() > 0) {
+        // Part of the pages are in the spill file; the rest joins them there.
+        if (!SpillCurrentDocument()) {
+            return false;
+        }
+        return SaveRawDocument(path, isSplit);
+    }
+
+    PrepareDocumentForSave();
+
     try {
-        PoDoFo::charbuff buffer;
-        {
-            PoDoFo::BufferStreamDevice device(buffer);
-            currentDoc_->Save(device);
+        // The input estimate is close to the output size, so the buffer
+        // rarely has to grow while the part is written.
+        PooledBuffer<PoDoFo::charbuff> pooled(accumulatedSize_);
+        PoDoFo::charbuff& buffer = pooled.Get();
+        if (!SerializeCurrentDocument(buffer)) {
+            Logger::Error("Failed to serialize document");
+            return false;
         }
 
         Logger::Debug("Document saved to buffer, size: " + std::to_string(buffer.size()));
@@ -95,6 +283,16 @@ bool PdfSplitManager::SaveCurrentDocument(const std::string& outputPath) {
         Logger::Debug("Saved file size: " + std::to_string(fileSize) + " bytes (" +
             std::to_string(fileSize / BYTES_IN_MEGABYTE) + " MB)");
 
+        if (options_.deduplicateResources) {
+            Logger::Debug("Deduplication so far: " + std::to_string(deduplicator_.GetFoldedObjects()) +
+                " object(s), " + std::to_string(deduplicator_.GetSavedBytes()) + " bytes");
+        }
+
+        if (options_.compactOutput && accumulatedSize_ > 0) {
+            outputRatio_ = (std::min)(1.0, static_cast<double>(buffer.size()) * OUTPUT_RATIO_MARGIN / accumulatedSize_);
+            Logger::Debug("Output/input size ratio for next part: " + std::to_string(outputRatio_));
+        }
+
         if (isSplit) {
             savedFiles_.push_back(path);
         }
@@ -112,30 +310,402 @@ bool PdfSplitManager::SaveCurrentDocument(const std::string& outputPath) {
     }
 }
 
+bool PdfSplitManager::SaveIncrementalUpdate(const std::string& path) {
+    Logger::Debug("Appending incremental update to: " + path);
+
+    // These stages rewrite objects all over the document, which would turn
+    // the update into a copy of the whole file.
+    if (options_.consolidateFontSubsets || options_.compressionLevel > 0 || options_.slimCategories != 0) {
+        Logger::Debug("Slimming, font subset consolidation and stream compression are not applied to updates");
+    }
+
+    try {
+        std::string update;
+        if (!incrementalWriter_.WriteUpdate(*currentDoc_, update)) {
+            Logger::Error("Failed to build incremental update");
+            return false;
+        }
+
+        if (update.empty()) {
+            Logger::Debug("No changes to append: " + path);
+            return true;
+        }
+
+        if (!FileSystemUtils::AppendBufferToFile(path, update.data(), update.size())) {
+            Logger::Error("Failed to append update to file: " + path);
+            return false;
+        }
+
+        Logger::Debug("Appended " + std::to_string(update.size()) + " bytes, file size: " +
+            std::to_string(FileSystemUtils::GetFileSize(path)) + " bytes");
+
+        if (maxSizeBytes_ > 0) {
+            savedFiles_.push_back(path);
+        }
+
+        return true;
+    }
+    catch (const PoDoFo::PdfError& e) {
+        Logger::Error("Failed to append update: PdfError code " +
+            std::to_string(static_cast<int>(e.GetCode())));
+        return false;
+    }
+    catch (const std::exception& e) {
+        Logger::Error("Exception: " + std::string(e.what()));
+        return false;
+    }
+}
+
+bool PdfSplitManager::SaveRawDocument(const std::string& path, bool isSplit) {
+    if (!rawWriter_.Finish(path)) {
+        Logger::Error("Failed to build raw copy document");
+        return false;
+    }
+
+    Logger::Debug("Successfully wrote " + std::to_string(FileSystemUtils::GetFileSize(path)) + " bytes to: " + path);
+    if (options_.deduplicateResources) {
+        Logger::Debug("Deduplication so far: " + std::to_string(rawWriter_.GetFoldedObjects()) +
+            " stream(s), " + std::to_string(rawWriter_.GetFoldedBytes()) + " bytes");
+    }
+
+    if (isSplit) {
+        savedFiles_.push_back(path);
+    }
+    return true;
+}
+
+bool PdfSplitManager::AddFileRaw(const std::string& filePath, size_t fileSize) {
+
+    if (ShouldStartNewPart(fileSize) && rawWriter_.GetPageCount() > 0) {
+        std::string partPath = FileSystemUtils::GeneratePartFileName(basePath_, currentPart_);
+        if (!SavePart(partPath)) {
+            return false;
+        }
+
+        currentPart_++;
+        accumulatedSize_ = rawWriter_.GetSize();
+        Logger::Debug("Started new document part #" + std::to_string(currentPart_));
+    }
+
+    // Image optimization needs the object model, so those inputs take the
+    // PoDoFo path as well.
+    bool copied = false;
+    bool cacheable = parseCache_.IsOpen() && PdfParseCache::Covers(filePath, options_);
+    PdfRawWriter::Fragment fragment;
+    if (cacheable && parseCache_.Lookup(filePath, fragment) && rawWriter_.AddFragment(fragment)) {
+        copied = true;
+    }
+    else {
+        PdfRawWriter::Fragment* capture = cacheable ? &fragment : nullptr;
+        if (FileSystemUtils::GetFileExtension(filePath) == ".pdf" && options_.imageTargetDpi == 0) {
+            PdfLazyReader reader;
+            bool opened = reader.Open(filePath);
+            if (opened && options_.parseThreads != 1) {
+                reader.Preload(static_cast<size_t>(options_.parseThreads));
+            }
+            copied = opened && rawWriter_.AddDocument(reader, capture);
+        }
+
+        if (!copied) {
+            // Images and inputs the raw path rejects are converted to a clean
+            // PDF by PoDoFo, which the raw path then always accepts.
+            Logger::Debug("Raw copy not possible, converting through PoDoFo: " + filePath);
+            PooledBuffer<PoDoFo::charbuff> pooled(fileSize);
+            PoDoFo::charbuff& buffer = pooled.Get();
+            if (!PdfProcessor::ConvertFile(filePath, options_, buffer)) {
+                Logger::Error("Failed to append file: " + filePath);
+                return false;
+            }
+
+            PdfLazyReader reader;
+            copied = reader.Open(buffer.data(), buffer.size()) && rawWriter_.AddDocument(reader, capture);
+        }
+
+        if (copied && cacheable) {
+            parseCache_.Store(filePath, fragment);
+        }
+    }
+
+    if (!copied) {
+        Logger::Error("Failed to append file: " + filePath);
+        return false;
+    }
+
+    // The writer knows the exact size of the part so far.
+    accumulatedSize_ = rawWriter_.GetSize();
+    Logger::Debug("File appended by raw copy: " + filePath);
+
+    if (streaming_ ||
+        (memoryBudget_ > 0 && rawWriter_.GetSize() - rawWriter_.GetSpilledSize() > memoryBudget_ * SPILL_FRACTION)) {
+        return SpillRawOutput();
+    }
+    return true;
+}
+
+std::string PdfSplitManager::GetSpillPath() const {
+    // Next to the output, so that the finished part is only renamed.
+    return basePath_ + ".spill";
+}
+
+bool PdfSplitManager::SpillRawOutput() {
+    size_t before = rawWriter_.GetSpilledSize();
+    if (!rawWriter_.Spill(GetSpillPath())) {
+        return false;
+    }
+    spilledBytes_ += rawWriter_.GetSpilledSize() - before;
+    inMemorySize_ = 0;
+    Logger::Debug("Spilled " + std::to_string(rawWriter_.GetSpilledSize() - before) + " bytes to: " + GetSpillPath());
+    return true;
+}
+
+bool PdfSplitManager::SpillCurrentDocument() {
+    if (currentDoc_->GetPages().GetCount() == 0) {
+        return true;
+    }
+
+    PrepareDocumentForSave();
+
+    try {
+        PooledBuffer<PoDoFo::charbuff> pooled(inMemorySize_);
+        PoDoFo::charbuff& buffer = pooled.Get();
+        PoDoFo::BufferStreamDevice device(buffer);
+        currentDoc_->Save(device);
+
+        // The object model goes before the copy is made, so that only the
+        // serialized pages and their copy are held at the same time.
+        currentDoc_ = std::make_unique<PoDoFo::PdfMemDocument>();
+        deduplicator_.Reset();
+
+        PdfLazyReader reader;
+        if (!reader.Open(buffer.data(), buffer.size()) || !rawWriter_.AddDocument(reader)) {
+            Logger::Error("Failed to move pages to the spill file");
+            return false;
+        }
+    }
+    catch (const PoDoFo::PdfError& e) {
+        Logger::Error("Failed to spill document: PdfError code " +
+            std::to_string(static_cast<int>(e.GetCode())));
+        return false;
+    }
+    catch (const std::exception& e) {
+        Logger::Error("Failed to spill document: " + std::string(e.what()));
+        return false;
+    }
+
+    return SpillRawOutput();
+}
+
 bool PdfSplitManager::AddFile(const std::string& filePath) {
-    Logger::Debug("Processing file: " + filePath + " (.pdf)");
+    FileSystemUtils::FileEntry file;
+    if (!FileSystemUtils::GetFileEntry(filePath, file)) {
+        // Fails with the reason when it is read.
+        file.path = filePath;
+    }
+    return AddInput(file, false);
+}
+
+bool PdfSplitManager::AddFile(const FileSystemUtils::FileEntry& file) {
+    return AddInput(file, false);
+}
+
+bool PdfSplitManager::AddTemplate(const std::string& filePath) {
+    FileSystemUtils::FileEntry file;
+    if (!FileSystemUtils::GetFileEntry(filePath, file)) {
+        file.path = filePath;
+    }
+    return AddInput(file, true);
+}
+
+bool PdfSplitManager::AddInput(const FileSystemUtils::FileEntry& file, bool isTemplate) {
+    PendingInput pending{ file, isTemplate, MergeManifest::Input() };
+    if (resumable_) {
+        if (!MergeManifest::Identify(file, pending.identity)) {
+            Logger::Error("Failed to read input: " + file.path);
+            return false;
+        }
+
+        if (resuming_) {
+            const MergeManifest::Part& part = previous_.GetParts()[resumePart_];
+            if (resumeQueue_.size() < part.inputs.size() && part.inputs[resumeQueue_.size()].SameAs(pending.identity)) {
+                resumeQueue_.push_back(pending);
+                // Whether an input follows an open part is known only in Finalize.
+                return resumeQueue_.size() < part.inputs.size() || part.open || ReusePart();
+            }
+            if (!StopResuming()) {
+                return false;
+            }
+        }
+    }
+    return AddPendingInput(pending);
+}
+
+bool PdfSplitManager::AddPendingInput(const PendingInput& pending) {
+    bool added;
+    if (rawCopy_) {
+        added = AddFileRaw(pending.file.path, static_cast<size_t>(pending.file.size));
+    }
+    else {
+        // The raw writer has no use for a parsed document; the parse cache
+        // serves templates there.
+        added = AddFileToDocument(pending.file.path, static_cast<size_t>(pending.file.size),
+            pending.isTemplate && FileSystemUtils::GetFileExtension(pending.file.path) == ".pdf");
+    }
+
+    if (added && resumable_) {
+        partInputs_.push_back(pending.identity);
+    }
+    return added;
+}
+
+bool PdfSplitManager::ReusePart() {
+    const MergeManifest::Part& part = previous_.GetParts()[resumePart_];
+    uint64_t size = 0;
+    uint64_t checksum = 0;
+    if (part.path != FileSystemUtils::GeneratePartFileName(basePath_, currentPart_) ||
+        !MergeManifest::Checksum(part.storedPath, size, checksum) ||
+        size != part.size || checksum != part.checksum) {
+        Logger::Debug("Part " + std::to_string(currentPart_) + " is missing or changed, building it again");
+        return StopResuming();
+    }
+
+    Logger::Debug("Part " + std::to_string(currentPart_) + " unchanged, reused: " + part.path);
+    // Recorded with the next saved part; until then the previous manifest
+    // still describes this part.
+    manifest_.GetParts().push_back(part);
+    savedFiles_.push_back(part.path);
+    ++reusedParts_;
+    ++currentPart_;
+    ++resumePart_;
+    resumeQueue_.clear();
+    resuming_ = resumePart_ < previous_.GetParts().size();
+    return true;
+}
 
-    size_t fileSize = FileSystemUtils::GetFileSize(filePath);
+bool PdfSplitManager::StopResuming() {
+    resuming_ = false;
+    Logger::Debug("Building from part " + std::to_string(currentPart_) + " on");
 
-    if (ShouldStartNewPart(fileSize) && currentDoc_->GetPages().GetCount() > 0) {
+    std::vector<PendingInput> queue;
+    queue.swap(resumeQueue_);
+    for (const PendingInput& pending : queue) {
+        if (!AddPendingInput(pending)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool PdfSplitManager::SavePart(const std::string& partPath, bool open) {
+    if (!resumable_) {
+        return SaveCurrentDocument(partPath);
+    }
+
+    // The previous output stays in place until the whole merge succeeds.
+    std::string stagedPath = partPath + STAGED_SUFFIX;
+    if (!SaveCurrentDocument(stagedPath)) {
+        return false;
+    }
+    if (!savedFiles_.empty() && savedFiles_.back() == stagedPath) {
+        savedFiles_.back() = partPath;
+    }
+
+    MergeManifest::Part part;
+    part.path = partPath;
+    part.storedPath = stagedPath;
+    part.open = open;
+    part.inputs.swap(partInputs_);
+    if (!MergeManifest::Checksum(stagedPath, part.size, part.checksum)) {
+        Logger::Error("Failed to read saved part: " + stagedPath);
+        return false;
+    }
+    manifest_.GetParts().push_back(std::move(part));
+    return manifest_.Save(GetManifestPath());
+}
+
+bool PdfSplitManager::CommitParts() {
+    bool committed = true;
+    for (MergeManifest::Part& part : manifest_.GetParts()) {
+        if (part.storedPath == part.path) {
+            continue;
+        }
+        if (!FileSystemUtils::RenameFile(part.storedPath, part.path)) {
+            Logger::Error("Failed to put part in place: " + part.path);
+            committed = false;
+            break;
+        }
+        part.storedPath = part.path;
+    }
+
+    // Also after a failure, so that the manifest shows where each part is.
+    return manifest_.Save(GetManifestPath()) && committed;
+}
+
+std::string PdfSplitManager::GetManifestPath() const {
+    return basePath_ + ".manifest";
+}
+
+std::string PdfSplitManager::GetOutputSettings() const {
+    // Everything that changes the bytes of a part; a part built with other
+    // settings is not reused.
+    return "split=" + std::to_string(maxSizeBytes_) +
+        " raw=" + std::to_string(rawCopy_) +
+        " streaming=" + std::to_string(streaming_) +
+        " dedup=" + std::to_string(options_.deduplicateResources) +
+        " fonts=" + std::to_string(options_.consolidateFontSubsets) +
+        " compression=" + std::to_string(options_.compressionLevel) +
+        " flate=" + std::to_string(options_.recompressFlateStreams) +
+        " compact=" + std::to_string(options_.compactOutput) +
+        " linearize=" + std::to_string(options_.linearize) +
+        " slim=" + std::to_string(options_.slimCategories) +
+        " duplicates=" + std::to_string(options_.duplicatePages) +
+        " budget=" + std::to_string(memoryBudget_) +
+        " images=" + std::to_string(options_.imageTargetDpi) + "/" + std::to_string(options_.imageJpegQuality);
+}
+
+bool PdfSplitManager::AddFileToDocument(const std::string& filePath, size_t fileSize, bool isTemplate) {
+    Logger::Debug("Processing file: " + filePath + " (.pdf)");
+
+    if (ShouldStartNewPart(fileSize) && GetCurrentPageCount() > 0) {
         std::string partPath = FileSystemUtils::GeneratePartFileName(basePath_, currentPart_);
-        if (!SaveCurrentDocument(partPath)) {
+        if (!SavePart(partPath)) {
             return false;
         }
 
         currentPart_++;
         accumulatedSize_ = 0;
+        inMemorySize_ = 0;
+        pagesRemoved_ = false;
         currentDoc_ = std::make_unique<PoDoFo::PdfMemDocument>();
+        deduplicator_.Reset();
+        appendTarget_.clear();
 
         Logger::Debug("Started new document part #" + std::to_string(currentPart_));
     }
 
+    if (memoryBudget_ > 0 && inMemorySize_ > 0 && inMemorySize_ + fileSize > memoryBudget_ * SPILL_FRACTION) {
+        if (!SpillCurrentDocument()) {
+            return false;
+        }
+    }
+
     Logger::Debug("AppendPdfFile: " + filePath);
-    bool result = PdfProcessor::ProcessFile(*currentDoc_, filePath);
+    unsigned firstPage = currentDoc_->GetPages().GetCount();
+    bool result = isTemplate
+        ? PdfTemplateCache::Instance().AppendPages(*currentDoc_, filePath)
+        : PdfProcessor::ProcessFile(*currentDoc_, filePath, options_);
 
     if (result) {
         accumulatedSize_ += fileSize;
+        inMemorySize_ += fileSize;
         Logger::Debug("PDF appended successfully");
+
+        if (options_.duplicatePages != DuplicatePageDetector::OFF) {
+            CheckDuplicatePages(filePath, firstPage);
+        }
+
+        if (options_.deduplicateResources && !deduplicator_.ProcessNewObjects(*currentDoc_)) {
+            Logger::Debug("Warning: resource deduplication skipped for: " + filePath);
+        }
     }
     else {
         Logger::Error("Failed to append PDF file: " + filePath);
@@ -144,6 +714,29 @@ bool PdfSplitManager::AddFile(const std::string& filePath) {
     return result;
 }
 
+void PdfSplitManager::CheckDuplicatePages(const std::string& filePath, unsigned firstPage) {
+    std::vector<unsigned> duplicates;
+    if (!duplicatePages_.Check(*currentDoc_, firstPage, FileSystemUtils::GetFileName(filePath), duplicates)) {
+        Logger::Debug("Warning: duplicate page check skipped for: " + filePath);
+        return;
+    }
+    if (duplicates.empty() || options_.duplicatePages != DuplicatePageDetector::REMOVE) {
+        return;
+    }
+
+    try {
+        for (auto index = duplicates.rbegin(); index != duplicates.rend(); ++index) {
+            currentDoc_->GetPages().RemovePageAt(*index);
+        }
+        pagesRemoved_ = true;
+        Logger::Debug("Removed " + std::to_string(duplicates.size()) + " duplicate page(s) of: " + filePath);
+    }
+    catch (const PoDoFo::PdfError& e) {
+        Logger::Error("Failed to remove duplicate pages: PdfError code " +
+            std::to_string(static_cast<int>(e.GetCode())));
+    }
+}
+
 bool PdfSplitManager::Finalize() {
     Logger::Debug("Finalizing PDF document(s)...");
 
@@ -156,12 +749,25 @@ bool PdfSplitManager::Finalize() {
         return SaveCurrentDocument();
     }
     else {
-        if (currentDoc_ && currentDoc_->GetPages().GetCount() > 0) {
+        // The open part of the last run is reused when the inputs end with
+        // it; otherwise the inputs matched so far belong to a part that did
+        // not get complete.
+        if (resuming_) {
+            const MergeManifest::Part& part = previous_.GetParts()[resumePart_];
+            bool reusable = part.open && resumeQueue_.size() == part.inputs.size();
+            if (reusable ? !ReusePart() : !StopResuming()) {
+                return false;
+            }
+        }
+        if (GetCurrentPageCount() > 0) {
             std::string finalPath = FileSystemUtils::GeneratePartFileName(basePath_, currentPart_);
-            if (!SaveCurrentDocument(finalPath)) {
+            if (!SavePart(finalPath, true)) {
                 return false;
             }
         }
+        if (resumable_ && !CommitParts()) {
+            return false;
+        }
 
         Logger::Debug("Created " + std::to_string(savedFiles_.size()) + " file(s):");
         for (const auto& file : savedFiles_) {
@@ -173,6 +779,26 @@ bool PdfSplitManager::Finalize() {
     }
 }
 
+const PdfSlimmer::Report& PdfSplitManager::GetSlimReport() const {
+    return slimReport_;
+}
+
+const DuplicatePageDetector& PdfSplitManager::GetDuplicatePages() const {
+    return duplicatePages_;
+}
+
+const PdfParseCache& PdfSplitManager::GetParseCache() const {
+    return parseCache_;
+}
+
+size_t PdfSplitManager::GetReusedParts() const {
+    return reusedParts_;
+}
+
+uint64_t PdfSplitManager::GetSpilledBytes() const {
+    return spilledBytes_;
+}
+
 const std::vector<std::string>& PdfSplitManager::GetSavedFiles() const {
     return savedFiles_;
 }
\ No newline at end of file
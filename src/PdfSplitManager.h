@@ -1,30 +1,128 @@
 #pragma once
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <memory>
 #include "podofo/podofo.h"
 #include "FileSystemUtils.h"
+#include "MergeOptions.h"
+#include "ResourceDeduplicator.h"
+#include "PdfIncrementalWriter.h"
+#include "PdfSlimmer.h"
+#include "PdfRawWriter.h"
+#include "PdfParseCache.h"
+#include "DuplicatePageDetector.h"
+#include "MergeManifest.h"
 
 class PdfSplitManager {
 public:
     
-    PdfSplitManager(const std::string& basePath, double maxSizeMB);
+    PdfSplitManager(const std::string& basePath, double maxSizeMB, const MergeOptions& options = MergeOptions());
     ~PdfSplitManager();
 
+    // In append mode, loads the existing output (the single file or the last
+    // part) so that new inputs are added to it as an incremental update.
+    // Does nothing when there is no previous output.
+    bool OpenExistingOutput();
+
     bool AddFile(const std::string& filePath);
+    // With the size and time from the directory listing, saving a query.
+    bool AddFile(const FileSystemUtils::FileEntry& file);
+    // Adds a template file through PdfTemplateCache, so that it is parsed
+    // once per process; in raw copy mode it is added like any input.
+    bool AddTemplate(const std::string& filePath);
     bool Finalize();
     const std::vector<std::string>& GetSavedFiles() const;
+    const PdfSlimmer::Report& GetSlimReport() const;
+    const DuplicatePageDetector& GetDuplicatePages() const;
+    // Bytes moved to spill files under the memory budget or by streaming
+    // output, all parts.
+    uint64_t GetSpilledBytes() const;
+    const PdfParseCache& GetParseCache() const;
+    // Parts of the previous run taken over unchanged in resumable mode.
+    size_t GetReusedParts() const;
 
 private:
     static constexpr size_t BYTES_IN_MEGABYTE = 1024 * 1024;
+    // Headroom on the observed output/input ratio, so that a part with
+    // slightly less compressible inputs still fits the limit.
+    static constexpr double OUTPUT_RATIO_MARGIN = 1.1;
+    // Share of the memory budget the inputs held in memory may take: while
+    // they are spilled, the object model or the raw writer's output, the
+    // serialized document and its copy exist side by side.
+    static constexpr double SPILL_FRACTION = 0.3;
+    // Suffix of parts written in resumable mode until the merge commits.
+    static constexpr const char* STAGED_SUFFIX = ".new";
+
+    struct PendingInput {
+        FileSystemUtils::FileEntry file;
+        bool isTemplate;
+        MergeManifest::Input identity;
+    };
 
     std::string basePath_;
     size_t accumulatedSize_ = 0;
+    double outputRatio_ = 1.0;
     size_t maxSizeBytes_;
     int currentPart_;
     std::unique_ptr<PoDoFo::PdfMemDocument> currentDoc_;
     std::vector<std::string> savedFiles_;
+    MergeOptions options_;
+    ResourceDeduplicator deduplicator_;
+    // Output file the current document was loaded from; empty for a new one.
+    std::string appendTarget_;
+    PdfIncrementalWriter incrementalWriter_;
+    PdfSlimmer::Report slimReport_;
+    // Kept for the whole merge: a page is a duplicate across parts too.
+    DuplicatePageDetector duplicatePages_;
+    // Pages were removed from the current part, leaving their objects behind.
+    bool pagesRemoved_ = false;
+    // Parts are built by rawWriter_ instead of currentDoc_.
+    bool rawCopy_ = false;
+    // rawWriter_ writes every input to the spill file right away.
+    bool streaming_ = false;
+    // Outside raw copy mode rawWriter_ collects the spilled pages of the
+    // current part, when there are any.
+    PdfRawWriter rawWriter_;
+    PdfParseCache parseCache_;
+    size_t memoryBudget_ = 0;
+    // Input bytes held in memory since the last spill.
+    size_t inMemorySize_ = 0;
+    uint64_t spilledBytes_ = 0;
+    // Resumable mode: manifest_ lists the parts of this run, previous_ those
+    // of the last one. While resuming_, inputs are matched against part
+    // resumePart_ of previous_ and queued; the part is reused once all its
+    // inputs match, and the queue is added normally on the first mismatch.
+    // An open part is reused only when the inputs end with it.
+    bool resumable_ = false;
+    bool resuming_ = false;
+    MergeManifest manifest_;
+    MergeManifest previous_;
+    size_t resumePart_ = 0;
+    std::vector<PendingInput> resumeQueue_;
+    // Inputs of the part being built.
+    std::vector<MergeManifest::Input> partInputs_;
+    size_t reusedParts_ = 0;
 
+    void PrepareDocumentForSave();
+    bool SerializeCurrentDocument(PoDoFo::charbuff& buffer);
     bool SaveCurrentDocument(const std::string& outputPath = "");
+    bool SaveIncrementalUpdate(const std::string& path);
+    bool SaveRawDocument(const std::string& path, bool isSplit);
+    bool AddFileRaw(const std::string& filePath, size_t fileSize);
+    bool AddFileToDocument(const std::string& filePath, size_t fileSize, bool isTemplate);
+    bool AddInput(const FileSystemUtils::FileEntry& file, bool isTemplate);
+    bool AddPendingInput(const PendingInput& pending);
+    bool ReusePart();
+    bool StopResuming();
+    bool SavePart(const std::string& partPath, bool open = false);
+    bool CommitParts();
+    std::string GetManifestPath() const;
+    std::string GetOutputSettings() const;
+    std::string GetSpillPath() const;
+    bool SpillCurrentDocument();
+    bool SpillRawOutput();
+    size_t GetCurrentPageCount() const;
     bool ShouldStartNewPart(size_t additionalSize) const;
+    void CheckDuplicatePages(const std::string& filePath, unsigned firstPage);
 };
\ No newline at end of file
@@ -0,0 +1,157 @@
+#include <windows.h>
+#include "FileSystemUtils.h"
+#include "Logger.h"
+#include "StringConverter.h"
+#include "PdfTemplateCache.h"
+
+namespace {
+
+    // The object model of a parsed document takes about this many times the
+    // size of its file, on top of the file buffer itself.
+    constexpr size_t ParsedSizeFactor = 2;
+
+    bool GetFileStamp(const std::string& filePath, uint64_t& size, uint64_t& time) {
+        WIN32_FILE_ATTRIBUTE_DATA info;
+        if (!GetFileAttributesExW(StringConverter::Utf8ToWide(filePath).c_str(), GetFileExInfoStandard, &info)) {
+            return false;
+        }
+        size = (static_cast<uint64_t>(info.nFileSizeHigh) << 32) | info.nFileSizeLow;
+        time = (static_cast<uint64_t>(info.ftLastWriteTime.dwHighDateTime) << 32) | info.ftLastWriteTime.dwLowDateTime;
+        return true;
+    }
+}
+
+PdfTemplateCache& PdfTemplateCache::Instance() {
+    static PdfTemplateCache instance;
+    return instance;
+}
+
+void PdfTemplateCache::SetLimit(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    limit_ = bytes;
+    TrimTo(bytes);
+}
+
+size_t PdfTemplateCache::GetLimit() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return limit_;
+}
+
+std::shared_ptr<PdfTemplateCache::Document> PdfTemplateCache::Acquire(const std::string& filePath) {
+    uint64_t fileSize = 0;
+    uint64_t fileTime = 0;
+    if (!GetFileStamp(filePath, fileSize, fileTime)) {
+        Logger::Error("Template not found: " + filePath);
+        return nullptr;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto found = index_.find(filePath);
+        if (found != index_.end()) {
+            const std::shared_ptr<Document>& cached = found->second->second;
+            if (cached->fileSize == fileSize && cached->fileTime == fileTime) {
+                entries_.splice(entries_.begin(), entries_, found->second);
+                ++hits_;
+                return cached;
+            }
+            Logger::Debug("Template changed on disk, parsing again: " + filePath);
+            Remove(found->second);
+        }
+        ++misses_;
+    }
+
+    // Parsed outside the lock: other merges keep using the cached templates.
+    auto document = std::make_shared<Document>();
+    if (!FileSystemUtils::ReadFileToBuffer(filePath, document->buffer)) {
+        return nullptr;
+    }
+    document->buffer.shrink_to_fit();
+    document->document.LoadFromBuffer(PoDoFo::bufferview(document->buffer.data(), document->buffer.size()));
+    document->fileSize = fileSize;
+    document->fileTime = fileTime;
+    document->cost = document->buffer.size() * (1 + ParsedSizeFactor);
+
+    Insert(filePath, document);
+    return document;
+}
+
+void PdfTemplateCache::Insert(const std::string& filePath, const std::shared_ptr<Document>& document) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (document->cost > limit_) {
+        Logger::Debug("Template exceeds the cache limit, not cached: " + filePath);
+        return;
+    }
+
+    // Another call may have parsed the same file meanwhile.
+    auto found = index_.find(filePath);
+    if (found != index_.end()) {
+        Remove(found->second);
+    }
+
+    entries_.emplace_front(filePath, document);
+    index_[filePath] = entries_.begin();
+    bytes_ += document->cost;
+    TrimTo(limit_);
+}
+
+void PdfTemplateCache::Remove(std::list<Entry>::iterator position) {
+    bytes_ -= position->second->cost;
+    index_.erase(position->first);
+    entries_.erase(position);
+}
+
+void PdfTemplateCache::TrimTo(size_t limit) {
+    while (bytes_ > limit && !entries_.empty()) {
+        Logger::Debug("Template dropped from cache: " + entries_.back().first);
+        Remove(std::prev(entries_.end()));
+    }
+}
+
+bool PdfTemplateCache::AppendPages(PoDoFo::PdfMemDocument& outputDoc, const std::string& filePath) {
+    Logger::Debug("Append template: " + filePath);
+    try {
+        // Kept alive by this reference even if it is dropped from the cache meanwhile.
+        std::shared_ptr<Document> document = Acquire(filePath);
+        if (!document) {
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(document->use);
+        outputDoc.GetPages().AppendDocumentPages(document->document);
+
+        Logger::Debug("Template appended successfully");
+        return true;
+    }
+    catch (const PoDoFo::PdfError& e) {
+        Logger::Error("PdfError code: " + std::to_string(static_cast<int>(e.GetCode())));
+        return false;
+    }
+    catch (const std::exception& e) {
+        Logger::Error("Exception: " + std::string(e.what()));
+        return false;
+    }
+}
+
+void PdfTemplateCache::Clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    TrimTo(0);
+}
+
+PdfTemplateCache::Stats PdfTemplateCache::GetStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stats stats;
+    stats.hits = hits_;
+    stats.misses = misses_;
+    stats.documents = entries_.size();
+    stats.bytes = bytes_;
+    stats.limit = limit_;
+    return stats;
+}
+
+std::string PdfTemplateCache::FormatStats() const {
+    Stats stats = GetStats();
+    return "hits " + std::to_string(stats.hits) + ", misses " + std::to_string(stats.misses) +
+        ", cached " + std::to_string(stats.documents) + " document(s) / " +
+        std::to_string(stats.bytes) + " of " + std::to_string(stats.limit) + " bytes";
+}
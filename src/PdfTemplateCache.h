@@ -0,0 +1,85 @@
+#ifndef __PDF_TEMPLATE_CACHE_H__
+#define __PDF_TEMPLATE_CACHE_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "podofo/podofo.h"
+
+// Parsed template documents (a cover letter, terms and conditions) kept in
+// the host process between merge calls, so that a file added to every merge
+// is read and parsed once instead of on every call.
+//
+// A document is reused while the size and modification time of its file
+// stay the same. The estimated memory of all documents is kept within a
+// limit by dropping the least recently used ones. Templates are appended as
+// they are: image optimization is not applied to them. All methods may be
+// called from any thread.
+class PdfTemplateCache {
+public:
+    static constexpr size_t DEFAULT_LIMIT = 64 * 1024 * 1024;
+
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        size_t documents = 0;
+        size_t bytes = 0;
+        size_t limit = 0;
+    };
+
+    static PdfTemplateCache& Instance();
+
+    // 0 caches nothing; documents over a lower limit are dropped at once.
+    void SetLimit(size_t bytes);
+    size_t GetLimit() const;
+
+    // Appends all pages of the template file to outputDoc, parsing the file
+    // only when it is not cached or has changed on disk.
+    bool AppendPages(PoDoFo::PdfMemDocument& outputDoc, const std::string& filePath);
+
+    // Drops every cached document.
+    void Clear();
+
+    Stats GetStats() const;
+    // "hits 10, misses 2, cached 2 document(s) / 1048576 of 67108864 bytes"
+    std::string FormatStats() const;
+
+    PdfTemplateCache(const PdfTemplateCache&) = delete;
+    PdfTemplateCache& operator=(const PdfTemplateCache&) = delete;
+
+private:
+    struct Document {
+        // Declared first: the document may read from the buffer until it is destroyed.
+        std::vector<char> buffer;
+        PoDoFo::PdfMemDocument document;
+        uint64_t fileSize = 0;
+        uint64_t fileTime = 0;
+        size_t cost = 0;
+        // Held while pages are copied from the document.
+        std::mutex use;
+    };
+
+    using Entry = std::pair<std::string, std::shared_ptr<Document>>;
+
+    PdfTemplateCache() = default;
+
+    std::shared_ptr<Document> Acquire(const std::string& filePath);
+    void Insert(const std::string& filePath, const std::shared_ptr<Document>& document);
+    void Remove(std::list<Entry>::iterator position);
+    void TrimTo(size_t limit);
+
+    mutable std::mutex mutex_;
+    // Most recently used first.
+    std::list<Entry> entries_;
+    std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+    size_t limit_ = DEFAULT_LIMIT;
+    size_t bytes_ = 0;
+    uint64_t hits_ = 0;
+    uint64_t misses_ = 0;
+};
+
+#endif // __PDF_TEMPLATE_CACHE_H__
@@ -0,0 +1,122 @@
+#include "PixelConverter.h"
+#include "CpuFeatures.h"
+
+namespace {
+
+    using namespace PixelConverterCoefficients;
+
+    inline uint8_t Clamp255(int v) {
+        return static_cast<uint8_t>(v < 0 ? 0 : (v > 255 ? 255 : v));
+    }
+
+    // Exact round(x / 255) for x in [0, 255 * 255].
+    inline uint8_t Div255(unsigned x) {
+        x += 128;
+        return static_cast<uint8_t>((x + (x >> 8)) >> 8);
+    }
+
+    void FlattenArgbToRgbScalar(const uint8_t* src, uint8_t* dst, size_t count) {
+        for (size_t i = 0; i < count; ++i, src += 4, dst += 3) {
+            unsigned a = src[3];
+            unsigned background = 255 * (255 - a);
+            dst[0] = Div255(src[0] * a + background);
+            dst[1] = Div255(src[1] * a + background);
+            dst[2] = Div255(src[2] * a + background);
+        }
+    }
+
+    void ArgbToGrayScalar(const uint8_t* src, uint8_t* dst, size_t count) {
+        for (size_t i = 0; i < count; ++i, src += 4) {
+            dst[i] = Clamp255((YR * src[2] + YG * src[1] + YB * src[0] + Round) >> Shift);
+        }
+    }
+
+    void ExpandPaletteScalar(const uint8_t* src, const uint32_t* palette, uint32_t* dst, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            dst[i] = palette[src[i]];
+        }
+    }
+
+}
+
+const PixelConverter::Kernels kPixelKernelsScalar = {
+    FlattenArgbToRgbScalar,
+    ArgbToGrayScalar,
+    ExpandPaletteScalar
+};
+
+namespace {
+
+    bool IsSupported(PixelConverter::Isa isa) {
+        switch (isa) {
+        case PixelConverter::Isa::Scalar:
+            return true;
+        case PixelConverter::Isa::Sse2:
+            return kPixelKernelsSse2 != nullptr && CpuFeatures::HasSse2();
+        case PixelConverter::Isa::Avx2:
+            return kPixelKernelsAvx2 != nullptr && CpuFeatures::HasAvx2();
+        case PixelConverter::Isa::Neon:
+            return kPixelKernelsNeon != nullptr && CpuFeatures::HasNeon();
+        default:
+            return false;
+        }
+    }
+
+    PixelConverter::Isa DetectIsa() {
+        const PixelConverter::Isa preference[] = {
+            PixelConverter::Isa::Avx2,
+            PixelConverter::Isa::Sse2,
+            PixelConverter::Isa::Neon
+        };
+        for (PixelConverter::Isa isa : preference) {
+            if (IsSupported(isa)) {
+                return isa;
+            }
+        }
+        return PixelConverter::Isa::Scalar;
+    }
+}
+
+const PixelConverter::Kernels* PixelConverter::ForIsa(Isa isa) {
+    if (!IsSupported(isa)) {
+        return nullptr;
+    }
+
+    switch (isa) {
+    case Isa::Sse2: return kPixelKernelsSse2;
+    case Isa::Avx2: return kPixelKernelsAvx2;
+    case Isa::Neon: return kPixelKernelsNeon;
+    default: return &kPixelKernelsScalar;
+    }
+}
+
+PixelConverter::Isa PixelConverter::ActiveIsa() {
+    static const Isa isa = DetectIsa();
+    return isa;
+}
+
+const PixelConverter::Kernels& PixelConverter::Active() {
+    static const Kernels* kernels = ForIsa(ActiveIsa());
+    return *kernels;
+}
+
+const char* PixelConverter::IsaName(Isa isa) {
+    switch (isa) {
+    case Isa::Sse2: return "SSE2";
+    case Isa::Avx2: return "AVX2";
+    case Isa::Neon: return "NEON";
+    default: return "Scalar";
+    }
+}
+
+void PixelConverter::FlattenArgbToRgb(const uint8_t* src, uint8_t* dst, size_t count) {
+    Active().FlattenArgbToRgb(src, dst, count);
+}
+
+void PixelConverter::ArgbToGray(const uint8_t* src, uint8_t* dst, size_t count) {
+    Active().ArgbToGray(src, dst, count);
+}
+
+void PixelConverter::ExpandPalette(const uint8_t* src, const uint32_t* palette, uint32_t* dst, size_t count) {
+    Active().ExpandPalette(src, palette, dst, count);
+}
@@ -0,0 +1,66 @@
+#ifndef __PIXEL_CONVERTER_H__
+#define __PIXEL_CONVERTER_H__
+
+#include <cstddef>
+#include <cstdint>
+
+// Pixel format conversion kernels used by the image pipeline.
+//
+// All 32-bit layouts are in GDI+ memory order (B, G, R, A per pixel, i.e.
+// PixelFormat32bppARGB on little-endian), 24-bit layouts are B, G, R
+// (PixelFormat24bppRGB). Every kernel has a scalar reference implementation
+// and SIMD variants that are bit-exact with it; the fastest variant supported
+// by the running CPU is chosen once on first use.
+class PixelConverter {
+public:
+    enum class Isa {
+        Scalar,
+        Sse2,
+        Avx2,
+        Neon
+    };
+
+    struct Kernels {
+        // BGRA -> BGR, alpha composited onto a white background.
+        void (*FlattenArgbToRgb)(const uint8_t* src, uint8_t* dst, size_t count);
+        // BGRA -> 8-bit luma. Alpha is ignored.
+        void (*ArgbToGray)(const uint8_t* src, uint8_t* dst, size_t count);
+        // 8-bit palette indices -> 32-bit palette entries. palette must have 256 entries.
+        void (*ExpandPalette)(const uint8_t* src, const uint32_t* palette, uint32_t* dst, size_t count);
+    };
+
+    // Kernels selected for the running CPU.
+    static const Kernels& Active();
+    static Isa ActiveIsa();
+
+    // Kernels for a specific instruction set. Returns nullptr when the set is
+    // not compiled in or not supported by the CPU.
+    static const Kernels* ForIsa(Isa isa);
+
+    static const char* IsaName(Isa isa);
+
+    // Convenience wrappers over Active().
+    static void FlattenArgbToRgb(const uint8_t* src, uint8_t* dst, size_t count);
+    static void ArgbToGray(const uint8_t* src, uint8_t* dst, size_t count);
+    static void ExpandPalette(const uint8_t* src, const uint32_t* palette, uint32_t* dst, size_t count);
+};
+
+// Fixed-point luma coefficients shared by all implementations (Q15, JFIF full range).
+namespace PixelConverterCoefficients {
+    constexpr int YR = 9798;
+    constexpr int YG = 19235;
+    constexpr int YB = 3736;
+    constexpr int Shift = 15;
+    constexpr int Round = 1 << (Shift - 1);
+}
+
+// Scalar reference kernels. SIMD variants use them for row tails.
+extern const PixelConverter::Kernels kPixelKernelsScalar;
+
+// Per-ISA kernel tables, defined in the PixelConverter*.cpp translation units.
+// A table is nullptr when its instruction set is not available for the target.
+extern const PixelConverter::Kernels* const kPixelKernelsSse2;
+extern const PixelConverter::Kernels* const kPixelKernelsAvx2;
+extern const PixelConverter::Kernels* const kPixelKernelsNeon;
+
+#endif // __PIXEL_CONVERTER_H__
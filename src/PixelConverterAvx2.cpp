@@ -0,0 +1,116 @@
+#include "PixelConverter.h"
+
+// Built with AVX2 code generation enabled (see CMakeLists.txt); only reached
+// after the runtime CPU check in PixelConverter.cpp.
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+
+namespace {
+
+    using namespace PixelConverterCoefficients;
+
+    inline __m256i PackCoefficients(int forBlue, int forRed) {
+        return _mm256_set1_epi32(static_cast<int>(
+            (static_cast<uint32_t>(static_cast<uint16_t>(forRed)) << 16) |
+            static_cast<uint16_t>(forBlue)));
+    }
+
+    inline __m256i WeightedSum(__m256i pixels, __m256i coeffBR, __m256i coeffG, __m256i bias) {
+        const __m256i lowByteMask = _mm256_set1_epi16(0x00FF);
+        __m256i br = _mm256_and_si256(pixels, lowByteMask);
+        __m256i ga = _mm256_srli_epi16(pixels, 8);
+        __m256i sum = _mm256_add_epi32(_mm256_madd_epi16(br, coeffBR), _mm256_madd_epi16(ga, coeffG));
+        return _mm256_srai_epi32(_mm256_add_epi32(sum, bias), Shift);
+    }
+
+    // Thirty-two BGRA pixels -> thirty-two saturated bytes in pixel order.
+    inline __m256i WeightedSum32(const uint8_t* src, __m256i coeffBR, __m256i coeffG, __m256i bias) {
+        __m256i p0 = WeightedSum(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src)), coeffBR, coeffG, bias);
+        __m256i p1 = WeightedSum(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 32)), coeffBR, coeffG, bias);
+        __m256i p2 = WeightedSum(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 64)), coeffBR, coeffG, bias);
+        __m256i p3 = WeightedSum(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 96)), coeffBR, coeffG, bias);
+        __m256i packed = _mm256_packus_epi16(_mm256_packs_epi32(p0, p1), _mm256_packs_epi32(p2, p3));
+        // Packs work per 128-bit lane; restore pixel order across lanes.
+        return _mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+    }
+
+    inline __m256i Flatten(__m256i pixels16, __m256i alpha16) {
+        const __m256i c255 = _mm256_set1_epi16(255);
+        const __m256i c128 = _mm256_set1_epi16(128);
+        __m256i x = _mm256_add_epi16(_mm256_mullo_epi16(pixels16, alpha16),
+            _mm256_mullo_epi16(_mm256_sub_epi16(c255, alpha16), c255));
+        __m256i t = _mm256_add_epi16(x, c128);
+        return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+    }
+
+    void FlattenArgbToRgbAvx2(const uint8_t* src, uint8_t* dst, size_t count) {
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i alphaShuffle = _mm256_setr_epi8(
+            6, 7, 6, 7, 6, 7, 6, 7, 14, 15, 14, 15, 14, 15, 14, 15,
+            6, 7, 6, 7, 6, 7, 6, 7, 14, 15, 14, 15, 14, 15, 14, 15);
+        const __m256i dropAlpha = _mm256_setr_epi8(
+            0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+            0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+
+        // Each iteration stores 16 bytes per lane but advances by 12, so keep
+        // enough pixels ahead that the overlapping tail store stays in bounds.
+        size_t i = 0;
+        for (; i + 10 <= count; i += 8, src += 32, dst += 24) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src));
+            __m256i lo = _mm256_unpacklo_epi8(v, zero);
+            __m256i hi = _mm256_unpackhi_epi8(v, zero);
+
+            __m256i rgb = _mm256_packus_epi16(
+                Flatten(lo, _mm256_shuffle_epi8(lo, alphaShuffle)),
+                Flatten(hi, _mm256_shuffle_epi8(hi, alphaShuffle)));
+            rgb = _mm256_shuffle_epi8(rgb, dropAlpha);
+
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm256_castsi256_si128(rgb));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 12), _mm256_extracti128_si256(rgb, 1));
+        }
+
+        kPixelKernelsScalar.FlattenArgbToRgb(src, dst, count - i);
+    }
+
+    void ArgbToGrayAvx2(const uint8_t* src, uint8_t* dst, size_t count) {
+        const __m256i yBR = PackCoefficients(YB, YR);
+        const __m256i yG = PackCoefficients(YG, 0);
+        const __m256i lumaBias = _mm256_set1_epi32(Round);
+
+        size_t i = 0;
+        for (; i + 32 <= count; i += 32, src += 128) {
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), WeightedSum32(src, yBR, yG, lumaBias));
+        }
+
+        kPixelKernelsScalar.ArgbToGray(src, dst + i, count - i);
+    }
+
+    void ExpandPaletteAvx2(const uint8_t* src, const uint32_t* palette, uint32_t* dst, size_t count) {
+        const int* table = reinterpret_cast<const int*>(palette);
+
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            __m128i indices8 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + i));
+            __m256i indices = _mm256_cvtepu8_epi32(indices8);
+            __m256i values = _mm256_i32gather_epi32(table, indices, 4);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), values);
+        }
+
+        kPixelKernelsScalar.ExpandPalette(src + i, palette, dst + i, count - i);
+    }
+
+    const PixelConverter::Kernels kAvx2Kernels = {
+        FlattenArgbToRgbAvx2,
+        ArgbToGrayAvx2,
+        ExpandPaletteAvx2
+    };
+}
+
+const PixelConverter::Kernels* const kPixelKernelsAvx2 = &kAvx2Kernels;
+
+#else
+
+const PixelConverter::Kernels* const kPixelKernelsAvx2 = nullptr;
+
+#endif
@@ -0,0 +1,90 @@
+#include "PixelConverter.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+
+#include <arm_neon.h>
+
+namespace {
+
+    using namespace PixelConverterCoefficients;
+
+    inline uint8x8_t Flatten(uint8x8_t channel, uint8x8_t alpha, uint8x8_t inverseAlpha) {
+        const uint8x8_t c255 = vdup_n_u8(255);
+        uint16x8_t x = vmlal_u8(vmull_u8(channel, alpha), inverseAlpha, c255);
+        uint16x8_t t = vaddq_u16(x, vdupq_n_u16(128));
+        return vshrn_n_u16(vaddq_u16(t, vshrq_n_u16(t, 8)), 8);
+    }
+
+    inline uint8x8_t WeightedSum(int16x8_t b, int16x8_t g, int16x8_t r,
+        int16_t cB, int16_t cG, int16_t cR, int32_t bias) {
+        int32x4_t lo = vdupq_n_s32(bias);
+        lo = vmlal_n_s16(lo, vget_low_s16(b), cB);
+        lo = vmlal_n_s16(lo, vget_low_s16(g), cG);
+        lo = vmlal_n_s16(lo, vget_low_s16(r), cR);
+        int32x4_t hi = vdupq_n_s32(bias);
+        hi = vmlal_n_s16(hi, vget_high_s16(b), cB);
+        hi = vmlal_n_s16(hi, vget_high_s16(g), cG);
+        hi = vmlal_n_s16(hi, vget_high_s16(r), cR);
+        int16x8_t narrowed = vcombine_s16(vqmovn_s32(vshrq_n_s32(lo, Shift)), vqmovn_s32(vshrq_n_s32(hi, Shift)));
+        return vqmovun_s16(narrowed);
+    }
+
+    inline int16x8_t Widen(uint8x8_t v) {
+        return vreinterpretq_s16_u16(vmovl_u8(v));
+    }
+
+    void FlattenArgbToRgbNeon(const uint8_t* src, uint8_t* dst, size_t count) {
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16, src += 64, dst += 48) {
+            uint8x16x4_t px = vld4q_u8(src);
+            uint8x16_t inverse = vmvnq_u8(px.val[3]);
+
+            uint8x16x3_t out;
+            for (int c = 0; c < 3; ++c) {
+                out.val[c] = vcombine_u8(
+                    Flatten(vget_low_u8(px.val[c]), vget_low_u8(px.val[3]), vget_low_u8(inverse)),
+                    Flatten(vget_high_u8(px.val[c]), vget_high_u8(px.val[3]), vget_high_u8(inverse)));
+            }
+            vst3q_u8(dst, out);
+        }
+
+        kPixelKernelsScalar.FlattenArgbToRgb(src, dst, count - i);
+    }
+
+    void ArgbToGrayNeon(const uint8_t* src, uint8_t* dst, size_t count) {
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8, src += 32) {
+            uint8x8x4_t px = vld4_u8(src);
+            vst1_u8(dst + i, WeightedSum(Widen(px.val[0]), Widen(px.val[1]), Widen(px.val[2]),
+                YB, YG, YR, Round));
+        }
+
+        kPixelKernelsScalar.ArgbToGray(src, dst + i, count - i);
+    }
+
+    void ExpandPaletteNeon(const uint8_t* src, const uint32_t* palette, uint32_t* dst, size_t count) {
+        // NEON has no 32-bit gather; an unrolled table walk is as good as it gets.
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4) {
+            dst[i] = palette[src[i]];
+            dst[i + 1] = palette[src[i + 1]];
+            dst[i + 2] = palette[src[i + 2]];
+            dst[i + 3] = palette[src[i + 3]];
+        }
+        kPixelKernelsScalar.ExpandPalette(src + i, palette, dst + i, count - i);
+    }
+
+    const PixelConverter::Kernels kNeonKernels = {
+        FlattenArgbToRgbNeon,
+        ArgbToGrayNeon,
+        ExpandPaletteNeon
+    };
+}
+
+const PixelConverter::Kernels* const kPixelKernelsNeon = &kNeonKernels;
+
+#else
+
+const PixelConverter::Kernels* const kPixelKernelsNeon = nullptr;
+
+#endif
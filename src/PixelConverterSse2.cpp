@@ -0,0 +1,110 @@
+#include "PixelConverter.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+
+#include <emmintrin.h>
+
+namespace {
+
+    using namespace PixelConverterCoefficients;
+
+    inline __m128i PackCoefficients(int forBlue, int forRed) {
+        return _mm_set1_epi32(static_cast<int>(
+            (static_cast<uint32_t>(static_cast<uint16_t>(forRed)) << 16) |
+            static_cast<uint16_t>(forBlue)));
+    }
+
+    // Four BGRA pixels -> four int32 results of (cB*B + cG*G + cR*R + bias) >> 15.
+    inline __m128i WeightedSum(__m128i pixels, __m128i coeffBR, __m128i coeffG, __m128i bias) {
+        const __m128i lowByteMask = _mm_set1_epi16(0x00FF);
+        __m128i br = _mm_and_si128(pixels, lowByteMask);   // B, R per pixel
+        __m128i ga = _mm_srli_epi16(pixels, 8);            // G, A per pixel
+        __m128i sum = _mm_add_epi32(_mm_madd_epi16(br, coeffBR), _mm_madd_epi16(ga, coeffG));
+        return _mm_srai_epi32(_mm_add_epi32(sum, bias), Shift);
+    }
+
+    // Sixteen BGRA pixels -> sixteen saturated bytes.
+    inline __m128i WeightedSum16(const uint8_t* src, __m128i coeffBR, __m128i coeffG, __m128i bias) {
+        __m128i p0 = WeightedSum(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src)), coeffBR, coeffG, bias);
+        __m128i p1 = WeightedSum(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 16)), coeffBR, coeffG, bias);
+        __m128i p2 = WeightedSum(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 32)), coeffBR, coeffG, bias);
+        __m128i p3 = WeightedSum(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 48)), coeffBR, coeffG, bias);
+        return _mm_packus_epi16(_mm_packs_epi32(p0, p1), _mm_packs_epi32(p2, p3));
+    }
+
+    inline __m128i Flatten(__m128i pixels16, __m128i alpha16) {
+        const __m128i c255 = _mm_set1_epi16(255);
+        const __m128i c128 = _mm_set1_epi16(128);
+        __m128i x = _mm_add_epi16(_mm_mullo_epi16(pixels16, alpha16),
+            _mm_mullo_epi16(_mm_sub_epi16(c255, alpha16), c255));
+        __m128i t = _mm_add_epi16(x, c128);
+        return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+    }
+
+    void FlattenArgbToRgbSse2(const uint8_t* src, uint8_t* dst, size_t count) {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i lowPixelMask = _mm_set1_epi64x(0x0000000000FFFFFFLL);
+        const __m128i highPixelMask = _mm_set1_epi64x(0x0000FFFFFF000000LL);
+
+        // No byte shuffle in SSE2: squeeze out alpha with 64-bit shifts, two
+        // pixels per half. Each half is stored as 8 bytes but advances by 6,
+        // so keep enough pixels ahead for the overlapping store.
+        size_t i = 0;
+        for (; i + 5 <= count; i += 4, src += 16, dst += 12) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+            __m128i lo = _mm_unpacklo_epi8(v, zero);
+            __m128i hi = _mm_unpackhi_epi8(v, zero);
+
+            __m128i alphaLo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+            __m128i alphaHi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+
+            __m128i bgra = _mm_packus_epi16(Flatten(lo, alphaLo), Flatten(hi, alphaHi));
+            __m128i bgr = _mm_or_si128(_mm_and_si128(bgra, lowPixelMask),
+                _mm_and_si128(_mm_srli_epi64(bgra, 8), highPixelMask));
+
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(dst), bgr);
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + 6), _mm_unpackhi_epi64(bgr, bgr));
+        }
+
+        kPixelKernelsScalar.FlattenArgbToRgb(src, dst, count - i);
+    }
+
+    void ArgbToGraySse2(const uint8_t* src, uint8_t* dst, size_t count) {
+        const __m128i yBR = PackCoefficients(YB, YR);
+        const __m128i yG = PackCoefficients(YG, 0);
+        const __m128i lumaBias = _mm_set1_epi32(Round);
+
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16, src += 64) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), WeightedSum16(src, yBR, yG, lumaBias));
+        }
+
+        kPixelKernelsScalar.ArgbToGray(src, dst + i, count - i);
+    }
+
+    void ExpandPaletteSse2(const uint8_t* src, const uint32_t* palette, uint32_t* dst, size_t count) {
+        // SSE2 has no gather; an unrolled table walk is as good as it gets.
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4) {
+            dst[i] = palette[src[i]];
+            dst[i + 1] = palette[src[i + 1]];
+            dst[i + 2] = palette[src[i + 2]];
+            dst[i + 3] = palette[src[i + 3]];
+        }
+        kPixelKernelsScalar.ExpandPalette(src + i, palette, dst + i, count - i);
+    }
+
+    const PixelConverter::Kernels kSse2Kernels = {
+        FlattenArgbToRgbSse2,
+        ArgbToGraySse2,
+        ExpandPaletteSse2
+    };
+}
+
+const PixelConverter::Kernels* const kPixelKernelsSse2 = &kSse2Kernels;
+
+#else
+
+const PixelConverter::Kernels* const kPixelKernelsSse2 = nullptr;
+
+#endif
@@ -0,0 +1,317 @@
+#include <algorithm>
+#include <cstring>
+#include "Logger.h"
+#include "ContentHash.h"
+#include "ResourceDeduplicator.h"
+
+namespace {
+
+    // Objects that are part of the document structure or point back into it
+    // are unique by nature and must never be shared.
+    bool IsEligible(const PoDoFo::PdfObject& obj) {
+        if (obj.IsArray()) {
+            return true;
+        }
+        if (!obj.IsDictionary()) {
+            return false;
+        }
+
+        const PoDoFo::PdfDictionary& dict = obj.GetDictionary();
+        if (dict.HasKey("Parent") || dict.HasKey("P") || dict.HasKey("Kids")) {
+            return false;
+        }
+
+        const PoDoFo::PdfObject* type = dict.GetKey(PoDoFo::PdfName::KeyType);
+        if (type && type->IsName()) {
+            static const char* const structuralTypes[] = {
+                "Page", "Pages", "Catalog", "Annot", "Outlines",
+                "StructTreeRoot", "StructElem", "ObjStm", "XRef", "Sig"
+            };
+            for (const char* structural : structuralTypes) {
+                if (type->GetName() == structural) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    uint64_t HashStream(const PoDoFo::PdfObject& obj, size_t& size) {
+        if (!obj.HasStream()) {
+            size = 0;
+            return 0;
+        }
+        PoDoFo::charbuff raw = obj.GetStream()->GetCopy(true);
+        size = raw.size();
+        return ContentHash::Hash64(raw.data(), raw.size());
+    }
+}
+
+void ResourceDeduplicator::Reset() {
+    index_.clear();
+    replaced_.clear();
+    lastObjectNumber_ = 0;
+}
+
+void ResourceDeduplicator::SkipExistingObjects(PoDoFo::PdfMemDocument& doc) {
+    for (PoDoFo::PdfObject* obj : doc.GetObjects()) {
+        lastObjectNumber_ = (std::max)(lastObjectNumber_, obj->GetIndirectReference().ObjectNumber());
+    }
+}
+
+size_t ResourceDeduplicator::GetFoldedObjects() const {
+    return foldedObjects_;
+}
+
+uint64_t ResourceDeduplicator::GetSavedBytes() const {
+    return savedBytes_;
+}
+
+PoDoFo::PdfReference ResourceDeduplicator::Resolve(const PoDoFo::PdfReference& ref) const {
+    PoDoFo::PdfReference current = ref;
+    auto it = replaced_.find(current.ObjectNumber());
+    while (it != replaced_.end()) {
+        current = it->second;
+        it = replaced_.find(current.ObjectNumber());
+    }
+    return current;
+}
+
+void ResourceDeduplicator::AppendCanonical(const PoDoFo::PdfObject& obj, std::string& out, bool skipLength) const {
+    if (obj.IsReference()) {
+        PoDoFo::PdfReference ref = Resolve(obj.GetReference());
+        out += 'R';
+        out += std::to_string(ref.ObjectNumber());
+        out += '.';
+        out += std::to_string(ref.GenerationNumber());
+        out += ' ';
+    }
+    else if (obj.IsArray()) {
+        out += '[';
+        for (const PoDoFo::PdfObject& item : obj.GetArray()) {
+            AppendCanonical(item, out, false);
+        }
+        out += ']';
+    }
+    else if (obj.IsDictionary()) {
+        // Sort keys so that the description does not depend on key order.
+        std::vector<std::pair<std::string, const PoDoFo::PdfObject*>> entries;
+        for (const auto& pair : obj.GetDictionary()) {
+            std::string key(pair.first.GetString());
+            if (skipLength && key == "Length") {
+                continue;
+            }
+            entries.emplace_back(std::move(key), &pair.second);
+        }
+        std::sort(entries.begin(), entries.end(),
+            [](const auto& a, const auto& b) { return a.first < b.first; });
+
+        out += "<<";
+        for (const auto& entry : entries) {
+            out += '/';
+            out += entry.first;
+            out += ' ';
+            AppendCanonical(*entry.second, out, false);
+        }
+        out += ">>";
+    }
+    else {
+        out += obj.ToString();
+        out += ' ';
+    }
+}
+
+std::string ResourceDeduplicator::Describe(const PoDoFo::PdfObject& obj) const {
+    std::string description;
+    bool hasStream = obj.HasStream();
+    description += hasStream ? 'S' : 'O';
+    // The stream length is covered by the stream hash and may itself be an
+    // indirect object, which would make identical streams look different.
+    AppendCanonical(obj, description, hasStream);
+    return description;
+}
+
+bool ResourceDeduplicator::IsSameContent(PoDoFo::PdfMemDocument& doc, const Candidate& candidate,
+    const std::string& description, const PoDoFo::PdfReference& other, size_t otherStreamSize) const {
+
+    PoDoFo::PdfObject* otherObject = doc.GetObjects().GetObject(other);
+    if (!otherObject || otherObject == candidate.object) {
+        return false;
+    }
+
+    if (otherObject->HasStream() != candidate.object->HasStream() ||
+        candidate.streamSize != otherStreamSize) {
+        return false;
+    }
+
+    if (Describe(*otherObject) != description) {
+        return false;
+    }
+
+    if (!candidate.object->HasStream()) {
+        return true;
+    }
+
+    // Hashes matched; confirm byte by byte before sharing the object.
+    PoDoFo::charbuff a = candidate.object->GetStream()->GetCopy(true);
+    PoDoFo::charbuff b = otherObject->GetStream()->GetCopy(true);
+    return a.size() == b.size() && std::memcmp(a.data(), b.data(), a.size()) == 0;
+}
+
+void ResourceDeduplicator::RewriteReferences(PoDoFo::PdfObject& obj) const {
+    if (obj.IsReference()) {
+        PoDoFo::PdfReference resolved = Resolve(obj.GetReference());
+        if (resolved != obj.GetReference()) {
+            obj = PoDoFo::PdfObject(resolved);
+        }
+    }
+    else if (obj.IsArray()) {
+        for (PoDoFo::PdfObject& item : obj.GetArray()) {
+            RewriteReferences(item);
+        }
+    }
+    else if (obj.IsDictionary()) {
+        for (auto& pair : obj.GetDictionary()) {
+            RewriteReferences(pair.second);
+        }
+    }
+}
+
+bool ResourceDeduplicator::ProcessNewObjects(PoDoFo::PdfMemDocument& doc) {
+    try {
+        PoDoFo::PdfIndirectObjectList& objects = doc.GetObjects();
+
+        std::vector<PoDoFo::PdfObject*> newObjects;
+        std::vector<Candidate> candidates;
+        uint32_t maxObjectNumber = lastObjectNumber_;
+
+        for (PoDoFo::PdfObject* obj : objects) {
+            uint32_t number = obj->GetIndirectReference().ObjectNumber();
+            if (number <= lastObjectNumber_) {
+                continue;
+            }
+            maxObjectNumber = (std::max)(maxObjectNumber, number);
+            newObjects.push_back(obj);
+
+            if (IsEligible(*obj)) {
+                Candidate candidate{ obj, 0, 0, false };
+                candidate.streamHash = HashStream(*obj, candidate.streamSize);
+                candidates.push_back(candidate);
+            }
+        }
+        lastObjectNumber_ = maxObjectNumber;
+
+        if (candidates.empty()) {
+            return true;
+        }
+
+        std::vector<PoDoFo::PdfReference> folded;
+        uint64_t savedBytes = 0;
+
+        for (int round = 0; round < MAX_ROUNDS; ++round) {
+            bool changed = false;
+            // First occurrences within this batch, so duplicates inside one
+            // input fold as well.
+            std::unordered_map<uint64_t, std::vector<size_t>> roundIndex;
+
+            for (size_t i = 0; i < candidates.size(); ++i) {
+                Candidate& candidate = candidates[i];
+                if (candidate.folded) {
+                    continue;
+                }
+
+                std::string description = Describe(*candidate.object);
+                uint64_t hash = ContentHash::Hash64(description.data(), description.size(), candidate.streamHash);
+
+                bool found = false;
+                PoDoFo::PdfReference target;
+
+                auto it = index_.find(hash);
+                if (it != index_.end()) {
+                    for (const CanonicalEntry& entry : it->second) {
+                        if (entry.streamHash == candidate.streamHash &&
+                            IsSameContent(doc, candidate, description, entry.reference, entry.streamSize)) {
+                            target = entry.reference;
+                            found = true;
+                            break;
+                        }
+                    }
+                }
+
+                if (!found) {
+                    auto roundIt = roundIndex.find(hash);
+                    if (roundIt != roundIndex.end()) {
+                        for (size_t otherIndex : roundIt->second) {
+                            const Candidate& other = candidates[otherIndex];
+                            if (!other.folded && other.streamHash == candidate.streamHash &&
+                                IsSameContent(doc, candidate, description,
+                                    other.object->GetIndirectReference(), other.streamSize)) {
+                                target = other.object->GetIndirectReference();
+                                found = true;
+                                break;
+                            }
+                        }
+                    }
+                }
+
+                if (found) {
+                    PoDoFo::PdfReference self = candidate.object->GetIndirectReference();
+                    replaced_[self.ObjectNumber()] = target;
+                    candidate.folded = true;
+                    folded.push_back(self);
+                    savedBytes += description.size() + candidate.streamSize;
+                    changed = true;
+                }
+                else {
+                    roundIndex[hash].push_back(i);
+                }
+            }
+
+            if (!changed) {
+                break;
+            }
+        }
+
+        // Survivors become canonical for the inputs that follow.
+        for (const Candidate& candidate : candidates) {
+            if (candidate.folded) {
+                continue;
+            }
+            std::string description = Describe(*candidate.object);
+            uint64_t hash = ContentHash::Hash64(description.data(), description.size(), candidate.streamHash);
+            index_[hash].push_back({ candidate.object->GetIndirectReference(),
+                candidate.streamHash, candidate.streamSize });
+        }
+
+        if (folded.empty()) {
+            return true;
+        }
+
+        for (PoDoFo::PdfObject* obj : newObjects) {
+            if (replaced_.find(obj->GetIndirectReference().ObjectNumber()) == replaced_.end()) {
+                RewriteReferences(*obj);
+            }
+        }
+
+        for (const PoDoFo::PdfReference& ref : folded) {
+            // Keep the numbers out of the free list so they are not handed
+            // out again to the objects of the next input.
+            objects.RemoveObject(ref, false);
+        }
+
+        foldedObjects_ += folded.size();
+        savedBytes_ += savedBytes;
+
+        Logger::Debug("Deduplicated " + std::to_string(folded.size()) + " object(s), saved " +
+            std::to_string(savedBytes) + " bytes");
+        return true;
+    }
+    catch (const PoDoFo::PdfError& e) {
+        Logger::Error("Deduplication failed: PdfError code " + std::to_string(static_cast<int>(e.GetCode())));
+        return false;
+    }
+    catch (const std::exception& e) {
+        Logger::Error("Deduplication failed: " + std::string(e.what()));
+        return false;
+    }
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "podofo/podofo.h"
+
+// Folds objects that were copied into a document more than once (the same
+// font, logo or ICC profile embedded by every merged input, identical raster
+// pages) into a single canonical copy.
+//
+// Objects are keyed by a content hash of their raw stream data and of their
+// dictionary structure, with references rewritten to the canonical copies
+// they point to. Folding repeats until nothing changes, so whole chains
+// (font file -> descriptor -> font) collapse one level per round.
+class ResourceDeduplicator {
+public:
+    // Processes the objects added to the document since the previous call.
+    bool ProcessNewObjects(PoDoFo::PdfMemDocument& doc);
+
+    // Forgets all canonical objects; call when a new document is started.
+    void Reset();
+
+    // Leaves the objects already in the document (an output file opened for
+    // appending) out of deduplication: they are neither folded nor indexed.
+    void SkipExistingObjects(PoDoFo::PdfMemDocument& doc);
+
+    size_t GetFoldedObjects() const;
+    uint64_t GetSavedBytes() const;
+
+private:
+    struct Candidate {
+        PoDoFo::PdfObject* object;
+        uint64_t streamHash;
+        size_t streamSize;
+        bool folded;
+    };
+
+    struct CanonicalEntry {
+        PoDoFo::PdfReference reference;
+        uint64_t streamHash;
+        size_t streamSize;
+    };
+
+    static constexpr int MAX_ROUNDS = 8;
+
+    std::unordered_map<uint64_t, std::vector<CanonicalEntry>> index_;
+    std::unordered_map<uint32_t, PoDoFo::PdfReference> replaced_;
+    uint32_t lastObjectNumber_ = 0;
+    size_t foldedObjects_ = 0;
+    uint64_t savedBytes_ = 0;
+
+    PoDoFo::PdfReference Resolve(const PoDoFo::PdfReference& ref) const;
+    void AppendCanonical(const PoDoFo::PdfObject& obj, std::string& out, bool skipLength) const;
+    std::string Describe(const PoDoFo::PdfObject& obj) const;
+    bool IsSameContent(PoDoFo::PdfMemDocument& doc, const Candidate& candidate, const std::string& description,
+        const PoDoFo::PdfReference& other, size_t otherStreamSize) const;
+    void RewriteReferences(PoDoFo::PdfObject& obj) const;
+};
@@ -0,0 +1,325 @@
+#include <algorithm>
+#include <windows.h>
+#include "BufferPool.h"
+#include "FileSystemUtils.h"
+#include "Logger.h"
+#include "PdfLazyReader.h"
+#include "PdfProcessor.h"
+#include "PdfRawWriter.h"
+#include "StringConverter.h"
+#include "SpoolWatcher.h"
+
+namespace {
+
+    constexpr DWORD NotifyBufferSize = 64 * 1024;
+    constexpr DWORD NotifyFilter = FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_SIZE |
+        FILE_NOTIFY_CHANGE_LAST_WRITE;
+
+    bool GetFileStamp(const std::string& filePath, uint64_t& size, uint64_t& time) {
+        WIN32_FILE_ATTRIBUTE_DATA info;
+        if (!GetFileAttributesExW(StringConverter::Utf8ToWide(filePath).c_str(), GetFileExInfoStandard, &info)) {
+            return false;
+        }
+        size = (static_cast<uint64_t>(info.nFileSizeHigh) << 32) | info.nFileSizeLow;
+        time = (static_cast<uint64_t>(info.ftLastWriteTime.dwHighDateTime) << 32) | info.ftLastWriteTime.dwLowDateTime;
+        return true;
+    }
+
+    // False while a scanner or copy still has the file open for writing.
+    bool IsClosedByWriters(const std::string& filePath) {
+        HANDLE hFile = CreateFileW(StringConverter::Utf8ToWide(filePath).c_str(), GENERIC_READ,
+            FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (hFile == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+        CloseHandle(hFile);
+        return true;
+    }
+}
+
+SpoolWatcher::Pause::Pause(SpoolWatcher& watcher) : watcher_(watcher) {
+    watcher_.paused_ = true;
+    std::lock_guard<std::mutex> wait(watcher_.work_);
+}
+
+SpoolWatcher::Pause::~Pause() {
+    watcher_.paused_ = false;
+}
+
+SpoolWatcher::~SpoolWatcher() {
+    Stop();
+}
+
+bool SpoolWatcher::Start(const std::string& folderPath, const std::string& outputFileName,
+    const MergeOptions& options) {
+    Stop();
+
+    HANDLE directory = CreateFileW(StringConverter::Utf8ToWide(folderPath).c_str(), FILE_LIST_DIRECTORY,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING,
+        FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+    if (directory == INVALID_HANDLE_VALUE) {
+        Logger::Error("Spool: cannot open folder: " + folderPath +
+            " (Error: " + std::to_string(GetLastError()) + ")");
+        return false;
+    }
+
+    stopEvent_ = CreateEventW(NULL, TRUE, FALSE, NULL);
+    if (!stopEvent_) {
+        CloseHandle(directory);
+        return false;
+    }
+
+    folder_ = folderPath;
+    if (folder_.back() != '\\') {
+        folder_ += '\\';
+    }
+    outputFileName_ = outputFileName;
+    options_ = options;
+    candidates_.clear();
+    done_.clear();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        status_ = Status();
+        status_.running = true;
+    }
+
+    // The merge only reads the parse cache in these modes.
+    cache_ = PdfParseCache();
+    if (!options_.parseCacheFolder.empty() && (options_.rawCopy || options_.streamingOutput)) {
+        cache_.Open(options_.parseCacheFolder,
+            static_cast<size_t>((std::max)(options_.parseCacheLimitMB, 0)) * 1024 * 1024);
+    }
+
+    Logger::Debug("Spool: watching " + folder_ + (cache_.IsOpen()
+        ? ", prepared files go to the parse cache" : ", files are validated only"));
+    thread_ = std::thread(&SpoolWatcher::Run, this, directory);
+    return true;
+}
+
+void SpoolWatcher::Stop() {
+    if (!thread_.joinable()) {
+        return;
+    }
+
+    SetEvent(stopEvent_);
+    thread_.join();
+    CloseHandle(stopEvent_);
+    stopEvent_ = nullptr;
+    Logger::Debug("Spool: stopped watching " + folder_);
+}
+
+const std::string& SpoolWatcher::GetFolder() const {
+    return folder_;
+}
+
+SpoolWatcher::Status SpoolWatcher::GetStatus() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return status_;
+}
+
+void SpoolWatcher::Run(void* directory) {
+    HANDLE hDirectory = static_cast<HANDLE>(directory);
+    OVERLAPPED overlapped = {};
+    overlapped.hEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    // ReadDirectoryChangesW needs a DWORD-aligned buffer.
+    std::vector<DWORD> buffer(NotifyBufferSize / sizeof(DWORD));
+
+    try {
+        Rescan();
+        bool notified = overlapped.hEvent && ReadDirectoryChangesW(hDirectory, buffer.data(), NotifyBufferSize,
+            FALSE, NotifyFilter, NULL, &overlapped, NULL) != 0;
+        if (!notified) {
+            Logger::Debug("Spool: change notifications not available, polling the folder");
+        }
+
+        HANDLE handles[2] = { stopEvent_, overlapped.hEvent };
+        for (;;) {
+            DWORD wait = WaitForMultipleObjects(notified ? 2 : 1, handles, FALSE, POLL_MS);
+            if (wait == WAIT_OBJECT_0) {
+                break;
+            }
+
+            if (wait == WAIT_OBJECT_0 + 1) {
+                DWORD bytes = 0;
+                if (GetOverlappedResult(hDirectory, &overlapped, &bytes, FALSE) && bytes > 0) {
+                    const char* pos = reinterpret_cast<const char*>(buffer.data());
+                    for (;;) {
+                        const FILE_NOTIFY_INFORMATION* info = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(pos);
+                        std::string path = folder_ + StringConverter::WideToUtf8(
+                            std::wstring(info->FileName, info->FileNameLength / sizeof(WCHAR)));
+                        if (info->Action == FILE_ACTION_REMOVED || info->Action == FILE_ACTION_RENAMED_OLD_NAME) {
+                            candidates_.erase(path);
+                            done_.erase(path);
+                            std::lock_guard<std::mutex> lock(mutex_);
+                            status_.failed.erase(std::remove(status_.failed.begin(), status_.failed.end(), path),
+                                status_.failed.end());
+                        }
+                        else {
+                            Touch(path);
+                        }
+                        if (info->NextEntryOffset == 0) {
+                            break;
+                        }
+                        pos += info->NextEntryOffset;
+                    }
+                }
+                else {
+                    // More changes than the buffer holds.
+                    Rescan();
+                }
+                ResetEvent(overlapped.hEvent);
+                notified = ReadDirectoryChangesW(hDirectory, buffer.data(), NotifyBufferSize,
+                    FALSE, NotifyFilter, NULL, &overlapped, NULL) != 0;
+            }
+            else if (!notified) {
+                Rescan();
+            }
+
+            PrepareCompleteFiles();
+        }
+
+        if (notified) {
+            DWORD bytes = 0;
+            CancelIo(hDirectory);
+            GetOverlappedResult(hDirectory, &overlapped, &bytes, TRUE);
+        }
+    }
+    catch (const std::exception& e) {
+        Logger::Error("Spool: exception - " + std::string(e.what()));
+    }
+
+    if (overlapped.hEvent) {
+        CloseHandle(overlapped.hEvent);
+    }
+    CloseHandle(hDirectory);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    status_.running = false;
+}
+
+void SpoolWatcher::Rescan() {
+    std::vector<std::string> files;
+    if (!FileSystemUtils::GetFilesFromDirectory(folder_, files)) {
+        Logger::Debug("Spool: cannot read folder: " + folder_);
+        return;
+    }
+    for (const auto& file : files) {
+        Touch(file);
+    }
+    UpdatePending();
+}
+
+void SpoolWatcher::Touch(const std::string& filePath) {
+    std::string fileName = FileSystemUtils::GetFileName(filePath);
+    if (FileSystemUtils::HasSupportedExtension(fileName) &&
+        !FileSystemUtils::IsOutputFile(fileName, outputFileName_)) {
+        // The stamp is compared on the next check; a new candidate always
+        // starts its quiet time there.
+        candidates_.emplace(filePath, Candidate());
+    }
+}
+
+void SpoolWatcher::PrepareCompleteFiles() {
+    std::lock_guard<std::mutex> work(work_);
+    uint64_t now = GetTickCount64();
+    for (auto it = candidates_.begin(); it != candidates_.end();) {
+        // Left for the next check while a merge runs.
+        if (paused_ || WaitForSingleObject(stopEvent_, 0) == WAIT_OBJECT_0) {
+            break;
+        }
+
+        Candidate& candidate = it->second;
+        uint64_t size = 0;
+        uint64_t time = 0;
+        if (!GetFileStamp(it->first, size, time)) {
+            it = candidates_.erase(it);
+            continue;
+        }
+
+        if (size != candidate.size || time != candidate.time || candidate.changedAt == 0) {
+            candidate.size = size;
+            candidate.time = time;
+            candidate.changedAt = now;
+            ++it;
+            continue;
+        }
+        if (now - candidate.changedAt < SETTLE_MS) {
+            ++it;
+            continue;
+        }
+        if (!IsClosedByWriters(it->first)) {
+            candidate.changedAt = now;
+            ++it;
+            continue;
+        }
+
+        auto done = done_.find(it->first);
+        if (done == done_.end() || done->second.first != size || done->second.second != time) {
+            bool prepared = Prepare(it->first);
+            done_[it->first] = { size, time };
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto failed = std::find(status_.failed.begin(), status_.failed.end(), it->first);
+            if (prepared) {
+                ++status_.prepared;
+                if (failed != status_.failed.end()) {
+                    status_.failed.erase(failed);
+                }
+            }
+            else if (failed == status_.failed.end()) {
+                status_.failed.push_back(it->first);
+            }
+        }
+        it = candidates_.erase(it);
+    }
+    UpdatePending();
+}
+
+bool SpoolWatcher::Prepare(const std::string& filePath) {
+    Logger::Debug("Spool: preparing " + filePath);
+    try {
+        bool cacheable = cache_.IsOpen() && PdfParseCache::Covers(filePath, options_);
+        PdfRawWriter::Fragment fragment;
+        if (cacheable && cache_.Lookup(filePath, fragment)) {
+            return true;
+        }
+
+        // The same steps as the raw copy merge, into a writer that is thrown away.
+        PdfRawWriter::Fragment* capture = cacheable ? &fragment : nullptr;
+        bool prepared = false;
+        if (FileSystemUtils::GetFileExtension(filePath) == ".pdf" && options_.imageTargetDpi == 0) {
+            PdfLazyReader reader;
+            PdfRawWriter scratch;
+            prepared = reader.Open(filePath) && scratch.AddDocument(reader, capture);
+        }
+        if (!prepared) {
+            PooledBuffer<PoDoFo::charbuff> pooled;
+            PdfLazyReader reader;
+            PdfRawWriter scratch;
+            prepared = PdfProcessor::ConvertFile(filePath, options_, pooled.Get()) &&
+                reader.Open(pooled.Get().data(), pooled.Get().size()) && scratch.AddDocument(reader, capture);
+        }
+
+        if (!prepared) {
+            Logger::Error("Spool: cannot prepare " + filePath);
+            return false;
+        }
+        if (cacheable) {
+            cache_.Store(filePath, fragment);
+        }
+        return true;
+    }
+    catch (const PoDoFo::PdfError& e) {
+        Logger::Error("Spool: PdfError code " + std::to_string(static_cast<int>(e.GetCode())) + " in " + filePath);
+        return false;
+    }
+    catch (const std::exception& e) {
+        Logger::Error("Spool: exception - " + std::string(e.what()) + " in " + filePath);
+        return false;
+    }
+}
+
+void SpoolWatcher::UpdatePending() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    status_.pending = candidates_.size();
+}
@@ -0,0 +1,109 @@
+#ifndef __SPOOL_WATCHER_H__
+#define __SPOOL_WATCHER_H__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "MergeOptions.h"
+#include "PdfParseCache.h"
+
+// Watches a source folder that fills up over the day and prepares every new
+// input on a background thread, so the merge at the end of the day finds
+// them validated and converted.
+//
+// A file is prepared once its size and time have not changed for
+// SETTLE_MS and no other process has it open for writing. Preparing means
+// copying it the way the raw copy merge does (images and PDFs the raw path
+// cannot read are converted through PoDoFo first); with a parse cache
+// folder and raw copy or streaming output set, the result goes to the parse
+// cache, where the merge picks it up without reading the input again.
+// Otherwise the input is only validated. PdfFiles::StartSpool switches
+// those modes on.
+//
+// A merge holds a Pause while it reads and deletes inputs, so that the
+// watcher has none of them open.
+class SpoolWatcher {
+public:
+    // Quiet time after the last change before a file counts as complete.
+    static constexpr unsigned SETTLE_MS = 2000;
+
+    struct Status {
+        bool running = false;
+        size_t pending = 0;     // seen, not complete or not prepared yet
+        size_t prepared = 0;
+        std::vector<std::string> failed;
+    };
+
+    // Stops the watcher from opening files until destroyed; waits for the
+    // file being prepared.
+    class Pause {
+    public:
+        explicit Pause(SpoolWatcher& watcher);
+        ~Pause();
+
+        Pause(const Pause&) = delete;
+        Pause& operator=(const Pause&) = delete;
+
+    private:
+        SpoolWatcher& watcher_;
+    };
+
+    SpoolWatcher() = default;
+    ~SpoolWatcher();
+
+    SpoolWatcher(const SpoolWatcher&) = delete;
+    SpoolWatcher& operator=(const SpoolWatcher&) = delete;
+
+    // Takes the files already in the folder as new ones, except the output
+    // file outputFileName and its parts.
+    bool Start(const std::string& folderPath, const std::string& outputFileName, const MergeOptions& options);
+    void Stop();
+
+    const std::string& GetFolder() const;
+    Status GetStatus() const;
+
+private:
+    // Check interval while no change notification arrives.
+    static constexpr unsigned POLL_MS = 500;
+
+    struct Candidate {
+        uint64_t size = 0;
+        uint64_t time = 0;
+        uint64_t changedAt = 0;     // GetTickCount64 of the last change seen
+    };
+
+    void Run(void* directory);
+    void Rescan();
+    void Touch(const std::string& filePath);
+    void PrepareCompleteFiles();
+    bool Prepare(const std::string& filePath);
+    void UpdatePending();
+
+    std::string folder_;
+    std::string outputFileName_;
+    MergeOptions options_;
+    PdfParseCache cache_;
+    std::thread thread_;
+    void* stopEvent_ = nullptr;
+
+    std::atomic<bool> paused_{ false };
+    // Held by the watcher thread while it opens and prepares files.
+    std::mutex work_;
+
+    // Used by the watcher thread only.
+    std::map<std::string, Candidate> candidates_;
+    // Size and time of the files prepared (or failed) so far, so that a
+    // rescan does not prepare them again.
+    std::map<std::string, std::pair<uint64_t, uint64_t>> done_;
+
+    mutable std::mutex mutex_;
+    Status status_;
+};
+
+#endif // __SPOOL_WATCHER_H__
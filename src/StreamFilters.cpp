@@ -0,0 +1,238 @@
+#include <cctype>
+#include <cstdint>
+#include <vector>
+#include <zlib.h>
+#include "StreamFilters.h"
+
+namespace {
+    constexpr size_t ChunkSize = 64 * 1024;
+
+    int HexValue(char c) {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+}
+
+bool StreamFilters::CanDecode(const std::string& filterName) {
+    return filterName == "FlateDecode" || filterName == "LZWDecode" ||
+        filterName == "ASCIIHexDecode" || filterName == "ASCII85Decode" ||
+        filterName == "RunLengthDecode";
+}
+
+bool StreamFilters::Decode(const std::string& filterName, const std::string& input, std::string& output) {
+    output.clear();
+    if (filterName == "FlateDecode") return Inflate(input, output);
+    if (filterName == "LZWDecode") return DecodeLzw(input, output);
+    if (filterName == "ASCIIHexDecode") return DecodeAsciiHex(input, output);
+    if (filterName == "ASCII85Decode") return DecodeAscii85(input, output);
+    if (filterName == "RunLengthDecode") return DecodeRunLength(input, output);
+    return false;
+}
+
+bool StreamFilters::Deflate(const char* data, size_t size, int level, std::string& output) {
+    z_stream zs = {};
+    if (deflateInit(&zs, level) != Z_OK) {
+        return false;
+    }
+
+    output.resize(deflateBound(&zs, static_cast<uLong>(size)));
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    zs.avail_in = static_cast<uInt>(size);
+    zs.next_out = reinterpret_cast<Bytef*>(&output[0]);
+    zs.avail_out = static_cast<uInt>(output.size());
+
+    int result = deflate(&zs, Z_FINISH);
+    output.resize(zs.total_out);
+    deflateEnd(&zs);
+    return result == Z_STREAM_END;
+}
+
+bool StreamFilters::Inflate(const std::string& input, std::string& output) {
+    z_stream zs = {};
+    if (inflateInit(&zs) != Z_OK) {
+        return false;
+    }
+
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+    zs.avail_in = static_cast<uInt>(input.size());
+
+    std::vector<char> chunk(ChunkSize);
+    int result = Z_OK;
+    while (result == Z_OK) {
+        zs.next_out = reinterpret_cast<Bytef*>(chunk.data());
+        zs.avail_out = static_cast<uInt>(chunk.size());
+        result = inflate(&zs, Z_NO_FLUSH);
+        output.append(chunk.data(), chunk.size() - zs.avail_out);
+        if (result == Z_BUF_ERROR && zs.avail_in == 0) {
+            // Truncated stream without an end marker; viewers accept it.
+            result = Z_STREAM_END;
+        }
+    }
+    inflateEnd(&zs);
+    return result == Z_STREAM_END;
+}
+
+bool StreamFilters::DecodeLzw(const std::string& input, std::string& output) {
+    // Codes of 9 to 12 bits, MSB first, EarlyChange 1 (the PDF default).
+    const int clearCode = 256;
+    const int endCode = 257;
+
+    std::vector<std::string> table;
+    auto resetTable = [&table]() {
+        table.assign(258, std::string());
+        for (int i = 0; i < 256; ++i) {
+            table[i] = std::string(1, static_cast<char>(i));
+        }
+    };
+    resetTable();
+
+    int codeLength = 9;
+    uint32_t bitBuffer = 0;
+    int bitCount = 0;
+    int previous = -1;
+
+    for (char byte : input) {
+        bitBuffer = (bitBuffer << 8) | static_cast<uint8_t>(byte);
+        bitCount += 8;
+
+        while (bitCount >= codeLength) {
+            int code = static_cast<int>((bitBuffer >> (bitCount - codeLength)) & ((1u << codeLength) - 1));
+            bitCount -= codeLength;
+
+            if (code == clearCode) {
+                resetTable();
+                codeLength = 9;
+                previous = -1;
+                continue;
+            }
+            if (code == endCode) {
+                return true;
+            }
+
+            std::string entry;
+            if (code < static_cast<int>(table.size())) {
+                entry = table[code];
+            }
+            else if (code == static_cast<int>(table.size()) && previous >= 0) {
+                entry = table[previous] + table[previous][0];
+            }
+            else {
+                return false;
+            }
+
+            output += entry;
+            if (previous >= 0 && table.size() < 4096) {
+                table.push_back(table[previous] + entry[0]);
+            }
+            previous = code;
+
+            // EarlyChange: the code length grows one code before the table does.
+            size_t next = table.size() + 1;
+            codeLength = next < 512 ? 9 : next < 1024 ? 10 : next < 2048 ? 11 : 12;
+        }
+    }
+    return true;
+}
+
+bool StreamFilters::DecodeAsciiHex(const std::string& input, std::string& output) {
+    int high = -1;
+    for (char c : input) {
+        if (c == '>') {
+            break;
+        }
+        if (std::isspace(static_cast<unsigned char>(c))) {
+            continue;
+        }
+        int value = HexValue(c);
+        if (value < 0) {
+            return false;
+        }
+        if (high < 0) {
+            high = value;
+        }
+        else {
+            output += static_cast<char>((high << 4) | value);
+            high = -1;
+        }
+    }
+    if (high >= 0) {
+        output += static_cast<char>(high << 4);
+    }
+    return true;
+}
+
+bool StreamFilters::DecodeAscii85(const std::string& input, std::string& output) {
+    uint32_t tuple = 0;
+    int count = 0;
+
+    size_t i = 0;
+    if (input.compare(0, 2, "<~") == 0) {
+        i = 2;
+    }
+    for (; i < input.size(); ++i) {
+        char c = input[i];
+        if (c == '~') {
+            break;
+        }
+        if (std::isspace(static_cast<unsigned char>(c))) {
+            continue;
+        }
+        if (c == 'z' && count == 0) {
+            output.append(4, '\0');
+            continue;
+        }
+        if (c < '!' || c > 'u') {
+            return false;
+        }
+
+        tuple = tuple * 85 + static_cast<uint32_t>(c - '!');
+        if (++count == 5) {
+            for (int shift = 24; shift >= 0; shift -= 8) {
+                output += static_cast<char>((tuple >> shift) & 0xFF);
+            }
+            tuple = 0;
+            count = 0;
+        }
+    }
+
+    if (count == 1) {
+        return false;
+    }
+    if (count > 1) {
+        // Pad the final group with 'u' and keep count - 1 bytes.
+        for (int pad = count; pad < 5; ++pad) {
+            tuple = tuple * 85 + 84;
+        }
+        for (int b = 0; b < count - 1; ++b) {
+            output += static_cast<char>((tuple >> (24 - 8 * b)) & 0xFF);
+        }
+    }
+    return true;
+}
+
+bool StreamFilters::DecodeRunLength(const std::string& input, std::string& output) {
+    size_t i = 0;
+    while (i < input.size()) {
+        int length = static_cast<uint8_t>(input[i++]);
+        if (length == 128) {
+            return true;
+        }
+        if (length < 128) {
+            size_t literal = static_cast<size_t>(length) + 1;
+            if (i + literal > input.size()) {
+                return false;
+            }
+            output.append(input, i, literal);
+            i += literal;
+        }
+        else {
+            if (i >= input.size()) {
+                return false;
+            }
+            output.append(static_cast<size_t>(257 - length), input[i++]);
+        }
+    }
+    return true;
+}
@@ -0,0 +1,29 @@
+#ifndef __STREAM_FILTERS_H__
+#define __STREAM_FILTERS_H__
+
+#include <cstddef>
+#include <string>
+
+// Standalone PDF stream codecs. Unlike the PoDoFo filters they touch no
+// document state, so they can run on worker threads.
+class StreamFilters {
+public:
+    // Decodes data encoded with one standard filter given by its PDF name
+    // (FlateDecode, LZWDecode, ASCIIHexDecode, ASCII85Decode, RunLengthDecode).
+    // Returns false for other filters and for malformed input.
+    static bool Decode(const std::string& filterName, const std::string& input, std::string& output);
+
+    static bool CanDecode(const std::string& filterName);
+
+    // zlib stream at the given level (1-9), as read by FlateDecode.
+    static bool Deflate(const char* data, size_t size, int level, std::string& output);
+
+private:
+    static bool Inflate(const std::string& input, std::string& output);
+    static bool DecodeLzw(const std::string& input, std::string& output);
+    static bool DecodeAsciiHex(const std::string& input, std::string& output);
+    static bool DecodeAscii85(const std::string& input, std::string& output);
+    static bool DecodeRunLength(const std::string& input, std::string& output);
+};
+
+#endif // __STREAM_FILTERS_H__
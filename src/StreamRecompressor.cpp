@@ -0,0 +1,176 @@
+#include <algorithm>
+#include "Logger.h"
+#include "ParallelFor.h"
+#include "StreamFilters.h"
+#include "StreamRecompressor.h"
+
+namespace {
+
+    using PoDoFo::PdfObject;
+
+    // Raw stream data held in memory at once; larger parts are processed
+    // in several batches.
+    constexpr size_t BatchBytes = 64 * 1024 * 1024;
+
+    // Pass-through probe: large unfiltered streams (usually raw image data)
+    // are skipped when a sample of them does not shrink at the fastest level.
+    constexpr size_t ProbeThreshold = 256 * 1024;
+    constexpr size_t ProbeSize = 32 * 1024;
+    constexpr double ProbeMaxRatio = 0.95;
+
+    struct Job {
+        PdfObject* object = nullptr;
+        std::vector<std::string> filters;
+        std::string raw;
+        std::string encoded;
+        bool apply = false;
+    };
+
+    bool ReadFilters(const PoDoFo::PdfDictionary& dict, std::vector<std::string>& filters) {
+        const PdfObject* filter = dict.FindKey("Filter");
+        if (!filter || filter->IsNull()) {
+            return true;
+        }
+        if (filter->IsName()) {
+            filters.emplace_back(filter->GetName().GetString());
+            return true;
+        }
+        if (!filter->IsArray()) {
+            return false;
+        }
+        for (const PdfObject& item : filter->GetArray()) {
+            if (!item.IsName()) {
+                return false;
+            }
+            filters.emplace_back(item.GetName().GetString());
+        }
+        return true;
+    }
+
+    bool IsEligible(const PdfObject& obj, const MergeOptions& options, std::vector<std::string>& filters) {
+        if (!obj.HasStream() || !obj.IsDictionary()) {
+            return false;
+        }
+
+        const PoDoFo::PdfDictionary& dict = obj.GetDictionary();
+        const PdfObject* type = dict.FindKey("Type");
+        if (type && type->IsName() &&
+            (type->GetName() == "XRef" || type->GetName() == "ObjStm" || type->GetName() == "Metadata")) {
+            return false;
+        }
+
+        // External streams, and decode parameters (predictors, LZW early
+        // change) that the standalone codecs do not implement.
+        const PdfObject* parms = dict.FindKey("DecodeParms");
+        if (dict.HasKey("F") || (parms && !parms->IsNull())) {
+            return false;
+        }
+
+        if (!ReadFilters(dict, filters)) {
+            return false;
+        }
+        for (const std::string& filter : filters) {
+            if (!StreamFilters::CanDecode(filter)) {
+                return false;
+            }
+        }
+
+        bool alreadyFlate = filters.size() == 1 && filters[0] == "FlateDecode";
+        return !alreadyFlate || options.recompressFlateStreams;
+    }
+
+    void Encode(Job& job, int level, bool passThrough) {
+        std::string data = job.raw;
+        std::string decoded;
+        for (const std::string& filter : job.filters) {
+            if (!StreamFilters::Decode(filter, data, decoded)) {
+                return;
+            }
+            data.swap(decoded);
+        }
+
+        if (passThrough && job.filters.empty() && data.size() >= ProbeThreshold) {
+            std::string sample;
+            if (!StreamFilters::Deflate(data.data(), ProbeSize, 1, sample) ||
+                sample.size() > ProbeSize * ProbeMaxRatio) {
+                return;
+            }
+        }
+
+        if (StreamFilters::Deflate(data.data(), data.size(), level, job.encoded)) {
+            job.apply = job.encoded.size() < job.raw.size();
+        }
+    }
+}
+
+bool StreamRecompressor::Recompress(PoDoFo::PdfMemDocument& doc, const MergeOptions& options) {
+    try {
+        int level = (std::min)((std::max)(options.compressionLevel, 1), 9);
+        bool passThrough = !options.recompressFlateStreams;
+        size_t threads = options.compressionThreads > 0
+            ? static_cast<size_t>(options.compressionThreads)
+            : ParallelFor::DefaultThreadCount();
+
+        size_t examined = 0;
+        size_t encoded = 0;
+        uint64_t bytesBefore = 0;
+        uint64_t bytesAfter = 0;
+
+        std::vector<Job> batch;
+        size_t batchBytes = 0;
+
+        auto flush = [&]() {
+            ParallelFor::Run(batch.size(), threads, [&](size_t i) {
+                Encode(batch[i], level, passThrough);
+            });
+
+            // Written back on this thread in object order.
+            for (Job& job : batch) {
+                if (!job.apply) {
+                    continue;
+                }
+                job.object->GetStream()->SetData(PoDoFo::bufferview(job.encoded.data(), job.encoded.size()),
+                    { PoDoFo::PdfFilterType::FlateDecode }, true);
+                job.object->GetDictionary().RemoveKey("DL");
+
+                ++encoded;
+                bytesBefore += job.raw.size();
+                bytesAfter += job.encoded.size();
+            }
+
+            examined += batch.size();
+            batch.clear();
+            batchBytes = 0;
+        };
+
+        for (PdfObject* obj : doc.GetObjects()) {
+            Job job;
+            if (!IsEligible(*obj, options, job.filters)) {
+                continue;
+            }
+            job.object = obj;
+            job.raw = obj->GetStream()->GetCopy(true);
+            batchBytes += job.raw.size();
+            batch.push_back(std::move(job));
+
+            if (batchBytes >= BatchBytes) {
+                flush();
+            }
+        }
+        flush();
+
+        Logger::Debug("Stream compression (level " + std::to_string(level) + ", " +
+            std::to_string(threads) + " thread(s), " + (passThrough ? "pass-through" : "full") + "): " +
+            std::to_string(encoded) + "/" + std::to_string(examined) + " stream(s) re-encoded, " +
+            std::to_string(bytesBefore) + " -> " + std::to_string(bytesAfter) + " bytes");
+        return true;
+    }
+    catch (const PoDoFo::PdfError& e) {
+        Logger::Error("Stream compression failed: PdfError code " + std::to_string(static_cast<int>(e.GetCode())));
+        return false;
+    }
+    catch (const std::exception& e) {
+        Logger::Error("Stream compression failed: " + std::string(e.what()));
+        return false;
+    }
+}
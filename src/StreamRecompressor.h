@@ -0,0 +1,19 @@
+#ifndef __STREAM_RECOMPRESSOR_H__
+#define __STREAM_RECOMPRESSOR_H__
+
+#include "podofo/podofo.h"
+#include "MergeOptions.h"
+
+// Pre-save stage that re-encodes streams copied from the inputs to Flate:
+// uncompressed content from legacy generators and data kept in weak filters
+// (LZW, ASCIIHex, ASCII85, RunLength). Image codecs (DCT, JPX, JBIG2, CCITT)
+// are never touched.
+//
+// Streams are compressed in parallel and written back in object order, so
+// the output does not depend on the number of threads.
+class StreamRecompressor {
+public:
+    static bool Recompress(PoDoFo::PdfMemDocument& doc, const MergeOptions& options);
+};
+
+#endif // __STREAM_RECOMPRESSOR_H__
@@ -0,0 +1,291 @@
+#include "TrueTypeSubset.h"
+
+namespace {
+
+    // Big-endian helpers for the sfnt structures.
+    inline uint16_t ReadU16(const std::string& s, size_t offset) {
+        return static_cast<uint16_t>((static_cast<uint8_t>(s[offset]) << 8) |
+            static_cast<uint8_t>(s[offset + 1]));
+    }
+
+    inline uint32_t ReadU32(const std::string& s, size_t offset) {
+        return (static_cast<uint32_t>(ReadU16(s, offset)) << 16) | ReadU16(s, offset + 2);
+    }
+
+    inline void WriteU16(std::string& s, size_t offset, uint16_t v) {
+        s[offset] = static_cast<char>(v >> 8);
+        s[offset + 1] = static_cast<char>(v & 0xFF);
+    }
+
+    inline void WriteU32(std::string& s, size_t offset, uint32_t v) {
+        WriteU16(s, offset, static_cast<uint16_t>(v >> 16));
+        WriteU16(s, offset + 2, static_cast<uint16_t>(v & 0xFFFF));
+    }
+
+    inline void AppendU16(std::string& s, uint16_t v) {
+        s += static_cast<char>(v >> 8);
+        s += static_cast<char>(v & 0xFF);
+    }
+
+    inline void AppendU32(std::string& s, uint32_t v) {
+        AppendU16(s, static_cast<uint16_t>(v >> 16));
+        AppendU16(s, static_cast<uint16_t>(v & 0xFFFF));
+    }
+
+    inline void PadTo4(std::string& s) {
+        while (s.size() % 4 != 0) {
+            s += '\0';
+        }
+    }
+
+    uint32_t TableChecksum(const std::string& s, size_t offset, size_t length) {
+        uint32_t sum = 0;
+        size_t end = offset + ((length + 3) & ~size_t(3));
+        for (size_t i = offset; i < end; i += 4) {
+            uint32_t word = 0;
+            for (size_t b = 0; b < 4; ++b) {
+                word = (word << 8) | (i + b < s.size() ? static_cast<uint8_t>(s[i + b]) : 0u);
+            }
+            sum += word;
+        }
+        return sum;
+    }
+
+    constexpr size_t HeadCheckSumAdjustment = 8;
+    constexpr size_t HeadUnitsPerEm = 18;
+    constexpr size_t HeadIndexToLocFormat = 50;
+    constexpr size_t HheaNumberOfHMetrics = 34;
+    constexpr size_t MaxpNumGlyphs = 4;
+
+    // Hinting programs are shared by all glyphs; subsets of one font keep
+    // them unchanged, so a difference means a different font program.
+    const char* const kSharedTables[] = { "cvt ", "fpgm", "prep" };
+}
+
+bool TrueTypeSubset::Parse(const char* data, size_t size) {
+    std::string font(data, size);
+    if (font.size() < 12) {
+        return false;
+    }
+
+    sfntVersion_ = ReadU32(font, 0);
+    if (sfntVersion_ != 0x00010000 && sfntVersion_ != 0x74727565) { // 'true'
+        return false;
+    }
+
+    uint16_t numTables = ReadU16(font, 4);
+    if (font.size() < 12 + static_cast<size_t>(numTables) * 16) {
+        return false;
+    }
+
+    tables_.clear();
+    for (uint16_t i = 0; i < numTables; ++i) {
+        size_t record = 12 + static_cast<size_t>(i) * 16;
+        std::string tag = font.substr(record, 4);
+        uint32_t offset = ReadU32(font, record + 8);
+        uint32_t length = ReadU32(font, record + 12);
+        if (offset > font.size() || length > font.size() - offset) {
+            return false;
+        }
+        tables_[tag] = font.substr(offset, length);
+    }
+
+    auto head = tables_.find("head");
+    auto hhea = tables_.find("hhea");
+    auto maxp = tables_.find("maxp");
+    auto loca = tables_.find("loca");
+    auto glyf = tables_.find("glyf");
+    auto hmtx = tables_.find("hmtx");
+    if (head == tables_.end() || hhea == tables_.end() || maxp == tables_.end() ||
+        loca == tables_.end() || glyf == tables_.end() || hmtx == tables_.end() ||
+        head->second.size() < 54 || hhea->second.size() < 36 || maxp->second.size() < 6) {
+        return false;
+    }
+
+    unitsPerEm_ = ReadU16(head->second, HeadUnitsPerEm);
+    bool longLoca = ReadU16(head->second, HeadIndexToLocFormat) != 0;
+    size_t numGlyphs = ReadU16(maxp->second, MaxpNumGlyphs);
+    size_t numberOfHMetrics = ReadU16(hhea->second, HheaNumberOfHMetrics);
+
+    if (numGlyphs == 0 || numberOfHMetrics == 0 || numberOfHMetrics > numGlyphs ||
+        loca->second.size() < (numGlyphs + 1) * (longLoca ? 4 : 2) ||
+        hmtx->second.size() < numberOfHMetrics * 4 + (numGlyphs - numberOfHMetrics) * 2) {
+        return false;
+    }
+
+    const std::string& glyphData = glyf->second;
+    glyphs_.assign(numGlyphs, std::string());
+    for (size_t g = 0; g < numGlyphs; ++g) {
+        size_t start = longLoca ? ReadU32(loca->second, g * 4) : ReadU16(loca->second, g * 2) * 2u;
+        size_t end = longLoca ? ReadU32(loca->second, (g + 1) * 4) : ReadU16(loca->second, (g + 1) * 2) * 2u;
+        if (start > end || end > glyphData.size()) {
+            return false;
+        }
+        glyphs_[g] = glyphData.substr(start, end - start);
+    }
+
+    const std::string& metrics = hmtx->second;
+    advances_.assign(numGlyphs, 0);
+    leftBearings_.assign(numGlyphs, 0);
+    for (size_t g = 0; g < numGlyphs; ++g) {
+        if (g < numberOfHMetrics) {
+            advances_[g] = ReadU16(metrics, g * 4);
+            leftBearings_[g] = static_cast<int16_t>(ReadU16(metrics, g * 4 + 2));
+        }
+        else {
+            advances_[g] = advances_[numberOfHMetrics - 1];
+            leftBearings_[g] = static_cast<int16_t>(ReadU16(metrics,
+                numberOfHMetrics * 4 + (g - numberOfHMetrics) * 2));
+        }
+    }
+
+    // Rebuilt on Serialize or no longer valid once glyphs are added.
+    tables_.erase("loca");
+    tables_.erase("glyf");
+    tables_.erase("hmtx");
+    tables_.erase("hdmx");
+    tables_.erase("LTSH");
+    tables_.erase("DSIG");
+    return true;
+}
+
+bool TrueTypeSubset::SameTable(const TrueTypeSubset& other, const std::string& tag) const {
+    auto mine = tables_.find(tag);
+    auto theirs = other.tables_.find(tag);
+    if (mine == tables_.end() || theirs == other.tables_.end()) {
+        return mine == tables_.end() && theirs == other.tables_.end();
+    }
+    return mine->second == theirs->second;
+}
+
+bool TrueTypeSubset::IsCompatible(const TrueTypeSubset& other) const {
+    if (glyphs_.size() != other.glyphs_.size() || unitsPerEm_ != other.unitsPerEm_) {
+        return false;
+    }
+
+    for (const char* tag : kSharedTables) {
+        if (!SameTable(other, tag)) {
+            return false;
+        }
+    }
+
+    for (size_t g = 0; g < glyphs_.size(); ++g) {
+        if (!glyphs_[g].empty() && !other.glyphs_[g].empty() && glyphs_[g] != other.glyphs_[g]) {
+            return false;
+        }
+        // Subsetters either keep all metrics or zero the unused ones.
+        if (advances_[g] != 0 && other.advances_[g] != 0 && advances_[g] != other.advances_[g]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void TrueTypeSubset::Merge(const TrueTypeSubset& other) {
+    for (size_t g = 0; g < glyphs_.size(); ++g) {
+        if (glyphs_[g].empty() && !other.glyphs_[g].empty()) {
+            glyphs_[g] = other.glyphs_[g];
+            leftBearings_[g] = other.leftBearings_[g];
+        }
+        if (advances_[g] == 0) {
+            advances_[g] = other.advances_[g];
+        }
+    }
+}
+
+size_t TrueTypeSubset::GetGlyphCount() const {
+    return glyphs_.size();
+}
+
+size_t TrueTypeSubset::GetUsedGlyphCount() const {
+    size_t used = 0;
+    for (const std::string& glyph : glyphs_) {
+        if (!glyph.empty()) {
+            ++used;
+        }
+    }
+    return used;
+}
+
+std::string TrueTypeSubset::Serialize() const {
+    std::map<std::string, std::string> tables = tables_;
+
+    std::string glyf;
+    std::vector<size_t> offsets;
+    offsets.reserve(glyphs_.size() + 1);
+    for (const std::string& glyph : glyphs_) {
+        offsets.push_back(glyf.size());
+        glyf += glyph;
+        PadTo4(glyf);
+    }
+    offsets.push_back(glyf.size());
+
+    bool longLoca = glyf.size() > 0x1FFFE;
+    std::string loca;
+    for (size_t offset : offsets) {
+        if (longLoca) {
+            AppendU32(loca, static_cast<uint32_t>(offset));
+        }
+        else {
+            AppendU16(loca, static_cast<uint16_t>(offset / 2));
+        }
+    }
+
+    // Trailing glyphs with the same advance share the last long metric.
+    size_t numberOfHMetrics = advances_.size();
+    while (numberOfHMetrics > 1 && advances_[numberOfHMetrics - 2] == advances_.back()) {
+        --numberOfHMetrics;
+    }
+    std::string hmtx;
+    for (size_t g = 0; g < advances_.size(); ++g) {
+        if (g < numberOfHMetrics) {
+            AppendU16(hmtx, advances_[g]);
+        }
+        AppendU16(hmtx, static_cast<uint16_t>(leftBearings_[g]));
+    }
+
+    tables["glyf"] = std::move(glyf);
+    tables["loca"] = std::move(loca);
+    tables["hmtx"] = std::move(hmtx);
+    WriteU32(tables["head"], HeadCheckSumAdjustment, 0);
+    WriteU16(tables["head"], HeadIndexToLocFormat, longLoca ? 1 : 0);
+    WriteU16(tables["hhea"], HheaNumberOfHMetrics, static_cast<uint16_t>(numberOfHMetrics));
+
+    uint16_t numTables = static_cast<uint16_t>(tables.size());
+    uint16_t entrySelector = 0;
+    while ((2u << entrySelector) <= numTables) {
+        ++entrySelector;
+    }
+    uint16_t searchRange = static_cast<uint16_t>((1u << entrySelector) * 16);
+
+    std::string font;
+    AppendU32(font, sfntVersion_);
+    AppendU16(font, numTables);
+    AppendU16(font, searchRange);
+    AppendU16(font, entrySelector);
+    AppendU16(font, static_cast<uint16_t>(numTables * 16 - searchRange));
+
+    size_t directory = font.size();
+    font.resize(directory + static_cast<size_t>(numTables) * 16, '\0');
+
+    size_t headOffset = 0;
+    size_t record = directory;
+    for (const auto& table : tables) {
+        size_t offset = font.size();
+        font += table.second;
+        PadTo4(font);
+
+        font.replace(record, 4, table.first);
+        WriteU32(font, record + 4, TableChecksum(font, offset, table.second.size()));
+        WriteU32(font, record + 8, static_cast<uint32_t>(offset));
+        WriteU32(font, record + 12, static_cast<uint32_t>(table.second.size()));
+        record += 16;
+
+        if (table.first == "head") {
+            headOffset = offset;
+        }
+    }
+
+    WriteU32(font, headOffset + HeadCheckSumAdjustment, 0xB1B0AFBA - TableChecksum(font, 0, font.size()));
+    return font;
+}
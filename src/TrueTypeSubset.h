@@ -0,0 +1,44 @@
+#ifndef __TRUETYPE_SUBSET_H__
+#define __TRUETYPE_SUBSET_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+// TrueType font program embedded as a subset (FontFile2), split into glyphs.
+//
+// Only subsets that keep the glyph IDs of the original font can be merged:
+// every subset then has the same glyph count, unused glyphs are empty, and a
+// glyph present in two subsets is byte-identical in both. Merging fills the
+// empty slots of one subset with the glyphs of the other.
+class TrueTypeSubset {
+public:
+    bool Parse(const char* data, size_t size);
+
+    // True when the other subset comes from the same font program and none
+    // of its glyphs or metrics contradict ours.
+    bool IsCompatible(const TrueTypeSubset& other) const;
+
+    // Copies the glyphs and metrics this subset lacks; call IsCompatible first.
+    void Merge(const TrueTypeSubset& other);
+
+    std::string Serialize() const;
+
+    size_t GetGlyphCount() const;
+    size_t GetUsedGlyphCount() const;
+
+private:
+    // Tables other than the ones rebuilt on Serialize, keyed by tag.
+    std::map<std::string, std::string> tables_;
+    std::vector<std::string> glyphs_;
+    std::vector<uint16_t> advances_;
+    std::vector<int16_t> leftBearings_;
+    uint32_t sfntVersion_ = 0;
+    uint16_t unitsPerEm_ = 0;
+
+    bool SameTable(const TrueTypeSubset& other, const std::string& tag) const;
+};
+
+#endif // __TRUETYPE_SUBSET_H__
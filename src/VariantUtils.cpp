@@ -15,6 +15,14 @@ double VariantUtils::GetDouble(const variant_t& var) {
         }, var);
 }
 
+int VariantUtils::GetInt(const variant_t& var) {
+    return std::visit(overloaded{
+        [](int i) { return i; },
+        [](double d) { return static_cast<int>(d); },
+        [](auto&&) { return 0; }
+        }, var);
+}
+
 bool VariantUtils::GetBool(const variant_t& var) {
     return std::visit(overloaded{
         [](bool b) { return b; },
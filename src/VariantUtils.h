@@ -6,5 +6,7 @@ public:
 
     static double GetDouble(const variant_t& var);
 
+    static int GetInt(const variant_t& var);
+
     static bool GetBool(const variant_t& var);
 };
\ No newline at end of file